@@ -0,0 +1,196 @@
+#ifndef _HTTP_PIPELINE_H_
+#define _HTTP_PIPELINE_H_
+
+#include <stdarg.h>
+#include <strings.h>
+
+#include "mbed.h"
+
+/**
+ * Pipelined ThingsBoard uploads (POST /api/v1/<token>/telemetry or /attributes)
+ * on one HTTP/1.1 connection: all requests of a reporting cycle are sent
+ * without waiting, the responses are read afterwards in the order of the
+ * requests. So a whole cycle costs one round trip instead of one per request.
+ * All requests have to be sent before the first response is read.
+ * The buffer is used for one request at a time and for reading the responses,
+ * it has to be large enough for the largest request and the response headers.
+ *
+ *   pipeline.postTelemetry(&socket, "{\"temperature\":%d}", 22);
+ *   pipeline.postTelemetry(&socket, "{\"humidity\":%.1f}", 42.5);
+ *   while (pipeline.pending())
+ *     status = pipeline.response();
+ */
+class HttpPipeline {
+public:
+  HttpPipeline(char *buf, size_t size)
+    : _buf(buf), _size(size), _rx_len(0), _pending(0), _keep_alive(true), _closing(false),
+      _socket(NULL), _token(NULL), _host(NULL) {
+  }
+
+  void begin(const char *token, const char *host) {
+    _token = token;
+    _host = host;
+  }
+
+  bool postTelemetry(Socket *socket, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    bool ret = post(socket, "telemetry", fmt, args);
+    va_end(args);
+    return ret;
+  }
+
+  bool postAttributes(Socket *socket, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    bool ret = post(socket, "attributes", fmt, args);
+    va_end(args);
+    return ret;
+  }
+
+  // requests sent whose response was not read yet
+  int pending() const { return _pending; }
+
+  /**
+   * Read the response to the oldest pending request.
+   * Returns the HTTP status code or a negative nsapi error, after an error
+   * the responses of the other pending requests are lost. A response without
+   * Content-Length ends with the connection, the requests sent after it get
+   * NSAPI_ERROR_NO_CONNECTION.
+   */
+  int response() {
+    if (_pending == 0)
+      return NSAPI_ERROR_PARAMETER;
+    _pending--;
+    if (_closing)
+      return NSAPI_ERROR_NO_CONNECTION;
+
+    char *end = NULL;
+    // a previous response may have left the start of this one in the buffer
+    _buf[_rx_len] = '\0';
+    end = strstr(_buf, "\r\n\r\n");
+    while (!end) {
+      if (_rx_len >= _size - 1)
+        return fail(NSAPI_ERROR_NO_MEMORY);
+      nsapi_size_or_error_t ret = _socket->recv(_buf + _rx_len, _size - 1 - _rx_len);
+      if (ret <= 0)
+        return fail(ret < 0 ? ret : NSAPI_ERROR_NO_CONNECTION);
+      _rx_len += ret;
+      _buf[_rx_len] = '\0';
+      end = strstr(_buf, "\r\n\r\n");
+    }
+
+    int status = 0;
+    if (sscanf(_buf, "HTTP/1.%*d %d", &status) != 1)
+      return fail(NSAPI_ERROR_DEVICE_ERROR);
+
+    size_t headers = end + 4 - _buf;
+    end[2] = '\0';
+    const char *value = header("Connection");
+    if (value && strstr(value, "close"))
+      _keep_alive = false;
+    // without Content-Length the end of the body and so the next response can not be found
+    value = header("Content-Length");
+    if (!value || header("Transfer-Encoding")) {
+      _keep_alive = false;
+      _closing = true;
+      _rx_len = 0;
+      return status;
+    }
+
+    size_t body = strtoul(value, NULL, 10);
+    size_t buffered = _rx_len - headers;
+    if (buffered >= body) {
+      // keep what belongs to the next response
+      memmove(_buf, _buf + headers + body, buffered - body);
+      _rx_len = buffered - body;
+      return status;
+    }
+
+    long remaining = (long)(body - buffered);
+    _rx_len = 0;
+    while (remaining > 0) {
+      nsapi_size_or_error_t ret = _socket->recv(_buf, remaining < (long)_size - 1 ? remaining : _size - 1);
+      if (ret <= 0)
+        return fail(ret < 0 ? ret : NSAPI_ERROR_NO_CONNECTION);
+      remaining -= ret;
+    }
+    return status;
+  }
+
+  // false if the server closes the connection or a response could not be read
+  bool keep_alive() const { return _keep_alive; }
+
+private:
+  bool post(Socket *socket, const char *type, const char *fmt, va_list args) {
+    // the start of unread responses would be overwritten
+    if (_rx_len > 0 || (_socket && socket != _socket && _pending > 0))
+      return false;
+    if (_pending == 0) {
+      _keep_alive = true;
+      _closing = false;
+    }
+    _socket = socket;
+
+    int head = snprintf(_buf, _size,
+      "POST /api/v1/%s/%s HTTP/1.1\r\n"
+      "Host: %s\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: %5u\r\n"
+      "\r\n", _token, type, _host, 0u);
+    if (head < 0 || (size_t)head >= _size)
+      return false;
+    int body = vsnprintf(_buf + head, _size - head, fmt, args);
+    if (body < 0 || (size_t)(head + body) >= _size || body > 99999)
+      return false;
+
+    // the length field is reserved with a fixed width and filled in now
+    char *length = strstr(_buf, "Content-Length: ") + 16;
+    char digits[6];
+    snprintf(digits, sizeof(digits), "%5u", (unsigned)body);
+    memcpy(length, digits, 5);
+
+    const char *data = _buf;
+    size_t len = head + body;
+    while (len > 0) {
+      nsapi_size_or_error_t ret = _socket->send(data, len);
+      if (ret < 0) {
+        fail(ret);
+        return false;
+      }
+      data += ret;
+      len -= ret;
+    }
+    _pending++;
+    return true;
+  }
+
+  int fail(int error) {
+    _keep_alive = false;
+    _pending = 0;
+    _rx_len = 0;
+    return error;
+  }
+
+  // value of a response header or NULL, the headers are null terminated
+  const char *header(const char *name) {
+    size_t n = strlen(name);
+
+    for (char *line = strstr(_buf, "\r\n"); line; line = strstr(line + 2, "\r\n"))
+      if (strncasecmp(line + 2, name, n) == 0 && line[2 + n] == ':')
+        return line + 3 + n;
+    return NULL;
+  }
+
+  char *_buf;
+  size_t _size;
+  size_t _rx_len;
+  int _pending;
+  bool _keep_alive;
+  bool _closing;          // the last response ends with the connection
+  Socket *_socket;
+  const char *_token;
+  const char *_host;
+};
+
+#endif // _HTTP_PIPELINE_H_
@@ -0,0 +1,143 @@
+#ifndef _TLS_CONNECTION_H_
+#define _TLS_CONNECTION_H_
+
+#include "mbed.h"
+#include "NetworkInterface.h"
+#include "TLSSocket.h"
+#include "tls-session-cache.h"
+#include "tls-trust-store.h"
+
+/**
+ * Keeps one TLS socket open across uploads instead of creating a new socket
+ * (and running a full TLS handshake) for every ThingsBoard request.
+ * HTTP/1.1 connections are persistent by default, so the ThingsBoardHttps
+ * client can reuse the socket as long as the server does not close it.
+ * connect() checks whether the server closed the connection in the meantime
+ * and reconnects transparently in that case.
+ * The root CA is not parsed per socket, all sockets share the chain of the TLSTrustStore.
+ * With a TLSSessionCache set, reconnects resume the previous TLS session.
+ * The socket is a TLSSocketWrapper over a TLSSessionCache::Transport, the same
+ * as a TLSSocket but with a transport the session cache can hook into.
+ */
+class TLSConnection {
+public:
+  // step in which the last connect() failed
+  enum Step {
+    STEP_NONE = 0,
+    STEP_OPEN,
+    STEP_CONNECT
+  };
+
+  TLSConnection(NetworkInterface *net, const char *hostname, TLSTrustStore *trust)
+    : _net(net), _hostname(hostname), _trust(trust), _transport(NULL), _socket(NULL),
+      _sessions(NULL), _step(STEP_NONE), _handshakes(0), _reuses(0) {
+  }
+
+  ~TLSConnection() {
+    close();
+  }
+
+  void set_session_cache(TLSSessionCache *sessions) {
+    _sessions = sessions;
+  }
+
+  /**
+   * Make sure there is an established connection to address.
+   * An already open connection is reused if the server did not close it.
+   */
+  nsapi_error_t connect(const SocketAddress &address) {
+    if (_socket) {
+      if (is_alive()) {
+        _reuses++;
+        return NSAPI_ERROR_OK;
+      }
+      printf("[TLSC] Connection closed by server, reconnecting\n");
+      close();
+    }
+
+    _transport = new TLSSessionCache::Transport();
+    _socket = new TLSSocketWrapper(_transport, NULL, TLSSocketWrapper::TRANSPORT_CONNECT_AND_CLOSE);
+
+    _step = STEP_OPEN;
+    nsapi_error_t result = _transport->open(_net);
+    if (result != NSAPI_ERROR_OK) {
+      close();
+      return result;
+    }
+
+    _trust->attach(_socket);
+    _socket->set_hostname(_hostname);
+
+    if (_sessions)
+      _sessions->attach(_socket, _transport);
+
+    _step = STEP_CONNECT;
+    result = _socket->connect(address);
+    if (result != NSAPI_ERROR_OK) {
+      // the server may have rejected the offered session, do not offer it again
+      if (_sessions)
+        _sessions->clear();
+      close();
+      return result;
+    }
+
+    if (_sessions)
+      _sessions->update(_socket);
+
+    _step = STEP_NONE;
+    _handshakes++;
+    return NSAPI_ERROR_OK;
+  }
+
+  /**
+   * Drop the current connection and connect again, e.g. after a failed request.
+   */
+  nsapi_error_t reconnect(const SocketAddress &address) {
+    close();
+    return connect(address);
+  }
+
+  void close() {
+    if (_socket) {
+      _socket->close();
+      delete _socket;
+      _socket = NULL;
+    }
+    // closed by the wrapper
+    delete _transport;
+    _transport = NULL;
+  }
+
+  TLSSocketWrapper *socket() const { return _socket; }
+  Step failed_step() const { return _step; }
+  uint32_t handshakes() const { return _handshakes; }
+  uint32_t reuses() const { return _reuses; }
+
+private:
+  /**
+   * A non-blocking read on an idle keep-alive connection has to return
+   * NSAPI_ERROR_WOULD_BLOCK. 0 means the server closed the connection,
+   * any data left over from a previous response makes the connection unusable too.
+   */
+  bool is_alive() {
+    uint8_t c;
+
+    _socket->set_blocking(false);
+    nsapi_size_or_error_t result = _socket->recv(&c, 1);
+    _socket->set_blocking(true);
+
+    return result == NSAPI_ERROR_WOULD_BLOCK;
+  }
+
+  NetworkInterface *_net;
+  const char *_hostname;
+  TLSTrustStore *_trust;
+  TLSSessionCache::Transport *_transport;
+  TLSSocketWrapper *_socket;
+  TLSSessionCache *_sessions;
+  Step _step;
+  uint32_t _handshakes;
+  uint32_t _reuses;
+};
+
+#endif // _TLS_CONNECTION_H_
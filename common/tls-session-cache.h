@@ -0,0 +1,214 @@
+#ifndef _TLS_SESSION_CACHE_H_
+#define _TLS_SESSION_CACHE_H_
+
+#include "mbed.h"
+#include "TLSSocket.h"
+#include "mbedtls/ssl.h"
+
+// keep the last TLS session in the retained crash data RAM, so it survives system_reset()
+// enable with the macro TLS_SESSION_RETAIN=1 in mbed_app.json, needs platform.crash-capture-enabled.
+// The master secret of the session is stored in plain text next to the crash report, anyone
+// who can read the RAM or the crash dump can decrypt the recorded traffic of that session.
+// Only enable it on devices without debug access in the field.
+#if defined(TLS_SESSION_RETAIN) && TLS_SESSION_RETAIN && MBED_CONF_PLATFORM_CRASH_CAPTURE_ENABLED
+#define TLS_SESSION_RETAIN_ENABLED 1
+#include "mbed_crash_data_offsets.h"
+#else
+#define TLS_SESSION_RETAIN_ENABLED 0
+#endif
+
+/**
+ * Remembers the last negotiated TLS session and offers it again on the next
+ * handshake (session ID or session ticket), so a reconnect only needs an
+ * abbreviated handshake instead of a full one with certificate verification
+ * and key exchange.
+ *
+ * TLSSocketWrapper runs mbedtls_ssl_setup() and the handshake inside connect(), so there
+ * is no public point in between to call mbedtls_ssl_set_session(), and the RNG of the
+ * SSL config is replaced there too. Between both steps it registers its sigio handler on
+ * the transport socket, the session is attached from the sigio() of the Transport below.
+ * A full handshake verifies the server certificate, an abbreviated one does not,
+ * this is used to count both kinds of handshakes.
+ */
+class TLSSessionCache {
+public:
+  /**
+   * TCP transport of a TLSSocketWrapper that offers the cached session,
+   * the wrapper has to be created with TRANSPORT_CONNECT_AND_CLOSE.
+   */
+  class Transport : public TCPSocket {
+  public:
+    Transport() : _cache(NULL), _socket(NULL) {}
+
+    void sigio(mbed::Callback<void()> func) override {
+      TCPSocket::sigio(func);
+      if (_cache && func) {
+        _cache->offer(_socket);
+        _cache = NULL;
+      }
+    }
+
+  private:
+    friend class TLSSessionCache;
+    TLSSessionCache *_cache;
+    TLSSocketWrapper *_socket;
+  };
+
+  TLSSessionCache()
+    : _valid(false), _offered(false), _verified(false), _full(0), _resumed(0) {
+    mbedtls_ssl_session_init(&_session);
+  }
+
+  ~TLSSessionCache() {
+    mbedtls_ssl_session_free(&_session);
+  }
+
+  /**
+   * Call before socket->connect(), transport is the transport socket of the wrapper.
+   */
+  void attach(TLSSocketWrapper *socket, Transport *transport) {
+    mbedtls_ssl_conf_verify(socket->get_ssl_config(), &TLSSessionCache::verify, this);
+    transport->_cache = this;
+    transport->_socket = socket;
+    _offered = false;
+    _verified = false;
+  }
+
+  /**
+   * Call after a successful socket->connect() to remember the negotiated session.
+   */
+  void update(TLSSocketWrapper *socket) {
+    mbedtls_ssl_session session;
+
+    if (_offered && !_verified)
+      _resumed++;
+    else
+      _full++;
+    _offered = false;
+
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_get_session(socket->get_ssl_context(), &session) != 0) {
+      mbedtls_ssl_session_free(&session);
+      clear();
+      return;
+    }
+
+    // take over the session including the buffers it owns
+    mbedtls_ssl_session_free(&_session);
+    _session = session;
+    _valid = true;
+
+#if TLS_SESSION_RETAIN_ENABLED
+    store_retained();
+#endif
+  }
+
+  /**
+   * Forget the session, e.g. if the server does not accept it anymore.
+   */
+  void clear() {
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_session_init(&_session);
+    _valid = false;
+#if TLS_SESSION_RETAIN_ENABLED
+    memset(retained(), 0, sizeof(retained_session_t));
+#endif
+  }
+
+  bool valid() const { return _valid; }
+  uint32_t full_handshakes() const { return _full; }
+  uint32_t resumed_handshakes() const { return _resumed; }
+
+#if TLS_SESSION_RETAIN_ENABLED
+  /**
+   * Restore the session stored before the last warm reboot.
+   * Only sessions with a session ID fit into the unused part of the error context.
+   */
+  bool load_retained() {
+    retained_session_t *r = retained();
+
+    if (sizeof(retained_session_t) > retained_size())
+      return false;
+    if (r->id_len == 0 || r->id_len > sizeof(r->id) || r->check != checksum(r))
+      return false;
+
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_session_init(&_session);
+    _session.ciphersuite = r->ciphersuite;
+    _session.id_len = r->id_len;
+    memcpy(_session.id, r->id, sizeof(r->id));
+    memcpy(_session.master, r->master, sizeof(r->master));
+    _valid = true;
+    return true;
+  }
+#endif
+
+private:
+  // called by the transport after mbedtls_ssl_setup(), before the ClientHello is written
+  void offer(TLSSocketWrapper *socket) {
+    mbedtls_ssl_context *ssl = socket->get_ssl_context();
+
+    if (_valid && ssl->conf && mbedtls_ssl_set_session(ssl, &_session) == 0)
+      _offered = true;
+  }
+
+  static int verify(void *ctx, mbedtls_x509_crt *crt, int depth, uint32_t *flags) {
+    static_cast<TLSSessionCache *>(ctx)->_verified = true;
+    return 0;
+  }
+
+#if TLS_SESSION_RETAIN_ENABLED
+  typedef struct {
+    uint16_t ciphersuite;
+    uint8_t id_len;
+    uint8_t check;
+    uint8_t id[32];
+    uint8_t master[48];
+  } retained_session_t;
+
+  // the error context only uses the start of its part of the crash data RAM
+  static retained_session_t *retained() {
+    return (retained_session_t *)((uint8_t *)&MBED_CRASH_DATA.error + sizeof(mbed_error_ctx));
+  }
+
+  static size_t retained_size() {
+    return sizeof(MBED_CRASH_DATA.error) - sizeof(mbed_error_ctx);
+  }
+
+  static uint8_t checksum(const retained_session_t *r) {
+    const uint8_t *p = (const uint8_t *)r;
+    uint8_t sum = 0xA5;
+
+    for (size_t i = 0; i < sizeof(retained_session_t); i++)
+      if (p + i != &r->check)
+        sum = (uint8_t)((sum << 1 | sum >> 7) ^ p[i]);
+    return sum;
+  }
+
+  void store_retained() {
+    retained_session_t *r = retained();
+
+    if (sizeof(retained_session_t) > retained_size())
+      return;
+    if (_session.id_len == 0 || _session.id_len > sizeof(r->id)) {
+      memset(r, 0, sizeof(retained_session_t));
+      return;
+    }
+
+    r->ciphersuite = (uint16_t)_session.ciphersuite;
+    r->id_len = (uint8_t)_session.id_len;
+    memcpy(r->id, _session.id, sizeof(r->id));
+    memcpy(r->master, _session.master, sizeof(r->master));
+    r->check = checksum(r);
+  }
+#endif
+
+  mbedtls_ssl_session _session;
+  bool _valid;
+  bool _offered;
+  bool _verified;
+  uint32_t _full;
+  uint32_t _resumed;
+};
+
+#endif // _TLS_SESSION_CACHE_H_
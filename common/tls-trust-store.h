@@ -0,0 +1,98 @@
+#ifndef _TLS_TRUST_STORE_H_
+#define _TLS_TRUST_STORE_H_
+
+#include "mbed.h"
+#include "TLSSocket.h"
+#include "mbedtls/x509_crt.h"
+
+/**
+ * Root CA chain parsed once at boot and shared by all TLS sockets.
+ * socket->set_root_ca_cert(pem) base64-decodes and parses the certificate
+ * again for every socket, attach() only hands the parsed chain over by reference.
+ * The certificate can be given as PEM (e.g. SSL_CA_PEM from secrets.h)
+ * or as DER converted at build time, e.g. with
+ *   openssl x509 -in ca.pem -outform der | xxd -i
+ */
+class TLSTrustStore {
+public:
+  TLSTrustStore() : _parsed(false), _parse_time_us(0), _parse_heap(0), _parse_peak(0) {
+    mbedtls_x509_crt_init(&_chain);
+  }
+
+  ~TLSTrustStore() {
+    mbedtls_x509_crt_free(&_chain);
+  }
+
+  /**
+   * Parse a PEM certificate (chain), the string has to be null terminated.
+   */
+  nsapi_error_t init(const char *pem) {
+    return parse((const unsigned char *)pem, strlen(pem) + 1);
+  }
+
+  /**
+   * Parse a DER encoded certificate.
+   */
+  nsapi_error_t init(const unsigned char *der, size_t len) {
+    return parse(der, len);
+  }
+
+  /**
+   * Use the parsed chain for the socket, the store has to outlive the socket.
+   */
+  void attach(TLSSocketWrapper *socket) {
+    socket->set_ca_chain(&_chain);
+  }
+
+  bool parsed() const { return _parsed; }
+  // CPU time and heap allocated for parsing, this is saved on every new connection
+  uint32_t parse_time_us() const { return _parse_time_us; }
+  uint32_t parse_heap() const { return _parse_heap; }
+  // how far the parse raised the heap peak (max_size), 0 if the peak was higher before
+  uint32_t parse_peak() const { return _parse_peak; }
+
+private:
+  nsapi_error_t parse(const unsigned char *buf, size_t len) {
+    Timer t;
+#if MBED_HEAP_STATS_ENABLED
+    mbed_stats_heap_t before, after;
+    mbed_stats_heap_get(&before);
+#endif
+
+    mbedtls_x509_crt_free(&_chain);
+    mbedtls_x509_crt_init(&_chain);
+
+    t.start();
+    int ret = mbedtls_x509_crt_parse(&_chain, buf, len);
+    t.stop();
+    _parse_time_us = (uint32_t)t.elapsed_time().count();
+
+#if MBED_HEAP_STATS_ENABLED
+    mbed_stats_heap_get(&after);
+    _parse_heap = after.total_size - before.total_size;
+    _parse_peak = after.max_size - before.max_size;
+    printf("[TLST] Root CA parsed in %lu us, heap: %lu bytes allocated in %lu blocks, %lu bytes kept, peak +%lu bytes\n",
+      (unsigned long)_parse_time_us, (unsigned long)_parse_heap, (unsigned long)(after.alloc_cnt - before.alloc_cnt),
+      (unsigned long)(after.current_size - before.current_size), (unsigned long)_parse_peak);
+#else
+    printf("[TLST] Root CA parsed in %lu us\n", (unsigned long)_parse_time_us);
+#endif
+
+    if (ret != 0) {
+      printf("[TLST] mbedtls_x509_crt_parse failed (-0x%04X)\n", -ret);
+      _parsed = false;
+      return NSAPI_ERROR_PARAMETER;
+    }
+
+    _parsed = true;
+    return NSAPI_ERROR_OK;
+  }
+
+  mbedtls_x509_crt _chain;
+  bool _parsed;
+  uint32_t _parse_time_us;
+  uint32_t _parse_heap;
+  uint32_t _parse_peak;
+};
+
+#endif // _TLS_TRUST_STORE_H_
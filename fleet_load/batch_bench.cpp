@@ -0,0 +1,189 @@
+// Bytes on the wire and requests per sample of the room sensor uploads,
+// one request per sample against all samples of a write interval in one
+// request, over a keep-alive connection to the HTTP stand-in of the tests:
+//  - library: sendTelemetry() of the ThingsBoard library per sample, the
+//    way the examples uploaded before the batches, without a timestamp
+//  - stream:  a TelemetryBatch of one row per request streamed with
+//    ThingsBoardStream, timestamped like the batches
+//  - batch:   TelemetryBatch of rows samples per request streamed with
+//    ThingsBoardStream, like the room sensor does now
+// The bytes are those of HTTP on the connection, both directions, the time
+// per sample includes the round trip time of the stand-in.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests fleet_load/batch_bench.cpp -o batch_bench -lpthread
+//   ./batch_bench [samples] [round trip ms]
+
+#include <math.h>
+
+#include "mbed.h"
+#include "ThingsBoard.h"
+#include "telemetry-batch.h"
+#include "thingsboard-stream.h"
+#include "http-standin.h"
+
+// the write intervals of the room sensor, samples are taken once per second
+#define UPLOAD_INTERVAL_MIN 5
+#define UPLOAD_INTERVAL_MAX 60
+
+const BatchKey roomKeys[5] = {
+  { "temperature",  2 },
+  { "humidity",     2 },
+  { "VOCindex",     0 },
+  { "CO2",          0 },
+  { "light",        1 },
+};
+
+typedef TelemetryBatch<5, UPLOAD_INTERVAL_MAX> RoomBatch;
+
+HttpStandin server;
+char streambuf[512];
+ThingsBoardStream tbs(streambuf, sizeof(streambuf));
+
+/**
+ * Uploads of one run and what the stand-in got for them.
+ */
+struct Run {
+  uint32_t samples;
+  uint32_t requests;
+  uint64_t up;
+  uint64_t down;
+  uint32_t us;
+  uint32_t failed;
+};
+
+// sample number i, every second like the room sensor
+void sample(int i, uint32_t &ts, float *values) {
+  ts = 1626950000 + i;
+  values[0] = 21.0f + 0.8f * sinf(i / 40.0f) + (i % 7) * 0.013f;
+  values[1] = 45.0f + 3.0f * cosf(i / 60.0f) + (i % 5) * 0.07f;
+  values[2] = (float)(100 + (i * 7) % 90);
+  values[3] = (float)(450 + (i * 13) % 900);
+  values[4] = 320.0f + 150.0f * sinf(i / 100.0f) + (i % 3) * 0.1f;
+}
+
+/**************************************************************************/
+/*
+    start counting what the stand-in gets
+*/
+/**************************************************************************/
+void begin(Run &run, TCPSocket &socket) {
+  memset(&run, 0, sizeof(run));
+  run.requests = server.requests;
+  run.up = server.bytes;
+  run.down = server.sent;
+  run.us = us_ticker_read();
+  socket.open(NetworkInterface::get_default_instance());
+  socket.connect(server.address());
+}
+
+void end(Run &run, TCPSocket &socket, uint32_t samples) {
+  socket.close();
+  run.us = us_ticker_read() - run.us;
+  run.samples = samples;
+  run.requests = server.requests - run.requests;
+  run.up = server.bytes - run.up;
+  run.down = server.sent - run.down;
+}
+
+/**************************************************************************/
+/*
+    one request per sample with the ThingsBoard library
+*/
+/**************************************************************************/
+void runLibrary(Run &run, int samples) {
+  TCPSocket socket;
+  ThingsBoardHttp tb;
+  SocketAddress adr = server.address();
+
+  begin(run, socket);
+  tb.begin(&socket, "token_of_the_room_sensor", "localhost", adr.get_port());
+  for (int i = 0; i < samples; i++) {
+    uint32_t ts;
+    float values[5];
+    sample(i, ts, values);
+    Telemetry data[5] = {
+      { roomKeys[0].key, values[0] }, { roomKeys[1].key, values[1] }, { roomKeys[2].key, (int)values[2] },
+      { roomKeys[3].key, (int)values[3] }, { roomKeys[4].key, values[4] }
+    };
+    if (!tb.sendTelemetry(data, 5))
+      run.failed++;
+  }
+  end(run, socket, samples);
+}
+
+/**************************************************************************/
+/*
+    rows samples per request, streamed like sendRows() of the room sensor
+*/
+/**************************************************************************/
+void runBatch(Run &run, int samples, int rows) {
+  static RoomBatch batch(roomKeys);
+  TCPSocket socket;
+
+  begin(run, socket);
+  tbs.begin("token_of_the_room_sensor", "localhost");
+  batch.clear();
+  for (int i = 0; i < samples; i++) {
+    uint32_t ts;
+    float values[5];
+    sample(i, ts, values);
+    batch.add(ts, values);
+    if ((int)batch.count() < rows && i < samples - 1)
+      continue;
+    if (tbs.beginTelemetry(&socket) == NSAPI_ERROR_OK)
+      batch.render(tbs);
+    if (tbs.end() != 200)
+      run.failed++;
+    batch.clear();
+  }
+  end(run, socket, samples);
+}
+
+void print(const char *label, const Run &run) {
+  printf("[BNCH] %-14s %6.3f requests/sample %7.1f bytes/sample up %6.1f down %7.2f ms/sample%s\n", label,
+    (double)run.requests / run.samples, (double)run.up / run.samples, (double)run.down / run.samples,
+    run.us / 1000.0 / run.samples, run.failed ? " FAILED" : "");
+}
+
+int main(int argc, char **argv) {
+  int samples = argc > 1 ? atoi(argv[1]) : 600;
+  int rtt = argc > 2 ? atoi(argv[2]) : 0;
+  if (samples < UPLOAD_INTERVAL_MAX || rtt < 0) {
+    printf("usage: %s [samples, at least %d] [round trip ms]\n", argv[0], UPLOAD_INTERVAL_MAX);
+    return 1;
+  }
+  server.body = "";
+  server.latency_ms = rtt;
+  if (!server.start())
+    return 1;
+  printf("[BNCH] %d samples of the room sensor, %d ms round trip\n", samples, rtt);
+
+  Run library, single;
+  runLibrary(library, samples);
+  print("library", library);
+  runBatch(single, samples, 1);
+  print("stream", single);
+  bool ok = library.failed == 0 && single.failed == 0 && library.requests == (uint32_t)samples &&
+    single.requests == (uint32_t)samples;
+
+  const int intervals[3] = { UPLOAD_INTERVAL_MIN, 15, UPLOAD_INTERVAL_MAX };
+  for (int i = 0; i < 3; i++) {
+    Run batched;
+    char label[32];
+    runBatch(batched, samples, intervals[i]);
+    snprintf(label, sizeof(label), "batch of %d", intervals[i]);
+    print(label, batched);
+    // one request per write interval, and fewer bytes than a request per sample
+    uint32_t requests = (samples + intervals[i] - 1) / intervals[i];
+    ok = ok && batched.failed == 0 && batched.requests == requests && batched.up < single.up &&
+      batched.up < library.up;
+    if (batched.up + batched.down)
+      printf("[BNCH]   %.1f times fewer bytes than the library, %.1f times fewer than a stream per sample\n",
+        (double)(library.up + library.down) / (batched.up + batched.down),
+        (double)(single.up + single.down) / (batched.up + batched.down));
+  }
+
+  printf("[BNCH] batch_bench %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+// Size and encode time of the room sensor batches as JSON and as CBOR, and
+// a decoder stand-in for the receiving side that turns the CBOR back into
+// the JSON of the batch, to check that no value is lost.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor fleet_load/cbor_bench.cpp -o cbor_bench -lpthread
+//   ./cbor_bench [rows] [iterations]
+
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+#include "telemetry-batch.h"
+#include "telemetry-cbor.h"
+
+#define ROWS_MAX 240
+
+const BatchKey roomKeys[5] = {
+  { "temperature",  2 },
+  { "humidity",     2 },
+  { "VOCindex",     0 },
+  { "CO2",          0 },
+  { "light",        1 },
+};
+
+typedef TelemetryBatch<5, ROWS_MAX> RoomBatch;
+
+/**
+ * Decodes the subset of CBOR written by CborWriter into JSON text, with
+ * the key table for the indexed layout. Returns false on malformed input.
+ */
+class CborDecoder {
+public:
+  CborDecoder(const uint8_t *data, size_t len, const BatchKey *keys, size_t nkeys)
+    : _p(data), _end(data + len), _keys(keys), _nkeys(nkeys) {}
+
+  bool json(std::string &out, bool indexed) {
+    _indexed = indexed;
+    return item(out, 0) && _p == _end;
+  }
+
+private:
+  bool head(uint8_t &major, uint8_t &info, uint64_t &value) {
+    if (_p >= _end)
+      return false;
+    major = *_p >> 5;
+    info = *_p & 0x1F;
+    _p++;
+    if (info < 24) {
+      value = info;
+      return true;
+    }
+    size_t n = info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : info == 27 ? 8 : 0;
+    if (n == 0 || (size_t)(_end - _p) < n)
+      return false;
+    value = 0;
+    for (size_t i = 0; i < n; i++)
+      value = value << 8 | *_p++;
+    return true;
+  }
+
+  // depth 2 is the values map of a row, its keys are indices in the indexed layout
+  bool item(std::string &out, int depth) {
+    uint8_t major, info;
+    uint64_t value;
+    char buf[48];
+
+    if (!head(major, info, value))
+      return false;
+    switch (major) {
+      case 0:
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value);
+        out += buf;
+        return true;
+      case 1:
+        snprintf(buf, sizeof(buf), "-%llu", (unsigned long long)value + 1);
+        out += buf;
+        return true;
+      case 3:
+        if ((uint64_t)(_end - _p) < value)
+          return false;
+        out += '"';
+        out.append((const char *)_p, value);
+        out += '"';
+        _p += value;
+        return true;
+      case 4:
+        // [ts, {values}] of the indexed layout becomes {"ts":...,"values":{...}}
+        if (_indexed && depth == 1) {
+          if (value != 2)
+            return false;
+          std::string ts;
+          if (!item(ts, 1))
+            return false;
+          out += "{\"ts\":" + ts + "000,\"values\":";
+          if (!item(out, 2))
+            return false;
+          out += '}';
+          return true;
+        }
+        out += '[';
+        for (uint64_t i = 0; i < value; i++) {
+          if (i)
+            out += ',';
+          if (!item(out, depth + 1))
+            return false;
+        }
+        out += ']';
+        return true;
+      case 5:
+        out += '{';
+        for (uint64_t i = 0; i < value; i++) {
+          if (i)
+            out += ',';
+          if (_indexed && depth == 2) {
+            uint8_t kmajor, kinfo;
+            uint64_t k;
+            if (!head(kmajor, kinfo, k) || kmajor != 0 || k >= _nkeys)
+              return false;
+            out += std::string("\"") + _keys[k].key + "\"";
+          } else if (!item(out, depth + 1)) {
+            return false;
+          }
+          out += ':';
+          if (!item(out, depth + 1))
+            return false;
+        }
+        out += '}';
+        return true;
+      case 7:
+        if (info == 25)
+          snprintf(buf, sizeof(buf), "%g", (double)CborWriter<CborBuffer>::fromHalf((uint16_t)value));
+        else if (info == 26) {
+          uint32_t bits = (uint32_t)value;
+          float f;
+          memcpy(&f, &bits, 4);
+          snprintf(buf, sizeof(buf), "%.7g", (double)f);
+        } else
+          return false;
+        out += buf;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  const uint8_t *_p;
+  const uint8_t *_end;
+  const BatchKey *_keys;
+  size_t _nkeys;
+  bool _indexed;
+};
+
+/**************************************************************************/
+/*
+    room sensor trace, the deadband has left out some values
+*/
+/**************************************************************************/
+void fillBatch(RoomBatch &batch, int rows) {
+  float values[5];
+  batch.clear();
+  for (int i = 0; i < rows; i++) {
+    values[0] = 21.0f + 0.8f * sinf(i / 40.0f) + (i % 7) * 0.013f;
+    values[1] = 45.0f + 3.0f * cosf(i / 60.0f) + (i % 5) * 0.07f;
+    values[2] = (float)(100 + (i * 7) % 90);
+    values[3] = (float)(450 + (i * 13) % 900);
+    values[4] = 320.0f + 150.0f * sinf(i / 100.0f) + (i % 3) * 0.1f;
+    if (i % 4)
+      values[2] = NAN;
+    if (i % 3)
+      values[4] = NAN;
+    batch.add(1626950000 + i * 10, values);
+  }
+}
+
+/**************************************************************************/
+/*
+    extract all numbers of a JSON text, for comparing decoded and original values,
+    unit is the last digit written, e.g. 0.01 for 22.53
+*/
+/**************************************************************************/
+std::vector<double> numbers(const std::string &json, std::vector<double> *unit = NULL) {
+  std::vector<double> v;
+  const char *p = json.c_str();
+  while (*p) {
+    if ((*p >= '0' && *p <= '9') || *p == '-') {
+      char *end;
+      v.push_back(strtod(p, &end));
+      if (unit) {
+        const char *dot = (const char *)memchr(p, '.', end - p);
+        unit->push_back(dot ? pow(10.0, -(double)(end - dot - 1)) : 1.0);
+      }
+      p = end;
+    } else {
+      p++;
+    }
+  }
+  return v;
+}
+
+/**************************************************************************/
+/*
+    every half float and rounding boundary against the decoder
+*/
+/**************************************************************************/
+bool checkHalf() {
+  for (uint32_t h = 0; h < 0x10000; h++) {
+    if ((h & 0x7C00) == 0x7C00)
+      continue;
+    float f = CborWriter<CborBuffer>::fromHalf((uint16_t)h);
+    uint16_t back = CborWriter<CborBuffer>::toHalf(f);
+    if (back != h && !(f == 0.0f && (back & 0x7FFF) == 0)) {
+      printf("half %04x -> %g -> %04x\n", h, (double)f, back);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int rows = argc > 1 ? atoi(argv[1]) : 60;
+  int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+  if (rows < 1 || rows > ROWS_MAX || iterations < 1) {
+    printf("usage: %s [rows 1..%d] [iterations]\n", argv[0], ROWS_MAX);
+    return 1;
+  }
+
+  static RoomBatch batch(roomKeys);
+  static char json[ROWS_MAX * 160];
+  static uint8_t cbor[ROWS_MAX * 64];
+  TelemetryCbor<5> named(roomKeys, CBOR_NAMED);
+  TelemetryCbor<5> indexed(roomKeys, CBOR_INDEXED);
+  fillBatch(batch, rows);
+
+  bool half = checkHalf();
+  printf("[CBOR] half float round trip: %s\n", half ? "ok" : "FAILED");
+
+  int json_len = batch.render(json, sizeof(json));
+  std::vector<double> unit;
+  std::vector<double> expected = numbers(json, &unit);
+  bool ok = half && json_len > 0;
+
+  const TelemetryCbor<5> *encoders[2] = { &named, &indexed };
+  const char *labels[2] = { "named", "indexed" };
+  int cbor_len[2];
+  for (int e = 0; e < 2; e++) {
+    cbor_len[e] = encoders[e]->render(cbor, sizeof(cbor), batch);
+    std::string decoded;
+    CborDecoder dec(cbor, cbor_len[e], roomKeys, 5);
+    bool valid = cbor_len[e] > 0 && dec.json(decoded, encoders[e]->layout() == CBOR_INDEXED);
+    // the same values in the same order, within half a unit of the decimals of the JSON
+    std::vector<double> got = numbers(decoded);
+    valid = valid && got.size() == expected.size();
+    for (size_t i = 0; valid && i < got.size(); i++)
+      valid = fabs(got[i] - expected[i]) < 0.5 * unit[i];
+    printf("[CBOR] %-7s decodes to the JSON values: %s\n", labels[e], valid ? "ok" : "FAILED");
+    ok = ok && valid;
+  }
+
+  uint32_t start = us_ticker_read();
+  for (int i = 0; i < iterations; i++)
+    json_len = batch.render(json, sizeof(json));
+  double json_ns = (us_ticker_read() - start) * 1000.0 / iterations;
+
+  double cbor_ns[2];
+  for (int e = 0; e < 2; e++) {
+    start = us_ticker_read();
+    for (int i = 0; i < iterations; i++)
+      cbor_len[e] = encoders[e]->render(cbor, sizeof(cbor), batch);
+    cbor_ns[e] = (us_ticker_read() - start) * 1000.0 / iterations;
+  }
+
+  printf("[CBOR] %d rows       bytes   per row   encode us   per row ns\n", rows);
+  printf("[CBOR] json     %10d %9.1f %11.2f %12.0f\n", json_len, (double)json_len / rows, json_ns / 1000.0, json_ns / rows);
+  for (int e = 0; e < 2; e++)
+    printf("[CBOR] %-8s %10d %9.1f %11.2f %12.0f  (%.0f%% of json)\n", labels[e], cbor_len[e],
+      (double)cbor_len[e] / rows, cbor_ns[e] / 1000.0, cbor_ns[e] / rows, 100.0 * cbor_len[e] / json_len);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+// Compression ratio, speed and RAM of the gzip stream for the backlog
+// batches of the room sensor, the output of each window size inflated with
+// zlib and compared with the JSON, and the Content-Encoding negotiation of
+// ThingsBoardStream against an HTTP stand-in in the same process that
+// either accepts compressed requests or answers them with 415.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor fleet_load/deflate_bench.cpp -o deflate_bench -lpthread -lz
+//   ./deflate_bench [rows] [iterations] [file.gz]
+// The optional file gets the compressed batch of the 1 KB window.
+
+#include <atomic>
+#include <stdarg.h>
+#include <string>
+#include <zlib.h>
+
+#include "mbed.h"
+#include "telemetry-batch.h"
+#include "deflate-stream.h"
+#include "thingsboard-stream.h"
+
+#define ROWS_MAX 240
+// rows of a backlog batch, LOG_BATCH of the room sensor
+#define ROWS_DEFAULT 32
+#define SERVER_PORT 18080
+
+const BatchKey roomKeys[5] = {
+  { "temperature",  2 },
+  { "humidity",     2 },
+  { "VOCindex",     0 },
+  { "CO2",          0 },
+  { "light",        1 },
+};
+
+typedef TelemetryBatch<5, ROWS_MAX> RoomBatch;
+
+std::atomic<bool> serverAcceptsGzip(true);
+std::atomic<uint32_t> serverGzipBodies(0);
+std::atomic<uint32_t> serverPlainBodies(0);
+
+/**************************************************************************/
+/*
+    room sensor trace, the deadband has left out some values
+*/
+/**************************************************************************/
+void fillBatch(RoomBatch &batch, int rows) {
+  float values[5];
+  batch.clear();
+  for (int i = 0; i < rows; i++) {
+    values[0] = 21.0f + 0.8f * sinf(i / 40.0f) + (i % 7) * 0.013f;
+    values[1] = 45.0f + 3.0f * cosf(i / 60.0f) + (i % 5) * 0.07f;
+    values[2] = (float)(100 + (i * 7) % 90);
+    values[3] = (float)(450 + (i * 13) % 900);
+    values[4] = 320.0f + 150.0f * sinf(i / 100.0f) + (i % 3) * 0.1f;
+    if (i % 4)
+      values[2] = NAN;
+    if (i % 3)
+      values[4] = NAN;
+    batch.add(1626950000 + i * 10, values);
+  }
+}
+
+// the rendered JSON goes straight into the compressor, like in the upload
+template <size_t WINDOW>
+class DeflateWriter {
+public:
+  DeflateWriter(DeflateStream<WINDOW> &z) : _z(z) {}
+
+  MBED_PRINTF_METHOD(1, 2)
+  void put(const char *fmt, ...) {
+    char text[128];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    if (len > 0)
+      _z.write(text, len < (int)sizeof(text) ? len : sizeof(text) - 1);
+  }
+
+  void write(const char *data, size_t len) { _z.write(data, len); }
+
+private:
+  DeflateStream<WINDOW> &_z;
+};
+
+// compressed output is only counted, or kept for the check
+void collect(void *ctx, const char *data, size_t len) {
+  if (ctx)
+    ((std::string *)ctx)->append(data, len);
+}
+
+/**************************************************************************/
+/*
+    inflate a gzip stream with zlib, which also checks the CRC and the length of the trailer
+*/
+/**************************************************************************/
+bool gunzip(const std::string &gz, std::string &out) {
+  z_stream s;
+  char buf[4096];
+  int ret;
+
+  memset(&s, 0, sizeof(s));
+  if (inflateInit2(&s, 16 + MAX_WBITS) != Z_OK)
+    return false;
+  s.next_in = (Bytef *)gz.data();
+  s.avail_in = gz.size();
+  do {
+    s.next_out = (Bytef *)buf;
+    s.avail_out = sizeof(buf);
+    ret = inflate(&s, Z_NO_FLUSH);
+    out.append(buf, sizeof(buf) - s.avail_out);
+  } while (ret == Z_OK);
+  inflateEnd(&s);
+  return ret == Z_STREAM_END && s.avail_in == 0;
+}
+
+/**************************************************************************/
+/*
+    compress the batch with a window size, check that it inflates to the JSON,
+    print ratio, speed and memory
+*/
+/**************************************************************************/
+template <size_t WINDOW>
+bool measure(const RoomBatch &batch, const char *json, int json_len, int iterations, std::string *gz) {
+  static DeflateStream<WINDOW> z;
+  DeflateWriter<WINDOW> w(z);
+  std::string out;
+  std::string inflated;
+
+  z.begin(collect, &out);
+  batch.render(w);
+  z.finish();
+  bool ok = gunzip(out, inflated) && inflated == std::string(json, json_len);
+  if (gz)
+    *gz = out;
+
+  uint32_t start = us_ticker_read();
+  for (int i = 0; i < iterations; i++) {
+    z.begin(collect, NULL);
+    batch.render(w);
+    z.finish();
+  }
+  double us = (double)(us_ticker_read() - start) / iterations;
+
+  printf("[BNCH] window %5u  ram %5u  bytes %6lu  %5.1f%% of json  %8.1f us  %6.1f MB/s  inflated: %s\n", (unsigned)WINDOW,
+    (unsigned)sizeof(z), (unsigned long)z.size_out(), 100.0 * z.size_out() / json_len, us, json_len / us,
+    ok ? "ok" : "FAILED");
+  return ok;
+}
+
+/**************************************************************************/
+/*
+    one connection of the HTTP stand-in: reads chunked requests, answers 200,
+    or 415 with a body for compressed requests if it does not accept them
+*/
+/**************************************************************************/
+void serverSession(int fd) {
+  std::string in;
+  char buf[4096];
+
+  while (true) {
+    size_t head_end;
+    while ((head_end = in.find("\r\n\r\n")) == std::string::npos) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0)
+        goto done;
+      in.append(buf, n);
+    }
+    bool gzip = in.substr(0, head_end).find("\r\nContent-Encoding: gzip\r\n") != std::string::npos;
+
+    // chunked body
+    std::string body;
+    size_t pos = head_end + 4;
+    while (true) {
+      size_t line;
+      while ((line = in.find("\r\n", pos)) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+          goto done;
+        in.append(buf, n);
+      }
+      size_t size = strtoul(in.c_str() + pos, NULL, 16);
+      while (in.size() < line + 2 + size + 2) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+          goto done;
+        in.append(buf, n);
+      }
+      body.append(in, line + 2, size);
+      pos = line + 2 + size + 2;
+      if (size == 0)
+        break;
+    }
+    in.erase(0, pos);
+
+    const char *response;
+    if (gzip && !serverAcceptsGzip) {
+      response = "HTTP/1.1 415 Unsupported Media Type\r\nContent-Length: 22\r\n\r\nunsupported encoding\r\n";
+    } else {
+      bool magic = body.size() >= 2 && (uint8_t)body[0] == 0x1F && (uint8_t)body[1] == 0x8B;
+      if (gzip != magic)
+        response = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+      else
+        response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+      (gzip ? serverGzipBodies : serverPlainBodies)++;
+    }
+    send(fd, response, strlen(response), MSG_NOSIGNAL);
+  }
+done:
+  close(fd);
+}
+
+/**************************************************************************/
+/*
+    accept clients on localhost, one thread per connection
+*/
+/**************************************************************************/
+void server(int listener) {
+  while (true) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+      return;
+    std::thread(serverSession, fd).detach();
+  }
+}
+
+/**************************************************************************/
+/*
+    upload the batch compressed if the stream allows it, again uncompressed if refused,
+    the same as sendRows of the room sensor
+*/
+/**************************************************************************/
+int upload(ThingsBoardStream &tbs, TCPSocket &socket, const RoomBatch &batch) {
+  bool gzip = tbs.compression();
+  if (tbs.beginTelemetry(&socket, "application/json", gzip) == NSAPI_ERROR_OK)
+    batch.render(tbs);
+  int status = tbs.end();
+  if (status == 415 && tbs.gzip_refused() && tbs.keep_alive()) {
+    if (tbs.beginTelemetry(&socket, "application/json", false) == NSAPI_ERROR_OK)
+      batch.render(tbs);
+    status = tbs.end();
+  }
+  return status;
+}
+
+/**************************************************************************/
+/*
+    a server that accepts gzip gets it compressed, one that does not gets it
+    uncompressed after the first 415, on the same connection
+*/
+/**************************************************************************/
+bool checkNegotiation(const RoomBatch &batch) {
+  static char streambuf[512];
+  static DeflateStream<> deflate;
+  bool ok = true;
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(SERVER_PORT);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(listener, 8) != 0) {
+    printf("Error! port %d is in use\n", SERVER_PORT);
+    return false;
+  }
+  std::thread(server, listener).detach();
+  SocketAddress adr("127.0.0.1", SERVER_PORT);
+
+  for (int accepts = 1; accepts >= 0; accepts--) {
+    ThingsBoardStream tbs(streambuf, sizeof(streambuf));
+    TCPSocket socket;
+    serverAcceptsGzip = accepts != 0;
+    serverGzipBodies = 0;
+    serverPlainBodies = 0;
+    tbs.begin("token", "localhost");
+    tbs.setCompression(&deflate);
+    socket.open(NetworkInterface::get_default_instance());
+    if (socket.connect(adr) != NSAPI_ERROR_OK) {
+      printf("Error! could not connect\n");
+      return false;
+    }
+    int first = upload(tbs, socket, batch);
+    uint32_t first_bytes = tbs.bytes();
+    int second = upload(tbs, socket, batch);
+    bool expected = first == 200 && second == 200 && tbs.keep_alive() &&
+      (accepts ? serverGzipBodies == 2 && serverPlainBodies == 0 && !tbs.gzip_refused()
+               : serverGzipBodies == 0 && serverPlainBodies == 2 && tbs.gzip_refused());
+    printf("[BNCH] server %-13s %d %d, %lu compressed and %lu plain bodies, %lu bytes sent: %s\n",
+      accepts ? "accepts gzip" : "answers 415", first, second, (unsigned long)serverGzipBodies.load(),
+      (unsigned long)serverPlainBodies.load(), (unsigned long)first_bytes, expected ? "ok" : "FAILED");
+    ok = ok && expected;
+    socket.close();
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int rows = argc > 1 ? atoi(argv[1]) : ROWS_DEFAULT;
+  int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+  const char *file = argc > 3 ? argv[3] : NULL;
+  if (rows < 1 || rows > ROWS_MAX || iterations < 1) {
+    printf("usage: %s [rows 1..%d] [iterations] [file.gz]\n", argv[0], ROWS_MAX);
+    return 1;
+  }
+
+  static RoomBatch batch(roomKeys);
+  static char json[ROWS_MAX * 160];
+  fillBatch(batch, rows);
+  int json_len = batch.render(json, sizeof(json));
+  printf("[BNCH] %d rows, %d bytes of json\n", rows, json_len);
+
+  std::string gz;
+  bool ok = measure<512>(batch, json, json_len, iterations, NULL);
+  ok = measure<1024>(batch, json, json_len, iterations, &gz) && ok;
+  ok = measure<2048>(batch, json, json_len, iterations, NULL) && ok;
+  ok = measure<4096>(batch, json, json_len, iterations, NULL) && ok;
+
+  if (file) {
+    FILE *f = fopen(file, "wb");
+    if (!f || fwrite(gz.data(), 1, gz.size(), f) != gz.size()) {
+      printf("Error! could not write %s\n", file);
+      return 1;
+    }
+    fclose(f);
+    printf("[BNCH] window 1024 output written to %s\n", file);
+  }
+
+  ok = checkNegotiation(batch) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,653 @@
+// This program simulates a fleet of room sensors uploading to ThingsBoard,
+// to size the ingest servers. Every virtual device runs the upload logic of
+// https_room_sensor (deadband, adaptive upload interval, timestamped batches)
+// with its own token and its own simulated room, all devices share one
+// epoll event loop.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor fleet_load/fleet_load.cpp -o fleet_load -lpthread
+//   ./fleet_load -n 2000 -H 127.0.0.1 -p 8080 -d 300 -s 10
+//
+// Every report interval it prints the requests/s, the latency percentiles
+// of the successful requests and the error rates.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+#include "telemetry-batch.h"
+#include "telemetry-deadband.h"
+#include "upload-scheduler.h"
+
+#define UPLOAD_INTERVAL_MIN 5
+#define UPLOAD_INTERVAL_MAX 60
+// rows of a batch like the room sensor, one sample per second of the longest interval
+#define BATCH_ROWS UPLOAD_INTERVAL_MAX
+
+// the same policies as https_room_sensor
+const BatchKey roomKeys[5] = {
+  { "temperature",  2 },
+  { "humidity",     2 },
+  { "VOCindex",     0 },
+  { "CO2",          0 },
+  { "light",        1 },
+};
+const DeadbandKey roomDeadbands[5] = {
+  { 0.1f,  300 },   // temperature
+  { 0.5f,  300 },   // humidity
+  { 5.0f,  300 },   // VOCindex
+  { 20.0f, 300 },   // CO2
+  { 10.0f, 300 },   // light
+};
+const float roomScales[5] = {
+  0.05f,  // temperature
+  0.2f,   // humidity
+  2.0f,   // VOCindex
+  5.0f,   // CO2
+  20.0f,  // light
+};
+SchedulerConfig schedulerConfig = {
+  UPLOAD_INTERVAL_MIN,
+  UPLOAD_INTERVAL_MAX,
+  0.1f,   // smoothing
+  2000,   // uploads slower than 2 s lengthen the interval
+  4.0f,   // failing uploads make the interval four times longer
+};
+
+typedef TelemetryRow<5> RoomSample;
+
+// command line options
+struct Options {
+  int devices = 100;
+  const char *host = "127.0.0.1";
+  const char *port = "8080";
+  uint32_t duration_s = 60;
+  float speed = 1.0f;           // simulated seconds per real second
+  const char *token = "sim";    // device i uses the token <prefix><i>
+  uint32_t report_s = 5;
+  uint32_t timeout_ms = 5000;
+  bool keep_alive = true;
+} opt;
+
+uint64_t nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Values of a simulated room: people come and go, CO2, VOC and temperature
+ * follow the occupancy, the light follows the day. Every device gets its
+ * own random room, so the deadband and the scheduler see realistic traces.
+ */
+class RoomSignal {
+public:
+  RoomSignal(uint32_t seed) : _seed(seed ? seed : 1), _occupied(false), _next_change(0) {
+    _base_temp = 19.5f + uniform() * 3.0f;
+    _temp = _base_temp;
+    _hum = 35.0f + uniform() * 20.0f;
+    _co2 = 420.0f + uniform() * 50.0f;
+    _voc = 100.0f;
+    _day_offset = (uint32_t)(uniform() * 86400);
+  }
+
+  void sample(uint32_t t, float *values) {
+    if (t >= _next_change) {
+      _occupied = !_occupied;
+      _next_change = t + 600 + (uint32_t)(uniform() * (_occupied ? 5400 : 10800));
+    }
+    float target_co2 = _occupied ? 1400.0f : 420.0f;
+    float target_temp = _base_temp + (_occupied ? 1.5f : 0.0f);
+    _co2 += (target_co2 - _co2) * 0.002f + gauss() * 2.0f;
+    _temp += (target_temp - _temp) * 0.0005f + gauss() * 0.01f;
+    _hum += gauss() * 0.05f;
+    _voc += ((_occupied ? 180.0f : 100.0f) - _voc) * 0.003f + gauss() * 0.5f;
+
+    float hour = fmodf((t + _day_offset) / 3600.0f, 24.0f);
+    float daylight = hour > 6.0f && hour < 20.0f ? sinf((hour - 6.0f) / 14.0f * (float)M_PI) : 0.0f;
+    float lux = daylight * 600.0f + (_occupied ? 300.0f : 0.0f) + gauss() * 3.0f;
+
+    values[0] = _temp;
+    values[1] = _hum;
+    values[2] = roundf(_voc);
+    values[3] = roundf(_co2);
+    values[4] = lux > 0.0f ? lux : 0.0f;
+  }
+
+private:
+  float uniform() {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return (_seed & 0xFFFFFF) / (float)0x1000000;
+  }
+
+  // sum of uniforms, close enough to a normal distribution for noise
+  float gauss() {
+    return (uniform() + uniform() + uniform() + uniform() - 2.0f) * 1.7f;
+  }
+
+  uint32_t _seed;
+  bool _occupied;
+  uint32_t _next_change;
+  uint32_t _day_offset;
+  float _base_temp;
+  float _temp;
+  float _hum;
+  float _co2;
+  float _voc;
+};
+
+// appends a printf like put() to a string, for TelemetryBatch::render
+class StringWriter {
+public:
+  StringWriter(std::string &s) : _s(s) {}
+
+  MBED_PRINTF_METHOD(1, 2)
+  void put(const char *fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0)
+      _s.append(buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+  }
+
+private:
+  std::string &_s;
+};
+
+enum DeviceState {
+  DEVICE_IDLE = 0,
+  DEVICE_CONNECTING,
+  DEVICE_SENDING,
+  DEVICE_RECEIVING
+};
+
+enum ErrorKind {
+  ERROR_CONNECT = 0,
+  ERROR_TIMEOUT,
+  ERROR_CLOSED,
+  ERROR_STATUS,
+  ERROR_KINDS
+};
+const char *const errorNames[ERROR_KINDS] = { "connect", "timeout", "closed", "status" };
+
+struct Device {
+  Device(int i, uint32_t seed)
+    : id(i), signal(seed), deadband(roomDeadbands), scheduler(schedulerConfig, roomScales), batch(roomKeys),
+      sampled_s(0), fd(-1), state(DEVICE_IDLE), seq(0), sent(0), start_us(0) {
+    snprintf(token, sizeof(token), "%s%d", opt.token, i);
+  }
+
+  int id;
+  char token[32];
+  RoomSignal signal;
+  TelemetryDeadband<5> deadband;
+  UploadScheduler<5> scheduler;
+  TelemetryBatch<5, BATCH_ROWS> batch;
+  uint32_t sampled_s;     // simulated seconds already sampled
+  int fd;
+  DeviceState state;
+  uint32_t seq;           // timers of an older sequence number are stale
+  std::string out;
+  size_t sent;
+  std::string in;
+  uint64_t start_us;
+};
+
+// counters of one report interval
+struct Window {
+  uint32_t started = 0;
+  uint32_t ok = 0;
+  uint32_t skipped = 0;   // no value passed the deadband, nothing to upload
+  uint32_t dropped = 0;   // rows overwritten in a full batch, e.g. after failed uploads
+  uint32_t connects = 0;
+  uint32_t errors[ERROR_KINDS] = {};
+  uint64_t bytes = 0;
+  std::vector<uint32_t> latency_us;
+
+  void merge(const Window &w) {
+    started += w.started;
+    ok += w.ok;
+    skipped += w.skipped;
+    dropped += w.dropped;
+    connects += w.connects;
+    for (int i = 0; i < ERROR_KINDS; i++)
+      errors[i] += w.errors[i];
+    bytes += w.bytes;
+    latency_us.insert(latency_us.end(), w.latency_us.begin(), w.latency_us.end());
+  }
+};
+
+typedef struct {
+  uint64_t due_us;
+  int device;
+  uint32_t seq;
+} TimerEntry;
+
+struct TimerLater {
+  bool operator()(const TimerEntry &a, const TimerEntry &b) const { return a.due_us > b.due_us; }
+};
+
+std::vector<Device *> devices;
+std::priority_queue<TimerEntry, std::vector<TimerEntry>, TimerLater> timers;
+struct sockaddr_storage serverAddr;
+socklen_t serverAddrLen;
+int epfd;
+uint64_t startUs;
+uint32_t startUnix;
+Window window;
+Window total;
+int connections = 0;
+
+/**************************************************************************/
+/*
+    run the next action of a device at due_us
+*/
+/**************************************************************************/
+void schedule(Device &d, uint64_t due_us) {
+  TimerEntry t = { due_us, d.id, d.seq };
+  timers.push(t);
+}
+
+/**************************************************************************/
+/*
+    simulated seconds since the start
+*/
+/**************************************************************************/
+uint32_t simSeconds(uint64_t now_us) {
+  return (uint32_t)((now_us - startUs) * opt.speed / 1000000.0);
+}
+
+/**************************************************************************/
+/*
+    real microseconds of a simulated interval
+*/
+/**************************************************************************/
+uint64_t realUs(uint32_t sim_s) {
+  return (uint64_t)(sim_s * 1000000.0 / opt.speed);
+}
+
+/**************************************************************************/
+/*
+    close the connection of a device
+*/
+/**************************************************************************/
+void closeDevice(Device &d) {
+  if (d.fd >= 0) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, d.fd, NULL);
+    close(d.fd);
+    d.fd = -1;
+    connections--;
+  }
+}
+
+/**************************************************************************/
+/*
+    finish an upload and schedule the next one after the interval of the scheduler
+*/
+/**************************************************************************/
+void finishUpload(Device &d, uint64_t now_us, bool ok, int error) {
+  uint32_t latency_us = (uint32_t)(now_us - d.start_us);
+
+  if (ok) {
+    window.ok++;
+    window.latency_us.push_back(latency_us);
+    d.batch.clear();
+  } else {
+    window.errors[error]++;
+    closeDevice(d);
+  }
+  d.scheduler.uploaded(ok, latency_us / 1000);
+  if (!opt.keep_alive)
+    closeDevice(d);
+
+  d.state = DEVICE_IDLE;
+  d.seq++;
+  d.out.clear();
+  d.in.clear();
+  schedule(d, now_us + realUs(d.scheduler.interval()));
+}
+
+/**************************************************************************/
+/*
+    write as much of the request as the socket takes
+*/
+/**************************************************************************/
+void sendRequest(Device &d, uint64_t now_us) {
+  while (d.sent < d.out.size()) {
+    ssize_t n = send(d.fd, d.out.data() + d.sent, d.out.size() - d.sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      finishUpload(d, now_us, false, ERROR_CLOSED);
+      return;
+    }
+    d.sent += n;
+    window.bytes += n;
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u32 = d.id;
+  epoll_ctl(epfd, EPOLL_CTL_MOD, d.fd, &ev);
+  d.state = DEVICE_RECEIVING;
+}
+
+/**************************************************************************/
+/*
+    read the response, the upload is done when the headers and the body are complete
+*/
+/**************************************************************************/
+void readResponse(Device &d, uint64_t now_us) {
+  char buf[2048];
+
+  while (true) {
+    ssize_t n = recv(d.fd, buf, sizeof(buf), 0);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      finishUpload(d, now_us, false, ERROR_CLOSED);
+      return;
+    }
+    if (n == 0) {
+      finishUpload(d, now_us, false, ERROR_CLOSED);
+      return;
+    }
+    d.in.append(buf, n);
+
+    size_t end = d.in.find("\r\n\r\n");
+    if (end == std::string::npos)
+      continue;
+    const char *headers = d.in.c_str();
+    const char *p = strcasestr(headers, "\r\ncontent-length:");
+    size_t length = p && p < headers + end ? strtoul(p + 17, NULL, 10) : 0;
+    if (d.in.size() < end + 4 + length)
+      continue;
+
+    int status = 0;
+    sscanf(headers, "HTTP/%*d.%*d %d", &status);
+    p = strcasestr(headers, "\r\nconnection: close");
+    bool close_after = p && p < headers + end;
+
+    finishUpload(d, now_us, status == 200, ERROR_STATUS);
+    if (close_after)
+      closeDevice(d);
+    return;
+  }
+}
+
+/**************************************************************************/
+/*
+    sample the simulated room up to now and start an upload if any value passed the deadband
+*/
+/**************************************************************************/
+void startUpload(Device &d, uint64_t now_us) {
+  uint32_t now_s = simSeconds(now_us);
+  RoomSample sample;
+
+  for (; d.sampled_s < now_s; d.sampled_s++) {
+    d.signal.sample(d.sampled_s, sample.values);
+    d.scheduler.sample(sample.values);
+    sample.ts = startUnix + d.sampled_s;
+    // behind by more than a batch after failed or slow uploads, the oldest rows are lost
+    bool full = d.batch.full();
+    if (d.deadband.add(d.batch, sample, d.sampled_s) && full)
+      window.dropped++;
+  }
+
+  d.seq++;
+  if (d.batch.count() == 0) {
+    window.skipped++;
+    schedule(d, now_us + realUs(d.scheduler.interval()));
+    return;
+  }
+
+  std::string body;
+  StringWriter w(body);
+  d.batch.render(w);
+  char header[256];
+  int n = snprintf(header, sizeof(header),
+    "POST /api/v1/%s/telemetry HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+    "Content-Length: %u\r\nConnection: %s\r\n\r\n",
+    d.token, opt.host, (unsigned)body.size(), opt.keep_alive ? "keep-alive" : "close");
+  d.out.assign(header, n);
+  d.out += body;
+  d.sent = 0;
+  d.in.clear();
+  d.start_us = now_us;
+  window.started++;
+  schedule(d, now_us + opt.timeout_ms * 1000ull);
+
+  struct epoll_event ev;
+  ev.data.u32 = d.id;
+  if (d.fd >= 0) {
+    d.state = DEVICE_SENDING;
+    ev.events = EPOLLOUT;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, d.fd, &ev);
+    sendRequest(d, now_us);
+    return;
+  }
+
+  d.fd = socket(serverAddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (d.fd < 0) {
+    finishUpload(d, now_us, false, ERROR_CONNECT);
+    return;
+  }
+  connections++;
+  int one = 1;
+  setsockopt(d.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  window.connects++;
+  d.state = DEVICE_CONNECTING;
+  ev.events = EPOLLOUT;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, d.fd, &ev);
+  if (connect(d.fd, (struct sockaddr *)&serverAddr, serverAddrLen) != 0 && errno != EINPROGRESS)
+    finishUpload(d, now_us, false, ERROR_CONNECT);
+}
+
+/**************************************************************************/
+/*
+    socket of a device is ready
+*/
+/**************************************************************************/
+void handleEvent(Device &d, uint32_t events, uint64_t now_us) {
+  if (d.state == DEVICE_CONNECTING) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(d.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err || (events & (EPOLLERR | EPOLLHUP))) {
+      finishUpload(d, now_us, false, ERROR_CONNECT);
+      return;
+    }
+    d.state = DEVICE_SENDING;
+  }
+  if (d.state == DEVICE_SENDING)
+    sendRequest(d, now_us);
+  else if (d.state == DEVICE_RECEIVING)
+    readResponse(d, now_us);
+  else if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+    closeDevice(d);   // idle keep-alive connection closed by the server
+}
+
+/**************************************************************************/
+/*
+    latency percentile of a sorted list
+*/
+/**************************************************************************/
+uint32_t percentile(const std::vector<uint32_t> &sorted, uint32_t percent) {
+  if (sorted.empty())
+    return 0;
+  size_t i = (sorted.size() * percent + 99) / 100;
+  return sorted[i ? i - 1 : 0];
+}
+
+/**************************************************************************/
+/*
+    print the counters of a window of the given length
+*/
+/**************************************************************************/
+void report(const char *label, Window &w, double seconds) {
+  std::sort(w.latency_us.begin(), w.latency_us.end());
+  uint32_t errors = 0;
+  for (int i = 0; i < ERROR_KINDS; i++)
+    errors += w.errors[i];
+  uint32_t done = w.ok + errors;
+
+  printf("[LOAD] %-6s %8.1f req/s %8.1f kB/s  latency ms p50 %7.2f p90 %7.2f p99 %7.2f max %7.2f  "
+         "errors %5.2f%% (", label, done / seconds, w.bytes / 1024.0 / seconds,
+    percentile(w.latency_us, 50) / 1000.0, percentile(w.latency_us, 90) / 1000.0,
+    percentile(w.latency_us, 99) / 1000.0, w.latency_us.empty() ? 0.0 : w.latency_us.back() / 1000.0,
+    done ? 100.0 * errors / done : 0.0);
+  for (int i = 0; i < ERROR_KINDS; i++)
+    printf("%s%s %lu", i ? ", " : "", errorNames[i], (unsigned long)w.errors[i]);
+  printf(")  connects %lu, skipped %lu, dropped rows %lu, open %d\n", (unsigned long)w.connects, (unsigned long)w.skipped,
+    (unsigned long)w.dropped, connections);
+}
+
+/**************************************************************************/
+/*
+    parse the command line
+*/
+/**************************************************************************/
+bool parseOptions(int argc, char **argv) {
+  int c;
+
+  while ((c = getopt(argc, argv, "n:H:p:d:s:t:r:T:i:I:ch")) != -1) {
+    switch (c) {
+      case 'n': opt.devices = atoi(optarg); break;
+      case 'H': opt.host = optarg; break;
+      case 'p': opt.port = optarg; break;
+      case 'd': opt.duration_s = atoi(optarg); break;
+      case 's': opt.speed = atof(optarg); break;
+      case 't': opt.token = optarg; break;
+      case 'r': opt.report_s = atoi(optarg); break;
+      case 'T': opt.timeout_ms = atoi(optarg); break;
+      case 'i': schedulerConfig.min_interval = atoi(optarg); break;
+      case 'I': schedulerConfig.max_interval = atoi(optarg); break;
+      case 'c': opt.keep_alive = false; break;
+      default:
+        printf("usage: %s [-n devices] [-H host] [-p port] [-d seconds] [-s speed] [-t token prefix]\n"
+               "       [-r report seconds] [-T timeout ms] [-i min interval] [-I max interval] [-c close connections]\n",
+          argv[0]);
+        return false;
+    }
+  }
+  if (opt.devices <= 0 || opt.speed <= 0.0f || opt.report_s == 0 || schedulerConfig.min_interval == 0 ||
+      schedulerConfig.max_interval < schedulerConfig.min_interval) {
+    printf("invalid options\n");
+    return false;
+  }
+  // a longer interval would always overwrite samples in the batch
+  if (schedulerConfig.max_interval > BATCH_ROWS) {
+    printf("the max interval is limited to %d s, the rows of a batch\n", BATCH_ROWS);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (!parseOptions(argc, argv))
+    return 1;
+
+  struct addrinfo hints;
+  struct addrinfo *ai;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(opt.host, opt.port, &hints, &ai) != 0) {
+    printf("Error! Resolving %s failed\n", opt.host);
+    return 1;
+  }
+  memcpy(&serverAddr, ai->ai_addr, ai->ai_addrlen);
+  serverAddrLen = ai->ai_addrlen;
+  freeaddrinfo(ai);
+
+  // one connection per device
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)opt.devices + 16)
+    printf("Warning: only %lu file descriptors for %d devices\n", (unsigned long)rl.rlim_cur, opt.devices);
+
+  epfd = epoll_create1(0);
+  startUs = nowUs();
+  startUnix = (uint32_t)time(NULL);
+
+  // the first uploads are spread over the shortest interval
+  for (int i = 0; i < opt.devices; i++) {
+    devices.push_back(new Device(i, 0x9E3779B9u * (i + 1)));
+    schedule(*devices[i], startUs + realUs(schedulerConfig.min_interval) * i / opt.devices);
+  }
+
+  printf("[LOAD] %d devices -> %s:%s, %.1f simulated s per s, %s connections\n", opt.devices, opt.host, opt.port,
+    opt.speed, opt.keep_alive ? "keep-alive" : "new");
+
+  uint64_t endUs = startUs + opt.duration_s * 1000000ull;
+  uint64_t reportUs = startUs + opt.report_s * 1000000ull;
+  uint64_t windowStartUs = startUs;
+  struct epoll_event events[256];
+
+  while (true) {
+    uint64_t now = nowUs();
+    if (now >= endUs)
+      break;
+
+    // timers: due uploads and request timeouts
+    while (!timers.empty() && timers.top().due_us <= now) {
+      TimerEntry t = timers.top();
+      timers.pop();
+      Device &d = *devices[t.device];
+      if (t.seq != d.seq)
+        continue;
+      if (d.state == DEVICE_IDLE)
+        startUpload(d, now);
+      else
+        finishUpload(d, now, false, ERROR_TIMEOUT);
+    }
+
+    if (now >= reportUs) {
+      report("window", window, (now - windowStartUs) / 1e6);
+      total.merge(window);
+      window = Window();
+      windowStartUs = now;
+      reportUs += opt.report_s * 1000000ull;
+    }
+
+    uint64_t wake = std::min(endUs, reportUs);
+    if (!timers.empty() && timers.top().due_us < wake)
+      wake = timers.top().due_us;
+    int timeout_ms = wake > now ? (int)((wake - now + 999) / 1000) : 0;
+
+    int n = epoll_wait(epfd, events, 256, timeout_ms);
+    now = nowUs();
+    for (int i = 0; i < n; i++)
+      handleEvent(*devices[events[i].data.u32], events[i].events, now);
+  }
+
+  total.merge(window);
+  report("total", total, (nowUs() - startUs) / 1e6);
+
+  uint64_t in = 0;
+  uint64_t out = 0;
+  for (size_t i = 0; i < devices.size(); i++) {
+    in += devices[i]->deadband.values_in();
+    out += devices[i]->deadband.values_out();
+    closeDevice(*devices[i]);
+    delete devices[i];
+  }
+  printf("[LOAD] deadband: %llu of %llu values sent (%.1f:1)\n", (unsigned long long)out, (unsigned long long)in,
+    out ? (double)in / out : 0.0);
+  close(epfd);
+  return 0;
+}
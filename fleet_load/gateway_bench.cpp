@@ -0,0 +1,287 @@
+// Compares N devices uploading with their own MQTT connection against one
+// ThingsBoard gateway connection carrying the samples of all N devices.
+// Both use the clients of http_send_batch, the broker is a minimal MQTT
+// stand-in in the same process that acknowledges every message, so the
+// numbers show the cost on the device side of the link.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I http_send_batch fleet_load/gateway_bench.cpp -o gateway_bench -lpthread
+//   ./gateway_bench [devices] [cycles] [samples per device and cycle]
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+#include "thingsboard-mqtt.h"
+#include "thingsboard-gateway.h"
+
+#define BROKER_PORT 18883
+
+typedef ThingsBoardMqtt<4, 256> DeviceMqtt;
+typedef ThingsBoardMqtt<4, 1024> GatewayMqtt;
+typedef ThingsBoardGateway<GatewayMqtt, 64, 256, 8192, 900> Gateway;
+
+std::atomic<uint64_t> brokerBytes(0);
+std::atomic<uint32_t> brokerConnections(0);
+std::atomic<uint32_t> brokerMessages(0);
+
+/**************************************************************************/
+/*
+    read exactly len bytes, false if the connection is closed
+*/
+/**************************************************************************/
+bool readAll(int fd, uint8_t *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = recv(fd, buf, len, 0);
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= n;
+    brokerBytes += n;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*
+    one client connection of the broker: CONNACK, PUBACK and PINGRESP
+*/
+/**************************************************************************/
+void brokerSession(int fd) {
+  std::vector<uint8_t> packet;
+  uint8_t type;
+
+  brokerConnections++;
+  while (readAll(fd, &type, 1)) {
+    size_t length = 0;
+    uint8_t byte;
+    int shift = 0;
+    do {
+      if (!readAll(fd, &byte, 1))
+        goto done;
+      length |= (size_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    packet.resize(length);
+    if (length && !readAll(fd, packet.data(), length))
+      break;
+
+    if ((type & 0xF0) == 0x10) {
+      const uint8_t connack[4] = { 0x20, 0x02, 0x00, 0x00 };
+      send(fd, connack, 4, MSG_NOSIGNAL);
+    } else if ((type & 0xF0) == 0x30) {
+      size_t topic = (size_t)packet[0] << 8 | packet[1];
+      brokerMessages++;
+      if (type & 0x06) {
+        const uint8_t puback[4] = { 0x40, 0x02, packet[2 + topic], packet[3 + topic] };
+        send(fd, puback, 4, MSG_NOSIGNAL);
+      }
+    } else if ((type & 0xF0) == 0xC0) {
+      const uint8_t pingresp[2] = { 0xD0, 0x00 };
+      send(fd, pingresp, 2, MSG_NOSIGNAL);
+    } else if ((type & 0xF0) == 0xE0) {
+      break;
+    }
+  }
+done:
+  close(fd);
+}
+
+/**************************************************************************/
+/*
+    accept clients on localhost, one thread per connection
+*/
+/**************************************************************************/
+void broker(int listener) {
+  while (true) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+      return;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::thread(brokerSession, fd).detach();
+  }
+}
+
+// client side results of one mode
+struct Result {
+  uint32_t connections;
+  uint64_t bytes;
+  uint32_t messages;
+  std::vector<uint32_t> cycle_us;
+};
+
+/**************************************************************************/
+/*
+    telemetry values of a device in a cycle, the same for both modes
+*/
+/**************************************************************************/
+int renderValues(char *buf, size_t size, int device, int cycle, int sample) {
+  return snprintf(buf, size, "\"temperature\":%.2f,\"humidity\":%.2f,\"CO2\":%d",
+    20.0 + device % 7 * 0.3 + sample * 0.01, 40.0 + cycle % 10, 450 + (device * 13 + cycle) % 400);
+}
+
+/**************************************************************************/
+/*
+    every device has its own connection and publishes its samples
+*/
+/**************************************************************************/
+Result runDirect(const SocketAddress &adr, int devices, int cycles, int samples) {
+  std::vector<TCPSocket *> sockets;
+  std::vector<DeviceMqtt *> clients;
+  std::vector<std::string> tokens;
+  Result r = { 0, 0, 0, {} };
+  char json[256];
+  char values[128];
+  uint64_t ts = 1626950000000ull;
+
+  tokens.reserve(devices);
+  for (int d = 0; d < devices; d++) {
+    tokens.push_back("device" + std::to_string(d));
+    sockets.push_back(new TCPSocket());
+    clients.push_back(new DeviceMqtt());
+    clients[d]->begin(tokens[d].c_str(), tokens[d].c_str());
+    sockets[d]->open(NetworkInterface::get_default_instance());
+    if (sockets[d]->connect(adr) != NSAPI_ERROR_OK || clients[d]->connect(sockets[d]) != NSAPI_ERROR_OK) {
+      printf("Error! device %d could not connect\n", d);
+      exit(1);
+    }
+    r.connections++;
+  }
+
+  for (int c = 0; c < cycles; c++) {
+    uint32_t start = us_ticker_read();
+    for (int d = 0; d < devices; d++) {
+      // one timestamped batch per device, like the room sensor
+      int len = snprintf(json, sizeof(json), "[");
+      for (int s = 0; s < samples; s++) {
+        renderValues(values, sizeof(values), d, c, s);
+        len += snprintf(json + len, sizeof(json) - len, "%s{\"ts\":%llu,\"values\":{%s}}", s ? "," : "",
+          (unsigned long long)(ts + s * 1000), values);
+      }
+      snprintf(json + len, sizeof(json) - len, "]");
+      if (!clients[d]->sendTelemetryJson(json))
+        printf("Error! device %d publish failed\n", d);
+    }
+    for (int d = 0; d < devices; d++)
+      clients[d]->flush();
+    r.cycle_us.push_back(us_ticker_read() - start);
+    ts += samples * 1000;
+  }
+
+  for (int d = 0; d < devices; d++) {
+    clients[d]->disconnect();
+    r.bytes += clients[d]->bytes();
+    r.messages += clients[d]->published();
+    sockets[d]->close();
+    delete clients[d];
+    delete sockets[d];
+  }
+  return r;
+}
+
+/**************************************************************************/
+/*
+    one gateway connection uploads the samples of all devices
+*/
+/**************************************************************************/
+Result runGateway(const SocketAddress &adr, int devices, int cycles, int samples) {
+  TCPSocket socket;
+  GatewayMqtt *mqtt = new GatewayMqtt();
+  Gateway *gw = new Gateway(*mqtt);
+  std::vector<std::string> names;
+  Result r = { 0, 0, 0, {} };
+  char values[128];
+  uint64_t ts = 1626950000000ull;
+
+  names.reserve(devices);
+  for (int d = 0; d < devices; d++) {
+    names.push_back("device" + std::to_string(d));
+    if (gw->addDevice(names[d].c_str(), "room-sensor") < 0) {
+      printf("Error! the gateway supports at most %u devices\n", (unsigned)gw->devices());
+      exit(1);
+    }
+  }
+  mqtt->begin("gateway", "gateway");
+  socket.open(NetworkInterface::get_default_instance());
+  if (socket.connect(adr) != NSAPI_ERROR_OK || mqtt->connect(&socket) != NSAPI_ERROR_OK || !gw->connect()) {
+    printf("Error! gateway could not connect\n");
+    exit(1);
+  }
+  r.connections++;
+
+  for (int c = 0; c < cycles; c++) {
+    uint32_t start = us_ticker_read();
+    for (int d = 0; d < devices; d++)
+      for (int s = 0; s < samples; s++) {
+        renderValues(values, sizeof(values), d, c, s);
+        gw->telemetry(d, ts + s * 1000, "%s", values);
+      }
+    if (!gw->flush() || !mqtt->flush())
+      printf("Error! gateway upload failed\n");
+    r.cycle_us.push_back(us_ticker_read() - start);
+    ts += samples * 1000;
+  }
+
+  mqtt->disconnect();
+  r.bytes = mqtt->bytes();
+  r.messages = mqtt->published();
+  socket.close();
+  delete gw;
+  delete mqtt;
+  return r;
+}
+
+/**************************************************************************/
+/*
+    print the results of a mode
+*/
+/**************************************************************************/
+void report(const char *label, Result &r, int devices, int cycles, int samples) {
+  std::sort(r.cycle_us.begin(), r.cycle_us.end());
+  uint64_t sum = 0;
+  for (size_t i = 0; i < r.cycle_us.size(); i++)
+    sum += r.cycle_us[i];
+  printf("[BNCH] %-8s connections %5lu  messages %6lu  bytes %8llu (%6.1f per sample)  cycle us mean %7llu p90 %7lu max %7lu\n",
+    label, (unsigned long)r.connections, (unsigned long)r.messages, (unsigned long long)r.bytes,
+    (double)r.bytes / ((double)devices * cycles * samples), (unsigned long long)(sum / r.cycle_us.size()),
+    (unsigned long)r.cycle_us[r.cycle_us.size() * 9 / 10], (unsigned long)r.cycle_us.back());
+}
+
+int main(int argc, char **argv) {
+  int devices = argc > 1 ? atoi(argv[1]) : 16;
+  int cycles = argc > 2 ? atoi(argv[2]) : 100;
+  int samples = argc > 3 ? atoi(argv[3]) : 1;
+
+  if (devices < 1 || devices > 64 || cycles < 1 || samples < 1 || samples > 2) {
+    printf("usage: %s [devices 1..64] [cycles] [samples per device and cycle 1..2]\n", argv[0]);
+    return 1;
+  }
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(BROKER_PORT);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(listener, 128) != 0) {
+    printf("Error! port %d is in use\n", BROKER_PORT);
+    return 1;
+  }
+  std::thread(broker, listener).detach();
+
+  SocketAddress adr("127.0.0.1", BROKER_PORT);
+  printf("[BNCH] %d devices, %d cycles, %d samples per device and cycle\n", devices, cycles, samples);
+
+  Result direct = runDirect(adr, devices, cycles, samples);
+  report("direct", direct, devices, cycles, samples);
+  Result gateway = runGateway(adr, devices, cycles, samples);
+  report("gateway", gateway, devices, cycles, samples);
+  printf("[BNCH] broker received %llu bytes on %lu connections\n", (unsigned long long)brokerBytes.load(),
+    (unsigned long)brokerConnections.load());
+  return 0;
+}
@@ -0,0 +1,304 @@
+// Append, peek and consume throughput of the flash log of the room sensor on
+// a file-backed block device, the erase stalls of the appends and the two
+// kinds of wraparound: the ring wrapping over the device, with and without
+// dropping records the uploads did not keep up with, and the sequence
+// numbers wrapping after 2^32 records, which is set up by an ack record
+// close to the end of the sequence numbers in an erased log.
+// Every run restarts the log from the file on the way, like a reboot.
+//
+// The times are those of the host file, an erase of a 256 KiB sector of
+// the STM32F767 takes 1 to 2 s, so the erase count is what matters there.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor fleet_load/log_bench.cpp -o log_bench -lpthread
+//   ./log_bench [records] [erase size, e.g. 262144 like the room sensor]
+
+#include "mbed.h"
+#include "FileBlockDevice.h"
+#include "telemetry-batch.h"
+#include "telemetry-log.h"
+
+typedef TelemetryRow<5> RoomSample;
+typedef TelemetryLog<RoomSample> RoomLog;
+
+// like the room sensor: 512 KiB of flash, uploads of LOG_BATCH samples
+#define LOG_SIZE  0x80000
+#define LOG_BATCH 32
+
+// the log of the wraparound checks, 3 units of 4 KiB make 384 slots, not a power of two
+#define WRAP_ERASE_SIZE 4096
+#define WRAP_SIZE       (3 * WRAP_ERASE_SIZE)
+
+/**
+ * The file block device with the number and the longest time of the erases.
+ */
+class TimedBlockDevice : public FileBlockDevice {
+public:
+  TimedBlockDevice(const char *path, const char *flags, bd_size_t size, bd_size_t erase_size)
+    : FileBlockDevice(path, flags, size, 1, 1, erase_size), erases(0), erase_max_us(0) {
+  }
+
+  int erase(bd_addr_t addr, bd_size_t size) override {
+    uint32_t start = us_ticker_read();
+    int ret = FileBlockDevice::erase(addr, size);
+    uint32_t us = us_ticker_read() - start;
+    erases++;
+    if (us > erase_max_us)
+      erase_max_us = us;
+    return ret;
+  }
+
+  uint32_t erases;
+  uint32_t erase_max_us;
+};
+
+struct Stats {
+  uint32_t appends, append_us, append_max_us;
+  uint32_t peeks, peek_us;
+  uint32_t consumes, consume_us;
+};
+
+static char path[64];
+
+// sample number i, the timestamp tells the order
+RoomSample sample(uint32_t i) {
+  RoomSample s;
+  s.ts = i;
+  for (int k = 0; k < 5; k++)
+    s.values[k] = 20.0f + (i % 100) * 0.1f + k;
+  return s;
+}
+
+/**************************************************************************/
+/*
+    append one sample and time it, an append entering an erase unit erases it
+*/
+/**************************************************************************/
+bool append(RoomLog &log, uint32_t i, Stats &st) {
+  uint32_t start = us_ticker_read();
+  int ret = log.append(sample(i));
+  uint32_t us = us_ticker_read() - start;
+  st.appends++;
+  st.append_us += us;
+  if (us > st.append_max_us)
+    st.append_max_us = us;
+  return ret == BD_ERROR_OK;
+}
+
+/**************************************************************************/
+/*
+    upload the whole log in batches like the room sensor, the samples have
+    to come in order starting with sample expect
+*/
+/**************************************************************************/
+bool drain(RoomLog &log, uint32_t &expect, Stats &st) {
+  RoomSample rows[LOG_BATCH];
+
+  while (log.pending() > 0) {
+    uint32_t start = us_ticker_read();
+    size_t n = log.peek(rows, LOG_BATCH);
+    st.peek_us += us_ticker_read() - start;
+    st.peeks++;
+    if (n == 0) {
+      printf("[BNCH] FAILED: %lu pending but nothing to peek\n", (unsigned long)log.pending());
+      return false;
+    }
+    for (size_t i = 0; i < n; i++, expect++) {
+      if (rows[i].ts != expect) {
+        printf("[BNCH] FAILED: sample %lu instead of %lu\n", (unsigned long)rows[i].ts, (unsigned long)expect);
+        return false;
+      }
+    }
+    start = us_ticker_read();
+    int ret = log.consume();
+    st.consume_us += us_ticker_read() - start;
+    st.consumes++;
+    if (ret != BD_ERROR_OK)
+      return false;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*
+    an empty log whose next record gets sequence number seq: the device
+    erased, with an ack of seq - 1 in the first slot, in the layout and
+    with the CRC of TelemetryLog
+*/
+/**************************************************************************/
+bool seed(uint32_t seq) {
+  struct {
+    uint32_t seq;
+    uint16_t type;
+    uint16_t crc;
+    RoomSample data;
+  } r;
+  MbedCRC<POLY_16BIT_CCITT, 16> ct;
+  uint32_t c = 0;
+
+  TimedBlockDevice bd(path, "w+b", WRAP_SIZE, WRAP_ERASE_SIZE);
+  if (bd.init() != BD_ERROR_OK)
+    return false;
+  memset(&r, 0, sizeof(r));
+  r.seq = seq - 1;
+  r.type = 0x5A02;
+  memcpy(&r.data, &r.seq, sizeof(r.seq));
+  ct.compute_partial_start(&c);
+  ct.compute_partial(&r.seq, sizeof(r.seq), &c);
+  ct.compute_partial(&r.data, sizeof(r.data), &c);
+  ct.compute_partial_stop(&c);
+  r.crc = (uint16_t)(c ^ r.type);
+  return bd.program(&r, 0, sizeof(r)) == BD_ERROR_OK;
+}
+
+/**************************************************************************/
+/*
+    throughput: appends in bursts of four batches, each burst uploaded
+    before the next, for records samples, with a reboot halfway
+*/
+/**************************************************************************/
+bool checkThroughput(uint32_t records, bd_size_t erase_size) {
+  Stats st;
+  uint32_t erases = 0, erase_max_us = 0;
+  uint32_t next = 0, expect = 0, capacity = 0;
+  bool ok = true;
+
+  memset(&st, 0, sizeof(st));
+  for (int boot = 0; boot < 2 && ok; boot++) {
+    TimedBlockDevice bd(path, boot ? "r+b" : "w+b", LOG_SIZE, erase_size);
+    RoomLog log(&bd);
+    if (log.init() != BD_ERROR_OK)
+      return false;
+    capacity = log.capacity();
+    uint32_t end = boot ? records : records / 2;
+    while (ok && next < end) {
+      for (int i = 0; ok && i < 4 * LOG_BATCH && next < end; i++)
+        ok = append(log, next++, st);
+      ok = ok && drain(log, expect, st);
+    }
+    ok = ok && log.dropped() == 0;
+    erases += bd.erases;
+    if (bd.erase_max_us > erase_max_us)
+      erase_max_us = bd.erase_max_us;
+  }
+
+  printf("[BNCH] %lu records, %lu slots, erase unit %lu bytes: the ring wrapped %lu times\n",
+    (unsigned long)records, (unsigned long)capacity, (unsigned long)erase_size, (unsigned long)(records / capacity));
+  printf("[BNCH]   append  %8.0f records/s, %6.2f us average, %6lu us longest\n",
+    st.append_us ? st.appends * 1e6 / st.append_us : 0.0, (double)st.append_us / st.appends,
+    (unsigned long)st.append_max_us);
+  printf("[BNCH]   peek    %8.0f records/s, %6.2f us per batch of %d\n",
+    st.peek_us ? records * 1e6 / st.peek_us : 0.0, (double)st.peek_us / st.peeks, LOG_BATCH);
+  printf("[BNCH]   consume %8.0f records/s, %6.2f us per batch\n",
+    st.consume_us ? records * 1e6 / st.consume_us : 0.0, (double)st.consume_us / st.consumes);
+  printf("[BNCH]   erase stalls: %lu erases, %.2f per 1000 records, longest %lu us\n", (unsigned long)erases,
+    erases * 1000.0 / records, (unsigned long)erase_max_us);
+  if (!ok || expect != records) {
+    printf("[BNCH] FAILED: %lu of %lu records uploaded in order\n", (unsigned long)expect, (unsigned long)records);
+    return false;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*
+    uploads stopped: appending records samples into a log of the wrap size
+    starting with sequence number seq drops the oldest erase units, the
+    newest samples stay in order, also after a reboot
+*/
+/**************************************************************************/
+bool checkOverflow(uint32_t seq, uint32_t records) {
+  Stats st;
+  uint32_t pending = 0, dropped = 0, slots = 0, slots_per_unit = WRAP_ERASE_SIZE / 32;
+
+  memset(&st, 0, sizeof(st));
+  if (!seed(seq))
+    return false;
+  {
+    TimedBlockDevice bd(path, "r+b", WRAP_SIZE, WRAP_ERASE_SIZE);
+    RoomLog log(&bd);
+    if (log.init() != BD_ERROR_OK || log.pending() != 0)
+      return false;
+    slots = log.capacity();
+    for (uint32_t i = 0; i < records; i++)
+      if (!append(log, i, st))
+        return false;
+    pending = log.pending();
+    dropped = log.dropped();
+  }
+
+  // a reboot, the log has to find the same records
+  TimedBlockDevice bd(path, "r+b", WRAP_SIZE, WRAP_ERASE_SIZE);
+  RoomLog log(&bd);
+  if (log.init() != BD_ERROR_OK)
+    return false;
+  uint32_t expect = records - pending;
+  bool ok = log.pending() == pending && drain(log, expect, st);
+
+  printf("[BNCH] overflow from sequence number %08lx: %lu records into %lu slots, %lu pending, %lu dropped\n",
+    (unsigned long)seq, (unsigned long)records, (unsigned long)slots, (unsigned long)pending, (unsigned long)dropped);
+  // the head erases a whole unit ahead of it, at most one unit is lost on top of the overflow
+  if (!ok || expect != records || pending + dropped != records || pending > slots ||
+    pending < slots - slots_per_unit) {
+    printf("[BNCH] FAILED: overflow from %08lx, %lu of %lu records after the reboot\n", (unsigned long)seq,
+      (unsigned long)(expect - (records - pending)), (unsigned long)pending);
+    return false;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*
+    uploads keeping up while the sequence numbers wrap from 0xffffffff to 0,
+    with reboots on the way
+*/
+/**************************************************************************/
+bool checkSequenceWrap(uint32_t seq, uint32_t records) {
+  Stats st;
+  uint32_t next = 0, expect = 0;
+
+  memset(&st, 0, sizeof(st));
+  if (!seed(seq))
+    return false;
+  for (int boot = 0; boot < 4; boot++) {
+    TimedBlockDevice bd(path, "r+b", WRAP_SIZE, WRAP_ERASE_SIZE);
+    RoomLog log(&bd);
+    if (log.init() != BD_ERROR_OK)
+      return false;
+    uint32_t end = records / 4 * (boot + 1);
+    while (next < end) {
+      for (int i = 0; i < 3 * LOG_BATCH && next < end; i++)
+        if (!append(log, next++, st))
+          return false;
+      if (!drain(log, expect, st))
+        return false;
+    }
+    if (log.dropped() != 0) {
+      printf("[BNCH] FAILED: %lu records dropped across the sequence wrap\n", (unsigned long)log.dropped());
+      return false;
+    }
+  }
+  printf("[BNCH] sequence numbers from %08lx over the wrap: %lu records uploaded in order, 4 boots\n",
+    (unsigned long)seq, (unsigned long)expect);
+  return expect == next;
+}
+
+int main(int argc, char **argv) {
+  uint32_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+  bd_size_t erase_size = argc > 2 ? strtoul(argv[2], NULL, 10) : 0x40000;
+  if (records < 2 || erase_size < 32 || erase_size % 32 || LOG_SIZE % erase_size || LOG_SIZE / erase_size < 2) {
+    printf("usage: %s [records] [erase size, a multiple of 32 dividing %u into two or more]\n", argv[0], LOG_SIZE);
+    return 1;
+  }
+  snprintf(path, sizeof(path), "/tmp/log_bench_%d.bin", (int)getpid());
+
+  bool ok = checkThroughput(records, erase_size);
+  // the ring alone, then the ring wrapping over the sequence wrap
+  ok = checkOverflow(1, 1000) && ok;
+  ok = checkOverflow(0xFFFFFF00, 1000) && ok;
+  ok = checkSequenceWrap(0xFFFFFC00, 3000) && ok;
+  unlink(path);
+
+  printf("[BNCH] log_bench %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
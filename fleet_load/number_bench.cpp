@@ -0,0 +1,253 @@
+// Checks formatNumber() against every float and measures it against
+// printf("%.*f") in CPU cycles.
+//
+// For every finite float (all 2^32 bit patterns) and each tested number of
+// decimals the text has to be well formed and the shortest of its value,
+// and the value has to be the exact float times 10^decimals rounded to
+// nearest with ties to even, computed in double (exact below 2^53). Above
+// that the floats are integers, which are compared with glibc printf once.
+// A random sample is compared with glibc printf for all decimals, the
+// reference itself is checked that way.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor fleet_load/number_bench.cpp -o number_bench -lpthread
+//   ./number_bench [decimals, e.g. 012 or all] [iterations]
+//   ./number_bench quick
+// Each number of decimals takes about 40 minutes on one core, the default
+// checks 0, 1 and 2 of the room sensor keys. The quick run checks every
+// QUICK_STRIDE-th float with all decimals in a few seconds, for ctest.
+
+#include <fenv.h>
+#include <math.h>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mbed.h"
+#include "telemetry-number.h"
+
+static const double pow10d[7] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+// odd, so the quick run sees all exponents and low mantissa bits
+#define QUICK_STRIDE 4099
+
+// cycle counter of the host, like DWT->CYCCNT on the target
+static inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (uint64_t)us_ticker_read() * 1000;
+#endif
+}
+
+/**************************************************************************/
+/*
+    printf text in the shape of formatNumber: trailing zeros dropped but one decimal kept,
+    no sign on zero
+*/
+/**************************************************************************/
+std::string printfShortest(float value, int decimals) {
+  char text[400];
+  snprintf(text, sizeof(text), "%.*f", decimals, (double)value);
+  std::string s(text);
+  if (decimals) {
+    while (s[s.size() - 1] == '0' && s[s.size() - 2] != '.')
+      s.erase(s.size() - 1);
+  }
+  if (s[0] == '-' && s.find_first_not_of("-0.") == std::string::npos)
+    s.erase(0, 1);
+  return s;
+}
+
+/**************************************************************************/
+/*
+    split the text into sign, integer digits and fraction digits,
+    false if it is not the shortest form for the decimals
+*/
+/**************************************************************************/
+bool parse(const char *text, size_t len, int decimals, bool &negative, std::string &int_part, std::string &frac) {
+  const char *p = text;
+  const char *end = text + len;
+
+  negative = *p == '-';
+  if (negative)
+    p++;
+  const char *dot = (const char *)memchr(p, '.', end - p);
+  int_part.assign(p, dot ? dot : end);
+  frac = dot ? std::string(dot + 1, end) : std::string();
+  if (int_part.empty() || int_part.find_first_not_of("0123456789") != std::string::npos ||
+    frac.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+  if (int_part.size() > 1 && int_part[0] == '0')
+    return false;
+  if (decimals == 0)
+    return dot == NULL;
+  if (!dot || frac.empty() || frac.size() > (size_t)decimals || (frac.size() > 1 && frac[frac.size() - 1] == '0'))
+    return false;
+  // no "-0.0"
+  return !(negative && int_part == "0" && frac.find_first_not_of('0') == std::string::npos);
+}
+
+/**************************************************************************/
+/*
+    every stride-th float with the given decimals (1 = all 2^32), the integers above 2^53
+    against printf if huge is set
+*/
+/**************************************************************************/
+bool checkAll(int decimals, bool huge, uint32_t stride) {
+  char text[NUMBER_TEXT_MAX];
+  std::string int_part, frac;
+  bool negative;
+  uint64_t errors = 0, huge_checked = 0, checked = 0;
+  uint32_t start = us_ticker_read();
+
+  fesetround(FE_TONEAREST);
+  for (uint64_t b = 0; b <= 0xFFFFFFFFull; b += stride) {
+    checked++;
+    uint32_t bits = (uint32_t)b;
+    float value;
+    memcpy(&value, &bits, 4);
+    size_t len = formatNumber(text, value, decimals);
+
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+      if (len != 4 || strcmp(text, "null") != 0)
+        errors++;
+      continue;
+    }
+    if (len >= NUMBER_TEXT_MAX || text[len] != '\0' || !parse(text, len, decimals, negative, int_part, frac)) {
+      if (errors++ < 10)
+        printf("[BNCH] %a with %d decimals is malformed: %s\n", (double)value, decimals, text);
+      continue;
+    }
+
+    double scaled = fabs((double)value) * pow10d[decimals];
+    bool ok;
+    if (scaled < 9007199254740992.0) {
+      // exact product, rounded to nearest even
+      uint64_t expected = (uint64_t)nearbyint(scaled);
+      uint64_t got = 0;
+      for (size_t i = 0; i < int_part.size(); i++)
+        got = got * 10 + (int_part[i] - '0');
+      for (int i = 0; i < decimals; i++)
+        got = got * 10 + ((size_t)i < frac.size() ? frac[i] - '0' : 0);
+      ok = got == expected && negative == (signbit(value) && expected != 0);
+    } else {
+      // an integer, the fraction has to be zero
+      ok = negative == (bool)signbit(value) && (decimals == 0 || frac == "0");
+      if (ok && huge) {
+        char ref[64];
+        snprintf(ref, sizeof(ref), "%.0f", fabs((double)value));
+        ok = int_part == ref;
+        huge_checked++;
+      }
+    }
+    if (!ok && errors++ < 10)
+      printf("[BNCH] %a with %d decimals: %s, printf %s\n", (double)value, decimals, text,
+        printfShortest(value, decimals).c_str());
+
+    if (stride == 1 && (bits & 0x0FFFFFFF) == 0x0FFFFFFF) {
+      printf("\r[BNCH] decimals %d: %3d%%", decimals, (int)((b + 1) * 100 >> 32));
+      fflush(stdout);
+    }
+  }
+  printf("\r[BNCH] decimals %d: %llu floats %s, %llu errors, %llu integers compared with printf, %lu s\n",
+    decimals, (unsigned long long)checked, errors ? "FAILED" : "ok", (unsigned long long)errors,
+    (unsigned long long)huge_checked, (unsigned long)((us_ticker_read() - start) / 1000000));
+  return errors == 0;
+}
+
+/**************************************************************************/
+/*
+    random floats of all magnitudes and values close to the room sensor readings against printf
+*/
+/**************************************************************************/
+bool checkPrintf(int samples) {
+  char text[NUMBER_TEXT_MAX];
+  uint32_t state = 2463534242u;
+  int errors = 0;
+
+  for (int i = 0; i < samples; i++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    float value;
+    if (i & 1) {
+      memcpy(&value, &state, 4);
+      if (isnan(value) || isinf(value))
+        continue;
+    } else {
+      // ties like 22.125 and 0.5 are frequent among short values
+      value = (float)((int32_t)(state % 2000000) - 1000000) / (float)(1 << (state >> 28));
+    }
+    for (int d = 0; d <= 6; d++) {
+      formatNumber(text, value, d);
+      std::string ref = printfShortest(value, d);
+      if (ref != text && errors++ < 10)
+        printf("[BNCH] %a with %d decimals: %s, printf %s\n", (double)value, d, text, ref.c_str());
+    }
+  }
+  printf("[BNCH] %d random values, 0 to 6 decimals, same as printf: %s\n", samples, errors ? "FAILED" : "ok");
+  return errors == 0;
+}
+
+/**************************************************************************/
+/*
+    cycles per value of formatNumber and snprintf for room sensor readings
+*/
+/**************************************************************************/
+void benchmark(int iterations) {
+  static const struct {
+    const char *name;
+    int decimals;
+    float base;
+    float step;
+  } keys[4] = {
+    { "temperature", 2, 21.0f, 0.013f },
+    { "humidity", 2, 45.0f, 0.07f },
+    { "light", 1, 320.0f, 0.7f },
+    { "CO2", 0, 450.0f, 13.0f },
+  };
+  char text[NUMBER_TEXT_MAX];
+  volatile size_t sink = 0;
+
+  printf("[BNCH] %d values per key       cycles   snprintf cycles   speedup\n", iterations);
+  for (int k = 0; k < 4; k++) {
+    uint64_t start = cycles();
+    for (int i = 0; i < iterations; i++)
+      sink += formatNumber(text, keys[k].base + (i % 997) * keys[k].step, keys[k].decimals);
+    double fast = (double)(cycles() - start) / iterations;
+
+    start = cycles();
+    for (int i = 0; i < iterations; i++)
+      sink += snprintf(text, sizeof(text), "%.*f", keys[k].decimals, (double)(keys[k].base + (i % 997) * keys[k].step));
+    double slow = (double)(cycles() - start) / iterations;
+
+    printf("[BNCH] %-11s %d decimals %10.1f %17.1f %8.1fx\n", keys[k].name, keys[k].decimals, fast, slow, slow / fast);
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string decimals = argc > 1 ? argv[1] : "012";
+  int iterations = argc > 2 ? atoi(argv[2]) : 1000000;
+  uint32_t stride = 1;
+  int samples = 2000000;
+  if (decimals == "quick") {
+    decimals = "0123456";
+    iterations = 10000;
+    stride = QUICK_STRIDE;
+    samples = 100000;
+  }
+  if (decimals == "all")
+    decimals = "0123456";
+  if (decimals.find_first_not_of("0123456") != std::string::npos || iterations < 1) {
+    printf("usage: %s [decimals 0..6, e.g. 012 or all] [iterations] | quick\n", argv[0]);
+    return 1;
+  }
+
+  benchmark(iterations);
+  bool ok = checkPrintf(samples);
+  for (size_t i = 0; i < decimals.size(); i++)
+    ok = checkAll(decimals[i] - '0', i == 0, stride) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+// Render time of a telemetry message with the compile-time TelemetrySchema
+// against the type-erased Telemetry key/value array of the ThingsBoard
+// library. libThingsBoard is a submodule and not built on the host, so
+// LibTelemetry below stands in for its path: a tagged value per key,
+// setValue() by type, a JSON document built from the array and serialized
+// with escaped keys. The heap document of ArduinoJson is not modelled, the
+// real library is slower than the stand-in.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor fleet_load/schema_bench.cpp -o schema_bench -lpthread
+//   ./schema_bench [iterations]
+// With -DSCHEMA_WRONG_TYPE the build has to fail, a float is set for an integer key.
+
+#include "mbed.h"
+#include "telemetry-schema.h"
+
+/**
+ * Stand-in of the Telemetry class of the ThingsBoard library: key and
+ * value of one of the supported types, selected at runtime.
+ */
+class LibTelemetry {
+public:
+  enum Type { TYPE_NONE, TYPE_BOOL, TYPE_INT, TYPE_REAL, TYPE_STR };
+
+  LibTelemetry() : _key(NULL), _type(TYPE_NONE) { _value.integer = 0; }
+  LibTelemetry(const char *key, int value) : _key(key), _type(TYPE_INT) { _value.integer = value; }
+  LibTelemetry(const char *key, float value) : _key(key), _type(TYPE_REAL) { _value.real = value; }
+
+  void setValue(bool value) { _type = TYPE_BOOL; _value.boolean = value; }
+  void setValue(int value) { _type = TYPE_INT; _value.integer = value; }
+  void setValue(uint32_t value) { _type = TYPE_INT; _value.integer = (int)value; }
+  void setValue(float value) { _type = TYPE_REAL; _value.real = value; }
+  void setValue(const char *value) { _type = TYPE_STR; _value.str = value; }
+
+  const char *key() const { return _key; }
+  Type type() const { return _type; }
+  bool boolean() const { return _value.boolean; }
+  int integer() const { return _value.integer; }
+  float real() const { return _value.real; }
+  const char *str() const { return _value.str; }
+
+private:
+  const char *_key;
+  Type _type;
+  union {
+    bool boolean;
+    int integer;
+    float real;
+    const char *str;
+  } _value;
+};
+
+/**
+ * Generic serialization of a LibTelemetry array: the values are copied into
+ * a document first, then written key by key with escaping, floats with
+ * printf and the decimals of the key.
+ */
+int libRender(char *buf, size_t size, const LibTelemetry *data, size_t n, const int *decimals) {
+  struct Member {
+    const char *key;
+    LibTelemetry::Type type;
+    double number;
+    const char *str;
+  } doc[16];
+  size_t len = 0;
+
+  if (n > 16 || size < 2)
+    return -1;
+  for (size_t i = 0; i < n; i++) {
+    doc[i].key = data[i].key();
+    doc[i].type = data[i].type();
+    doc[i].str = data[i].type() == LibTelemetry::TYPE_STR ? data[i].str() : NULL;
+    doc[i].number = data[i].type() == LibTelemetry::TYPE_REAL ? data[i].real()
+                  : data[i].type() == LibTelemetry::TYPE_BOOL ? data[i].boolean() : data[i].integer();
+  }
+
+  buf[len++] = '{';
+  for (size_t i = 0; i < n; i++) {
+    if (len + 4 >= size)
+      return -1;
+    if (i)
+      buf[len++] = ',';
+    buf[len++] = '"';
+    for (const char *p = doc[i].key; *p; p++) {
+      if (*p == '"' || *p == '\\') {
+        if (len + 1 >= size)
+          return -1;
+        buf[len++] = '\\';
+      }
+      if (len + 1 >= size)
+        return -1;
+      buf[len++] = *p;
+    }
+    if (len + 2 >= size)
+      return -1;
+    buf[len++] = '"';
+    buf[len++] = ':';
+    int ret;
+    switch (doc[i].type) {
+      case LibTelemetry::TYPE_BOOL:
+        ret = snprintf(buf + len, size - len, "%s", doc[i].number != 0 ? "true" : "false");
+        break;
+      case LibTelemetry::TYPE_INT:
+        ret = snprintf(buf + len, size - len, "%u", (unsigned)(int)doc[i].number);
+        break;
+      case LibTelemetry::TYPE_REAL:
+        ret = snprintf(buf + len, size - len, "%.*f", decimals[i], doc[i].number);
+        break;
+      case LibTelemetry::TYPE_STR:
+        ret = snprintf(buf + len, size - len, "\"%s\"", doc[i].str);
+        break;
+      default:
+        ret = snprintf(buf + len, size - len, "null");
+        break;
+    }
+    if (ret < 0 || (size_t)ret >= size - len)
+      return -1;
+    len += ret;
+  }
+  if (len + 2 > size)
+    return -1;
+  buf[len++] = '}';
+  buf[len] = '\0';
+  return (int)len;
+}
+
+// the room sensor snapshot, the keys of the former data1 array
+constexpr char kTemperature[] = "temperature";
+constexpr char kHumidity[] = "humidity";
+constexpr char kVOCindex[] = "VOCindex";
+constexpr char kCO2[] = "CO2";
+constexpr char kLight[] = "light";
+typedef SchemaKey<kTemperature, float, 2> Temperature;
+typedef SchemaKey<kHumidity, float, 2> Humidity;
+typedef SchemaKey<kVOCindex, uint32_t> VOCindex;
+typedef SchemaKey<kCO2, uint32_t> CO2;
+typedef SchemaKey<kLight, float, 1> Light;
+typedef TelemetrySchema<Temperature, Humidity, VOCindex, CO2, Light> RoomSchema;
+
+// the boot status of the room sensor
+constexpr char kReason[] = "reason";
+constexpr char kErrorStatus[] = "errorstatus";
+constexpr char kErrorAddress[] = "erroraddress";
+typedef SchemaKey<kReason, uint32_t> ResetReasonKey;
+typedef SchemaKey<kErrorStatus, uint32_t> ErrorStatusKey;
+typedef SchemaKey<kErrorAddress, uint32_t> ErrorAddressKey;
+typedef TelemetrySchema<ResetReasonKey, ErrorStatusKey, ErrorAddressKey> BootSchema;
+
+// sensor values of a sample, changing so nothing is cached
+struct Sample {
+  float temperature, humidity, light;
+  uint32_t voc, co2;
+};
+
+Sample sample(int i) {
+  Sample s;
+  s.temperature = 21.0f + (i % 300) * 0.013f;
+  s.humidity = 45.0f + (i % 97) * 0.07f;
+  s.voc = 100 + (i * 7) % 90;
+  s.co2 = 450 + (i * 13) % 900;
+  s.light = 320.0f + (i % 211) * 0.7f;
+  return s;
+}
+
+/**************************************************************************/
+/*
+    the same keys and values, the schema drops trailing zeros of the decimals
+*/
+/**************************************************************************/
+bool sameJson(const char *a, const char *b) {
+  while (*a && *b) {
+    if ((*a >= '0' && *a <= '9') || *a == '-') {
+      char *end_a, *end_b;
+      if (strtod(a, &end_a) != strtod(b, &end_b))
+        return false;
+      a = end_a;
+      b = end_b;
+    } else if (*a++ != *b++) {
+      return false;
+    }
+  }
+  return *a == *b;
+}
+
+/**************************************************************************/
+/*
+    both paths have to produce the same keys and values
+*/
+/**************************************************************************/
+bool check(int n) {
+  static const int roomDecimals[5] = { 2, 2, 0, 0, 1 };
+  LibTelemetry data1[5] = {
+    { "temperature", 0.0f }, { "humidity", 0.0f }, { "VOCindex", 0 }, { "CO2", 0 }, { "light", 0.0f }
+  };
+  RoomSchema room;
+  char a[160], b[160];
+
+  for (int i = 0; i < n; i++) {
+    Sample s = sample(i);
+    data1[0].setValue(s.temperature);
+    data1[1].setValue(s.humidity);
+    data1[2].setValue(s.voc);
+    data1[3].setValue(s.co2);
+    data1[4].setValue(s.light);
+    room.setValue<Temperature>(s.temperature);
+    room.setValue<Humidity>(s.humidity);
+    room.setValue<VOCindex>(s.voc);
+    room.setValue<CO2>(s.co2);
+    room.setValue<Light>(s.light);
+#ifdef SCHEMA_WRONG_TYPE
+    room.setValue<CO2>(s.light);
+#endif
+    int la = libRender(a, sizeof(a), data1, 5, roomDecimals);
+    int lb = room.render(b, sizeof(b));
+    if (la < 0 || lb < 0 || !sameJson(a, b)) {
+      printf("[BNCH] different JSON:\n  %s\n  %s\n", a, b);
+      return false;
+    }
+  }
+  printf("[BNCH] %d samples render the same JSON, e.g. %s\n", n, b);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+  if (iterations < 1) {
+    printf("usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+  if (!check(100000))
+    return 1;
+
+  static const int roomDecimals[5] = { 2, 2, 0, 0, 1 };
+  static const int bootDecimals[3] = { 0, 0, 0 };
+  LibTelemetry data1[5] = {
+    { "temperature", 0.0f }, { "humidity", 0.0f }, { "VOCindex", 0 }, { "CO2", 0 }, { "light", 0.0f }
+  };
+  LibTelemetry data2[3] = { { "reason", 0 }, { "errorstatus", 0 }, { "erroraddress", 0 } };
+  RoomSchema room;
+  BootSchema boot;
+  char json[160];
+  volatile int sink = 0;
+
+  uint32_t start = us_ticker_read();
+  for (int i = 0; i < iterations; i++) {
+    Sample s = sample(i);
+    data1[0].setValue(s.temperature);
+    data1[1].setValue(s.humidity);
+    data1[2].setValue(s.voc);
+    data1[3].setValue(s.co2);
+    data1[4].setValue(s.light);
+    sink += libRender(json, sizeof(json), data1, 5, roomDecimals);
+  }
+  double lib_room = (us_ticker_read() - start) * 1000.0 / iterations;
+
+  start = us_ticker_read();
+  for (int i = 0; i < iterations; i++) {
+    Sample s = sample(i);
+    room.setValue<Temperature>(s.temperature);
+    room.setValue<Humidity>(s.humidity);
+    room.setValue<VOCindex>(s.voc);
+    room.setValue<CO2>(s.co2);
+    room.setValue<Light>(s.light);
+    sink += room.render(json, sizeof(json));
+  }
+  double schema_room = (us_ticker_read() - start) * 1000.0 / iterations;
+
+  start = us_ticker_read();
+  for (int i = 0; i < iterations; i++) {
+    data2[0].setValue((uint32_t)(i & 7));
+    data2[1].setValue((uint32_t)i);
+    data2[2].setValue((uint32_t)(0x08000000 + i));
+    sink += libRender(json, sizeof(json), data2, 3, bootDecimals);
+  }
+  double lib_boot = (us_ticker_read() - start) * 1000.0 / iterations;
+
+  start = us_ticker_read();
+  for (int i = 0; i < iterations; i++) {
+    boot.setValue<ResetReasonKey>((uint32_t)(i & 7));
+    boot.setValue<ErrorStatusKey>((uint32_t)i);
+    boot.setValue<ErrorAddressKey>((uint32_t)(0x08000000 + i));
+    sink += boot.render(json, sizeof(json));
+  }
+  double schema_boot = (us_ticker_read() - start) * 1000.0 / iterations;
+
+  printf("[BNCH] %d iterations           ns per message   RAM bytes\n", iterations);
+  printf("[BNCH] room  5 keys  Telemetry %12.1f %11u\n", lib_room, (unsigned)sizeof(data1));
+  printf("[BNCH] room  5 keys  schema    %12.1f %11u  (%.1fx, %u bytes of JSON in flash)\n", schema_room,
+    (unsigned)sizeof(room), lib_room / schema_room, (unsigned)RoomSchema::skeleton_length());
+  printf("[BNCH] boot  3 keys  Telemetry %12.1f %11u\n", lib_boot, (unsigned)sizeof(data2));
+  printf("[BNCH] boot  3 keys  schema    %12.1f %11u  (%.1fx, %u bytes of JSON in flash)\n", schema_boot,
+    (unsigned)sizeof(boot), lib_boot / schema_boot, (unsigned)BootSchema::skeleton_length());
+  return sink == 0;
+}
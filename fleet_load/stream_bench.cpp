@@ -0,0 +1,212 @@
+// CPU cycles per key and peak RAM of an upload of N telemetry keys, streamed
+// with ThingsBoardStream against the ThingsBoard library path, which renders
+// the whole JSON object into a buffer before it is sent (the host stand-in of
+// ThingsBoard.h formats into stack buffers where the library uses an
+// ArduinoJson document, the shape is the same: the memory holds the whole
+// payload). Both send into a socket that only counts the bytes and answers
+// 200, so the numbers are those of the formatting and the HTTP framing.
+//
+// The peak RAM is the stack used by the upload, measured by painting the
+// stack before, plus the static buffer of the stream. The stream has to use
+// the same memory for any number of keys. The library path grows with the
+// Telemetry objects and fails once the JSON object does not fit its buffer.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor fleet_load/stream_bench.cpp -o stream_bench -lpthread
+//   ./stream_bench [iterations]
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <alloca.h>
+#include <new>
+
+#include "mbed.h"
+#include "ThingsBoard.h"
+#include "telemetry-number.h"
+#include "thingsboard-stream.h"
+
+#define KEYS_MAX    80
+#define STACK_PAINT 16384
+
+// cycle counter of the host, like DWT->CYCCNT on the target
+static inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (uint64_t)us_ticker_read() * 1000;
+#endif
+}
+
+/**
+ * Socket of the benchmark: counts what is sent and answers every request
+ * with 200 and an empty body.
+ */
+class NullSocket : public TCPSocket {
+public:
+  NullSocket() : bytes(0) {}
+
+  nsapi_size_or_error_t send(const void *data, nsapi_size_t size) override {
+    bytes += size;
+    return size;
+  }
+
+  nsapi_size_or_error_t recv(void *data, nsapi_size_t size) override {
+    static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    size_t n = sizeof(response) - 1 < size ? sizeof(response) - 1 : size;
+    memcpy(data, response, n);
+    return n;
+  }
+
+  uint64_t bytes;
+};
+
+char keys[KEYS_MAX][8];
+float values[KEYS_MAX];
+char streambuf[512];
+ThingsBoardStream tbs(streambuf, sizeof(streambuf));
+NullSocket sink;
+
+/**************************************************************************/
+/*
+    the ThingsBoard library: Telemetry objects on the stack of the caller
+    like in the examples, rendered into one JSON object
+*/
+/**************************************************************************/
+__attribute__((noinline)) bool uploadLibrary(int n) {
+  ThingsBoardHttp tb;
+  Telemetry *data = (Telemetry *)alloca(n * sizeof(Telemetry));
+
+  tb.begin(&sink, "token_of_the_room_sensor", "localhost", 443);
+  for (int k = 0; k < n; k++)
+    new (&data[k]) Telemetry(keys[k], values[k]);
+  return tb.sendTelemetry(data, n);
+}
+
+/**************************************************************************/
+/*
+    the stream: every key formatted into the chunk buffer, full chunks sent
+*/
+/**************************************************************************/
+__attribute__((noinline)) bool uploadStream(int n) {
+  if (tbs.beginTelemetry(&sink) == NSAPI_ERROR_OK) {
+    tbs.put("{");
+    for (int k = 0; k < n; k++) {
+      char number[NUMBER_TEXT_MAX];
+      formatNumber(number, values[k], 2);
+      tbs.put("%s\"%s\":%s", k ? "," : "", keys[k], number);
+    }
+    tbs.put("}");
+  }
+  return tbs.end() == 200;
+}
+
+__attribute__((noinline)) bool uploadNone(int n) {
+  return true;
+}
+
+// the painted area, kept as a number, the frame of paintStack() is gone when it is read
+static uintptr_t painted;
+
+// fill the stack below the caller with a pattern
+__attribute__((noinline)) void paintStack() {
+  volatile uint8_t area[STACK_PAINT];
+  for (size_t i = 0; i < sizeof(area); i++)
+    area[i] = 0xA5;
+  painted = (uintptr_t)area;
+}
+
+// bytes of the painted stack written since, the stack grows down
+size_t stackUsed() {
+  size_t i = 0;
+  while (i < STACK_PAINT && ((volatile uint8_t *)painted)[i] == 0xA5)
+    i++;
+  return STACK_PAINT - i;
+}
+
+/**************************************************************************/
+/*
+    stack used by one upload, without what a call of nothing uses
+*/
+/**************************************************************************/
+size_t stackPeak(bool (*upload)(int), int n, bool &ok) {
+  // once before, the first call also resolves the library functions on the stack
+  upload(n);
+  paintStack();
+  uploadNone(n);
+  size_t base = stackUsed();
+  paintStack();
+  ok = upload(n);
+  size_t used = stackUsed();
+  return used > base ? used - base : 0;
+}
+
+/**************************************************************************/
+/*
+    cycles of one upload, the best of iterations
+*/
+/**************************************************************************/
+uint64_t bestCycles(bool (*upload)(int), int n, int iterations) {
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < iterations; i++) {
+    uint64_t start = cycles();
+    upload(n);
+    uint64_t c = cycles() - start;
+    if (c < best)
+      best = c;
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+  if (iterations < 1) {
+    printf("usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+  for (int k = 0; k < KEYS_MAX; k++) {
+    snprintf(keys[k], sizeof(keys[k]), "key%02d", k);
+    values[k] = 21.0f + k * 0.37f;
+  }
+  tbs.begin("token_of_the_room_sensor", "localhost");
+
+  const int counts[5] = { 5, 10, 20, 40, KEYS_MAX };
+  size_t stream_peak[5];
+  bool ok = true;
+  printf("[BNCH] keys    library cycles/key  stack  bytes    stream cycles/key  stack+buffer  bytes\n");
+  for (int i = 0; i < 5; i++) {
+    int n = counts[i];
+    bool lib_ok, stream_ok;
+    size_t lib_stack = stackPeak(uploadLibrary, n, lib_ok);
+    sink.bytes = 0;
+    uploadLibrary(n);
+    uint64_t lib_bytes = sink.bytes;
+    stream_peak[i] = stackPeak(uploadStream, n, stream_ok);
+    sink.bytes = 0;
+    uploadStream(n);
+    uint64_t stream_bytes = sink.bytes;
+
+    char lib[64];
+    if (lib_ok)
+      snprintf(lib, sizeof(lib), "%17.0f  %5u  %5lu", (double)bestCycles(uploadLibrary, n, iterations) / n,
+        (unsigned)lib_stack, (unsigned long)lib_bytes);
+    else
+      snprintf(lib, sizeof(lib), "%31s", "does not fit");
+    printf("[BNCH] %4d %s %17.0f  %5u+%-6u  %5lu\n", n, lib,
+      (double)bestCycles(uploadStream, n, iterations) / n, (unsigned)stream_peak[i], (unsigned)sizeof(streambuf),
+      (unsigned long)stream_bytes);
+    ok = ok && stream_ok;
+  }
+
+  // the stream memory does not grow with the keys: the same stack for all payloads sent in more than one
+  // chunk (40 and more keys), the sending of full chunks is one frame more than a payload in the last chunk
+  if (stream_peak[4] > stream_peak[3] || stream_peak[3] > stream_peak[0] + 512) {
+    printf("[BNCH] FAILED: the stream uses %u, %u and %u bytes of stack for %d, %d and %d keys\n",
+      (unsigned)stream_peak[0], (unsigned)stream_peak[3], (unsigned)stream_peak[4], counts[0], counts[3], counts[4]);
+    ok = false;
+  }
+
+  printf("[BNCH] stream_bench %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
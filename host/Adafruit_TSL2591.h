@@ -0,0 +1,116 @@
+#ifndef _HOST_ADAFRUIT_TSL2591_H_
+#define _HOST_ADAFRUIT_TSL2591_H_
+
+#include <math.h>
+
+#include "mbed.h"
+
+typedef enum {
+  TSL2591_GAIN_LOW = 0x00,
+  TSL2591_GAIN_MED = 0x10,
+  TSL2591_GAIN_HIGH = 0x20,
+  TSL2591_GAIN_MAX = 0x30
+} tsl2591Gain_t;
+
+typedef enum {
+  TSL2591_INTEGRATIONTIME_100MS = 0x00,
+  TSL2591_INTEGRATIONTIME_200MS = 0x01,
+  TSL2591_INTEGRATIONTIME_300MS = 0x02,
+  TSL2591_INTEGRATIONTIME_400MS = 0x03,
+  TSL2591_INTEGRATIONTIME_500MS = 0x04,
+  TSL2591_INTEGRATIONTIME_600MS = 0x05
+} tsl2591IntegrationTime_t;
+
+/**
+ * Stand-in of the TSL2591 library that is also the simulated sensor on the
+ * I2C bus. Once enabled, a new integration is valid after each integration
+ * time, the channels give about 320 lux with the gain and time set.
+ */
+class Adafruit_TSL2591 : public HostI2CDevice {
+public:
+  Adafruit_TSL2591() : _gain(TSL2591_GAIN_MED), _timing(TSL2591_INTEGRATIONTIME_100MS), _enabled(false), _reg(0) {}
+
+  bool begin(I2C &i2c) {
+    HostI2C::attach(ADDRESS, this);
+    return true;
+  }
+
+  void setGain(tsl2591Gain_t gain) { _gain = gain; }
+  tsl2591Gain_t getGain() { return _gain; }
+  void setTiming(tsl2591IntegrationTime_t timing) { _timing = timing; }
+  tsl2591IntegrationTime_t getTiming() { return _timing; }
+
+  uint32_t getFullLuminosity() {
+    uint16_t full, ir;
+    channels(full, ir);
+    return (uint32_t)ir << 16 | full;
+  }
+
+  float calculateLux(uint16_t ch0, uint16_t ch1) {
+    if (ch0 == 0xFFFF || ch1 == 0xFFFF)
+      return -1;
+    float cpl = integrationMs() * again() / 408.0f;
+    return ((float)ch0 - (float)ch1) * (1.0f - (float)ch1 / (float)ch0) / cpl;
+  }
+
+  int write(const char *data, int length, bool repeated) override {
+    if (length < 1)
+      return -1;
+    _reg = (uint8_t)data[0] & 0x1F;
+    if (length > 1 && _reg == 0x00) {
+      _enabled = ((uint8_t)data[1] & 0x03) == 0x03;
+      _start = std::chrono::steady_clock::now();
+    }
+    return 0;
+  }
+
+  // status, C0DATAL, C0DATAH, C1DATAL, C1DATAH from register 0x13
+  int read(char *data, int length) override {
+    if (_reg != 0x13 || length < 5)
+      return -1;
+    uint16_t full, ir;
+    channels(full, ir);
+    bool valid = _enabled && std::chrono::steady_clock::now() - _start >= std::chrono::milliseconds(integrationMs());
+    data[0] = valid ? 0x01 : 0x00;
+    data[1] = (char)(full & 0xFF);
+    data[2] = (char)(full >> 8);
+    data[3] = (char)(ir & 0xFF);
+    data[4] = (char)(ir >> 8);
+    return 0;
+  }
+
+private:
+  static const int ADDRESS = 0x29 << 1;
+
+  int integrationMs() const { return 100 * (_timing + 1); }
+
+  float again() const {
+    switch (_gain) {
+      case TSL2591_GAIN_MED:
+        return 25.0f;
+      case TSL2591_GAIN_HIGH:
+        return 428.0f;
+      case TSL2591_GAIN_MAX:
+        return 9876.0f;
+      default:
+        return 1.0f;
+    }
+  }
+
+  // IR is 30 % of the full spectrum, so lux = full * 0.7 * 0.7 / cpl
+  void channels(uint16_t &full, uint16_t &ir) const {
+    float minutes = std::chrono::duration_cast<std::chrono::milliseconds>(Kernel::Clock::now().time_since_epoch()).count() / 60000.0f;
+    float lux = 320.0f + 150.0f * sinf(minutes / 20.0f);
+    float ch0 = lux * integrationMs() * again() / 408.0f / 0.49f;
+    full = ch0 >= 65535.0f ? 0xFFFF : (uint16_t)ch0;
+    ir = full == 0xFFFF ? 0xFFFF : (uint16_t)(full * 0.3f);
+  }
+
+  tsl2591Gain_t _gain;
+  tsl2591IntegrationTime_t _timing;
+  bool _enabled;
+  uint8_t _reg;
+  std::chrono::steady_clock::time_point _start;
+};
+
+#endif // _HOST_ADAFRUIT_TSL2591_H_
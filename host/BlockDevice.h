@@ -0,0 +1,30 @@
+#ifndef _HOST_BLOCKDEVICE_H_
+#define _HOST_BLOCKDEVICE_H_
+
+#include "mbed.h"
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+enum bd_error {
+  BD_ERROR_OK = 0,
+  BD_ERROR_DEVICE_ERROR = -4001
+};
+
+class BlockDevice {
+public:
+  virtual ~BlockDevice() {}
+  virtual int init() = 0;
+  virtual int deinit() = 0;
+  virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int erase(bd_addr_t addr, bd_size_t size) = 0;
+  virtual bd_size_t get_read_size() const = 0;
+  virtual bd_size_t get_program_size() const = 0;
+  virtual bd_size_t get_erase_size() const = 0;
+  virtual bd_size_t get_erase_size(bd_addr_t addr) const { return get_erase_size(); }
+  virtual int get_erase_value() const { return -1; }
+  virtual bd_size_t size() const = 0;
+};
+
+#endif // _HOST_BLOCKDEVICE_H_
@@ -0,0 +1,109 @@
+#ifndef _HOST_FILEBLOCKDEVICE_H_
+#define _HOST_FILEBLOCKDEVICE_H_
+
+#include "BlockDevice.h"
+
+/**
+ * Block device in a file, like the FileBlockDevice of Mbed OS, with the rules
+ * of NOR flash: programming only clears bits, erasing sets the erase unit to
+ * 0xFF. A new or short file is filled up with 0xFF by init(), an existing
+ * file keeps its content, so a log survives a restart of the process.
+ * flags are the flags of fopen(), e.g. "r+b" for an existing file or "w+b"
+ * to start empty.
+ */
+class FileBlockDevice : public BlockDevice {
+public:
+  FileBlockDevice(const char *path, const char *flags, bd_size_t bd_size, bd_size_t read_size = 1,
+    bd_size_t write_size = 1, bd_size_t erase_size = 512)
+    : _path(path), _flags(flags), _file(NULL), _size(bd_size), _read_size(read_size), _write_size(write_size),
+      _erase_size(erase_size) {
+  }
+
+  ~FileBlockDevice() { deinit(); }
+
+  int init() override {
+    if (_file)
+      return BD_ERROR_OK;
+    _file = fopen(_path, _flags);
+    if (!_file && strchr(_flags, 'r'))
+      _file = fopen(_path, "w+b");
+    if (!_file)
+      return BD_ERROR_DEVICE_ERROR;
+
+    // fill up with the erase value
+    uint8_t ff[4096];
+    memset(ff, 0xFF, sizeof(ff));
+    fseek(_file, 0, SEEK_END);
+    for (bd_size_t pos = (bd_size_t)ftell(_file); pos < _size;) {
+      size_t n = _size - pos < sizeof(ff) ? (size_t)(_size - pos) : sizeof(ff);
+      if (fwrite(ff, 1, n, _file) != n)
+        return BD_ERROR_DEVICE_ERROR;
+      pos += n;
+    }
+    fflush(_file);
+    return BD_ERROR_OK;
+  }
+
+  int deinit() override {
+    if (_file)
+      fclose(_file);
+    _file = NULL;
+    return BD_ERROR_OK;
+  }
+
+  int read(void *buffer, bd_addr_t addr, bd_size_t size) override {
+    if (!_file || addr % _read_size || size % _read_size || addr + size > _size)
+      return BD_ERROR_DEVICE_ERROR;
+    return pread(fileno(_file), buffer, size, addr) == (ssize_t)size ? BD_ERROR_OK : BD_ERROR_DEVICE_ERROR;
+  }
+
+  int program(const void *buffer, bd_addr_t addr, bd_size_t size) override {
+    uint8_t data[512];
+
+    if (!_file || addr % _write_size || size % _write_size || addr + size > _size)
+      return BD_ERROR_DEVICE_ERROR;
+    for (bd_size_t done = 0; done < size;) {
+      size_t n = size - done < sizeof(data) ? (size_t)(size - done) : sizeof(data);
+      if (pread(fileno(_file), data, n, addr + done) != (ssize_t)n)
+        return BD_ERROR_DEVICE_ERROR;
+      for (size_t i = 0; i < n; i++)
+        data[i] &= ((const uint8_t *)buffer)[done + i];
+      if (pwrite(fileno(_file), data, n, addr + done) != (ssize_t)n)
+        return BD_ERROR_DEVICE_ERROR;
+      done += n;
+    }
+    return BD_ERROR_OK;
+  }
+
+  int erase(bd_addr_t addr, bd_size_t size) override {
+    uint8_t ff[4096];
+
+    if (!_file || addr % _erase_size || size % _erase_size || addr + size > _size)
+      return BD_ERROR_DEVICE_ERROR;
+    memset(ff, 0xFF, sizeof(ff));
+    for (bd_size_t done = 0; done < size;) {
+      size_t n = size - done < sizeof(ff) ? (size_t)(size - done) : sizeof(ff);
+      if (pwrite(fileno(_file), ff, n, addr + done) != (ssize_t)n)
+        return BD_ERROR_DEVICE_ERROR;
+      done += n;
+    }
+    return BD_ERROR_OK;
+  }
+
+  bd_size_t get_read_size() const override { return _read_size; }
+  bd_size_t get_program_size() const override { return _write_size; }
+  bd_size_t get_erase_size() const override { return _erase_size; }
+  int get_erase_value() const override { return 0xFF; }
+  bd_size_t size() const override { return _size; }
+
+private:
+  const char *_path;
+  const char *_flags;
+  FILE *_file;
+  bd_size_t _size;
+  bd_size_t _read_size;
+  bd_size_t _write_size;
+  bd_size_t _erase_size;
+};
+
+#endif // _HOST_FILEBLOCKDEVICE_H_
@@ -0,0 +1,59 @@
+#ifndef _HOST_FLASHIAPBLOCKDEVICE_H_
+#define _HOST_FLASHIAPBLOCKDEVICE_H_
+
+#include "BlockDevice.h"
+
+// the 256 KiB sectors of the upper flash bank of the STM32F767
+#define HOST_FLASH_SECTOR_SIZE 0x40000
+
+/**
+ * Internal flash in RAM, with the rules of NOR flash: programming only
+ * clears bits, erasing sets a whole sector to 0xFF. The content is lost
+ * when the process ends, like a flash erased before the first boot.
+ */
+class FlashIAPBlockDevice : public BlockDevice {
+public:
+  FlashIAPBlockDevice(uint32_t address, uint32_t size) : _size(size) {}
+
+  int init() override {
+    if (_flash.size() != _size)
+      _flash.assign(_size, 0xFF);
+    return BD_ERROR_OK;
+  }
+
+  int deinit() override { return BD_ERROR_OK; }
+
+  int read(void *buffer, bd_addr_t addr, bd_size_t size) override {
+    if (addr + size > _flash.size())
+      return BD_ERROR_DEVICE_ERROR;
+    memcpy(buffer, &_flash[addr], size);
+    return BD_ERROR_OK;
+  }
+
+  int program(const void *buffer, bd_addr_t addr, bd_size_t size) override {
+    if (addr + size > _flash.size())
+      return BD_ERROR_DEVICE_ERROR;
+    for (bd_size_t i = 0; i < size; i++)
+      _flash[addr + i] &= ((const uint8_t *)buffer)[i];
+    return BD_ERROR_OK;
+  }
+
+  int erase(bd_addr_t addr, bd_size_t size) override {
+    if (addr % HOST_FLASH_SECTOR_SIZE || size % HOST_FLASH_SECTOR_SIZE || addr + size > _flash.size())
+      return BD_ERROR_DEVICE_ERROR;
+    memset(&_flash[addr], 0xFF, size);
+    return BD_ERROR_OK;
+  }
+
+  bd_size_t get_read_size() const override { return 1; }
+  bd_size_t get_program_size() const override { return 1; }
+  bd_size_t get_erase_size() const override { return HOST_FLASH_SECTOR_SIZE; }
+  int get_erase_value() const override { return 0xFF; }
+  bd_size_t size() const override { return _size; }
+
+private:
+  uint32_t _size;
+  std::vector<uint8_t> _flash;
+};
+
+#endif // _HOST_FLASHIAPBLOCKDEVICE_H_
@@ -0,0 +1,51 @@
+#ifndef _HOST_MHZ19_H_
+#define _HOST_MHZ19_H_
+
+#include <math.h>
+
+#include "mbed.h"
+
+/**
+ * Stand-in of the MH-Z19 library that is also the simulated sensor on the
+ * serial port: a read command (0x86) is answered with the CO2 concentration
+ * at once. The concentration oscillates between about 450 and 1050 ppm.
+ */
+class MHZ19 : public HostSerialDevice {
+public:
+  MHZ19() : _serial(NULL) {}
+
+  void begin(BufferedSerial &serial) {
+    _serial = &serial;
+    HostSerial::attach(serial.tx(), this);
+  }
+
+  void printCommunication(bool is_dec = true, bool is_printed = true) {}
+  void autoCalibration(bool is_on = true) {}
+  void calibrate() {}
+
+  void getVersion(char *version) { memcpy(version, "0543", 4); }
+  int getRange() { return 5000; }
+  int getCO2() { return co2(); }
+
+  void received(const uint8_t *data, size_t length) override {
+    if (length < 9 || data[0] != 0xFF || data[2] != 0x86 || !_serial)
+      return;
+    int value = co2();
+    uint8_t answer[9] = { 0xFF, 0x86, (uint8_t)(value >> 8), (uint8_t)value, 0x47, 0x00, 0x00, 0x00, 0x00 };
+    uint8_t sum = 0;
+    for (int i = 1; i < 8; i++)
+      sum += answer[i];
+    answer[8] = (uint8_t)(0xFF - sum + 1);
+    _serial->inject(answer, sizeof(answer));
+  }
+
+private:
+  static int co2() {
+    float minutes = std::chrono::duration_cast<std::chrono::milliseconds>(Kernel::Clock::now().time_since_epoch()).count() / 60000.0f;
+    return 750 + (int)(300.0f * sinf(minutes / 30.0f));
+  }
+
+  BufferedSerial *_serial;
+};
+
+#endif // _HOST_MHZ19_H_
@@ -0,0 +1,56 @@
+#ifndef _HOST_MBEDCRC_H_
+#define _HOST_MBEDCRC_H_
+
+#include "mbed.h"
+
+typedef enum crc_polynomial {
+  POLY_7BIT_SD = 0x09,
+  POLY_8BIT_CCITT = 0x07,
+  POLY_16BIT_CCITT = 0x1021,
+  POLY_16BIT_IBM = 0x8005,
+  POLY_32BIT_ANSI = 0x04C11DB7
+} crc_polynomial_t;
+
+/**
+ * Bitwise CRC with the defaults of MbedCRC: initial value all ones for the
+ * CCITT and ANSI polynomials, no reflection and no final XOR.
+ */
+template <uint32_t polynomial = POLY_32BIT_ANSI, int width = 32>
+class MbedCRC {
+public:
+  int32_t compute(const void *buffer, size_t size, uint32_t *crc) {
+    compute_partial_start(crc);
+    compute_partial(buffer, size, crc);
+    return compute_partial_stop(crc);
+  }
+
+  int32_t compute_partial_start(uint32_t *crc) {
+    *crc = polynomial == POLY_16BIT_CCITT || polynomial == POLY_32BIT_ANSI ? mask() : 0;
+    return 0;
+  }
+
+  int32_t compute_partial(const void *buffer, size_t size, uint32_t *crc) {
+    const uint8_t *data = (const uint8_t *)buffer;
+    uint32_t c = *crc;
+
+    for (size_t i = 0; i < size; i++) {
+      c ^= (uint32_t)data[i] << (width - 8);
+      for (int b = 0; b < 8; b++)
+        c = c & top() ? (c << 1) ^ polynomial : c << 1;
+      c &= mask();
+    }
+    *crc = c;
+    return 0;
+  }
+
+  int32_t compute_partial_stop(uint32_t *crc) {
+    *crc &= mask();
+    return 0;
+  }
+
+private:
+  static uint32_t mask() { return width == 32 ? 0xFFFFFFFFu : (1u << width) - 1; }
+  static uint32_t top() { return 1u << (width - 1); }
+};
+
+#endif // _HOST_MBEDCRC_H_
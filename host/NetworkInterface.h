@@ -0,0 +1,6 @@
+#ifndef _HOST_NETWORKINTERFACE_H_
+#define _HOST_NETWORKINTERFACE_H_
+
+#include "mbed.h"
+
+#endif // _HOST_NETWORKINTERFACE_H_
@@ -0,0 +1,28 @@
+#ifndef _HOST_RESETREASON_H_
+#define _HOST_RESETREASON_H_
+
+#include <stdint.h>
+
+typedef enum {
+  RESET_REASON_POWER_ON,
+  RESET_REASON_PIN_RESET,
+  RESET_REASON_BROWN_OUT,
+  RESET_REASON_SOFTWARE,
+  RESET_REASON_WATCHDOG,
+  RESET_REASON_LOCKUP,
+  RESET_REASON_WAKE_LOW_POWER,
+  RESET_REASON_ACCESS_ERROR,
+  RESET_REASON_BOOT_ERROR,
+  RESET_REASON_MULTIPLE,
+  RESET_REASON_PLATFORM,
+  RESET_REASON_UNKNOWN
+} reset_reason_t;
+
+// every start of a host process is a power on
+class ResetReason {
+public:
+  static reset_reason_t get() { return RESET_REASON_POWER_ON; }
+  static uint32_t get_raw() { return 0; }
+};
+
+#endif // _HOST_RESETREASON_H_
@@ -0,0 +1,74 @@
+#ifndef _HOST_SPARKFUNHTU21D_H_
+#define _HOST_SPARKFUNHTU21D_H_
+
+#include <math.h>
+
+#include "mbed.h"
+
+/**
+ * Stand-in of the HTU21D library that is also the simulated sensor: begin()
+ * puts it on the I2C bus, so the split phase driver of the room sensor talks
+ * to it with the commands of the data sheet. Temperature and humidity drift
+ * slowly around 21.5 C and 45 %RH.
+ */
+class HTU21D : public HostI2CDevice {
+public:
+  HTU21D() : _command(0) {}
+
+  void begin(I2C &i2c) {
+    HostI2C::attach(ADDRESS, this);
+  }
+
+  float readTemperature() { return temperature(); }
+  float readHumidity() { return humidity(); }
+
+  int write(const char *data, int length, bool repeated) override {
+    if (length < 1)
+      return -1;
+    _command = (uint8_t)data[0];
+    _start = std::chrono::steady_clock::now();
+    return 0;
+  }
+
+  // "no hold master": not acknowledged until the conversion is done
+  int read(char *data, int length) override {
+    bool humid = _command == 0xF5 || _command == 0xE5;
+    std::chrono::milliseconds busy(humid ? 16 : 50);
+    if ((_command != 0xF3 && _command != 0xF5 && _command != 0xE3 && _command != 0xE5) ||
+      std::chrono::steady_clock::now() - _start < busy || length < 3)
+      return -1;
+
+    float value = humid ? (humidity() + 6.0f) / 125.0f : (temperature() + 46.85f) / 175.72f;
+    uint16_t raw = (uint16_t)(value * 65536.0f) & 0xFFFC;
+    data[0] = (char)(raw >> 8);
+    data[1] = (char)(raw | (humid ? 0x02 : 0x00));
+    data[2] = (char)crc8(data, 2);
+    return 0;
+  }
+
+private:
+  static const int ADDRESS = 0x40 << 1;
+
+  static float minutes() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Kernel::Clock::now().time_since_epoch()).count() / 60000.0f;
+  }
+
+  static float temperature() { return 21.5f + 0.8f * sinf(minutes() / 10.0f); }
+  static float humidity() { return 45.0f + 4.0f * cosf(minutes() / 15.0f); }
+
+  static uint8_t crc8(const char *data, int len) {
+    uint8_t crc = 0;
+
+    for (int i = 0; i < len; i++) {
+      crc ^= (uint8_t)data[i];
+      for (int b = 0; b < 8; b++)
+        crc = crc & 0x80 ? (uint8_t)(crc << 1 ^ 0x31) : (uint8_t)(crc << 1);
+    }
+    return crc;
+  }
+
+  uint8_t _command;
+  std::chrono::steady_clock::time_point _start;
+};
+
+#endif // _HOST_SPARKFUNHTU21D_H_
@@ -0,0 +1,31 @@
+#ifndef _HOST_SPARKFUN_SGP40_ARDUINO_LIBRARY_H_
+#define _HOST_SPARKFUN_SGP40_ARDUINO_LIBRARY_H_
+
+#include <math.h>
+
+#include "mbed.h"
+
+/**
+ * Stand-in of the SGP40 library with the VOC index computed on the host:
+ * 0 during the first 45 samples like the algorithm of the sensor, then
+ * around 100.
+ */
+class SGP40 {
+public:
+  SGP40() : _samples(0) {}
+
+  void enableDebugging(bool debug) {}
+
+  bool begin(I2C &i2c, bool selftest = true) { return true; }
+
+  int32_t getVOCindex(float RH = 50, float T = 25) {
+    if (++_samples <= 45)
+      return 0;
+    return 100 + (int32_t)(20.0f * sinf(_samples / 300.0f));
+  }
+
+private:
+  uint32_t _samples;
+};
+
+#endif // _HOST_SPARKFUN_SGP40_ARDUINO_LIBRARY_H_
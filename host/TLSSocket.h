@@ -0,0 +1,171 @@
+#ifndef _HOST_TLSSOCKET_H_
+#define _HOST_TLSSOCKET_H_
+
+#include "mbed.h"
+#include "mbedtls/ssl.h"
+
+/**
+ * TLSSocketWrapper of the host build: passes the data through to the
+ * transport socket without encryption, so the upload logic runs unchanged
+ * against a plain http ThingsBoard stand-in and the cost of TLS is not part
+ * of host measurements. The SSL config and context are the host mbed TLS
+ * stand-in and connect() goes through the same steps as on the target:
+ * mbedtls_ssl_setup(), the sigio handler is set on the transport, then the
+ * handshake. A session set in between is resumed, otherwise the handshake
+ * calls the verify callback and creates a new session.
+ */
+class TLSSocketWrapper : public Socket {
+public:
+  typedef enum {
+    TRANSPORT_KEEP = 0x00,
+    TRANSPORT_CONNECT_AND_CLOSE = 0x01,
+    TRANSPORT_CONNECT = 0x02,
+    TRANSPORT_CLOSE = 0x04
+  } control_transport;
+
+  TLSSocketWrapper(Socket *transport, const char *hostname = NULL, control_transport control = TRANSPORT_CLOSE)
+    : Socket(SOCK_STREAM), _transport(transport), _ssl_conf(&_config), _connect_transport(control == TRANSPORT_CONNECT || control == TRANSPORT_CONNECT_AND_CLOSE),
+      _close_transport(control == TRANSPORT_CLOSE || control == TRANSPORT_CONNECT_AND_CLOSE), _handshake_done(false) {
+    mbedtls_ssl_config_init(&_config);
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_x509_crt_init(&_own_chain);
+  }
+
+  ~TLSSocketWrapper() {
+    if (_transport)
+      close();
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_config_free(&_config);
+    mbedtls_x509_crt_free(&_own_chain);
+  }
+
+  void set_hostname(const char *hostname) {}
+
+  nsapi_error_t set_root_ca_cert(const void *root_ca, size_t len) {
+    mbedtls_x509_crt_free(&_own_chain);
+    mbedtls_x509_crt_init(&_own_chain);
+    if (mbedtls_x509_crt_parse(&_own_chain, (const unsigned char *)root_ca, len) != 0)
+      return NSAPI_ERROR_PARAMETER;
+    set_ca_chain(&_own_chain);
+    return NSAPI_ERROR_OK;
+  }
+
+  nsapi_error_t set_root_ca_cert(const char *root_ca_pem) {
+    return set_root_ca_cert(root_ca_pem, strlen(root_ca_pem) + 1);
+  }
+
+  nsapi_error_t set_client_cert_key(const char *client_cert_pem, const char *client_private_key_pem) {
+    return NSAPI_ERROR_OK;
+  }
+
+  void set_ca_chain(mbedtls_x509_crt *crt) { mbedtls_ssl_conf_ca_chain(_ssl_conf, crt, NULL); }
+  mbedtls_x509_crt *get_ca_chain() { return _ssl_conf->ca_chain; }
+  mbedtls_ssl_config *get_ssl_config() { return _ssl_conf; }
+  void set_ssl_config(mbedtls_ssl_config *conf) { _ssl_conf = conf; }
+  mbedtls_ssl_context *get_ssl_context() { return &_ssl; }
+
+  nsapi_error_t connect(const SocketAddress &address) override {
+    if (!_transport)
+      return NSAPI_ERROR_NO_SOCKET;
+    if (_handshake_done)
+      return NSAPI_ERROR_IS_CONNECTED;
+    if (_connect_transport) {
+      nsapi_error_t result = _transport->connect(address);
+      if (result != NSAPI_ERROR_OK && result != NSAPI_ERROR_IS_CONNECTED)
+        return result;
+    }
+    return start_handshake();
+  }
+
+  nsapi_error_t close() override {
+    if (!_transport)
+      return NSAPI_ERROR_NO_SOCKET;
+    _transport->sigio(Callback<void()>());
+    nsapi_error_t result = _close_transport ? _transport->close() : NSAPI_ERROR_OK;
+    _transport = NULL;
+    _handshake_done = false;
+    return result;
+  }
+
+  nsapi_size_or_error_t send(const void *data, nsapi_size_t size) override {
+    if (!_transport || !_handshake_done)
+      return NSAPI_ERROR_NO_CONNECTION;
+    return _transport->send(data, size);
+  }
+
+  nsapi_size_or_error_t recv(void *data, nsapi_size_t size) override {
+    if (!_transport || !_handshake_done)
+      return NSAPI_ERROR_NO_CONNECTION;
+    return _transport->recv(data, size);
+  }
+
+  void set_timeout(int timeout_ms) override {
+    if (_transport)
+      _transport->set_timeout(timeout_ms);
+  }
+
+  void set_blocking(bool blocking) override {
+    if (_transport)
+      _transport->set_blocking(blocking);
+  }
+
+private:
+  nsapi_error_t start_handshake() {
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_setup(&_ssl, _ssl_conf);
+    _transport->sigio(callback(this, &TLSSocketWrapper::event));
+
+    if (!_ssl.resume) {
+      // full handshake, the server certificate is checked against the chain
+      if (_ssl_conf->f_vrfy) {
+        uint32_t flags = 0;
+        if (_ssl_conf->f_vrfy(_ssl_conf->p_vrfy, _ssl_conf->ca_chain, 0, &flags) != 0 || flags)
+          return NSAPI_ERROR_AUTH_FAILURE;
+      }
+      _ssl.session.ciphersuite = 0xC02F;
+      _ssl.session.id_len = sizeof(_ssl.session.id);
+      for (size_t i = 0; i < sizeof(_ssl.session.id); i++)
+        _ssl.session.id[i] = (unsigned char)rand();
+      for (size_t i = 0; i < sizeof(_ssl.session.master); i++)
+        _ssl.session.master[i] = (unsigned char)rand();
+    }
+    _handshake_done = true;
+    return NSAPI_ERROR_OK;
+  }
+
+  void event() {
+    if (_sigio)
+      _sigio();
+  }
+
+  Socket *_transport;
+  mbedtls_ssl_config _config;
+  mbedtls_ssl_config *_ssl_conf;
+  mbedtls_ssl_context _ssl;
+  mbedtls_x509_crt _own_chain;
+  bool _connect_transport;
+  bool _close_transport;
+  bool _handshake_done;
+};
+
+/**
+ * TLSSocketWrapper over its own TCPSocket, opened with open() like on the target.
+ */
+class TLSSocket : public TLSSocketWrapper {
+public:
+  TLSSocket() : TLSSocketWrapper(&_tcp, NULL, TRANSPORT_CONNECT_AND_CLOSE) {}
+
+  // the transport has to be closed while it still exists
+  ~TLSSocket() { close(); }
+
+  template <typename S>
+  nsapi_error_t open(S *stack) {
+    return _tcp.open(stack);
+  }
+
+private:
+  TCPSocket _tcp;
+};
+
+#endif // _HOST_TLSSOCKET_H_
@@ -0,0 +1,175 @@
+#ifndef _HOST_THINGSBOARD_H_
+#define _HOST_THINGSBOARD_H_
+
+#include "mbed.h"
+
+/**
+ * Stand-in of the ThingsBoard library (libThingsBoard) for the host build,
+ * with the HTTP client of the examples: Telemetry/Attribute key value pairs
+ * rendered as one JSON object and posted to /api/v1/<token>/telemetry or
+ * /attributes, the request succeeds with status 200. The library builds the
+ * JSON with ArduinoJson on the heap, the stand-in formats into a buffer.
+ */
+class Telemetry {
+public:
+  Telemetry() : _key(NULL), _type(TYPE_NONE) { _value.integer = 0; }
+  Telemetry(const char *key, int value) : _key(key), _type(TYPE_INT) { _value.integer = value; }
+  Telemetry(const char *key, bool value) : _key(key), _type(TYPE_BOOL) { _value.boolean = value; }
+  Telemetry(const char *key, float value) : _key(key), _type(TYPE_REAL) { _value.real = value; }
+  Telemetry(const char *key, double value) : _key(key), _type(TYPE_REAL) { _value.real = (float)value; }
+  Telemetry(const char *key, const char *value) : _key(key), _type(TYPE_STR) { _value.str = value; }
+
+  void setValue(int value) { _type = TYPE_INT; _value.integer = value; }
+  void setValue(bool value) { _type = TYPE_BOOL; _value.boolean = value; }
+  void setValue(float value) { _type = TYPE_REAL; _value.real = value; }
+  void setValue(double value) { _type = TYPE_REAL; _value.real = (float)value; }
+  void setValue(const char *value) { _type = TYPE_STR; _value.str = value; }
+
+  // "key":value, returns the length or -1 if it does not fit
+  int render(char *buf, size_t size) const {
+    int len;
+    switch (_type) {
+      case TYPE_INT:
+        len = snprintf(buf, size, "\"%s\":%d", _key, _value.integer);
+        break;
+      case TYPE_BOOL:
+        len = snprintf(buf, size, "\"%s\":%s", _key, _value.boolean ? "true" : "false");
+        break;
+      case TYPE_REAL:
+        len = snprintf(buf, size, "\"%s\":%g", _key, (double)_value.real);
+        break;
+      case TYPE_STR:
+        len = snprintf(buf, size, "\"%s\":\"%s\"", _key, _value.str);
+        break;
+      default:
+        len = snprintf(buf, size, "\"%s\":null", _key ? _key : "");
+        break;
+    }
+    return len < 0 || (size_t)len >= size ? -1 : len;
+  }
+
+private:
+  enum Type { TYPE_NONE, TYPE_INT, TYPE_BOOL, TYPE_REAL, TYPE_STR };
+
+  const char *_key;
+  Type _type;
+  union {
+    int integer;
+    bool boolean;
+    float real;
+    const char *str;
+  } _value;
+};
+
+typedef Telemetry Attribute;
+
+class ThingsBoardHttp {
+public:
+  ThingsBoardHttp() : _socket(NULL), _token(NULL), _host(NULL), _port(80) {}
+
+  void begin(Socket *socket, const char *token, const char *host, int port = 80) {
+    _socket = socket;
+    _token = token;
+    _host = host;
+    _port = port;
+  }
+
+  // the https examples set the socket per connection with setSocket()
+  void begin(const char *token, const char *host, int port = 443) { begin(NULL, token, host, port); }
+
+  void setSocket(Socket *socket) { _socket = socket; }
+
+  bool sendTelemetry(const Telemetry *data, size_t data_count) { return post("telemetry", data, data_count); }
+  bool sendAttributes(const Attribute *data, size_t data_count) { return post("attributes", data, data_count); }
+  bool sendTelemetryJson(const char *json) { return post("telemetry", json); }
+  bool sendAttributeJSON(const char *json) { return post("attributes", json); }
+
+  bool sendTelemetryInt(const char *key, int value) { return sendOne("telemetry", Telemetry(key, value)); }
+  bool sendTelemetryBool(const char *key, bool value) { return sendOne("telemetry", Telemetry(key, value)); }
+  bool sendTelemetryFloat(const char *key, float value) { return sendOne("telemetry", Telemetry(key, value)); }
+  bool sendAttributeInt(const char *key, int value) { return sendOne("attributes", Attribute(key, value)); }
+  bool sendAttributeBool(const char *key, bool value) { return sendOne("attributes", Attribute(key, value)); }
+  bool sendAttributeStr(const char *key, const char *value) { return sendOne("attributes", Attribute(key, value)); }
+
+private:
+  bool sendOne(const char *path, const Telemetry &data) { return post(path, &data, 1); }
+
+  bool post(const char *path, const Telemetry *data, size_t data_count) {
+    char json[512];
+    size_t len = 0;
+
+    json[len++] = '{';
+    for (size_t i = 0; i < data_count; i++) {
+      if (i)
+        json[len++] = ',';
+      int n = data[i].render(json + len, sizeof(json) - len - 1);
+      if (n < 0 || len + n + 2 > sizeof(json))
+        return false;
+      len += n;
+    }
+    json[len++] = '}';
+    json[len] = '\0';
+    return post(path, json);
+  }
+
+  bool post(const char *path, const char *json) {
+    char buf[768];
+
+    if (!_socket)
+      return false;
+    int len = snprintf(buf, sizeof(buf),
+      "POST /api/v1/%s/%s HTTP/1.1\r\nHost: %s:%d\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n%s",
+      _token, path, _host, _port, (unsigned)strlen(json), json);
+    if (len < 0 || (size_t)len >= sizeof(buf))
+      return false;
+    for (int sent = 0; sent < len;) {
+      nsapi_size_or_error_t n = _socket->send(buf + sent, len - sent);
+      if (n <= 0)
+        return false;
+      sent += n;
+    }
+    return response() == 200;
+  }
+
+  // status of the response, the body is skipped
+  int response() {
+    char buf[512];
+    size_t len = 0;
+    char *end = NULL;
+
+    while (!end) {
+      if (len == sizeof(buf) - 1)
+        return -1;
+      nsapi_size_or_error_t n = _socket->recv(buf + len, sizeof(buf) - 1 - len);
+      if (n <= 0)
+        return -1;
+      len += n;
+      buf[len] = '\0';
+      end = strstr(buf, "\r\n\r\n");
+    }
+    int status = 0;
+    if (sscanf(buf, "HTTP/1.%*d %d", &status) != 1)
+      return -1;
+
+    const char *cl = strstr(buf, "Content-Length:");
+    size_t body = cl && cl < end ? strtoul(cl + 15, NULL, 10) : 0;
+    size_t have = len - (end + 4 - buf);
+    while (have < body) {
+      nsapi_size_or_error_t n = _socket->recv(buf, body - have < sizeof(buf) ? body - have : sizeof(buf));
+      if (n <= 0)
+        return -1;
+      have += n;
+    }
+    return status;
+  }
+
+  Socket *_socket;
+  const char *_token;
+  const char *_host;
+  int _port;
+};
+
+// the examples over TLS only differ in the socket
+typedef ThingsBoardHttp ThingsBoardHttps;
+
+#endif // _HOST_THINGSBOARD_H_
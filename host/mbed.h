@@ -0,0 +1,1021 @@
+#ifndef _HOST_MBED_H_
+#define _HOST_MBED_H_
+
+/**
+ * Host shims of the Mbed OS APIs used by the examples, so the upload logic
+ * can run on Linux under perf, valgrind or a benchmark instead of on the
+ * NUCLEO_F767ZI. Put this directory in front of the include path:
+ *   g++ -std=c++14 -O2 -g -I host -I <example> -I common ... -lpthread
+ *
+ *  - NetworkInterface resolves with getaddrinfo(), TCPSocket and UDPSocket are
+ *    BSD sockets, so the examples talk to a ThingsBoard stand-in on localhost.
+ *  - TLSSocket connects without TLS (see TLSSocket.h), the stand-in has to speak plain http.
+ *  - I2C and BufferedSerial forward to simulated devices registered with
+ *    HostI2C::attach() and HostSerial::attach().
+ *  - Thread, EventQueue, EventFlags, Mutex, ScopedLock and CriticalSectionLock map to the
+ *    C++ standard library, Kernel::Clock and us_ticker_read() to the steady clock.
+ *  - DWT->CYCCNT counts the cycles of the host, HAL_GetUIDw0() to 2 are the host and process ID.
+ * The other headers of this directory stand in for the platform APIs (crash data,
+ * stats, flash, reset reason), mbed TLS, and the ThingsBoard and sensor libraries.
+ * Only the parts the examples use are implemented, with the same signatures
+ * and nsapi error codes as Mbed OS 6.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* nsapi */
+
+typedef int nsapi_error_t;
+typedef int nsapi_size_or_error_t;
+typedef int nsapi_value_or_error_t;
+typedef unsigned int nsapi_size_t;
+
+enum nsapi_error {
+  NSAPI_ERROR_OK = 0,
+  NSAPI_ERROR_WOULD_BLOCK = -3001,
+  NSAPI_ERROR_UNSUPPORTED = -3002,
+  NSAPI_ERROR_PARAMETER = -3003,
+  NSAPI_ERROR_NO_CONNECTION = -3004,
+  NSAPI_ERROR_NO_SOCKET = -3005,
+  NSAPI_ERROR_NO_ADDRESS = -3006,
+  NSAPI_ERROR_NO_MEMORY = -3007,
+  NSAPI_ERROR_NO_SSID = -3008,
+  NSAPI_ERROR_DNS_FAILURE = -3009,
+  NSAPI_ERROR_DHCP_FAILURE = -3010,
+  NSAPI_ERROR_AUTH_FAILURE = -3011,
+  NSAPI_ERROR_DEVICE_ERROR = -3012,
+  NSAPI_ERROR_IN_PROGRESS = -3013,
+  NSAPI_ERROR_ALREADY = -3014,
+  NSAPI_ERROR_IS_CONNECTED = -3015,
+  NSAPI_ERROR_CONNECTION_LOST = -3016,
+  NSAPI_ERROR_CONNECTION_TIMEOUT = -3017,
+  NSAPI_ERROR_ADDRESS_IN_USE = -3018,
+  NSAPI_ERROR_TIMEOUT = -3019,
+  NSAPI_ERROR_BUSY = -3020
+};
+
+typedef enum {
+  NSAPI_UNSPEC,
+  NSAPI_IPv4,
+  NSAPI_IPv6
+} nsapi_version_t;
+
+// map errno of a failed socket call to the nsapi error
+static inline nsapi_error_t host_nsapi_error(int err) {
+  switch (err) {
+    case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+    case EWOULDBLOCK:
+#endif
+      return NSAPI_ERROR_WOULD_BLOCK;
+    case EINPROGRESS:
+      return NSAPI_ERROR_IN_PROGRESS;
+    case EISCONN:
+      return NSAPI_ERROR_IS_CONNECTED;
+    case EALREADY:
+      return NSAPI_ERROR_ALREADY;
+    case ECONNREFUSED:
+    case ENOTCONN:
+      return NSAPI_ERROR_NO_CONNECTION;
+    case ECONNRESET:
+    case EPIPE:
+      return NSAPI_ERROR_CONNECTION_LOST;
+    case ETIMEDOUT:
+      return NSAPI_ERROR_CONNECTION_TIMEOUT;
+    case EADDRINUSE:
+      return NSAPI_ERROR_ADDRESS_IN_USE;
+    case ENOMEM:
+    case ENOBUFS:
+      return NSAPI_ERROR_NO_MEMORY;
+    default:
+      return NSAPI_ERROR_DEVICE_ERROR;
+  }
+}
+
+/* time */
+
+namespace Kernel {
+struct Clock {
+  typedef std::chrono::milliseconds duration;
+  typedef duration::rep rep;
+  typedef duration::period period;
+  typedef std::chrono::time_point<Clock> time_point;
+  static const bool is_steady = true;
+
+  static time_point now() {
+    return time_point(std::chrono::duration_cast<duration>(std::chrono::steady_clock::now() - start()));
+  }
+
+  // the kernel starts with the first use of the clock
+  static std::chrono::steady_clock::time_point start() {
+    static std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    return t0;
+  }
+};
+}
+
+static inline uint32_t us_ticker_read() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - Kernel::Clock::start()).count();
+}
+
+namespace ThisThread {
+inline void sleep_for(std::chrono::milliseconds ms) {
+  std::this_thread::sleep_for(ms);
+}
+inline void sleep_for(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+}
+
+static inline void thread_sleep_for(uint32_t ms) {
+  ThisThread::sleep_for(ms);
+}
+
+static inline void wait_us(int us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+class Timer {
+public:
+  Timer() : _running(false), _elapsed(0) {}
+
+  void start() {
+    if (!_running) {
+      _start = std::chrono::steady_clock::now();
+      _running = true;
+    }
+  }
+
+  void stop() {
+    if (_running) {
+      _elapsed += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start);
+      _running = false;
+    }
+  }
+
+  void reset() {
+    _elapsed = std::chrono::microseconds(0);
+    _start = std::chrono::steady_clock::now();
+  }
+
+  std::chrono::microseconds elapsed_time() const {
+    if (!_running)
+      return _elapsed;
+    return _elapsed + std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start);
+  }
+
+private:
+  bool _running;
+  std::chrono::steady_clock::time_point _start;
+  std::chrono::microseconds _elapsed;
+};
+
+// the rtc is the system clock, set_time() only reports
+static inline void set_time(time_t t) {
+  printf("[HOST] set_time(%ld) ignored, using the system clock\n", (long)t);
+}
+
+static inline void system_reset() {
+  printf("[HOST] system_reset()\n");
+  exit(1);
+}
+
+#define MBED_ASSERT(expr) do { if (!(expr)) { printf("[HOST] assertion failed: %s\n", #expr); abort(); } } while (0)
+// format checks of printf like methods, the indices do not count this
+#define MBED_PRINTF_METHOD(format_index, first_param_index) \
+  __attribute__((__format__(__printf__, format_index + 1, first_param_index + 1)))
+
+/* callbacks and rtos */
+
+template <typename F>
+class Callback;
+
+template <typename R, typename... A>
+class Callback<R(A...)> {
+public:
+  Callback() {}
+  Callback(R (*f)(A...)) : _f(f) {}
+  template <typename T>
+  Callback(T *obj, R (T::*method)(A...)) : _f([obj, method](A... a) { return (obj->*method)(a...); }) {}
+  template <typename T>
+  Callback(const T *obj, R (T::*method)(A...) const) : _f([obj, method](A... a) { return (obj->*method)(a...); }) {}
+
+  R operator()(A... a) const { return _f(a...); }
+  R call(A... a) const { return _f(a...); }
+  explicit operator bool() const { return (bool)_f; }
+
+private:
+  std::function<R(A...)> _f;
+};
+
+template <typename R, typename... A>
+Callback<R(A...)> callback(R (*f)(A...)) {
+  return Callback<R(A...)>(f);
+}
+
+template <typename T, typename R, typename... A>
+Callback<R(A...)> callback(T *obj, R (T::*method)(A...)) {
+  return Callback<R(A...)>(obj, method);
+}
+
+template <typename T, typename R, typename... A>
+Callback<R(A...)> callback(const T *obj, R (T::*method)(A...) const) {
+  return Callback<R(A...)>(obj, method);
+}
+
+namespace mbed {
+using ::Callback;
+using ::callback;
+}
+
+// one lock for all critical sections, recursive like the nesting on the target
+static inline std::recursive_mutex &host_critical_section() {
+  static std::recursive_mutex m;
+  return m;
+}
+
+class CriticalSectionLock {
+public:
+  CriticalSectionLock() { host_critical_section().lock(); }
+  ~CriticalSectionLock() { host_critical_section().unlock(); }
+};
+
+class Mutex {
+public:
+  void lock() { _m.lock(); }
+  bool trylock() { return _m.try_lock(); }
+  void unlock() { _m.unlock(); }
+
+private:
+  std::recursive_mutex _m;
+};
+
+namespace rtos {
+typedef ::Mutex Mutex;
+}
+
+// locks for the lifetime of the object, like mbed::ScopedLock
+template <typename Lockable>
+class ScopedLock {
+public:
+  ScopedLock(Lockable &lockable) : _lockable(lockable) { _lockable.lock(); }
+  ~ScopedLock() { _lockable.unlock(); }
+
+private:
+  Lockable &_lockable;
+};
+
+typedef enum {
+  osPriorityIdle,
+  osPriorityLow,
+  osPriorityBelowNormal,
+  osPriorityNormal,
+  osPriorityAboveNormal,
+  osPriorityHigh,
+  osPriorityRealtime
+} osPriority;
+
+#define OS_STACK_SIZE 4096
+
+// priorities and stack sizes are ignored, the host schedules the threads
+class Thread {
+public:
+  Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE,
+    unsigned char *stack_mem = NULL, const char *name = NULL) : _name(name) {}
+
+  ~Thread() {
+    if (_thread.joinable())
+      _thread.detach();
+  }
+
+  int start(Callback<void()> task) {
+    _thread = std::thread([task]() { task(); });
+    return 0;
+  }
+
+  int join() {
+    if (_thread.joinable())
+      _thread.join();
+    return 0;
+  }
+
+  const char *get_name() const { return _name; }
+
+private:
+  const char *_name;
+  std::thread _thread;
+};
+
+#define osWaitForever 0xFFFFFFFFu
+#define osFlagsError 0x80000000u
+
+class EventFlags {
+public:
+  EventFlags() : _flags(0) {}
+
+  uint32_t set(uint32_t flags) {
+    std::lock_guard<std::mutex> lock(_m);
+    _flags |= flags;
+    _cv.notify_all();
+    return _flags;
+  }
+
+  uint32_t clear(uint32_t flags = 0x7fffffff) {
+    std::lock_guard<std::mutex> lock(_m);
+    uint32_t old = _flags;
+    _flags &= ~flags;
+    return old;
+  }
+
+  uint32_t get() const { return _flags; }
+
+  uint32_t wait_any_for(uint32_t flags, std::chrono::milliseconds timeout, bool clear = true) {
+    std::unique_lock<std::mutex> lock(_m);
+    if (!_cv.wait_for(lock, timeout, [&]() { return (_flags & flags) != 0; }))
+      return osFlagsError;
+    uint32_t result = _flags;
+    if (clear)
+      _flags &= ~flags;
+    return result;
+  }
+
+  uint32_t wait_any(uint32_t flags, uint32_t millisec = osWaitForever, bool clear = true) {
+    if (millisec == osWaitForever)
+      millisec = 0x7FFFFFFF;
+    return wait_any_for(flags, std::chrono::milliseconds(millisec), clear);
+  }
+
+private:
+  std::mutex _m;
+  std::condition_variable _cv;
+  volatile uint32_t _flags;
+};
+
+/**
+ * Timed events run by the thread that dispatches the queue, as on the target.
+ */
+class EventQueue {
+public:
+  EventQueue(unsigned size = 0, unsigned char *buffer = NULL) : _next_id(1), _break(false) {}
+
+  template <typename F>
+  int call(F f) {
+    return post(std::chrono::milliseconds(0), std::chrono::milliseconds(0), f);
+  }
+
+  template <typename D, typename F>
+  int call_in(D delay, F f) {
+    return post(std::chrono::duration_cast<std::chrono::milliseconds>(delay), std::chrono::milliseconds(0), f);
+  }
+
+  template <typename D, typename F>
+  int call_every(D period, F f) {
+    std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(period);
+    return post(ms, ms, f);
+  }
+
+  bool cancel(int id) {
+    std::lock_guard<std::mutex> lock(_m);
+    return _events.erase(id) > 0;
+  }
+
+  void dispatch_forever() {
+    dispatch_until(std::chrono::steady_clock::time_point::max());
+  }
+
+  void dispatch_for(std::chrono::milliseconds ms) {
+    dispatch_until(std::chrono::steady_clock::now() + ms);
+  }
+
+  void dispatch_once() {
+    dispatch_until(std::chrono::steady_clock::now());
+  }
+
+  void break_dispatch() {
+    std::lock_guard<std::mutex> lock(_m);
+    _break = true;
+    _cv.notify_all();
+  }
+
+private:
+  typedef struct {
+    std::chrono::steady_clock::time_point due;
+    std::chrono::milliseconds period;
+    std::function<void()> f;
+  } Event;
+
+  template <typename F>
+  int post(std::chrono::milliseconds delay, std::chrono::milliseconds period, F f) {
+    std::lock_guard<std::mutex> lock(_m);
+    int id = _next_id++;
+    Event &e = _events[id];
+    e.due = std::chrono::steady_clock::now() + delay;
+    e.period = period;
+    e.f = f;
+    _cv.notify_all();
+    return id;
+  }
+
+  void dispatch_until(std::chrono::steady_clock::time_point end) {
+    std::unique_lock<std::mutex> lock(_m);
+    _break = false;
+    while (!_break) {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      std::map<int, Event>::iterator next = _events.end();
+      for (std::map<int, Event>::iterator it = _events.begin(); it != _events.end(); ++it)
+        if (next == _events.end() || it->second.due < next->second.due)
+          next = it;
+
+      if (next != _events.end() && next->second.due <= now) {
+        std::function<void()> f = next->second.f;
+        if (next->second.period.count())
+          next->second.due += next->second.period;
+        else
+          _events.erase(next);
+        lock.unlock();
+        f();
+        lock.lock();
+        continue;
+      }
+      if (now >= end)
+        break;
+      std::chrono::steady_clock::time_point wake = next != _events.end() && next->second.due < end ? next->second.due : end;
+      _cv.wait_until(lock, wake);
+    }
+  }
+
+  std::mutex _m;
+  std::condition_variable _cv;
+  std::map<int, Event> _events;
+  int _next_id;
+  bool _break;
+};
+
+/* network */
+
+class SocketAddress {
+public:
+  SocketAddress() : _port(0) {
+    memset(&_addr, 0, sizeof(_addr));
+    _ip[0] = '\0';
+  }
+
+  SocketAddress(const char *ip, uint16_t port = 0) : _port(port) {
+    memset(&_addr, 0, sizeof(_addr));
+    _ip[0] = '\0';
+    set_ip_address(ip);
+  }
+
+  bool set_ip_address(const char *ip) {
+    struct sockaddr_in *in4 = (struct sockaddr_in *)&_addr;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&_addr;
+
+    memset(&_addr, 0, sizeof(_addr));
+    _ip[0] = '\0';
+    if (ip && inet_pton(AF_INET, ip, &in4->sin_addr) == 1) {
+      _addr.ss_family = AF_INET;
+    } else if (ip && inet_pton(AF_INET6, ip, &in6->sin6_addr) == 1) {
+      _addr.ss_family = AF_INET6;
+    } else {
+      return false;
+    }
+    snprintf(_ip, sizeof(_ip), "%s", ip);
+    return true;
+  }
+
+  // from a resolved or accepted address
+  void set_sockaddr(const struct sockaddr *sa) {
+    memset(&_addr, 0, sizeof(_addr));
+    if (sa->sa_family == AF_INET) {
+      memcpy(&_addr, sa, sizeof(struct sockaddr_in));
+      _port = ntohs(((const struct sockaddr_in *)sa)->sin_port);
+      inet_ntop(AF_INET, &((const struct sockaddr_in *)sa)->sin_addr, _ip, sizeof(_ip));
+    } else if (sa->sa_family == AF_INET6) {
+      memcpy(&_addr, sa, sizeof(struct sockaddr_in6));
+      _port = ntohs(((const struct sockaddr_in6 *)sa)->sin6_port);
+      inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)sa)->sin6_addr, _ip, sizeof(_ip));
+    }
+  }
+
+  // with the port set, for connect() and sendto()
+  socklen_t sockaddr(struct sockaddr_storage *sa) const {
+    *sa = _addr;
+    if (_addr.ss_family == AF_INET6) {
+      ((struct sockaddr_in6 *)sa)->sin6_port = htons(_port);
+      return sizeof(struct sockaddr_in6);
+    }
+    ((struct sockaddr_in *)sa)->sin_port = htons(_port);
+    return sizeof(struct sockaddr_in);
+  }
+
+  void set_port(uint16_t port) { _port = port; }
+  uint16_t get_port() const { return _port; }
+  const char *get_ip_address() const { return _ip[0] ? _ip : NULL; }
+  nsapi_version_t get_ip_version() const {
+    return _addr.ss_family == AF_INET ? NSAPI_IPv4 : _addr.ss_family == AF_INET6 ? NSAPI_IPv6 : NSAPI_UNSPEC;
+  }
+
+  explicit operator bool() const { return _addr.ss_family != 0; }
+
+  bool operator==(const SocketAddress &other) const {
+    return _port == other._port && strcmp(_ip, other._ip) == 0;
+  }
+  bool operator!=(const SocketAddress &other) const { return !(*this == other); }
+
+private:
+  struct sockaddr_storage _addr;
+  uint16_t _port;
+  char _ip[INET6_ADDRSTRLEN];
+};
+
+class NetworkInterface;
+
+/**
+ * Socket on a BSD socket. Blocking with an optional timeout like the
+ * sockets of Mbed OS, set_blocking(false) makes the calls return
+ * NSAPI_ERROR_WOULD_BLOCK.
+ */
+class Socket {
+public:
+  Socket(int type) : _type(type), _fd(-1), _timeout_ms(-1) {}
+  virtual ~Socket() { close(); }
+
+  virtual nsapi_error_t close() {
+    if (_fd >= 0)
+      ::close(_fd);
+    _fd = -1;
+    return NSAPI_ERROR_OK;
+  }
+
+  virtual nsapi_error_t connect(const SocketAddress &address) {
+    struct sockaddr_storage sa;
+    socklen_t len = address.sockaddr(&sa);
+
+    if (_fd < 0 && (_fd = ::socket(sa.ss_family, _type, 0)) < 0)
+      return NSAPI_ERROR_NO_SOCKET;
+    if (_type == SOCK_STREAM) {
+      int one = 1;
+      setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (::connect(_fd, (struct sockaddr *)&sa, len) != 0) {
+      if (errno != EINPROGRESS)
+        return host_nsapi_error(errno);
+      if (!wait(POLLOUT))
+        return NSAPI_ERROR_CONNECTION_TIMEOUT;
+      int err = 0;
+      socklen_t errlen = sizeof(err);
+      getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+      if (err)
+        return host_nsapi_error(err);
+    }
+    _peer = address;
+    return NSAPI_ERROR_OK;
+  }
+
+  virtual nsapi_size_or_error_t send(const void *data, nsapi_size_t size) {
+    if (_fd < 0)
+      return NSAPI_ERROR_NO_SOCKET;
+    if (!wait(POLLOUT))
+      return NSAPI_ERROR_WOULD_BLOCK;
+    ssize_t n = ::send(_fd, data, size, MSG_NOSIGNAL);
+    return n < 0 ? host_nsapi_error(errno) : (nsapi_size_or_error_t)n;
+  }
+
+  virtual nsapi_size_or_error_t recv(void *data, nsapi_size_t size) {
+    if (_fd < 0)
+      return NSAPI_ERROR_NO_SOCKET;
+    if (!wait(POLLIN))
+      return NSAPI_ERROR_WOULD_BLOCK;
+    ssize_t n = ::recv(_fd, data, size, 0);
+    return n < 0 ? host_nsapi_error(errno) : (nsapi_size_or_error_t)n;
+  }
+
+  virtual nsapi_size_or_error_t sendto(const SocketAddress &address, const void *data, nsapi_size_t size) {
+    struct sockaddr_storage sa;
+    socklen_t len = address.sockaddr(&sa);
+
+    if (_fd < 0 && (_fd = ::socket(sa.ss_family, _type, 0)) < 0)
+      return NSAPI_ERROR_NO_SOCKET;
+    if (!wait(POLLOUT))
+      return NSAPI_ERROR_WOULD_BLOCK;
+    ssize_t n = ::sendto(_fd, data, size, 0, (struct sockaddr *)&sa, len);
+    return n < 0 ? host_nsapi_error(errno) : (nsapi_size_or_error_t)n;
+  }
+
+  virtual nsapi_size_or_error_t recvfrom(SocketAddress *address, void *data, nsapi_size_t size) {
+    struct sockaddr_storage sa;
+    socklen_t len = sizeof(sa);
+
+    if (_fd < 0)
+      return NSAPI_ERROR_NO_SOCKET;
+    if (!wait(POLLIN))
+      return NSAPI_ERROR_WOULD_BLOCK;
+    ssize_t n = ::recvfrom(_fd, data, size, 0, (struct sockaddr *)&sa, &len);
+    if (n < 0)
+      return host_nsapi_error(errno);
+    if (address)
+      address->set_sockaddr((struct sockaddr *)&sa);
+    return (nsapi_size_or_error_t)n;
+  }
+
+  // the timeout applies to every call, -1 blocks forever and 0 does not block
+  virtual void set_timeout(int timeout_ms) { _timeout_ms = timeout_ms; }
+  virtual void set_blocking(bool blocking) { _timeout_ms = blocking ? -1 : 0; }
+
+  // kept but never called, the host sockets are used blocking or polled
+  virtual void sigio(Callback<void()> func) { _sigio = func; }
+
+  nsapi_error_t getpeername(SocketAddress *address) {
+    if (_fd < 0)
+      return NSAPI_ERROR_NO_SOCKET;
+    *address = _peer;
+    return NSAPI_ERROR_OK;
+  }
+
+  int fd() const { return _fd; }
+
+protected:
+  bool wait(short events) {
+    struct pollfd p = { _fd, events, 0 };
+    int ret;
+
+    do {
+      ret = ::poll(&p, 1, _timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    return ret > 0;
+  }
+
+  int _type;
+  int _fd;
+  int _timeout_ms;
+  SocketAddress _peer;
+  Callback<void()> _sigio;
+};
+
+class InternetSocket : public Socket {
+public:
+  InternetSocket(int type) : Socket(type) {}
+
+  // the socket is created on connect, when the address family is known
+  template <typename S>
+  nsapi_error_t open(S *stack) {
+    close();
+    return NSAPI_ERROR_OK;
+  }
+};
+
+class TCPSocket : public InternetSocket {
+public:
+  TCPSocket() : InternetSocket(SOCK_STREAM) {}
+};
+
+class UDPSocket : public InternetSocket {
+public:
+  UDPSocket() : InternetSocket(SOCK_DGRAM) {}
+};
+
+/**
+ * The network of the host, connect() always succeeds. Name resolution uses
+ * getaddrinfo(), the asynchronous variant runs it on a detached thread.
+ * The calls are virtual like in Mbed OS, tests override them to inject faults.
+ */
+class NetworkInterface {
+public:
+  virtual ~NetworkInterface() {}
+
+  static NetworkInterface *get_default_instance() {
+    static NetworkInterface net;
+    return &net;
+  }
+
+  virtual nsapi_error_t connect() { return NSAPI_ERROR_OK; }
+  virtual nsapi_error_t disconnect() { return NSAPI_ERROR_OK; }
+
+  nsapi_error_t get_ip_address(SocketAddress *address) {
+    address->set_ip_address("127.0.0.1");
+    return NSAPI_ERROR_OK;
+  }
+  nsapi_error_t get_netmask(SocketAddress *address) {
+    address->set_ip_address("255.0.0.0");
+    return NSAPI_ERROR_OK;
+  }
+  nsapi_error_t get_gateway(SocketAddress *address) {
+    address->set_ip_address("127.0.0.1");
+    return NSAPI_ERROR_OK;
+  }
+
+  virtual nsapi_error_t gethostbyname(const char *host, SocketAddress *address, nsapi_version_t version = NSAPI_UNSPEC,
+    const char *interface_name = NULL) {
+    SocketAddress *result = NULL;
+    nsapi_value_or_error_t count = getaddrinfo(host, NULL, &result);
+    if (count <= 0)
+      return count < 0 ? count : NSAPI_ERROR_DNS_FAILURE;
+    *address = result[0];
+    delete[] result;
+    return NSAPI_ERROR_OK;
+  }
+
+  // the caller frees the result with delete[]
+  virtual nsapi_value_or_error_t getaddrinfo(const char *host, SocketAddress *hints, SocketAddress **result,
+    const char *interface_name = NULL) {
+    struct addrinfo h;
+    struct addrinfo *list = NULL;
+    int count = 0;
+
+    memset(&h, 0, sizeof(h));
+    h.ai_family = AF_UNSPEC;
+    h.ai_socktype = SOCK_STREAM;
+    if (::getaddrinfo(host, NULL, &h, &list) != 0)
+      return NSAPI_ERROR_DNS_FAILURE;
+    for (struct addrinfo *ai = list; ai; ai = ai->ai_next)
+      count++;
+    *result = new SocketAddress[count];
+    count = 0;
+    for (struct addrinfo *ai = list; ai; ai = ai->ai_next)
+      (*result)[count++].set_sockaddr(ai->ai_addr);
+    freeaddrinfo(list);
+    return count;
+  }
+
+  template <typename C>
+  nsapi_value_or_error_t getaddrinfo_async(const char *host, SocketAddress *hints, C cb,
+    const char *interface_name = NULL) {
+    std::thread([this, host, cb]() {
+      SocketAddress *result = NULL;
+      nsapi_value_or_error_t count = getaddrinfo(host, NULL, &result);
+      cb(count, result);
+      delete[] result;
+    }).detach();
+    return NSAPI_ERROR_IN_PROGRESS;
+  }
+};
+
+class EthInterface : public NetworkInterface {
+public:
+  static NetworkInterface *get_default_instance() {
+    return NetworkInterface::get_default_instance();
+  }
+};
+
+/* peripherals */
+
+typedef enum {
+  NC = -1,
+  I2C_SDA = 0,
+  I2C_SCL,
+  PB_8,
+  PB_9,
+  PC_12,
+  PD_2,
+  USBTX,
+  USBRX,
+  LED1,
+  LED2,
+  LED3,
+  BUTTON1
+} PinName;
+
+/**
+ * Simulated I2C device, addresses are 8 bit like the I2C API of Mbed OS.
+ * Return 0 for an acknowledged transfer.
+ */
+class HostI2CDevice {
+public:
+  virtual ~HostI2CDevice() {}
+  virtual int write(const char *data, int length, bool repeated) = 0;
+  virtual int read(char *data, int length) = 0;
+};
+
+class HostI2C {
+public:
+  static void attach(int address, HostI2CDevice *device) {
+    devices()[address & 0xFE] = device;
+  }
+
+  static HostI2CDevice *device(int address) {
+    std::map<int, HostI2CDevice *>::iterator it = devices().find(address & 0xFE);
+    return it == devices().end() ? NULL : it->second;
+  }
+
+private:
+  static std::map<int, HostI2CDevice *> &devices() {
+    static std::map<int, HostI2CDevice *> d;
+    return d;
+  }
+};
+
+// transfers to an address without a simulated device are not acknowledged
+class I2C {
+public:
+  I2C(PinName sda, PinName scl) {}
+
+  void frequency(int hz) {}
+
+  int write(int address, const char *data, int length, bool repeated = false) {
+    HostI2CDevice *dev = HostI2C::device(address);
+    return dev ? dev->write(data, length, repeated) : -1;
+  }
+
+  int read(int address, char *data, int length, bool repeated = false) {
+    HostI2CDevice *dev = HostI2C::device(address);
+    return dev ? dev->read(data, length) : -1;
+  }
+};
+
+/**
+ * Simulated serial device, e.g. a CO2 sensor answering commands.
+ * The device queues its answer with HostSerial::reply().
+ */
+class HostSerialDevice {
+public:
+  virtual ~HostSerialDevice() {}
+  virtual void received(const uint8_t *data, size_t length) = 0;
+};
+
+class BufferedSerial;
+
+class HostSerial {
+public:
+  static void attach(PinName tx, HostSerialDevice *device) {
+    devices()[tx] = device;
+  }
+
+  static HostSerialDevice *device(PinName tx) {
+    std::map<int, HostSerialDevice *>::iterator it = devices().find(tx);
+    return it == devices().end() ? NULL : it->second;
+  }
+
+private:
+  static std::map<int, HostSerialDevice *> &devices() {
+    static std::map<int, HostSerialDevice *> d;
+    return d;
+  }
+};
+
+// a serial port without a simulated device writes to stdout and never has data
+class BufferedSerial {
+public:
+  BufferedSerial(PinName tx, PinName rx, int baud = 9600) : _tx(tx) {
+    instances()[tx] = this;
+  }
+
+  ~BufferedSerial() {
+    instances().erase(_tx);
+  }
+
+  void set_baud(int baud) {}
+  void set_blocking(bool blocking) {}
+
+  bool readable() {
+    std::lock_guard<std::mutex> lock(_m);
+    return !_rx.empty();
+  }
+
+  ssize_t read(void *buffer, size_t length) {
+    std::lock_guard<std::mutex> lock(_m);
+    size_t n = length < _rx.size() ? length : _rx.size();
+    memcpy(buffer, _rx.data(), n);
+    _rx.erase(_rx.begin(), _rx.begin() + n);
+    return n ? (ssize_t)n : -EAGAIN;
+  }
+
+  ssize_t write(const void *buffer, size_t length) {
+    HostSerialDevice *dev = HostSerial::device(_tx);
+    if (dev)
+      dev->received((const uint8_t *)buffer, length);
+    else
+      fwrite(buffer, 1, length, stdout);
+    return (ssize_t)length;
+  }
+
+  PinName tx() const { return _tx; }
+
+  // data from the simulated device
+  void inject(const void *data, size_t length) {
+    std::lock_guard<std::mutex> lock(_m);
+    _rx.insert(_rx.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+  }
+
+  static BufferedSerial *instance(PinName tx) {
+    std::map<int, BufferedSerial *>::iterator it = instances().find(tx);
+    return it == instances().end() ? NULL : it->second;
+  }
+
+private:
+  static std::map<int, BufferedSerial *> &instances() {
+    static std::map<int, BufferedSerial *> s;
+    return s;
+  }
+
+  PinName _tx;
+  std::mutex _m;
+  std::vector<uint8_t> _rx;
+};
+
+class DigitalIn {
+public:
+  DigitalIn(PinName pin) : _value(0) {}
+  int read() { return _value; }
+  operator int() { return _value; }
+  void write(int value) { _value = value; }
+
+private:
+  int _value;
+};
+
+class DigitalOut {
+public:
+  DigitalOut(PinName pin, int value = 0) : _value(value) {}
+  void write(int value) { _value = value; }
+  int read() { return _value; }
+  DigitalOut &operator=(int value) {
+    _value = value;
+    return *this;
+  }
+  operator int() { return _value; }
+
+private:
+  int _value;
+};
+
+/* target */
+
+// cycle counter of the host (time stamp counter, or ns elsewhere)
+static inline uint64_t host_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// DWT->CYCCNT counts the host cycles, writing it sets the count
+class HostCycleCounter {
+public:
+  HostCycleCounter() : _offset(host_cycles()) {}
+  operator uint32_t() const { return (uint32_t)(host_cycles() - _offset); }
+  HostCycleCounter &operator=(uint32_t value) {
+    _offset = host_cycles() - value;
+    return *this;
+  }
+
+private:
+  uint64_t _offset;
+};
+
+typedef struct {
+  volatile uint32_t CTRL;
+  HostCycleCounter CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+static inline DWT_Type *host_dwt() {
+  static DWT_Type dwt;
+  return &dwt;
+}
+
+static inline CoreDebug_Type *host_core_debug() {
+  static CoreDebug_Type core_debug;
+  return &core_debug;
+}
+
+#define DWT (host_dwt())
+#define CoreDebug (host_core_debug())
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+// unique ID of the chip, the host ID and the process, so several instances on one host differ
+static inline uint32_t HAL_GetUIDw0() { return (uint32_t)gethostid(); }
+static inline uint32_t HAL_GetUIDw1() { return (uint32_t)getpid(); }
+static inline uint32_t HAL_GetUIDw2() { return 0x484F5354; }
+
+// part of mbed.h on the target
+#include "mbed_stats.h"
+
+#endif // _HOST_MBED_H_
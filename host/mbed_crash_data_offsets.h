@@ -0,0 +1,32 @@
+#ifndef _HOST_MBED_CRASH_DATA_OFFSETS_H_
+#define _HOST_MBED_CRASH_DATA_OFFSETS_H_
+
+#include "mbed_error.h"
+#include "mbed_fault_handler.h"
+
+#define MBED_CRASH_DATA_FAULT_SIZE 0x80
+#define MBED_CRASH_DATA_ERROR_SIZE 0x80
+
+/**
+ * The crash data RAM of the target, kept over warm reboots there. On the
+ * host it is a zeroed static that lives as long as the process.
+ */
+typedef struct {
+  union {
+    mbed_fault_context_t context;
+    uint8_t pad[MBED_CRASH_DATA_FAULT_SIZE];
+  } fault;
+  union {
+    mbed_error_ctx context;
+    uint8_t pad[MBED_CRASH_DATA_ERROR_SIZE];
+  } error;
+} mbed_crash_data_t;
+
+static inline mbed_crash_data_t &host_crash_data() {
+  static mbed_crash_data_t data;
+  return data;
+}
+
+#define MBED_CRASH_DATA (host_crash_data())
+
+#endif // _HOST_MBED_CRASH_DATA_OFFSETS_H_
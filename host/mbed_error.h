@@ -0,0 +1,30 @@
+#ifndef _HOST_MBED_ERROR_H_
+#define _HOST_MBED_ERROR_H_
+
+#include "mbed.h"
+
+typedef int mbed_error_status_t;
+
+// error context of the crash data RAM, the same fields as Mbed OS 6
+typedef struct _mbed_error_ctx {
+  mbed_error_status_t error_status;
+  uint32_t error_address;
+  uint32_t error_value;
+  uint32_t thread_id;
+  uint32_t thread_entry_address;
+  uint32_t thread_stack_size;
+  uint32_t thread_stack_mem;
+  uint32_t thread_current_sp;
+  int32_t error_reboot_count;
+  int32_t is_error_processed;
+  uint32_t crc_error_ctx;
+} mbed_error_ctx;
+
+// the host does not reboot after an error, the context is only kept for the process
+static inline void mbed_reset_reboot_count() {
+}
+
+static inline void mbed_reset_reboot_error_info() {
+}
+
+#endif // _HOST_MBED_ERROR_H_
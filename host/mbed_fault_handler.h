@@ -0,0 +1,31 @@
+#ifndef _HOST_MBED_FAULT_HANDLER_H_
+#define _HOST_MBED_FAULT_HANDLER_H_
+
+#include <stdint.h>
+
+// registers of the Cortex-M at a fault, never filled on the host
+typedef struct {
+  uint32_t R0_reg;
+  uint32_t R1_reg;
+  uint32_t R2_reg;
+  uint32_t R3_reg;
+  uint32_t R4_reg;
+  uint32_t R5_reg;
+  uint32_t R6_reg;
+  uint32_t R7_reg;
+  uint32_t R8_reg;
+  uint32_t R9_reg;
+  uint32_t R10_reg;
+  uint32_t R11_reg;
+  uint32_t R12_reg;
+  uint32_t SP_reg;
+  uint32_t LR_reg;
+  uint32_t PC_reg;
+  uint32_t xPSR;
+  uint32_t PSP;
+  uint32_t MSP;
+  uint32_t EXC_RETURN;
+  uint32_t CONTROL;
+} mbed_fault_context_t;
+
+#endif // _HOST_MBED_FAULT_HANDLER_H_
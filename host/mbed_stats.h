@@ -0,0 +1,72 @@
+#ifndef _HOST_MBED_STATS_H_
+#define _HOST_MBED_STATS_H_
+
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "mbed.h"
+
+typedef uint64_t us_timestamp_t;
+
+typedef struct {
+  uint32_t current_size;
+  uint32_t max_size;
+  uint32_t total_size;
+  uint32_t reserved_size;
+  uint32_t alloc_cnt;
+  uint32_t alloc_fail_cnt;
+  uint32_t overhead_size;
+} mbed_stats_heap_t;
+
+typedef struct {
+  uint32_t id;
+  uint32_t state;
+  uint32_t priority;
+  uint32_t stack_size;
+  uint32_t stack_space;
+  const char *name;
+} mbed_stats_thread_t;
+
+typedef struct {
+  us_timestamp_t uptime;
+  us_timestamp_t idle_time;
+  us_timestamp_t sleep_time;
+  us_timestamp_t deep_sleep_time;
+} mbed_stats_cpu_t;
+
+/**
+ * Heap of the glibc allocator: used and reserved bytes of its arenas. The
+ * allocations are not counted on the host, total_size, alloc_cnt and
+ * alloc_fail_cnt stay 0, max_size is the peak seen by the calls.
+ */
+static inline void mbed_stats_heap_get(mbed_stats_heap_t *stats) {
+  static uint32_t peak = 0;
+  struct mallinfo2 info = mallinfo2();
+
+  memset(stats, 0, sizeof(*stats));
+  stats->current_size = (uint32_t)(info.uordblks + info.hblkhd);
+  stats->reserved_size = (uint32_t)(info.arena + info.hblkhd);
+  if (stats->current_size > peak)
+    peak = stats->current_size;
+  stats->max_size = peak;
+}
+
+// the stacks of the host threads are not watched
+static inline size_t mbed_stats_thread_get_each(mbed_stats_thread_t *stats, size_t count) {
+  return 0;
+}
+
+// the time the process did not use the CPU counts as idle
+static inline void mbed_stats_cpu_get(mbed_stats_cpu_t *stats) {
+  struct rusage usage;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->uptime = (us_timestamp_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    Kernel::Clock::now().time_since_epoch()).count();
+  getrusage(RUSAGE_SELF, &usage);
+  us_timestamp_t busy = (us_timestamp_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  stats->idle_time = busy < stats->uptime ? stats->uptime - busy : 0;
+}
+
+#endif // _HOST_MBED_STATS_H_
@@ -0,0 +1,92 @@
+#ifndef _HOST_MBEDTLS_SSL_H_
+#define _HOST_MBEDTLS_SSL_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbedtls/x509_crt.h"
+
+#define MBEDTLS_ERR_SSL_BAD_INPUT_DATA -0x7100
+
+/**
+ * The parts of mbed TLS used by the examples, for the host TLSSocketWrapper
+ * that does not encrypt (see TLSSocket.h). The session only carries what
+ * the session cache keeps. A context with a session set by
+ * mbedtls_ssl_set_session() after mbedtls_ssl_setup() is resumed by the
+ * handshake of the wrapper, any other handshake is a full one that calls
+ * the verify callback of the config.
+ */
+typedef struct {
+  int ciphersuite;
+  size_t id_len;
+  unsigned char id[32];
+  unsigned char master[48];
+} mbedtls_ssl_session;
+
+typedef struct {
+  int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *);
+  void *p_vrfy;
+  mbedtls_x509_crt *ca_chain;
+} mbedtls_ssl_config;
+
+typedef struct {
+  const mbedtls_ssl_config *conf;
+  mbedtls_ssl_session session;
+  int resume;
+} mbedtls_ssl_context;
+
+static inline void mbedtls_ssl_session_init(mbedtls_ssl_session *session) {
+  memset(session, 0, sizeof(*session));
+}
+
+static inline void mbedtls_ssl_session_free(mbedtls_ssl_session *session) {
+  memset(session, 0, sizeof(*session));
+}
+
+static inline void mbedtls_ssl_config_init(mbedtls_ssl_config *conf) {
+  memset(conf, 0, sizeof(*conf));
+}
+
+static inline void mbedtls_ssl_config_free(mbedtls_ssl_config *conf) {
+  memset(conf, 0, sizeof(*conf));
+}
+
+static inline void mbedtls_ssl_conf_verify(mbedtls_ssl_config *conf,
+  int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *), void *p_vrfy) {
+  conf->f_vrfy = f_vrfy;
+  conf->p_vrfy = p_vrfy;
+}
+
+static inline void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config *conf, mbedtls_x509_crt *ca_chain, void *ca_crl) {
+  conf->ca_chain = ca_chain;
+}
+
+static inline void mbedtls_ssl_init(mbedtls_ssl_context *ssl) {
+  memset(ssl, 0, sizeof(*ssl));
+}
+
+static inline void mbedtls_ssl_free(mbedtls_ssl_context *ssl) {
+  memset(ssl, 0, sizeof(*ssl));
+}
+
+static inline int mbedtls_ssl_setup(mbedtls_ssl_context *ssl, const mbedtls_ssl_config *conf) {
+  ssl->conf = conf;
+  return 0;
+}
+
+static inline int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session) {
+  if (!ssl->conf || session->id_len == 0)
+    return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  ssl->session = *session;
+  ssl->resume = 1;
+  return 0;
+}
+
+static inline int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *session) {
+  if (!ssl->conf || ssl->session.id_len == 0)
+    return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  *session = ssl->session;
+  return 0;
+}
+
+#endif // _HOST_MBEDTLS_SSL_H_
@@ -0,0 +1,63 @@
+#ifndef _HOST_MBEDTLS_X509_CRT_H_
+#define _HOST_MBEDTLS_X509_CRT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MBEDTLS_ERR_X509_INVALID_FORMAT -0x2180
+
+/**
+ * Certificate chain of the host mbed TLS stand-in: the certificates are
+ * counted and their size is kept, nothing is decoded or verified.
+ */
+typedef struct mbedtls_x509_crt {
+  size_t raw_len;
+  struct mbedtls_x509_crt *next;
+} mbedtls_x509_crt;
+
+static inline void mbedtls_x509_crt_init(mbedtls_x509_crt *crt) {
+  memset(crt, 0, sizeof(*crt));
+}
+
+static inline void mbedtls_x509_crt_free(mbedtls_x509_crt *crt) {
+  mbedtls_x509_crt *next = crt->next;
+  while (next) {
+    mbedtls_x509_crt *p = next;
+    next = p->next;
+    free(p);
+  }
+  memset(crt, 0, sizeof(*crt));
+}
+
+// PEM with the terminating '\0' in buflen, or one DER certificate
+static inline int mbedtls_x509_crt_parse(mbedtls_x509_crt *chain, const unsigned char *buf, size_t buflen) {
+  static const char begin[] = "-----BEGIN CERTIFICATE-----";
+  const char *pem = (const char *)buf;
+  int certs = 0;
+
+  if (buflen > 0 && buf[buflen - 1] == '\0') {
+    for (const char *p = strstr(pem, begin); p; p = strstr(p + 1, begin)) {
+      const char *end = strstr(p, "-----END CERTIFICATE-----");
+      if (!end)
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+      mbedtls_x509_crt *crt = chain;
+      if (crt->raw_len) {
+        while (crt->next)
+          crt = crt->next;
+        crt->next = (mbedtls_x509_crt *)calloc(1, sizeof(mbedtls_x509_crt));
+        crt = crt->next;
+      }
+      crt->raw_len = end - p;
+      certs++;
+    }
+    return certs ? 0 : MBEDTLS_ERR_X509_INVALID_FORMAT;
+  }
+  // DER starts with a SEQUENCE
+  if (buflen < 2 || buf[0] != 0x30)
+    return MBEDTLS_ERR_X509_INVALID_FORMAT;
+  chain->raw_len = buflen;
+  return 0;
+}
+
+#endif // _HOST_MBEDTLS_X509_CRT_H_
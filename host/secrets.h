@@ -0,0 +1,20 @@
+#ifndef _HOST_SECRETS_H_
+#define _HOST_SECRETS_H_
+
+// secrets of the host build: the ThingsBoard stand-in on localhost, without TLS
+#ifndef TOKEN
+#define TOKEN "host-token"
+#endif
+#ifndef THINGSBOARD_HOST
+#define THINGSBOARD_HOST "localhost"
+#endif
+#ifndef THINGSBOARD_PORT
+#define THINGSBOARD_PORT 8080
+#endif
+
+// any certificate, the host TLSSocket does not verify
+const char SSL_CA_PEM[] = "-----BEGIN CERTIFICATE-----\n"
+"TUJFRC1IT1NULUNB\n"
+"-----END CERTIFICATE-----\n";
+
+#endif // _HOST_SECRETS_H_
@@ -33,7 +33,7 @@ echo:"Plattform: "%platform%
 echo:"IDE:       "%ide%
 
 mbed config -G MBED_OS_DIR %projectpath%\..\%mbedos%
-mbed export -v -m %platform% -i %ide% --source .\%prj% --source ..\%mbedos%
+mbed export -v -m %platform% -i %ide% --source .\%prj% --source .\common --source ..\%mbedos%
 
 cd .\%prj%
 pause 
\ No newline at end of file
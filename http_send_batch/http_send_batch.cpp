@@ -7,6 +7,9 @@
 
 #include "mbed.h"
 #include "network-helper.h"
+#include "thingsboard-mqtt.h"
+#include "thingsboard-gateway.h"
+#include "http-pipeline.h"
 #include "ThingsBoard.h"
 
 #define PRINT_STR_REPEAT(str, times) \
@@ -16,8 +19,19 @@
   puts(""); \
 }
 
+// the host build sets its own server
+#ifndef THINGSBOARD_HOST
 #define THINGSBOARD_HOST "192.168.178.84"
 #define THINGSBOARD_PORT 8888
+#endif
+// set to 1 to send over one long-lived MQTT connection instead of one HTTP request per upload
+#define THINGSBOARD_USE_MQTT 0
+#define THINGSBOARD_MQTT_PORT 1883
+// set to 1 (with THINGSBOARD_USE_MQTT) to upload the data of several logical devices over one
+// gateway connection, TOKEN has to be the token of a gateway device then
+#define THINGSBOARD_USE_GATEWAY 0
+// set to 1 to send telemetry and attributes back to back and read both responses afterwards
+#define THINGSBOARD_PIPELINE 1
 
 // See https://thingsboard.io/docs/getting-started-guides/helloworld/ 
 // to understand how to obtain an access token
@@ -26,15 +40,180 @@
 // #define TOKEN "..."
 
 NetworkInterface *net;
-TCPSocket socket;
+// not "socket", the host build has socket() of the C library in the global namespace
+TCPSocket tcpSocket;
 
 // Initialize ThingsBoard instance
 ThingsBoardHttp tb;
+// buffer for one request or the response headers
+char pipebuf[512];
+HttpPipeline pipeline(pipebuf, sizeof(pipebuf));
+#if THINGSBOARD_USE_MQTT
+#if THINGSBOARD_USE_GATEWAY
+// one message carries the samples of all devices, so the packets are larger
+typedef ThingsBoardMqtt<4, 1024> GatewayMqtt;
+GatewayMqtt tbm;
+ThingsBoardGateway<GatewayMqtt> gateway(tbm);
+// the board itself and two sensor nodes connected to it
+int gwLocal, gwUartNode, gwCanNode;
+#else
+// up to 4 QoS 1 messages in flight
+ThingsBoardMqtt<4> tbm;
+#endif
+// unique per board, the broker keeps the session of a client id and drops an older connection with the same id
+char clientId[48];
+#endif
+
+/**************************************************************************/
+/*
+    upload telemetry and attributes with one http request each, a new connection every time
+*/
+/**************************************************************************/
+void sendHttp(const SocketAddress &adr, Telemetry *data, int data_items, Attribute *attributes, int attribute_items) {
+  nsapi_error_t result;
+  bool bret;
+  Timer cycle;
+
+  while(true) {
+    cycle.reset();
+    cycle.start();
+    result = tcpSocket.open(net);
+    if (result != NSAPI_ERROR_OK) {
+      printf("Error! socket.open(net) returned: %d\n", result);
+      thread_sleep_for(30000);
+      system_reset();
+    }
+
+    result = tcpSocket.connect(adr);
+    if (result != NSAPI_ERROR_OK) {
+      printf("Error! socket.connect(adr) Failed (%d).\n", result);
+      thread_sleep_for(30000);
+      system_reset();
+    }
+
+    printf("Sending data...\n");
+
+#if THINGSBOARD_PIPELINE
+    // both requests are sent without waiting, so the cycle takes one round trip
+    bret = pipeline.postTelemetry(&tcpSocket, "{\"temperature\":%.1f,\"humidity\":%d}", 42.2, 80);
+    if(bret)
+      bret = pipeline.postAttributes(&tcpSocket, "{\"device_type\":\"%s\",\"active\":%s}", "sensor", "true");
+    if(!bret) printf("error sending data\n");
+
+    // the responses arrive in the order of the requests
+    while(pipeline.pending()) {
+      int status = pipeline.response();
+      if(status != 200) printf("ThingsBoard upload returned %d\n", status);
+    }
+#else
+    printf("Sending telemetry data...\n");
+    // Uploads new telemetry to ThingsBoard using MQTT. 
+    // See https://thingsboard.io/docs/reference/mqtt-api/#telemetry-upload-api 
+    // for more details
+    bret = tb.sendTelemetry(data, data_items);
+    if(!bret) printf("error sending telemetry\n");
+
+    printf("Sending attribute data...\n");
+    // Publish attribute update to ThingsBoard using MQTT. 
+    // See https://thingsboard.io/docs/reference/mqtt-api/#publish-attribute-update-to-the-server 
+    // for more details
+    bret = tb.sendAttributes(attributes, attribute_items);
+    if(!bret) printf("error sending attribute\n");
+#endif
+
+    tcpSocket.close();
+
+    printf("Upload cycle with 2 messages took %lld ms\n",
+      (long long)std::chrono::duration_cast<std::chrono::milliseconds>(cycle.elapsed_time()).count());
+    
+    thread_sleep_for(15000);
+  }
+}
+
+#if THINGSBOARD_USE_MQTT
+/**************************************************************************/
+/*
+    upload the same data over one MQTT connection that is kept open,
+    prints messages per second and bytes per message for comparison with http
+*/
+/**************************************************************************/
+void sendMqtt(const SocketAddress &adr) {
+  nsapi_error_t result;
+  bool bret;
+  Timer cycle;
+  uint32_t bytes, published;
+
+  while(true) {
+    cycle.reset();
+    cycle.start();
+    bytes = tbm.bytes();
+    published = tbm.published();
+
+    if(!tbm.connected()) {
+      tcpSocket.close();
+      result = tcpSocket.open(net);
+      if (result == NSAPI_ERROR_OK)
+        result = tcpSocket.connect(adr);
+      if (result == NSAPI_ERROR_OK)
+        result = tbm.connect(&tcpSocket);
+      if (result != NSAPI_ERROR_OK) {
+        printf("Error! MQTT connect failed (%d).\n", result);
+        thread_sleep_for(30000);
+        system_reset();
+      }
+      printf("MQTT connected, session present: %s\n", tbm.session_present()?"yes":"no");
+#if THINGSBOARD_USE_GATEWAY
+      if(!gateway.connect())
+        printf("error announcing the gateway devices\n");
+#endif
+    }
+
+    printf("Sending data...\n");
+
+#if THINGSBOARD_USE_GATEWAY
+    // the values of all devices go into one message on the gateway connection
+    // See https://thingsboard.io/docs/reference/gateway-mqtt-api/
+    gateway.telemetry(gwLocal, 0, "\"temperature\":%.1f,\"humidity\":%d", 42.2, 80);
+    // values received from the nodes, e.g. over UART or CAN
+    gateway.telemetry(gwUartNode, 0, "\"temperature\":%.1f", 21.5);
+    gateway.telemetry(gwCanNode, 0, "\"open\":%s", "false");
+    bret = gateway.flush();
+    if(!bret) printf("error sending telemetry\n");
+#else
+    // Uploads new telemetry to ThingsBoard using MQTT.
+    // See https://thingsboard.io/docs/reference/mqtt-api/#telemetry-upload-api
+    // for more details
+    bret = tbm.sendTelemetryJson("{\"temperature\":42.2,\"humidity\":80}");
+    if(!bret) printf("error sending telemetry\n");
+
+    // Publish attribute update to ThingsBoard using MQTT.
+    // See https://thingsboard.io/docs/reference/mqtt-api/#publish-attribute-update-to-the-server
+    // for more details
+    bret = tbm.sendAttributeJSON("{\"device_type\":\"sensor\",\"active\":true}");
+    if(!bret) printf("error sending attribute\n");
+#endif
+
+    // both messages are in flight at the same time, wait for the acknowledgements
+    if(!tbm.flush())
+      printf("error waiting for acknowledgements, %u messages in flight\n", (unsigned)tbm.inFlight());
+
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(cycle.elapsed_time()).count();
+    published = tbm.published() - published;
+    bytes = tbm.bytes() - bytes;
+    printf("Upload cycle with %lu messages took %lld ms (%lld messages/s), %lu bytes per message\n",
+      (unsigned long)published, ms, ms > 0 ? published * 1000LL / ms : 0LL, (unsigned long)(published ? bytes / published : 0));
+
+    // keeps the connection alive while waiting
+    for(int i = 0; i < 15; i++) {
+      tbm.poll(1000);
+    }
+  }
+}
+#endif
 
 int main() {
   SocketAddress adr;
   nsapi_error_t result;
-  bool bret;
 
   const int data_items = 2;
   Telemetry data[data_items] = {
@@ -72,41 +251,20 @@ int main() {
   }
   adr.set_port(THINGSBOARD_PORT);
   
-  tb.begin(&socket, TOKEN, THINGSBOARD_HOST, THINGSBOARD_PORT);
-
-  while(true) {
-    result = socket.open(net);
-    if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.open(net) returned: %d\n", result);
-      thread_sleep_for(30000);
-      system_reset();
-    }
-
-    result = socket.connect(adr);
-    if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.connect(adr) Failed (%d).\n", result);
-      thread_sleep_for(30000);
-      system_reset();
-    }
-
-    printf("Sending data...\n");
-
-    printf("Sending telemetry data...\n");
-    // Uploads new telemetry to ThingsBoard using MQTT. 
-    // See https://thingsboard.io/docs/reference/mqtt-api/#telemetry-upload-api 
-    // for more details
-    bret = tb.sendTelemetry(data, data_items);
-    if(!bret) printf("error sending telemetry\n");
-
-    printf("Sending attribute data...\n");
-    // Publish attribute update to ThingsBoard using MQTT. 
-    // See https://thingsboard.io/docs/reference/mqtt-api/#publish-attribute-update-to-the-server 
-    // for more details
-    bret = tb.sendAttributes(attributes, attribute_items);
-    if(!bret) printf("error sending attribute\n");
-
-    socket.close();
-    
-    thread_sleep_for(15000);
-  }
+#if THINGSBOARD_USE_MQTT
+  adr.set_port(THINGSBOARD_MQTT_PORT);
+  snprintf(clientId, sizeof(clientId), "http_send_batch-%08lx%08lx%08lx",
+    (unsigned long)HAL_GetUIDw2(), (unsigned long)HAL_GetUIDw1(), (unsigned long)HAL_GetUIDw0());
+  tbm.begin(TOKEN, clientId);
+#if THINGSBOARD_USE_GATEWAY
+  gwLocal = gateway.addDevice("http_send_batch", "sensor");
+  gwUartNode = gateway.addDevice("http_send_batch-uart-1", "sensor");
+  gwCanNode = gateway.addDevice("http_send_batch-can-1", "door-sensor");
+#endif
+  sendMqtt(adr);
+#else
+  tb.begin(&tcpSocket, TOKEN, THINGSBOARD_HOST, THINGSBOARD_PORT);
+  pipeline.begin(TOKEN, THINGSBOARD_HOST);
+  sendHttp(adr, data, data_items, attributes, attribute_items);
+#endif
 }
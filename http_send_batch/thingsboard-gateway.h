@@ -0,0 +1,247 @@
+#ifndef _THINGSBOARD_GATEWAY_H_
+#define _THINGSBOARD_GATEWAY_H_
+
+#include <stdarg.h>
+
+#include "mbed.h"
+
+/**
+ * Client for the ThingsBoard gateway MQTT API: one connection with the
+ * token of the gateway device uploads the telemetry of several logical
+ * devices, e.g. the local sensors and nodes reporting over UART or CAN.
+ * Samples are collected with telemetry() and sent by flush() as one
+ * message per PAYLOAD bytes:
+ *   v1/gateway/telemetry {"room-1":[{"ts":...,"values":{...}},...],"room-1-door":[...]}
+ * ThingsBoard creates the devices on the first message, connect() announces
+ * them and their type with v1/gateway/connect.
+ * M is the MQTT client, e.g. ThingsBoardMqtt<4, 1024>, its PACKET has to
+ * hold PAYLOAD bytes plus topic and header. Samples are kept in a buffer of
+ * BUFFER bytes until flush(), if it is full telemetry() flushes first.
+ *
+ *   int door = gw.addDevice("room-1-door", "door-sensor");
+ *   gw.connect();
+ *   gw.telemetry(door, ts, "\"open\":%s", "true");
+ *   gw.flush();
+ */
+template <typename M, size_t DEVICES = 8, size_t ENTRIES = 32, size_t BUFFER = 1024, size_t PAYLOAD = 900>
+class ThingsBoardGateway {
+public:
+  ThingsBoardGateway(M &mqtt) : _mqtt(mqtt), _devices(0), _entries(0), _used(0), _messages(0), _samples(0) {
+  }
+
+  // register a logical device, returns its index or -1 if there is no room
+  int addDevice(const char *name, const char *type = "default") {
+    if (_devices >= DEVICES)
+      return -1;
+    _device[_devices].name = name;
+    _device[_devices].type = type;
+    _device[_devices].announced = false;
+    return (int)_devices++;
+  }
+
+  /**
+   * Announce the devices not announced yet. Call after every (re)connect of
+   * the MQTT client, the devices are announced again after a new session.
+   */
+  bool connect() {
+    char payload[128];
+
+    if (!_mqtt.session_present())
+      for (size_t i = 0; i < _devices; i++)
+        _device[i].announced = false;
+    for (size_t i = 0; i < _devices; i++) {
+      if (_device[i].announced)
+        continue;
+      int len = snprintf(payload, sizeof(payload), "{\"device\":\"%s\",\"type\":\"%s\"}", _device[i].name, _device[i].type);
+      if (len < 0 || (size_t)len >= sizeof(payload) || !_mqtt.publish("v1/gateway/connect", payload, len))
+        return false;
+      _device[i].announced = true;
+    }
+    return true;
+  }
+
+  /**
+   * Add a sample of a device, fmt renders the values without braces, e.g.
+   * "\"temperature\":%.2f,\"humidity\":%.1f". ts_ms 0 uses the time of arrival.
+   */
+  bool telemetry(int device, uint64_t ts_ms, const char *fmt, ...) {
+    va_list args;
+
+    if (device < 0 || (size_t)device >= _devices)
+      return false;
+    for (int attempt = 0; attempt < 2; attempt++) {
+      if (_entries < ENTRIES) {
+        va_start(args, fmt);
+        int len = vsnprintf(_buffer + _used, BUFFER - _used, fmt, args);
+        va_end(args);
+        if (len >= 0 && (size_t)len < BUFFER - _used) {
+          Entry &e = _entry[_entries++];
+          e.device = (uint8_t)device;
+          e.state = ENTRY_COLLECTED;
+          e.ts_ms = ts_ms;
+          e.offset = (uint16_t)_used;
+          e.len = (uint16_t)len;
+          _used += len;
+          _samples++;
+          return true;
+        }
+      }
+      // the buffer is full, send what is collected and try again
+      if (attempt == 0 && (_entries == 0 || !flush()))
+        return false;
+    }
+    return false;
+  }
+
+  /**
+   * Send attributes of a device right away:
+   *   v1/gateway/attributes {"room-1-door":{"firmware":"1.2"}}
+   */
+  bool attributes(int device, const char *fmt, ...) {
+    char payload[PAYLOAD];
+    va_list args;
+
+    if (device < 0 || (size_t)device >= _devices)
+      return false;
+    int len = snprintf(payload, sizeof(payload), "{\"%s\":{", _device[device].name);
+    if (len < 0 || (size_t)len >= sizeof(payload))
+      return false;
+    va_start(args, fmt);
+    int ret = vsnprintf(payload + len, sizeof(payload) - len, fmt, args);
+    va_end(args);
+    if (ret < 0 || (size_t)(len + ret + 2) >= sizeof(payload))
+      return false;
+    len += ret;
+    payload[len++] = '}';
+    payload[len++] = '}';
+    return _mqtt.publish("v1/gateway/attributes", payload, len);
+  }
+
+  /**
+   * Publish the collected samples grouped by device, as few messages as
+   * PAYLOAD allows. The samples are dropped after they were handed to the
+   * MQTT client, its window keeps them until the PUBACK. If a publish fails
+   * only the samples of the messages not published stay for the next flush.
+   */
+  bool flush() {
+    char payload[PAYLOAD];
+    size_t len = 0;
+    bool ok = true;
+
+    for (size_t d = 0; d < _devices && ok; d++) {
+      bool open = false;
+      for (size_t i = 0; i < _entries && ok; i++) {
+        Entry &e = _entry[i];
+        if (e.device != d)
+          continue;
+        char row[48];
+        int head = e.ts_ms ? snprintf(row, sizeof(row), "{\"ts\":%llu,\"values\":{", (unsigned long long)e.ts_ms)
+                           : snprintf(row, sizeof(row), "{\"values\":{");
+        // {"name":[ + row + values + }} + ]}
+        size_t need = (open ? 1 : strlen(_device[d].name) + 6) + head + e.len + 2 + 2;
+        if (len + need > sizeof(payload) && len > 0) {
+          ok = publish(payload, len, open);
+          len = 0;
+          open = false;
+          need = strlen(_device[d].name) + 6 + head + e.len + 4;
+        }
+        if (need > sizeof(payload)) {
+          printf("[TBGW] Sample of %s too large (%u bytes)\n", _device[d].name, (unsigned)e.len);
+          e.state = ENTRY_SENT;
+          continue;
+        }
+        if (!open)
+          len += sprintf(payload + len, "%s\"%s\":[", len ? "," : "{", _device[d].name);
+        else
+          payload[len++] = ',';
+        memcpy(payload + len, row, head);
+        len += head;
+        memcpy(payload + len, _buffer + e.offset, e.len);
+        len += e.len;
+        payload[len++] = '}';
+        payload[len++] = '}';
+        e.state = ENTRY_QUEUED;
+        open = true;
+      }
+      if (open)
+        payload[len++] = ']';
+    }
+    if (ok && len > 0)
+      ok = publish(payload, len, false);
+
+    compact();
+    return ok;
+  }
+
+  size_t devices() const { return _devices; }
+  size_t pending() const { return _entries; }
+  const char *name(int device) const { return _device[device].name; }
+  uint32_t messages() const { return _messages; }
+  uint32_t samples() const { return _samples; }
+
+private:
+  typedef struct {
+    const char *name;
+    const char *type;
+    bool announced;
+  } Device;
+
+  // a sample is collected, in the message being built, or published (or dropped)
+  enum {
+    ENTRY_COLLECTED = 0,
+    ENTRY_QUEUED,
+    ENTRY_SENT
+  };
+
+  typedef struct {
+    uint8_t device;
+    uint8_t state;
+    uint16_t offset;
+    uint16_t len;
+    uint64_t ts_ms;
+  } Entry;
+
+  // close the JSON (and the array of the device if it is open) and publish it
+  bool publish(char *payload, size_t len, bool open) {
+    if (open)
+      payload[len++] = ']';
+    payload[len++] = '}';
+    _messages++;
+    bool ok = _mqtt.publish("v1/gateway/telemetry", payload, len);
+    for (size_t i = 0; i < _entries; i++)
+      if (_entry[i].state == ENTRY_QUEUED)
+        _entry[i].state = ok ? ENTRY_SENT : ENTRY_COLLECTED;
+    return ok;
+  }
+
+  // remove the samples that were sent, the others move to the front in their order
+  void compact() {
+    size_t kept = 0;
+    size_t used = 0;
+
+    for (size_t i = 0; i < _entries; i++) {
+      Entry e = _entry[i];
+      if (e.state == ENTRY_SENT)
+        continue;
+      // the samples are in the order of their offsets, the text only moves down
+      memmove(_buffer + used, _buffer + e.offset, e.len);
+      e.offset = (uint16_t)used;
+      used += e.len;
+      _entry[kept++] = e;
+    }
+    _entries = kept;
+    _used = used;
+  }
+
+  M &_mqtt;
+  Device _device[DEVICES];
+  size_t _devices;
+  Entry _entry[ENTRIES];
+  size_t _entries;
+  char _buffer[BUFFER];
+  size_t _used;
+  uint32_t _messages;
+  uint32_t _samples;
+};
+
+#endif // _THINGSBOARD_GATEWAY_H_
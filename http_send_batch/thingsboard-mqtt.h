@@ -0,0 +1,412 @@
+#ifndef _THINGSBOARD_MQTT_H_
+#define _THINGSBOARD_MQTT_H_
+
+#include <stdarg.h>
+
+#include "mbed.h"
+
+/**
+ * Minimal ThingsBoard client for the MQTT device API (MQTT 3.1.1).
+ * One connection is kept open for all uploads, so a message only costs a
+ * few bytes of MQTT header instead of a full HTTP request with the token
+ * in the URL. Messages are published with QoS 1 without waiting for the
+ * PUBACK: up to WINDOW messages may be in flight, a new publish only blocks
+ * if the window is full. The in-flight messages are kept and sent again
+ * after a reconnect, the session is persistent (clean session = 0), so the
+ * broker does not lose acknowledged state either.
+ * A published message (header, topic and payload) has to fit into PACKET bytes.
+ *
+ *   mqtt.begin(TOKEN, "room-1");
+ *   mqtt.connect(&socket);
+ *   mqtt.sendTelemetryFloat("temperature", 22.5);
+ *   mqtt.flush();
+ */
+template <size_t WINDOW = 4, size_t PACKET = 256>
+class ThingsBoardMqtt {
+public:
+  ThingsBoardMqtt()
+    : _socket(NULL), _token(NULL), _client_id(NULL), _keep_alive(60), _next_id(1),
+      _connected(false), _session_present(false), _rx_len(0), _published(0), _acked(0), _resent(0), _bytes(0) {
+    memset(_slots, 0, sizeof(_slots));
+  }
+
+  // the device is authenticated with its access token as user name
+  void begin(const char *token, const char *client_id, uint16_t keep_alive = 60) {
+    _token = token;
+    _client_id = client_id;
+    _keep_alive = keep_alive;
+  }
+
+  /**
+   * Send CONNECT on an already connected socket and wait for the CONNACK.
+   * Messages that were not acknowledged on the last connection are sent again.
+   */
+  nsapi_error_t connect(Socket *socket, int timeout_ms = 5000) {
+    char buf[128];
+    size_t len = 0;
+
+    _socket = socket;
+    _connected = false;
+
+    size_t remaining = 10 + 2 + strlen(_client_id) + 2 + strlen(_token);
+    if (1 + 4 + remaining > sizeof(buf))
+      return NSAPI_ERROR_PARAMETER;
+    buf[len++] = 0x10;
+    len += encodeLength(buf + len, remaining);
+    len += putString(buf + len, "MQTT");
+    buf[len++] = 0x04;                // protocol level 3.1.1
+    buf[len++] = (char)0x80;          // user name, persistent session
+    buf[len++] = _keep_alive >> 8;
+    buf[len++] = _keep_alive & 0xFF;
+    len += putString(buf + len, _client_id);
+    len += putString(buf + len, _token);
+
+    nsapi_error_t result = sendAll(buf, len);
+    if (result != NSAPI_ERROR_OK)
+      return result;
+
+    uint8_t type;
+    result = readPacket(&type, timeout_ms);
+    if (result != NSAPI_ERROR_OK)
+      return result;
+    if (type != 0x20 || _rx_len != 2 || _rx[1] != 0) {
+      printf("[TBMQ] Connection refused (%d)\n", _rx_len == 2 ? _rx[1] : -1);
+      return NSAPI_ERROR_AUTH_FAILURE;
+    }
+    _session_present = _rx[0] & 0x01;
+    _connected = true;
+    _last_send.reset();
+    _last_send.start();
+
+    // resend everything not acknowledged, with the DUP flag set
+    for (size_t i = 0; i < WINDOW; i++) {
+      if (!_slots[i].len)
+        continue;
+      _slots[i].packet[0] |= 0x08;
+      result = sendAll(_slots[i].packet, _slots[i].len);
+      if (result != NSAPI_ERROR_OK)
+        return disconnected(result);
+      _resent++;
+    }
+    return NSAPI_ERROR_OK;
+  }
+
+  bool sendTelemetryJson(const char *json) {
+    return publish("v1/devices/me/telemetry", json);
+  }
+
+  bool sendAttributeJSON(const char *json) {
+    return publish("v1/devices/me/attributes", json);
+  }
+
+  bool sendTelemetryInt(const char *key, int value) {
+    return publishf("v1/devices/me/telemetry", "{\"%s\":%d}", key, value);
+  }
+
+  bool sendTelemetryBool(const char *key, bool value) {
+    return publishf("v1/devices/me/telemetry", "{\"%s\":%s}", key, value ? "true" : "false");
+  }
+
+  bool sendTelemetryFloat(const char *key, float value) {
+    return publishf("v1/devices/me/telemetry", "{\"%s\":%.2f}", key, (double)value);
+  }
+
+  bool sendAttributeInt(const char *key, int value) {
+    return publishf("v1/devices/me/attributes", "{\"%s\":%d}", key, value);
+  }
+
+  bool sendAttributeBool(const char *key, bool value) {
+    return publishf("v1/devices/me/attributes", "{\"%s\":%s}", key, value ? "true" : "false");
+  }
+
+  bool sendAttributeString(const char *key, const char *value) {
+    return publishf("v1/devices/me/attributes", "{\"%s\":\"%s\"}", key, value);
+  }
+
+  /**
+   * Publish with QoS 1, returns as soon as the message is sent.
+   * Blocks only while all WINDOW slots wait for their PUBACK.
+   */
+  bool publish(const char *topic, const char *payload) {
+    return publish(topic, payload, strlen(payload));
+  }
+
+  bool publish(const char *topic, const char *payload, size_t size) {
+    if (!_connected)
+      return false;
+
+    // wait for a free slot
+    Slot *slot = freeSlot();
+    while (!slot) {
+      if (poll(_keep_alive * 1000) != NSAPI_ERROR_OK)
+        return false;
+      slot = freeSlot();
+    }
+
+    size_t topic_len = strlen(topic);
+    size_t remaining = 2 + topic_len + 2 + size;
+    if (1 + 4 + remaining > PACKET) {
+      printf("[TBMQ] Message too large (%u bytes)\n", (unsigned)size);
+      return false;
+    }
+
+    uint16_t id = nextId();
+    char *p = slot->packet;
+    size_t len = 0;
+    p[len++] = 0x32;                  // PUBLISH, QoS 1
+    len += encodeLength(p + len, remaining);
+    len += putString(p + len, topic);
+    p[len++] = id >> 8;
+    p[len++] = id & 0xFF;
+    memcpy(p + len, payload, size);
+    len += size;
+
+    slot->id = id;
+    slot->len = len;
+    _published++;
+
+    nsapi_error_t result = sendAll(p, len);
+    if (result != NSAPI_ERROR_OK) {
+      // the message stays in its slot and is sent again after connect()
+      disconnected(result);
+      return false;
+    }
+
+    // handle acknowledgements that already arrived without waiting
+    return poll(0) == NSAPI_ERROR_OK;
+  }
+
+  /**
+   * Process incoming packets (PUBACK, PINGRESP) and send a PINGREQ if the
+   * connection was idle for half of the keep alive time.
+   * Waits at most timeout_ms for the first packet.
+   */
+  nsapi_error_t poll(int timeout_ms) {
+    if (!_connected)
+      return NSAPI_ERROR_NO_CONNECTION;
+
+    if (_last_send.elapsed_time() > std::chrono::seconds(_keep_alive / 2)) {
+      const char ping[2] = { (char)0xC0, 0x00 };
+      nsapi_error_t result = sendAll(ping, 2);
+      if (result != NSAPI_ERROR_OK)
+        return disconnected(result);
+    }
+
+    uint8_t type;
+    nsapi_error_t result = readPacket(&type, timeout_ms);
+    while (result == NSAPI_ERROR_OK) {
+      if (type == 0x40 && _rx_len == 2)
+        acknowledge((uint16_t)(_rx[0] << 8 | _rx[1]));
+      result = readPacket(&type, 0);
+    }
+    if (result == NSAPI_ERROR_WOULD_BLOCK)
+      return NSAPI_ERROR_OK;
+    return disconnected(result);
+  }
+
+  /**
+   * Wait until all messages are acknowledged, false on timeout or error.
+   */
+  bool flush(int timeout_ms = 5000) {
+    Timer timer;
+
+    timer.start();
+    while (inFlight() > 0) {
+      int left = timeout_ms - (int)std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed_time()).count();
+      if (left <= 0 || poll(left) != NSAPI_ERROR_OK)
+        return false;
+    }
+    return true;
+  }
+
+  // close the session cleanly, the socket is not closed
+  void disconnect() {
+    if (_connected) {
+      const char packet[2] = { (char)0xE0, 0x00 };
+      sendAll(packet, 2);
+    }
+    _connected = false;
+  }
+
+  bool connected() const { return _connected; }
+  // the broker still had the session of the last connection
+  bool session_present() const { return _session_present; }
+
+  size_t inFlight() const {
+    size_t n = 0;
+    for (size_t i = 0; i < WINDOW; i++)
+      if (_slots[i].len)
+        n++;
+    return n;
+  }
+
+  uint32_t published() const { return _published; }
+  uint32_t acked() const { return _acked; }
+  uint32_t resent() const { return _resent; }
+  // bytes sent including CONNECT, PINGREQ and resent messages
+  uint32_t bytes() const { return _bytes; }
+
+private:
+  typedef struct {
+    uint16_t id;
+    uint16_t len;           // 0 if the slot is free
+    char packet[PACKET];
+  } Slot;
+
+  bool publishf(const char *topic, const char *fmt, ...) {
+    char payload[PACKET];
+    va_list args;
+
+    va_start(args, fmt);
+    int ret = vsnprintf(payload, sizeof(payload), fmt, args);
+    va_end(args);
+    if (ret < 0 || (size_t)ret >= sizeof(payload))
+      return false;
+    return publish(topic, payload, ret);
+  }
+
+  Slot *freeSlot() {
+    for (size_t i = 0; i < WINDOW; i++)
+      if (!_slots[i].len)
+        return &_slots[i];
+    return NULL;
+  }
+
+  void acknowledge(uint16_t id) {
+    for (size_t i = 0; i < WINDOW; i++)
+      if (_slots[i].len && _slots[i].id == id) {
+        _slots[i].len = 0;
+        _acked++;
+        return;
+      }
+  }
+
+  // packet identifiers must not be 0 and not be in use
+  uint16_t nextId() {
+    while (true) {
+      uint16_t id = _next_id++;
+      if (_next_id == 0)
+        _next_id = 1;
+      bool used = false;
+      for (size_t i = 0; i < WINDOW && !used; i++)
+        used = _slots[i].len && _slots[i].id == id;
+      if (!used)
+        return id;
+    }
+  }
+
+  nsapi_error_t disconnected(nsapi_error_t result) {
+    if (_connected)
+      printf("[TBMQ] Connection lost (%d), %u messages kept\n", result, (unsigned)inFlight());
+    _connected = false;
+    return result;
+  }
+
+  static size_t encodeLength(char *buf, size_t length) {
+    size_t n = 0;
+    do {
+      char byte = length % 128;
+      length /= 128;
+      if (length > 0)
+        byte |= 0x80;
+      buf[n++] = byte;
+    } while (length > 0);
+    return n;
+  }
+
+  static size_t putString(char *buf, const char *s) {
+    size_t len = strlen(s);
+    buf[0] = len >> 8;
+    buf[1] = len & 0xFF;
+    memcpy(buf + 2, s, len);
+    return len + 2;
+  }
+
+  nsapi_error_t sendAll(const char *data, size_t len) {
+    _socket->set_blocking(true);
+    while (len > 0) {
+      nsapi_size_or_error_t ret = _socket->send(data, len);
+      if (ret < 0)
+        return ret;
+      data += ret;
+      len -= ret;
+      _bytes += ret;
+    }
+    _last_send.reset();
+    return NSAPI_ERROR_OK;
+  }
+
+  nsapi_error_t recvAll(uint8_t *data, size_t len) {
+    while (len > 0) {
+      nsapi_size_or_error_t ret = _socket->recv(data, len);
+      if (ret == 0)
+        return NSAPI_ERROR_NO_CONNECTION;
+      if (ret < 0)
+        return ret;
+      data += ret;
+      len -= ret;
+    }
+    return NSAPI_ERROR_OK;
+  }
+
+  /**
+   * Read one packet, the first bytes after the fixed header into _rx, the
+   * rest of packets larger than _rx is skipped.
+   * Returns NSAPI_ERROR_WOULD_BLOCK if no packet started within timeout_ms.
+   */
+  nsapi_error_t readPacket(uint8_t *type, int timeout_ms) {
+    uint8_t byte;
+
+    _socket->set_timeout(timeout_ms);
+    nsapi_size_or_error_t ret = _socket->recv(&byte, 1);
+    if (ret == 0)
+      return NSAPI_ERROR_NO_CONNECTION;
+    if (ret < 0)
+      return ret;
+    *type = byte & 0xF0;
+
+    // the rest of a started packet is read blocking
+    _socket->set_blocking(true);
+    size_t length = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+      nsapi_error_t result = recvAll(&byte, 1);
+      if (result != NSAPI_ERROR_OK)
+        return result;
+      length |= (size_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+
+    _rx_len = length < sizeof(_rx) ? length : sizeof(_rx);
+    nsapi_error_t result = recvAll(_rx, _rx_len);
+    if (result != NSAPI_ERROR_OK)
+      return result;
+    for (length -= _rx_len; length > 0;) {
+      uint8_t skip[16];
+      size_t n = length < sizeof(skip) ? length : sizeof(skip);
+      result = recvAll(skip, n);
+      if (result != NSAPI_ERROR_OK)
+        return result;
+      length -= n;
+    }
+    return NSAPI_ERROR_OK;
+  }
+
+  Socket *_socket;
+  const char *_token;
+  const char *_client_id;
+  uint16_t _keep_alive;
+  uint16_t _next_id;
+  bool _connected;
+  bool _session_present;
+  Slot _slots[WINDOW];
+  uint8_t _rx[16];
+  size_t _rx_len;
+  Timer _last_send;
+  uint32_t _published;
+  uint32_t _acked;
+  uint32_t _resent;
+  uint32_t _bytes;
+};
+
+#endif // _THINGSBOARD_MQTT_H_
@@ -7,6 +7,7 @@
 
 #include "mbed.h"
 #include "network-helper.h"
+#include "http-pipeline.h"
 #include "ThingsBoard.h"
 
 #define PRINT_STR_REPEAT(str, times) \
@@ -18,6 +19,8 @@
 
 #define THINGSBOARD_HOST "192.168.178.84"
 #define THINGSBOARD_PORT 8888
+// set to 1 to send both values back to back and read the responses afterwards
+#define THINGSBOARD_PIPELINE 1
 
 // See https://thingsboard.io/docs/getting-started-guides/helloworld/ 
 // to understand how to obtain an access token
@@ -30,11 +33,15 @@ TCPSocket socket;
 
 // Initialize ThingsBoard instance
 ThingsBoardHttp tb;
+// buffer for one request or the response headers
+char pipebuf[512];
+HttpPipeline pipeline(pipebuf, sizeof(pipebuf));
 
 int main() {
   SocketAddress adr;
   nsapi_error_t result;
   bool bret;
+  Timer cycle;
 
   printf("\n");
 #ifdef MBED_MAJOR_VERSION
@@ -60,8 +67,11 @@ int main() {
   adr.set_port(THINGSBOARD_PORT);
   
   tb.begin(&socket, TOKEN, THINGSBOARD_HOST, THINGSBOARD_PORT);
+  pipeline.begin(TOKEN, THINGSBOARD_HOST);
 
   while(true) {
+    cycle.reset();
+    cycle.start();
     result = socket.open(net);
     if (result != NSAPI_ERROR_OK) {
       printf("Error! socket.open(net) returned: %d\n", result);
@@ -79,12 +89,27 @@ int main() {
     printf("Sending data...\n");
 
     // Uploads new telemetry to ThingsBoard using http
+#if THINGSBOARD_PIPELINE
+    // the second request does not wait for the response to the first one
+    bret = pipeline.postTelemetry(&socket, "{\"temperature\":%d}", 22);
+    if(!bret) printf("error sending telemetry: temperature\n");
+    bret = pipeline.postTelemetry(&socket, "{\"humidity\":%.2f}", 42.5);
+    if(!bret) printf("error sending telemetry: humidity\n");
+    while(pipeline.pending()) {
+      int status = pipeline.response();
+      if(status != 200) printf("ThingsBoard upload returned %d\n", status);
+    }
+#else
     bret = tb.sendTelemetryInt("temperature", 22);
     if(!bret) printf("error sending telemetry: temperature\n");
     bret = tb.sendTelemetryFloat("humidity", 42.5);
     if(!bret) printf("error sending telemetry: humidity\n");
+#endif
 
     socket.close();
+
+    printf("Upload cycle with 2 requests took %lld ms\n",
+      std::chrono::duration_cast<std::chrono::milliseconds>(cycle.elapsed_time()).count());
     
     thread_sleep_for(15000);
   }
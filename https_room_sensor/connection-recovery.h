@@ -0,0 +1,52 @@
+#ifndef _CONNECTION_RECOVERY_H_
+#define _CONNECTION_RECOVERY_H_
+
+#include "mbed.h"
+#include "NetworkInterface.h"
+#include "reconnect-backoff.h"
+
+/**
+ * Reports a failed connection to the backoff at now_ms and performs the
+ * recovery step it returns before the next attempt: the next address of the
+ * DnsCache after a failed connect, resolving the host again, or reconnecting
+ * the interface. The address for the next attempt is updated in adr.
+ * Connection is a TLSConnection or anything with close() and failed_step().
+ * Returns the step, STEP_RESET is left to the caller.
+ */
+template <typename Connection, typename Resolver>
+ReconnectBackoff::Step recoverConnection(ReconnectBackoff &backoff, uint32_t now_ms, Connection &tls, Resolver &dns,
+  NetworkInterface *net, SocketAddress &adr) {
+  ReconnectBackoff::Step step = backoff.failure(now_ms);
+  nsapi_error_t result;
+
+  printf("Recovery after %lu failures: %s, next attempt in %lu ms\n",
+    (unsigned long)backoff.failures(), ReconnectBackoff::name(step), (unsigned long)backoff.delay_ms());
+  tls.close();
+
+  switch(step) {
+    case ReconnectBackoff::STEP_REOPEN_SOCKET:
+      // try the next address of ThingsBoard if there are several
+      if(tls.failed_step() == Connection::STEP_CONNECT)
+        dns.failed();
+      dns.address(adr);
+      break;
+    case ReconnectBackoff::STEP_RESOLVE:
+      // the address of ThingsBoard may have changed
+      result = dns.resolve(now_ms / 1000);
+      if(result != NSAPI_ERROR_OK)
+        printf("Error! dns.resolve returned: %d\n", result);
+      dns.address(adr);
+      break;
+    case ReconnectBackoff::STEP_RECONNECT_INTERFACE:
+      net->disconnect();
+      result = net->connect();
+      if(result != NSAPI_ERROR_OK)
+        printf("Error! net->connect returned: %d\n", result);
+      break;
+    default:
+      break;
+  }
+  return step;
+}
+
+#endif // _CONNECTION_RECOVERY_H_
@@ -0,0 +1,277 @@
+#ifndef _DEFLATE_STREAM_H_
+#define _DEFLATE_STREAM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Streaming gzip compressor (RFC 1951/1952) with a small fixed window, for
+ * HTTP bodies with "Content-Encoding: gzip". LZ77 with hash chains over the
+ * last WINDOW bytes and the fixed Huffman codes of deflate, so no tables are
+ * built and no heap is used. The working memory is about 4 * WINDOW + 600
+ * bytes, e.g. 4.6 KB for the default window of 1 KB. Telemetry JSON repeats
+ * its keys in every row, the matches are short and close, a small window
+ * finds most of them.
+ * The compressed data is passed to the output callback in pieces of up to
+ * 64 bytes while the input is written.
+ *
+ *   DeflateStream<> z;
+ *   z.begin(output, ctx);
+ *   z.write(json, len);
+ *   z.finish();
+ */
+template <size_t WINDOW = 1024>
+class DeflateStream {
+  static_assert(WINDOW >= 512 && WINDOW <= 16384 && (WINDOW & (WINDOW - 1)) == 0,
+    "the window has to be a power of two, larger than a match and addressable with 16 bits");
+
+public:
+  typedef void (*Output)(void *ctx, const char *data, size_t len);
+
+  DeflateStream() : _output(NULL), _ctx(NULL) {
+  }
+
+  void begin(Output output, void *ctx) {
+    static const char header[10] = { 0x1F, (char)0x8B, 8, 0, 0, 0, 0, 0, 0, (char)0xFF };
+
+    _output = output;
+    _ctx = ctx;
+    _pos = 0;
+    _end = 0;
+    _bits = 0;
+    _nbits = 0;
+    _out_len = 0;
+    _crc = 0xFFFFFFFF;
+    _size_in = 0;
+    _size_out = 0;
+    memset(_head, 0xFF, sizeof(_head));
+    memset(_prev, 0xFF, sizeof(_prev));
+
+    emit(header, sizeof(header));
+    putBits(3, 3);   // last block, fixed Huffman codes
+  }
+
+  void write(const char *data, size_t len) {
+    _crc = crc32(_crc, (const uint8_t *)data, len);
+    _size_in += len;
+    while (len > 0) {
+      if (_end == sizeof(_win))
+        slide();
+      size_t n = sizeof(_win) - _end;
+      if (n > len)
+        n = len;
+      memcpy(_win + _end, data, n);
+      _end += n;
+      data += n;
+      len -= n;
+      compress(false);
+    }
+  }
+
+  // compress the rest and write the trailer
+  void finish() {
+    compress(true);
+    putCode(0, 7);   // end of block
+    if (_nbits)
+      putBits(0, 8 - _nbits);
+    uint32_t crc = _crc ^ 0xFFFFFFFF;
+    char trailer[8];
+    for (int i = 0; i < 4; i++) {
+      trailer[i] = (char)(crc >> (8 * i));
+      trailer[4 + i] = (char)(_size_in >> (8 * i));
+    }
+    emit(trailer, sizeof(trailer));
+    flush();
+  }
+
+  uint32_t size_in() const { return _size_in; }
+  uint32_t size_out() const { return _size_out; }
+
+private:
+  enum {
+    MIN_MATCH = 3,
+    HASH_BITS = 8,
+    MAX_CHAIN = 16
+  };
+  // typed, they are mixed with window positions in conditional expressions
+  static const size_t MAX_MATCH = 258;
+  static const uint16_t NIL = 0xFFFF;   // no position in _head and _prev
+
+  // keep the last WINDOW bytes before _pos, the buffer always moves by WINDOW
+  void slide() {
+    memmove(_win, _win + WINDOW, WINDOW);
+    _pos -= WINDOW;
+    _end -= WINDOW;
+    for (size_t i = 0; i < (1 << HASH_BITS); i++)
+      _head[i] = _head[i] != NIL && _head[i] >= WINDOW ? _head[i] - WINDOW : NIL;
+    for (size_t i = 0; i < WINDOW; i++)
+      _prev[i] = _prev[i] != NIL && _prev[i] >= WINDOW ? _prev[i] - WINDOW : NIL;
+  }
+
+  uint32_t hash(size_t p) const {
+    return ((_win[p] << 5) ^ (_win[p + 1] << 2) ^ _win[p + 2] ^ (_win[p] >> 3)) & ((1 << HASH_BITS) - 1);
+  }
+
+  void insert(size_t p) {
+    uint32_t h = hash(p);
+    _prev[p & (WINDOW - 1)] = _head[h];
+    _head[h] = (uint16_t)p;
+  }
+
+  // greedy LZ77, without the final flag a full match length is kept as lookahead
+  void compress(bool final) {
+    while (_pos < _end && (final || _end - _pos > MAX_MATCH)) {
+      size_t avail = _end - _pos;
+      size_t best_len = 0;
+      size_t best_dist = 0;
+
+      if (avail >= MIN_MATCH) {
+        size_t max = avail < MAX_MATCH ? avail : MAX_MATCH;
+        uint16_t cand = _head[hash(_pos)];
+        for (int chain = 0; cand != NIL && chain < MAX_CHAIN; chain++) {
+          size_t dist = _pos - cand;
+          if (dist == 0 || dist > WINDOW)
+            break;
+          if (_win[cand + best_len] == _win[_pos + best_len]) {
+            size_t len = 0;
+            while (len < max && _win[cand + len] == _win[_pos + len])
+              len++;
+            if (len > best_len) {
+              best_len = len;
+              best_dist = dist;
+              if (len == max)
+                break;
+            }
+          }
+          uint16_t next = _prev[cand & (WINDOW - 1)];
+          if (next == NIL || next >= cand)
+            break;
+          cand = next;
+        }
+      }
+
+      if (best_len >= MIN_MATCH) {
+        putMatch(best_len, best_dist);
+        for (size_t i = 0; i < best_len; i++, _pos++)
+          if (_end - _pos >= MIN_MATCH)
+            insert(_pos);
+      } else {
+        putLiteral(_win[_pos]);
+        if (avail >= MIN_MATCH)
+          insert(_pos);
+        _pos++;
+      }
+    }
+  }
+
+  void putLiteral(uint8_t c) {
+    if (c < 144)
+      putCode(0x30 + c, 8);
+    else
+      putCode(0x190 + c - 144, 9);
+  }
+
+  void putMatch(size_t len, size_t dist) {
+    static const uint16_t len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+      257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+      7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int l = 28;
+    while (len_base[l] > len)
+      l--;
+    int sym = 257 + l;
+    if (sym < 280)
+      putCode(sym - 256, 7);
+    else
+      putCode(0xC0 + sym - 280, 8);
+    putBits(len - len_base[l], len_extra[l]);
+
+    int d = 29;
+    while (dist_base[d] > dist)
+      d--;
+    putCode(d, 5);
+    putBits(dist - dist_base[d], dist_extra[d]);
+  }
+
+  // Huffman codes are sent from the most significant bit
+  void putCode(uint32_t code, int len) {
+    uint32_t rev = 0;
+    for (int i = 0; i < len; i++)
+      rev |= ((code >> i) & 1) << (len - 1 - i);
+    putBits(rev, len);
+  }
+
+  void putBits(uint32_t value, int len) {
+    _bits |= value << _nbits;
+    _nbits += len;
+    while (_nbits >= 8) {
+      char c = (char)_bits;
+      emit(&c, 1);
+      _bits >>= 8;
+      _nbits -= 8;
+    }
+  }
+
+  void emit(const char *data, size_t len) {
+    while (len > 0) {
+      size_t n = sizeof(_out) - _out_len;
+      if (n > len)
+        n = len;
+      memcpy(_out + _out_len, data, n);
+      _out_len += n;
+      data += n;
+      len -= n;
+      if (_out_len == sizeof(_out))
+        flush();
+    }
+  }
+
+  void flush() {
+    if (_out_len) {
+      _output(_ctx, _out, _out_len);
+      _size_out += _out_len;
+      _out_len = 0;
+    }
+  }
+
+  // with a table of 16 entries, small and fast enough for the upload path
+  static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t len) {
+    static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    while (len--) {
+      crc ^= *p++;
+      crc = (crc >> 4) ^ table[crc & 15];
+      crc = (crc >> 4) ^ table[crc & 15];
+    }
+    return crc;
+  }
+
+  Output _output;
+  void *_ctx;
+  uint8_t _win[2 * WINDOW];
+  uint16_t _head[1 << HASH_BITS];
+  uint16_t _prev[WINDOW];
+  size_t _pos;
+  size_t _end;
+  uint32_t _bits;
+  int _nbits;
+  char _out[64];
+  size_t _out_len;
+  uint32_t _crc;
+  uint32_t _size_in;
+  uint32_t _size_out;
+};
+
+template <size_t WINDOW>
+const size_t DeflateStream<WINDOW>::MAX_MATCH;
+template <size_t WINDOW>
+const uint16_t DeflateStream<WINDOW>::NIL;
+
+#endif // _DEFLATE_STREAM_H_
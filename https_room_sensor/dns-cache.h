@@ -0,0 +1,157 @@
+#ifndef _DNS_CACHE_H_
+#define _DNS_CACHE_H_
+
+#include "mbed.h"
+#include "NetworkInterface.h"
+
+/**
+ * Keeps the resolved addresses (A and AAAA records) of one host, so a
+ * connect never waits for DNS. The addresses are resolved again in the
+ * background shortly before they expire, so a changed address is picked up
+ * without a reset. If the refresh fails, the old addresses stay in use.
+ * failed() switches to the next address, e.g. after a failed connect.
+ * The resolver of Mbed OS does not return the TTL of the records, the
+ * lifetime of the addresses is configured instead.
+ * The addresses are guarded by a mutex, not a critical section: copying a
+ * SocketAddress frees the text of get_ip_address() on the heap. The
+ * background query completes in a thread of the network stack, not in an ISR.
+ */
+template <size_t MAX = 4>
+class DnsCache {
+public:
+  DnsCache(NetworkInterface *net, const char *host, uint16_t port, uint32_t ttl_s = 300, uint32_t refresh_ahead_s = 30)
+    : _net(net), _host(host), _port(port), _ttl_s(ttl_s), _refresh_ahead_s(refresh_ahead_s),
+      _count(0), _current(0), _expires_s(0), _retry_s(0), _now_s(0), _pending(false), _refreshes(0), _refresh_errors(0) {
+  }
+
+  void set_network(NetworkInterface *net) {
+    _net = net;
+  }
+
+  /**
+   * Resolve blocking, e.g. at boot or if the cache is empty.
+   */
+  nsapi_error_t resolve(uint32_t now_s) {
+    SocketAddress hints;
+    SocketAddress *result = NULL;
+
+    nsapi_value_or_error_t count = _net->getaddrinfo(_host, &hints, &result);
+    if (count <= 0) {
+      printf("[DNSC] Resolving %s failed (%d)\n", _host, count);
+      return count < 0 ? count : NSAPI_ERROR_DNS_FAILURE;
+    }
+    store(result, count, now_s);
+    delete[] result;
+    return NSAPI_ERROR_OK;
+  }
+
+  /**
+   * Start a background refresh if the addresses are about to expire, call
+   * this regularly. Returns immediately.
+   */
+  void poll(uint32_t now_s) {
+    if (_pending || _count == 0 || (int32_t)(now_s - (_expires_s - _refresh_ahead_s)) < 0 ||
+        (int32_t)(now_s - _retry_s) < 0)
+      return;
+
+    SocketAddress hints;
+    _pending = true;
+    _now_s = now_s;
+    nsapi_value_or_error_t ret = _net->getaddrinfo_async(_host, &hints, callback(this, &DnsCache::resolved));
+    if (ret < 0 && ret != NSAPI_ERROR_IN_PROGRESS) {
+      _pending = false;
+      failedRefresh(now_s, ret);
+    }
+  }
+
+  /**
+   * Current address with the port set, false if nothing was resolved yet.
+   * Expired addresses are still returned, a stale address is more useful than none.
+   */
+  bool address(SocketAddress &adr) {
+    ScopedLock<rtos::Mutex> lock(_mutex);
+    if (_count == 0)
+      return false;
+    adr = _addresses[_current];
+    return true;
+  }
+
+  // the current address did not work, use the next one
+  void failed() {
+    size_t current, count;
+    {
+      ScopedLock<rtos::Mutex> lock(_mutex);
+      count = _count;
+      if (count > 1)
+        _current = (_current + 1) % count;
+      current = _current;
+    }
+    if (count > 1)
+      printf("[DNSC] Switching to address %u of %u\n", (unsigned)current + 1, (unsigned)count);
+  }
+
+  size_t count() const { return _count; }
+  // a background refresh is running
+  bool pending() const { return _pending; }
+  bool expired(uint32_t now_s) const { return (int32_t)(now_s - _expires_s) >= 0; }
+  uint32_t refreshes() const { return _refreshes; }
+  uint32_t refresh_errors() const { return _refresh_errors; }
+
+private:
+  void store(const SocketAddress *addresses, size_t count, uint32_t now_s) {
+    ScopedLock<rtos::Mutex> lock(_mutex);
+    if (count > MAX)
+      count = MAX;
+    // stay on the address in use if it is still valid
+    SocketAddress used;
+    if (_count)
+      used = _addresses[_current];
+    size_t current = 0;
+    for (size_t i = 0; i < count; i++) {
+      _addresses[i] = addresses[i];
+      _addresses[i].set_port(_port);
+      if (_count && _addresses[i] == used)
+        current = i;
+    }
+    _current = current;
+    _count = count;
+    _expires_s = now_s + _ttl_s;
+    _retry_s = now_s;
+  }
+
+  void failedRefresh(uint32_t now_s, nsapi_error_t error) {
+    _refresh_errors++;
+    printf("[DNSC] Refreshing %s failed (%d), keeping %u addresses\n", _host, error, (unsigned)_count);
+    // try again in a while, the old addresses are kept
+    _retry_s = now_s + _refresh_ahead_s / 2 + 1;
+  }
+
+  // called by the network stack when the background query is done
+  void resolved(nsapi_value_or_error_t result, SocketAddress *addresses) {
+    if (result > 0) {
+      store(addresses, result, _now_s);
+      _refreshes++;
+    } else {
+      failedRefresh(_now_s, result);
+    }
+    _pending = false;
+  }
+
+  NetworkInterface *_net;
+  const char *_host;
+  uint16_t _port;
+  uint32_t _ttl_s;
+  uint32_t _refresh_ahead_s;
+  rtos::Mutex _mutex;
+  SocketAddress _addresses[MAX];
+  size_t _count;
+  size_t _current;
+  uint32_t _expires_s;
+  uint32_t _retry_s;
+  uint32_t _now_s;
+  volatile bool _pending;
+  uint32_t _refreshes;
+  uint32_t _refresh_errors;
+};
+
+#endif // _DNS_CACHE_H_
@@ -0,0 +1,160 @@
+#ifndef _HEALTH_REPORT_H_
+#define _HEALTH_REPORT_H_
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "mbed.h"
+#include "mbed_stats.h"
+
+#if defined(_NEWLIB_VERSION) && !defined(_NANO_MALLOC)
+#include <malloc.h>
+
+// free chunk of the malloc of newlib (dlmalloc, mallocr.c)
+struct NewlibChunk {
+  size_t prev_size;
+  size_t size;          // bytes of the chunk, the two lowest bits are flags
+  NewlibChunk *fd;
+  NewlibChunk *bk;
+};
+
+// bins of free chunks of newlib, bin 0 is the top chunk at the end of the heap
+extern "C" NewlibChunk *__malloc_av_[];
+// heap region of Mbed OS (mbed_boot.h)
+extern "C" unsigned char *mbed_heap_start;
+extern "C" uint32_t mbed_heap_size;
+
+/**
+ * Largest block malloc() can return, from the free chunks of newlib and the
+ * top chunk plus the heap above it that sbrk() has not handed out yet.
+ * Allocates nothing, the malloc lock keeps other threads from changing the
+ * bins during the walk. Returns false for other C libraries.
+ */
+static bool heapLargestFree(uint32_t *largest) {
+  const size_t head = sizeof(size_t);
+  const size_t flags = 3;
+  size_t best = 0;
+
+  __malloc_lock(_REENT);
+  for (size_t i = 1; i < 128; i++) {
+    NewlibChunk *bin = (NewlibChunk *)((char *)&__malloc_av_[2 * i + 2] - 2 * head);
+    for (NewlibChunk *p = bin->bk; p != bin; p = p->bk) {
+      size_t size = p->size & ~flags;
+      if (size > best)
+        best = size;
+    }
+  }
+  // the top chunk grows up to the end of the heap, malloc() keeps a minimal chunk free in it
+  unsigned char *top = (unsigned char *)__malloc_av_[2];
+  unsigned char *end = mbed_heap_start + mbed_heap_size;
+  if (top >= mbed_heap_start && top + sizeof(NewlibChunk) + head < end && (size_t)(end - top) - sizeof(NewlibChunk) > best)
+    best = (size_t)(end - top) - sizeof(NewlibChunk);
+  __malloc_unlock(_REENT);
+
+  *largest = best > head ? (uint32_t)(best - head) : 0;
+  return true;
+}
+#else
+static bool heapLargestFree(uint32_t *largest) {
+  *largest = 0;
+  return false;
+}
+#endif
+
+/**
+ * Snapshot of the heap, stack and CPU statistics of Mbed OS, rendered as
+ * telemetry keys so memory growth can be seen before a device crashes:
+ *   heap_used, heap_peak, heap_free    bytes
+ *   heap_largest                       largest block that can be allocated
+ *   heap_frag                          % of the free heap not in the largest block
+ *   heap_fails                         failed allocations since boot
+ *   cpu_idle                           % of the time idle since the last snapshot
+ *   stack_<thread>                     bytes of the stack never used (high water mark)
+ * Needs platform.all-stats-enabled (or the heap, thread and CPU stats) and
+ * MBED_HEAP_STATS_ENABLED. heap_largest and heap_frag are only sent with
+ * the malloc of newlib (GCC_ARM), collect() walks its free chunks.
+ */
+template <size_t THREADS = 8>
+class HealthReport {
+public:
+  HealthReport() : _largest(0), _largest_known(false), _threads(0), _idle_permille(0), _last_uptime(0), _last_idle(0) {
+    memset(&_heap, 0, sizeof(_heap));
+  }
+
+  void collect() {
+    mbed_stats_heap_get(&_heap);
+    _largest_known = heapLargestFree(&_largest);
+
+    _threads = mbed_stats_thread_get_each(_thread, THREADS);
+
+    mbed_stats_cpu_t cpu;
+    mbed_stats_cpu_get(&cpu);
+    uint64_t uptime = cpu.uptime - _last_uptime;
+    uint64_t idle = cpu.idle_time - _last_idle;
+    _idle_permille = uptime ? (uint32_t)(idle * 1000 / uptime) : 0;
+    _last_uptime = cpu.uptime;
+    _last_idle = cpu.idle_time;
+  }
+
+  uint32_t heap_free() const { return _heap.reserved_size - _heap.current_size; }
+  // % of the free heap that can not be allocated in one block
+  uint32_t heap_fragmentation() const {
+    uint32_t available = heap_free();
+    return available ? 100 - (uint32_t)((uint64_t)_largest * 100 / available) : 0;
+  }
+
+  template <typename W>
+  void render(W &w) const {
+    char name[24];
+
+    w.put("{\"heap_used\":%lu,\"heap_peak\":%lu,\"heap_free\":%lu,\"heap_fails\":%lu,\"cpu_idle\":%lu.%lu",
+      (unsigned long)_heap.current_size, (unsigned long)_heap.max_size, (unsigned long)heap_free(),
+      (unsigned long)_heap.alloc_fail_cnt, (unsigned long)_idle_permille / 10, (unsigned long)_idle_permille % 10);
+    if (_largest_known)
+      w.put(",\"heap_largest\":%lu,\"heap_frag\":%lu", (unsigned long)_largest, (unsigned long)heap_fragmentation());
+    for (size_t i = 0; i < _threads; i++)
+      w.put(",\"stack_%s\":%lu", threadName(i, name, sizeof(name)), (unsigned long)_thread[i].stack_space);
+    w.put("}");
+  }
+
+  void print() const {
+    char name[24];
+
+    printf("[HLTH] heap used %lu peak %lu free %lu, failed allocations %lu, cpu idle %lu.%lu%%\n",
+      (unsigned long)_heap.current_size, (unsigned long)_heap.max_size, (unsigned long)heap_free(),
+      (unsigned long)_heap.alloc_fail_cnt, (unsigned long)_idle_permille / 10, (unsigned long)_idle_permille % 10);
+    if (_largest_known)
+      printf("[HLTH] heap largest free block %lu (%lu%% fragmented)\n", (unsigned long)_largest,
+        (unsigned long)heap_fragmentation());
+    for (size_t i = 0; i < _threads; i++)
+      printf("[HLTH] stack %-12s %5lu of %5lu bytes never used\n", threadName(i, name, sizeof(name)),
+        (unsigned long)_thread[i].stack_space, (unsigned long)_thread[i].stack_size);
+  }
+
+private:
+  // thread name usable as telemetry key
+  const char *threadName(size_t i, char *buf, size_t size) const {
+    const char *name = _thread[i].name;
+    size_t n = 0;
+
+    if (!name || !*name) {
+      snprintf(buf, size, "thread%u", (unsigned)i);
+      return buf;
+    }
+    for (; name[n] && n < size - 1; n++)
+      buf[n] = isalnum((unsigned char)name[n]) ? name[n] : '_';
+    buf[n] = '\0';
+    return buf;
+  }
+
+  mbed_stats_heap_t _heap;
+  uint32_t _largest;
+  bool _largest_known;
+  mbed_stats_thread_t _thread[THREADS];
+  size_t _threads;
+  uint32_t _idle_permille;
+  uint64_t _last_uptime;
+  uint64_t _last_idle;
+};
+
+#endif // _HEALTH_REPORT_H_
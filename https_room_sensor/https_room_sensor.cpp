@@ -11,7 +11,25 @@
 #include "mbed_error.h"
 #include "mbed_fault_handler.h"
 #include "network-helper.h"
-#include "ThingsBoard.h"
+#include "tls-connection.h"
+#include "tls-trust-store.h"
+#include "sntp-helper.h"
+#include "telemetry-log.h"
+#include "telemetry-batch.h"
+#include "telemetry-aggregate.h"
+#include "telemetry-deadband.h"
+#include "telemetry-cbor.h"
+#include "telemetry-schema.h"
+#include "upload-scheduler.h"
+#include "reconnect-backoff.h"
+#include "connection-recovery.h"
+#include "dns-cache.h"
+#include "phase-trace.h"
+#include "health-report.h"
+#include "thingsboard-stream.h"
+#include "sensor-sampler.h"
+#include "sensor-async.h"
+#include "FlashIAPBlockDevice.h"
 #include "SparkFunHTU21D.h"
 #include "SparkFun_SGP40_Arduino_Library.h"
 #include "Adafruit_TSL2591.h"
@@ -21,10 +39,46 @@
 
 #include "mbed_crash_data_offsets.h"
 
-// wait WRITEINTERAL seconds between each writing to ThingsBoard - sensor reading is done once per second, mainly neccessary for SGP40
+// wait UPLOAD_INTERVAL_MIN to UPLOAD_INTERVAL_MAX seconds between each writing to ThingsBoard - sensor reading is done once per second, mainly neccessary for SGP40
+// the interval is short while values change fast and long while they are stable or the uploads fail
+// all samples of the interval are sent with one request
 // wait WRITEINTERAL_STARTUP seconds before writing the first time - ca. 2min needed by SGP40 to get first correct values
-#define WRITEINTERAL 15
+#define UPLOAD_INTERVAL_MIN 5
+#define UPLOAD_INTERVAL_MAX 60
 #define WRITEINTERAL_STARTUP 120
+// failed connections are retried with exponential backoff, escalating every RECONNECT_ATTEMPTS failures
+// from reopening the socket to resolving the host, reconnecting the interface and finally a reset,
+// the samples of this time are kept in the flash log
+#define RECONNECT_BASE_MS 2000
+#define RECONNECT_MAX_MS 300000
+#define RECONNECT_ATTEMPTS 3
+
+// flash log for telemetry that could not be uploaded: last two 256 KB sectors of the NUCLEO_F767ZI flash
+#define LOG_FLASH_ADDRESS 0x08180000
+#define LOG_FLASH_SIZE    0x80000
+// the log is uploaded in batches of LOG_BATCH samples, at most LOG_MAX_BATCHES per write interval
+#define LOG_BATCH 32
+#define LOG_MAX_BATCHES 4
+// min/max/mean of the samples are sent every AGGREGATE_WINDOW seconds, so peaks between uploads are kept,
+// windows that could not be sent are kept in RAM, the last AGGREGATE_KEEP - 1 of them
+#define AGGREGATE_WINDOW 60
+#define AGGREGATE_KEEP 32
+// print the latency of the upload phases every TRACE_REPORT uploads, and send it as telemetry if TRACE_TELEMETRY is 1
+#define TRACE_REPORT 20
+#define TRACE_TELEMETRY 1
+// set to 1 to print the CPU cycles of formatNumber() and snprintf() at boot
+#define BENCHMARK_NUMBERS 0
+// send heap, stack and cpu statistics with the first upload after boot and then every HEALTH_INTERVAL seconds
+#define HEALTH_INTERVAL 3600
+// set to 1 to upload the samples as CBOR with indexed keys (about a quarter of the JSON), the receiver
+// has to decode it, e.g. an ingest proxy, the http api of ThingsBoard itself only accepts JSON
+#define TELEMETRY_CBOR 0
+// batches of about COMPRESS_MIN_BYTES and more (COMPRESS_ROW_BYTES per row) are sent gzip compressed, mostly
+// the backlog after an outage, with 0 nothing is compressed. Servers answering 415 get everything uncompressed.
+#define COMPRESS_MIN_BYTES 1024
+#define COMPRESS_ROW_BYTES 90
+// time the MH-Z19 gets to answer a request, counted from the start of the sampling cycle
+#define MHZ19_TIMEOUT_MS 200
 
 #define PRINT_STR_REPEAT(str, times) \
 { \
@@ -77,10 +131,8 @@
 //"-----END CERTIFICATE-----\n";
 
 NetworkInterface *net;
-TLSSocket *socket;
-
-// Initialize ThingsBoard instance
-ThingsBoardHttps tb;
+// root CA parsed once and shared by all TLS sockets
+TLSTrustStore trust;
 
 I2C i2c(I2C_SDA , I2C_SCL );
 
@@ -91,6 +143,13 @@ MHZ19 myMHZ19;                         // create an instance of the MHZ19 class
 BufferedSerial rserMHZ19(PC_12, PD_2); // create serial port instance for MH-Z19
 DigitalIn myBtn(BUTTON1);             // Calibration user button
 int btnvalue; 
+bool bTSL2591 = true;
+bool bSGP40 = true;
+
+// the conversions of all sensors are started at once and collected when they are done
+HTU21Async asyncHTU21(i2c);
+TSL2591Async asyncTSL2591(i2c);
+MHZ19Async asyncMHZ19(rserMHZ19);
 
 #if MBED_CONF_PLATFORM_CRASH_CAPTURE_ENABLED
 mbed_error_status_t err_status;
@@ -113,6 +172,108 @@ void mbed_error_reboot_callback(mbed_error_ctx *error_context) {
 
 bool bBoot = true;
 
+// traced phases of the sampling and upload cycle
+enum {
+  TRACE_SENSORS = 0,
+  TRACE_DNS,
+  TRACE_CONNECT,    // TCP connect and TLS handshake
+  TRACE_REQUEST,    // request sent
+  TRACE_RESPONSE,   // waiting for and reading the response
+  TRACE_CYCLE,      // whole upload cycle
+  TRACE_PHASES
+};
+const char *const traceNames[TRACE_PHASES] = { "sensors", "dns", "connect", "request", "response", "cycle" };
+typedef PhaseTrace<TRACE_PHASES> UploadTrace;
+UploadTrace trace(traceNames);
+
+HealthReport<> health;
+uint32_t healthNext = 0;
+
+// one timestamped sample of all room sensor values, kept in the flash log while ThingsBoard is not reachable
+typedef TelemetryRow<5> RoomSample;
+
+const BatchKey roomKeys[5] = {
+  { "temperature",  2 },
+  { "humidity",     2 },
+  { "VOCindex",     0 },
+  { "CO2",          0 },
+  { "light",        1 },
+};
+
+// samples of the current write interval
+TelemetryBatch<5, UPLOAD_INTERVAL_MAX> batch(roomKeys);
+#if TELEMETRY_CBOR
+TelemetryCbor<5> batchCbor(roomKeys, CBOR_INDEXED);
+#endif
+
+// reset reason and error of the last crash, sent with the first upload after boot
+constexpr char kReason[] = "reason";
+constexpr char kErrorStatus[] = "errorstatus";
+constexpr char kErrorAddress[] = "erroraddress";
+typedef SchemaKey<kReason, uint32_t> ResetReasonKey;
+typedef SchemaKey<kErrorStatus, uint32_t> ErrorStatusKey;
+typedef SchemaKey<kErrorAddress, uint32_t> ErrorAddressKey;
+TelemetrySchema<ResetReasonKey, ErrorStatusKey, ErrorAddressKey> bootStatus;
+
+// statistics sent per key for each aggregation window, e.g. CO2_max or temperature_mean
+const uint8_t roomAggregates[5] = {
+  AGG_MIN | AGG_MAX | AGG_MEAN,             // temperature
+  AGG_MEAN,                                 // humidity
+  AGG_MAX | AGG_MEAN,                       // VOCindex
+  AGG_MIN | AGG_MAX | AGG_MEAN | AGG_STDDEV, // CO2
+  AGG_MEAN,                                 // light
+};
+TelemetryAggregate<5> aggregate(roomKeys, roomAggregates, AGGREGATE_WINDOW);
+AggregateQueue<5, AGGREGATE_KEEP> windows;
+// values are only uploaded if they changed by more than the deadband, but at least every 5 minutes
+const DeadbandKey roomDeadbands[5] = {
+  { 0.1f,  300 },   // temperature
+  { 0.5f,  300 },   // humidity
+  { 5.0f,  300 },   // VOCindex
+  { 20.0f, 300 },   // CO2
+  { 10.0f, 300 },   // light
+};
+TelemetryDeadband<5> deadband(roomDeadbands);
+
+// change per second that counts as fast and shortens the upload interval
+const float roomScales[5] = {
+  0.05f,  // temperature
+  0.2f,   // humidity
+  2.0f,   // VOCindex
+  5.0f,   // CO2
+  20.0f,  // light
+};
+const SchedulerConfig schedulerConfig = {
+  UPLOAD_INTERVAL_MIN,
+  UPLOAD_INTERVAL_MAX,
+  0.1f,   // smoothing
+  2000,   // uploads slower than 2 s lengthen the interval
+  4.0f,   // failing uploads make the interval four times longer
+};
+UploadScheduler<5> scheduler(schedulerConfig, roomScales);
+
+// CPU cycles spent in aggregate.add()
+uint32_t aggregateCycles = 0;
+uint32_t aggregateSamples = 0;
+
+// batches are streamed to ThingsBoard in chunks of this buffer
+char streambuf[512];
+ThingsBoardStream tbs(streambuf, sizeof(streambuf));
+#if COMPRESS_MIN_BYTES
+// 4.6 KB of RAM, compresses a backlog batch of JSON to about a quarter
+DeflateStream<> deflate;
+#endif
+
+const BackoffConfig backoffConfig = { RECONNECT_BASE_MS, RECONNECT_MAX_MS, RECONNECT_ATTEMPTS };
+ReconnectBackoff backoff(backoffConfig, HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2());
+
+// addresses of ThingsBoard, refreshed in the background every 5 minutes
+DnsCache<4> dns(NULL, THINGSBOARD_HOST, THINGSBOARD_PORT, 300);
+
+FlashIAPBlockDevice logbd(LOG_FLASH_ADDRESS, LOG_FLASH_SIZE);
+TelemetryLog<RoomSample> backlog(&logbd);
+bool bLog = true;
+
 /**************************************************************************/
 /*
     Configures the gain and integration time for the TSL2591
@@ -154,17 +315,291 @@ void configureSensorTSL2591(void) {
 
 /**************************************************************************/
 /*
-    read IR and Full Spectrum at once and convert to lux
+    read IR and Full Spectrum of the last integration and convert to lux,
+    the TSL2591 integrates continuously so there is no need to wait
 */
 /**************************************************************************/
-float readLux(void) {
-  // More advanced data read example. Read 32 bits with top 16 bits IR, bottom 16 bits full spectrum
-  // That way you can do whatever math and comparisons you want!
-  uint32_t lum = myTSL2591.getFullLuminosity();
+bool readLux(float &lux) {
   uint16_t ir, full;
-  ir = lum >> 16;
-  full = lum & 0xFFFF;
-  return myTSL2591.calculateLux(full, ir);
+  if (!asyncTSL2591.read(full, ir))
+    return false;
+  lux = myTSL2591.calculateLux(full, ir);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    read all sensors, called once per second in the sampler thread
+    all conversions run at the same time, so a cycle takes about as long as
+    the HTU21 conversions plus the SGP40 measurement instead of the sum of all
+    conversion times. Values that could not be read keep the last reading.
+*/
+/**************************************************************************/
+void readSensors(RoomSample &sample) {
+  TraceSpan<UploadTrace> span(trace, TRACE_SENSORS);
+  static float fTemp = 0.0f;
+  static float fHum = 0.0f;
+  static int32_t iCO2 = 0;
+  static float fLux = 0.0f;
+  int32_t iVOC = 0;
+  Timer cycle;
+
+  cycle.start();
+  // the MH-Z19 answer is received by BufferedSerial in the background
+  asyncMHZ19.request();
+  bool bHTU21 = asyncHTU21.startTemperature();
+  if(bTSL2591)
+    readLux(fLux);
+
+  if(bHTU21) {
+    ThisThread::sleep_for(std::chrono::milliseconds(HTU21Async::TEMPERATURE_MS));
+    for(int i = 0; i < 5 && !asyncHTU21.readTemperature(fTemp); i++)
+      ThisThread::sleep_for(std::chrono::milliseconds(5));
+    asyncHTU21.startHumidity();
+    ThisThread::sleep_for(std::chrono::milliseconds(HTU21Async::HUMIDITY_MS));
+    for(int i = 0; i < 5 && !asyncHTU21.readHumidity(fHum); i++)
+      ThisThread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  // the VOC index is compensated with the current temperature and humidity
+  if(bSGP40)
+    iVOC = mySGP40.getVOCindex(fHum, fTemp);
+
+  while(!asyncMHZ19.collect(iCO2) && cycle.elapsed_time() < std::chrono::milliseconds(MHZ19_TIMEOUT_MS))
+    ThisThread::sleep_for(std::chrono::milliseconds(5));
+
+  sample.ts = sntp_time_valid()?(uint32_t)time(NULL):0;
+  sample.values[0] = fTemp;
+  sample.values[1] = fHum;
+  sample.values[2] = (float)iVOC;
+  sample.values[3] = (float)iCO2;
+  sample.values[4] = fLux;
+
+  if(myBtn.read() == true && btnvalue == false) {
+    myMHZ19.calibrate();
+    printf("start calibration\n");
+  }
+  btnvalue = myBtn.read();
+}
+
+// reads the sensors every second independent of the uploads, the SGP40 VOC algorithm depends on that
+SensorSampler<RoomSample, 64> sampler(readSensors, std::chrono::milliseconds(1000));
+
+/**************************************************************************/
+/*
+    finish a chunked http request, trace its phases and close the connection if the server wants to
+*/
+/**************************************************************************/
+bool endUpload(TLSConnection &tls) {
+  int status = tbs.end();
+  trace.add(TRACE_REQUEST, tbs.request_us());
+  if (tbs.response_us())
+    trace.add(TRACE_RESPONSE, tbs.response_us());
+  if (!tbs.keep_alive())
+    tls.close();
+  if (status != 200)
+    printf("ThingsBoard upload returned %d\n", status);
+  return status == 200;
+}
+
+/**************************************************************************/
+/*
+    upload samples (the current batch if rows is NULL) with one chunked http request
+*/
+/**************************************************************************/
+bool sendRows(TLSConnection &tls, const RoomSample *rows, size_t n, bool gzip) {
+#if TELEMETRY_CBOR
+  if (tbs.beginTelemetry(tls.socket(), "application/cbor", gzip) == NSAPI_ERROR_OK) {
+    if (rows)
+      batchCbor.render(tbs, rows, n);
+    else
+      batchCbor.render(tbs, batch);
+  }
+#else
+  if (tbs.beginTelemetry(tls.socket(), "application/json", gzip) == NSAPI_ERROR_OK) {
+    if (rows)
+      batch.render(tbs, rows, n);
+    else
+      batch.render(tbs);
+  }
+#endif
+  return endUpload(tls);
+}
+
+/**************************************************************************/
+/*
+    upload samples, large batches compressed if the server accepts it
+*/
+/**************************************************************************/
+bool sendRows(TLSConnection &tls, const RoomSample *rows, size_t n) {
+  size_t count = rows ? n : batch.count();
+  bool gzip = COMPRESS_MIN_BYTES && count * COMPRESS_ROW_BYTES >= COMPRESS_MIN_BYTES && tbs.compression();
+
+  bool ok = sendRows(tls, rows, n, gzip);
+  if (ok && gzip && tbs.uncompressed())
+    printf("Compressed %lu to %lu bytes\n", (unsigned long)tbs.uncompressed(), (unsigned long)tbs.bytes());
+  // refused with 415, send it again uncompressed, on the same connection if it is still open
+  if (!ok && gzip && tbs.gzip_refused() && tls.socket())
+    ok = sendRows(tls, rows, n, false);
+  return ok;
+}
+
+/**************************************************************************/
+/*
+    upload the statistics of an aggregation window with one chunked http request
+*/
+/**************************************************************************/
+bool sendAggregate(TLSConnection &tls, const TelemetryAggregate<5> &window) {
+  if (tbs.beginTelemetry(tls.socket()) == NSAPI_ERROR_OK)
+    window.render(tbs);
+  return endUpload(tls);
+}
+
+/**************************************************************************/
+/*
+    upload the closed aggregation windows, the oldest first, a window that
+    could not be sent is kept for the next upload
+*/
+/**************************************************************************/
+void sendWindows(TLSConnection &tls) {
+  while (!windows.empty() && tls.socket()) {
+    if (!sendAggregate(tls, windows.front())) {
+      printf("error sending statistics, %u windows kept\n", (unsigned)windows.size());
+      return;
+    }
+    printf("Sent statistics of %lu samples\n", (unsigned long)windows.front().samples());
+    windows.pop();
+  }
+}
+
+/**************************************************************************/
+/*
+    upload the heap, stack and cpu statistics
+*/
+/**************************************************************************/
+bool sendHealth(TLSConnection &tls) {
+  if (tbs.beginTelemetry(tls.socket()) == NSAPI_ERROR_OK)
+    health.render(tbs);
+  return endUpload(tls);
+}
+
+/**************************************************************************/
+/*
+    upload the reset reason and the error of the last crash
+*/
+/**************************************************************************/
+bool sendBootStatus(TLSConnection &tls) {
+  if (tbs.beginTelemetry(tls.socket()) == NSAPI_ERROR_OK)
+    bootStatus.render(tbs);
+  return endUpload(tls);
+}
+
+/**************************************************************************/
+/*
+    upload the latency summary of the traced phases
+*/
+/**************************************************************************/
+bool sendTrace(TLSConnection &tls) {
+  if (tbs.beginTelemetry(tls.socket()) == NSAPI_ERROR_OK)
+    trace.render(tbs);
+  return endUpload(tls);
+}
+
+/**************************************************************************/
+/*
+    add a sample to the aggregation window, counts the CPU cycles needed
+*/
+/**************************************************************************/
+void aggregateSample(const RoomSample &sample) {
+  uint32_t start = DWT->CYCCNT;
+  aggregate.add(sample);
+  aggregateCycles += DWT->CYCCNT - start;
+  aggregateSamples++;
+}
+
+#if BENCHMARK_NUMBERS
+/**************************************************************************/
+/*
+    CPU cycles per value of formatNumber() and snprintf() for the decimals of the room keys
+*/
+/**************************************************************************/
+void benchmarkNumbers() {
+  char text[NUMBER_TEXT_MAX];
+  volatile size_t sink = 0;
+
+  for (size_t k = 0; k < 5; k++) {
+    uint32_t start = DWT->CYCCNT;
+    for (int i = 0; i < 100; i++)
+      sink += formatNumber(text, 21.0f + i * 7.13f, roomKeys[k].decimals);
+    uint32_t fast = DWT->CYCCNT - start;
+    start = DWT->CYCCNT;
+    for (int i = 0; i < 100; i++)
+      sink += snprintf(text, sizeof(text), "%.*f", roomKeys[k].decimals, (double)(21.0f + i * 7.13f));
+    uint32_t slow = DWT->CYCCNT - start;
+    printf("Number format %s: %lu cycles, snprintf %lu cycles\n", roomKeys[k].key,
+      (unsigned long)fast / 100, (unsigned long)slow / 100);
+  }
+}
+#endif
+
+/**************************************************************************/
+/*
+    upload the samples kept in the flash log in batches
+*/
+/**************************************************************************/
+void uploadBacklog(TLSConnection &tls) {
+  static RoomSample samples[LOG_BATCH];
+
+  for (int i = 0; i < LOG_MAX_BATCHES && backlog.pending() > 0 && tls.socket(); i++) {
+    size_t n = backlog.peek(samples, LOG_BATCH);
+    if (n > 0 && !sendRows(tls, samples, n)) {
+      printf("error sending backlog\n");
+      return;
+    }
+    backlog.consume();
+    printf("Sent %u samples from backlog, %lu left\n", (unsigned)n, (unsigned long)backlog.pending());
+  }
+}
+
+/**************************************************************************/
+/*
+    keep the samples of the current batch in the flash log, their values
+    only count as sent for the deadband if they were stored
+*/
+/**************************************************************************/
+void storeBatch(void) {
+  bool stored = bLog;
+  for (size_t i = 0; i < batch.count() && stored; i++)
+    stored = backlog.append(batch.row(i)) == BD_ERROR_OK;
+  if (!stored) {
+    if (bLog)
+      printf("error storing samples in flash log\n");
+    deadband.rollback();
+    return;
+  }
+  deadband.commit();
+  printf("%u samples stored in flash log, %lu pending\n", (unsigned)batch.count(), (unsigned long)backlog.pending());
+}
+
+/**************************************************************************/
+/*
+    milliseconds since boot, for the reconnect backoff
+*/
+/**************************************************************************/
+uint32_t uptimeMs(void) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Kernel::Clock::now().time_since_epoch()).count();
+}
+
+/**************************************************************************/
+/*
+    store the error in the crash data and reset, the error is sent after the reboot
+*/
+/**************************************************************************/
+void resetWithError(nsapi_error_t error, uint32_t address) {
+  MBED_CRASH_DATA.error.context.error_status = error;
+  MBED_CRASH_DATA.error.context.error_address = address;
+  thread_sleep_for(1000);
+  system_reset();
 }
 
 std::string reset_reason_to_string(const reset_reason_t reason) {
@@ -186,27 +621,17 @@ int main() {
   SocketAddress adr;
   nsapi_error_t result;
   bool bret;
-  bool bTSL2591 = true;
-  bool bSGP40 = true;
-  float fTemp, fHum, fLux;
-  int32_t iVOC, iCO2;
+  RoomSample sample;
   int writeCounter = 0;
+  uint32_t uptime;
   // wait WRITEINTERAL_STARTUP seconds before writing the first time - ca. 2min needed by SGP40 to get first correct values
   int writeinterval = WRITEINTERAL_STARTUP; 
+  bool bWarmup = true;
+  bool bConnect;
+  uint32_t cycleStart, traceStart;
+  int traceUploads = 0;
+  Timer uploadTimer;
   
-  Telemetry data1[5] = {
-    { "temperature",  0.0 },
-    { "humidity",     0.0 },
-    { "VOCindex",     0 },
-    { "CO2",          0 },
-    { "light",        0.0 },
-  };
-  Telemetry data2[3] = {
-    { "reason",  0 },
-    { "errorstatus",  0 },
-    { "erroraddress", 0 }
-  };
- 
 
   printf("\n");
 #ifdef MBED_MAJOR_VERSION
@@ -237,27 +662,63 @@ int main() {
 #endif
   
 
-  net = connect_to_default_network_interface();
-  if (!net) {
+  // retry with backoff, reset only if all recovery steps failed
+  while (!(net = connect_to_default_network_interface())) {
     printf("Error! No network interface found.\n");
-    MBED_CRASH_DATA.error.context.error_status = 0;
-    MBED_CRASH_DATA.error.context.error_address = 1;
-    thread_sleep_for(30000);
-    system_reset();
-    return -1;
+    if (backoff.failure(uptimeMs()) == ReconnectBackoff::STEP_RESET)
+      resetWithError(0, 1);
+    thread_sleep_for(backoff.delay_ms());
+  }
+  backoff.success();
+
+  dns.set_network(net);
+  while ((result = dns.resolve(uptimeMs() / 1000)) != NSAPI_ERROR_OK) {
+    printf("Error! dns.resolve returned: %d\n", result);
+    ReconnectBackoff::Step step = backoff.failure(uptimeMs());
+    if (step == ReconnectBackoff::STEP_RESET)
+      resetWithError(result, 2);
+    if (step == ReconnectBackoff::STEP_RECONNECT_INTERFACE) {
+      net->disconnect();
+      net->connect();
+    }
+    thread_sleep_for(backoff.delay_ms());
+  }
+  backoff.success();
+  dns.address(adr);
+  printf("%s resolved to %u addresses, using %s\n", THINGSBOARD_HOST, (unsigned)dns.count(), adr.get_ip_address());
+  
+  tbs.begin(TOKEN, THINGSBOARD_HOST);
+#if COMPRESS_MIN_BYTES
+  tbs.setCompression(&deflate);
+#endif
+
+  // timestamps are needed for samples uploaded from the flash log
+  if(!sntp_time_valid())
+    sntp_sync_time(net);
+
+  if(backlog.init() != BD_ERROR_OK) {
+    printf("Error! flash log not available\n");
+    bLog = false;
   }
 
-  result = net->gethostbyname(THINGSBOARD_HOST, &adr);
-  if (result != NSAPI_ERROR_OK ) {
-    printf("Error! net->gethostbyname returned: %d\n", result);
+  result = trust.init(SSL_CA_PEM);
+  if (result != NSAPI_ERROR_OK) {
+    printf("Error! trust.init(ssl_ca_pem) returned: %d\n", result);
     MBED_CRASH_DATA.error.context.error_status = result;
-    MBED_CRASH_DATA.error.context.error_address = 2;
+    MBED_CRASH_DATA.error.context.error_address = 4;
     thread_sleep_for(30000);
     system_reset();
   }
-  adr.set_port(THINGSBOARD_PORT);
-  
-  tb.begin(TOKEN, THINGSBOARD_HOST, THINGSBOARD_PORT);
+
+  // keep one TLS connection open over all uploads, resume the TLS session on reconnects
+  TLSConnection tls(net, THINGSBOARD_HOST, &trust);
+  TLSSessionCache tls_sessions;
+  tls.set_session_cache(&tls_sessions);
+#if TLS_SESSION_RETAIN_ENABLED
+  // after a warm reboot the session stored before system_reset() can be resumed
+  if(reason==RESET_REASON_SOFTWARE || reason==RESET_REASON_WATCHDOG)
+    printf("TLS session retained: %s\n", tls_sessions.load_retained()?"yes":"no");
+#endif
   
   printf("\n");
   
@@ -271,6 +732,8 @@ int main() {
   } else {
     /* Configure the sensor */
     configureSensorTSL2591();
+    // keep integrating, readLux() takes the result of the last integration
+    asyncTSL2591.start();
   }
 
   //Initialize air quality sensor SGP40
@@ -298,94 +761,170 @@ int main() {
 
   btnvalue = myBtn.read();
 
+  // cycle counter for measuring the aggregation and the number formatting
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#if BENCHMARK_NUMBERS
+  benchmarkNumbers();
+#endif
+
   printf("\n");
 
+  sampler.start();
+
   while(true) {
-    fTemp = myHTU21.readTemperature();
-    fHum = myHTU21.readHumidity();
-    int32_t iVOC = bSGP40?mySGP40.getVOCindex(fHum, fTemp):0;
-    int32_t iCO2 = myMHZ19.getCO2();
-    float fLux = bTSL2591?readLux():0.0f;
+    if(!sampler.wait(std::chrono::milliseconds(2000))) {
+      printf("no samples from sampler thread\n");
+      continue;
+    }
 
-    if(writeCounter >= writeinterval) {
-      socket = new TLSSocket();
-    
-      result = socket->open(net);
-      if (result != NSAPI_ERROR_OK) {
-        printf("Error! socket.open(net) returned: %d\n", result);
-        MBED_CRASH_DATA.error.context.error_status = result;
-        MBED_CRASH_DATA.error.context.error_address = 3;
-        thread_sleep_for(30000);
-        system_reset();
+    // the batch only keeps the last UPLOAD_INTERVAL_MAX samples, also during the SGP40 warm-up
+    while(writeCounter < writeinterval && sampler.pop(sample)) {
+      scheduler.sample(sample.values);
+      // a fast change shortens the running interval as well
+      if(!bWarmup && (int)scheduler.interval() < writeinterval)
+        writeinterval = scheduler.interval();
+      // the SGP40 values of the warm-up are not aggregated, a full window is closed whether the link is up or not
+      if(!bWarmup) {
+        aggregateSample(sample);
+        if(aggregate.complete()) {
+          uint32_t dropped = windows.dropped();
+          windows.close(aggregate);
+          if(windows.dropped() != dropped)
+            printf("statistics window dropped, %lu so far\n", (unsigned long)windows.dropped());
+        }
       }
+      // unchanged values are not uploaded
+      uptime = std::chrono::duration_cast<std::chrono::seconds>(Kernel::Clock::now().time_since_epoch()).count();
+      deadband.add(batch, sample, uptime);
+      writeCounter++;
+    }
 
-      result = socket->set_root_ca_cert(SSL_CA_PEM);
-      if (result != NSAPI_ERROR_OK) {
-        printf("Error! socket.set_root_ca_cert(ssl_ca_pem) returned: %d\n", result);
-        MBED_CRASH_DATA.error.context.error_status = result;
-        MBED_CRASH_DATA.error.context.error_address = 4;
-        thread_sleep_for(30000);
-        system_reset();
-      }
-      
-      socket->set_hostname(THINGSBOARD_HOST);
+    if(writeCounter >= writeinterval) {
+      writeCounter = 0;
 
-      result = socket->connect(adr);
+      uploadTimer.reset();
+      uploadTimer.start();
+      cycleStart = trace.start();
+
+      // refresh the address in the background before it expires, connects never wait for DNS
+      traceStart = trace.start();
+      dns.poll(uptimeMs() / 1000);
+      dns.address(adr);
+      trace.end(TRACE_DNS, traceStart);
+
+      // while backing off the samples go to the flash log without trying to connect
+      bConnect = backoff.ready(uptimeMs());
+      traceStart = trace.start();
+      result = bConnect ? tls.connect(adr) : NSAPI_ERROR_WOULD_BLOCK;
+      if(bConnect)
+        trace.end(TRACE_CONNECT, traceStart);
       if (result != NSAPI_ERROR_OK) {
-        printf("Error! socket.connect(adr) Failed (%d).\n", result);
-        MBED_CRASH_DATA.error.context.error_status = result;
-        MBED_CRASH_DATA.error.context.error_address = 5;
-        thread_sleep_for(30000);
-        system_reset();
-      }
-      
-      tb.setSocket(socket);
-
-      printf("Sending data...\n");
-
-      if(bBoot) {
-        printf("Sending error status ...\n");
-        if(reboot_error_happened) {
-          data2[0].setValue(reason);
-          data2[1].setValue((uint32_t)err_status);
-          data2[2].setValue((uint32_t)error_address);
-          bret = tb.sendTelemetry(data2, 3);
-          if(!bret) printf("error sending telemetry\n");
+        // keep the samples, they are uploaded from the flash log when ThingsBoard is reachable again
+        storeBatch();
+        if(bConnect) {
+          printf("Error! tls.connect(adr) Failed in step %d (%d).\n", tls.failed_step(), result);
+          scheduler.uploaded(false, 0);
+          if(recoverConnection(backoff, uptimeMs(), tls, dns, net, adr) == ReconnectBackoff::STEP_RESET)
+            // 3: socket open, 5: connect
+            resetWithError(result, tls.failed_step()==TLSConnection::STEP_OPEN?3:5);
+        }
+      } else {
+        backoff.success();
+
+        if(!sntp_time_valid())
+          sntp_sync_time(net);
+
+        printf("Sending data...\n");
+
+        if(bBoot) {
+          printf("Sending error status ...\n");
+          if(reboot_error_happened) {
+            bootStatus.setValue<ResetReasonKey>((uint32_t)reason);
+            bootStatus.setValue<ErrorStatusKey>((uint32_t)err_status);
+            bootStatus.setValue<ErrorAddressKey>(error_address);
+            bret = sendBootStatus(tls);
+            if(!bret) printf("error sending telemetry\n");
+          } else {
+            bootStatus.setValue<ResetReasonKey>((uint32_t)reason);
+            bootStatus.setValue<ErrorStatusKey>(reason==RESET_REASON_SOFTWARE?(uint32_t)MBED_CRASH_DATA.error.context.error_status:0u);
+            bootStatus.setValue<ErrorAddressKey>(reason==RESET_REASON_SOFTWARE?(uint32_t)MBED_CRASH_DATA.error.context.error_address:0u);
+            bret = sendBootStatus(tls);
+            if(!bret) printf("error sending telemetry\n");
+          }
+          reboot_error_happened = false;
+          bBoot = false;
+          mbed_reset_reboot_error_info();
+        }
+
+        // Uploads the timestamped samples of the write interval to ThingsBoard using http
+        // nothing to send if no value changed in this interval
+        bret = batch.count() == 0 || sendRows(tls, NULL, 0);
+        if(!bret && tls.reconnect(adr) == NSAPI_ERROR_OK) {
+          // the server may have closed the connection right before the request
+          bret = sendRows(tls, NULL, 0);
+        }
+        scheduler.uploaded(bret, std::chrono::duration_cast<std::chrono::milliseconds>(uploadTimer.elapsed_time()).count());
+        if(!bret) {
+          printf("error sending telemetry\n");
+          storeBatch();
         } else {
-          data2[0].setValue(reason);
-          data2[1].setValue(reason==RESET_REASON_SOFTWARE?MBED_CRASH_DATA.error.context.error_status:0);
-          data2[2].setValue(reason==RESET_REASON_SOFTWARE?MBED_CRASH_DATA.error.context.error_address:0);
-          bret = tb.sendTelemetry(data2, 3);
-          if(!bret) printf("error sending telemetry\n");
+          deadband.commit();
+          if(batch.count())
+            printf("Sent %u samples with one request (%lu bytes)\n", (unsigned)batch.count(), (unsigned long)tbs.bytes());
+          printf("Deadband: %lu of %lu values sent (%.1f:1)\n", (unsigned long)deadband.values_out(),
+            (unsigned long)deadband.values_in(), deadband.ratio());
+
+          // the windows closed since the last successful upload
+          sendWindows(tls);
+
+          // low rate, the first report goes next to the boot record
+          if((int32_t)(uptimeMs() / 1000 - healthNext) >= 0) {
+            health.collect();
+            health.print();
+            if(sendHealth(tls))
+              healthNext = uptimeMs() / 1000 + HEALTH_INTERVAL;
+            else
+              printf("error sending health report\n");
+          }
+
+          if(bLog) uploadBacklog(tls);
+
+          if(++traceUploads >= TRACE_REPORT) {
+            trace.print();
+#if TRACE_TELEMETRY
+            if(!sendTrace(tls))
+              printf("error sending trace\n");
+#endif
+            trace.reset();
+            traceUploads = 0;
+          }
         }
-        reboot_error_happened = false;
-        bBoot = false;
-        mbed_reset_reboot_error_info();
+        
+        printf("TLS handshakes: %lu (full: %lu, resumed: %lu), connection reused: %lu\n",
+          (unsigned long)tls.handshakes(), (unsigned long)tls_sessions.full_handshakes(),
+          (unsigned long)tls_sessions.resumed_handshakes(), (unsigned long)tls.reuses());
       }
-
-      // Uploads new telemetry to ThingsBoard using http
-      data1[0].setValue(fTemp);
-      data1[1].setValue(fHum);
-      data1[2].setValue(iVOC);
-      data1[3].setValue(iCO2);
-      data1[4].setValue(fLux);
-      bret = tb.sendTelemetry(data1, 5);
-      if(!bret) printf("error sending telemetry\n");
       
-      socket->~TLSSocket();
-      writeCounter = 0;
-      
-      // start writing to Thingsboard every WRITEINTERAL second
-      writeinterval = WRITEINTERAL;
-    }
+      batch.clear();
+      trace.end(TRACE_CYCLE, cycleStart);
+
+      SamplerStats stats = sampler.stats();
+      printf("Sampling: %lu samples, %lu dropped, jitter mean %lu us max %lu us, sensor read mean %lu us max %lu us\n",
+        (unsigned long)stats.samples, (unsigned long)stats.dropped, (unsigned long)stats.jitter_mean_us,
+        (unsigned long)stats.jitter_max_us, (unsigned long)stats.read_mean_us, (unsigned long)stats.read_max_us);
+      if(aggregateSamples) {
+        printf("Aggregation: %lu cycles per sample\n", (unsigned long)(aggregateCycles / aggregateSamples));
+        aggregateCycles = 0;
+        aggregateSamples = 0;
+      }
 
-    if(myBtn.read() == true && btnvalue == false) {
-      myMHZ19.calibrate();
-      printf("start calibration\n");
+      // the next upload depends on how fast the values change and how well the uploads go
+      bWarmup = false;
+      writeinterval = scheduler.interval();
+      printf("Next upload in %d s (activity %.2f, failure rate %.2f, latency %.0f ms)\n",
+        writeinterval, scheduler.activity(), scheduler.failure_rate(), scheduler.latency_ms());
     }
-    btnvalue = myBtn.read();
-    
-    writeCounter++;
-    thread_sleep_for(1000);
   }
 }
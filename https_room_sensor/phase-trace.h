@@ -0,0 +1,161 @@
+#ifndef _PHASE_TRACE_H_
+#define _PHASE_TRACE_H_
+
+#include "mbed.h"
+
+// statistics of one phase since the last reset
+typedef struct {
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint64_t sum_us;
+  uint16_t histogram[24];   // bucket i counts durations below 2^(i+1) us, the last one all longer
+} PhaseStats;
+
+/**
+ * Lightweight latency tracing: a span is two reads of a Timer that runs
+ * from construction (microseconds, wrapping after 71 minutes), the duration is added to a log2 histogram and min/max/sum of its
+ * phase and written to a fixed ring of the last RING spans for debugging.
+ * No heap is used and a span costs well below a microsecond of CPU time,
+ * so the upload path can be traced permanently. Spans can be ended from
+ * any thread.
+ *
+ *   uint32_t start = trace.start();
+ *   ...
+ *   trace.end(PHASE_CONNECT, start);
+ */
+template <size_t PHASES, size_t RING = 32>
+class PhaseTrace {
+public:
+  static const size_t BUCKETS = 24;
+
+  typedef struct {
+    uint8_t phase;
+    uint32_t duration_us;
+  } Span;
+
+  PhaseTrace(const char *const *names) : _names(names), _next(0), _spans(0) {
+    reset();
+    _clock.start();
+  }
+
+  uint32_t start() const {
+    return (uint32_t)_clock.elapsed_time().count();
+  }
+
+  void end(size_t phase, uint32_t start) {
+    add(phase, this->start() - start);
+  }
+
+  // add a duration measured elsewhere, e.g. by the http client
+  void add(size_t phase, uint32_t duration_us) {
+    size_t bucket = duration_us ? 31 - __builtin_clz(duration_us) : 0;
+    if (bucket >= BUCKETS)
+      bucket = BUCKETS - 1;
+
+    CriticalSectionLock lock;
+    PhaseStats &s = _stats[phase];
+    if (s.count == 0 || duration_us < s.min_us)
+      s.min_us = duration_us;
+    if (duration_us > s.max_us)
+      s.max_us = duration_us;
+    s.count++;
+    s.sum_us += duration_us;
+    if (s.histogram[bucket] < 0xFFFF)
+      s.histogram[bucket]++;
+
+    _ring[_next].phase = (uint8_t)phase;
+    _ring[_next].duration_us = duration_us;
+    _next = (_next + 1) % RING;
+    _spans++;
+  }
+
+  // upper bound of the bucket that contains the given percentile
+  uint32_t percentile(size_t phase, uint32_t percent) const {
+    const PhaseStats &s = _stats[phase];
+    uint32_t limit = (s.count * percent + 99) / 100;
+    uint32_t n = 0;
+
+    for (size_t i = 0; i < BUCKETS; i++) {
+      n += s.histogram[i];
+      if (n >= limit && n > 0)
+        return i + 1 < BUCKETS ? (2u << i) - 1 : s.max_us;
+    }
+    return s.max_us;
+  }
+
+  const PhaseStats &stats(size_t phase) const { return _stats[phase]; }
+  uint32_t mean(size_t phase) const { return _stats[phase].count ? (uint32_t)(_stats[phase].sum_us / _stats[phase].count) : 0; }
+
+  // the i-th newest span of the ring, false if there is none
+  bool span(size_t i, Span &s) const {
+    if (i >= RING || i >= _spans)
+      return false;
+    s = _ring[(_next + RING - 1 - i) % RING];
+    return true;
+  }
+
+  void reset() {
+    CriticalSectionLock lock;
+    memset(_stats, 0, sizeof(_stats));
+  }
+
+  void print() const {
+    for (size_t p = 0; p < PHASES; p++) {
+      const PhaseStats &s = _stats[p];
+      if (s.count)
+        printf("[TRCE] %-10s n %4lu  min %8lu  mean %8lu  p90 < %8lu  max %8lu us\n", _names[p],
+          (unsigned long)s.count, (unsigned long)s.min_us, (unsigned long)mean(p),
+          (unsigned long)percentile(p, 90), (unsigned long)s.max_us);
+    }
+  }
+
+  /**
+   * Render a summary as telemetry keys <phase>_mean_us, <phase>_p90_us and
+   * <phase>_max_us into a writer with a printf like put().
+   */
+  template <typename W>
+  void render(W &w) const {
+    bool first = true;
+
+    w.put("{");
+    for (size_t p = 0; p < PHASES; p++) {
+      if (!_stats[p].count)
+        continue;
+      w.put("%s\"%s_mean_us\":%lu,\"%s_p90_us\":%lu,\"%s_max_us\":%lu", first ? "" : ",",
+        _names[p], (unsigned long)mean(p), _names[p], (unsigned long)percentile(p, 90), _names[p],
+        (unsigned long)_stats[p].max_us);
+      first = false;
+    }
+    w.put("}");
+  }
+
+private:
+  const char *const *_names;
+  Timer _clock;
+  PhaseStats _stats[PHASES];
+  Span _ring[RING];
+  size_t _next;
+  uint32_t _spans;
+};
+
+/**
+ * Ends a span when it goes out of scope.
+ */
+template <typename T>
+class TraceSpan {
+public:
+  TraceSpan(T &trace, size_t phase) : _trace(trace), _phase(phase), _start(trace.start()) {
+  }
+
+  ~TraceSpan() {
+    _trace.end(_phase, _start);
+  }
+
+private:
+  T &_trace;
+  size_t _phase;
+  uint32_t _start;
+};
+
+#endif // _PHASE_TRACE_H_
@@ -0,0 +1,107 @@
+#ifndef _RECONNECT_BACKOFF_H_
+#define _RECONNECT_BACKOFF_H_
+
+#include <stdint.h>
+
+// timing of the ReconnectBackoff
+typedef struct {
+  uint32_t base_ms;            // delay after the first failure
+  uint32_t max_ms;             // the delay doubles up to this limit
+  uint8_t attempts_per_step;   // failures before escalating to the next recovery step
+} BackoffConfig;
+
+/**
+ * Recovery from connection failures without rebooting right away: every
+ * failure waits a jittered, exponentially growing delay, and after
+ * attempts_per_step failures the recovery escalates one step:
+ *   reopen the socket -> resolve the host again -> reconnect the interface -> reset
+ * A success returns to the first step. Pure logic, the caller performs the
+ * steps and passes in the time, so it can be tested with a simulated network.
+ */
+class ReconnectBackoff {
+public:
+  enum Step {
+    STEP_REOPEN_SOCKET = 0,
+    STEP_RESOLVE,
+    STEP_RECONNECT_INTERFACE,
+    STEP_RESET
+  };
+
+  ReconnectBackoff(const BackoffConfig &config, uint32_t seed = 1)
+    : _config(config), _seed(seed ? seed : 1), _step(STEP_REOPEN_SOCKET), _attempts(0),
+      _failures(0), _next_ms(0), _delay_ms(0) {
+  }
+
+  void success() {
+    _step = STEP_REOPEN_SOCKET;
+    _attempts = 0;
+    _failures = 0;
+    _delay_ms = 0;
+  }
+
+  /**
+   * Report a failed attempt at now_ms, returns the recovery step to perform
+   * before the next attempt. The next attempt is allowed at ready().
+   */
+  Step failure(uint32_t now_ms) {
+    _failures++;
+    if (++_attempts > _config.attempts_per_step && _step != STEP_RESET) {
+      _step = (Step)(_step + 1);
+      _attempts = 1;
+    }
+
+    // full delay doubles per failure, the jitter spreads it over 50..100%
+    uint32_t delay = _config.base_ms;
+    for (uint32_t i = 1; i < _failures && delay < _config.max_ms; i++)
+      delay *= 2;
+    if (delay > _config.max_ms)
+      delay = _config.max_ms;
+    delay = delay / 2 + random() % (delay / 2 + 1);
+
+    _delay_ms = delay;
+    _next_ms = now_ms + delay;
+    return _step;
+  }
+
+  // true if the next attempt may be made at now_ms
+  bool ready(uint32_t now_ms) const {
+    return _failures == 0 || (int32_t)(now_ms - _next_ms) >= 0;
+  }
+
+  Step step() const { return _step; }
+  // failures since the last success
+  uint32_t failures() const { return _failures; }
+  uint32_t delay_ms() const { return _delay_ms; }
+
+  static const char *name(Step step) {
+    switch (step) {
+      case STEP_REOPEN_SOCKET:
+        return "reopen socket";
+      case STEP_RESOLVE:
+        return "resolve host";
+      case STEP_RECONNECT_INTERFACE:
+        return "reconnect interface";
+      default:
+        return "reset";
+    }
+  }
+
+private:
+  // xorshift32, deterministic for a given seed
+  uint32_t random() {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+  }
+
+  BackoffConfig _config;
+  uint32_t _seed;
+  Step _step;
+  uint8_t _attempts;
+  uint32_t _failures;
+  uint32_t _next_ms;
+  uint32_t _delay_ms;
+};
+
+#endif // _RECONNECT_BACKOFF_H_
@@ -0,0 +1,179 @@
+#ifndef _SENSOR_ASYNC_H_
+#define _SENSOR_ASYNC_H_
+
+#include "mbed.h"
+
+/**
+ * Split phase access to the room sensors: every conversion is started first
+ * and the result is collected later, so the conversions of all sensors run
+ * at the same time and the thread can sleep (or do other work) meanwhile.
+ * The drivers only cover measuring, setup and calibration are still done
+ * with the sensor libraries.
+ */
+
+/**
+ * HTU21D temperature/humidity in "no hold master" mode.
+ */
+class HTU21Async {
+public:
+  // maximum conversion times for 14 bit temperature and 12 bit humidity
+  static const int TEMPERATURE_MS = 50;
+  static const int HUMIDITY_MS = 16;
+
+  HTU21Async(I2C &i2c) : _i2c(i2c) {
+  }
+
+  bool startTemperature() {
+    return command(0xF3);
+  }
+
+  bool startHumidity() {
+    return command(0xF5);
+  }
+
+  // false if the conversion is not finished yet (the sensor does not acknowledge)
+  bool readTemperature(float &value) {
+    uint16_t raw;
+    if (!read(raw))
+      return false;
+    value = -46.85f + 175.72f * raw / 65536.0f;
+    return true;
+  }
+
+  bool readHumidity(float &value) {
+    uint16_t raw;
+    if (!read(raw))
+      return false;
+    value = -6.0f + 125.0f * raw / 65536.0f;
+    return true;
+  }
+
+private:
+  static const int ADDRESS = 0x40 << 1;
+
+  bool command(char cmd) {
+    return _i2c.write(ADDRESS, &cmd, 1) == 0;
+  }
+
+  bool read(uint16_t &raw) {
+    char buf[3];
+
+    if (_i2c.read(ADDRESS, buf, 3) != 0)
+      return false;
+    if (crc8(buf, 2) != (uint8_t)buf[2])
+      return false;
+    // the lowest two bits are status bits
+    raw = ((uint8_t)buf[0] << 8 | (uint8_t)buf[1]) & 0xFFFC;
+    return true;
+  }
+
+  // CRC-8 with polynomial x^8 + x^5 + x^4 + 1
+  static uint8_t crc8(const char *data, int len) {
+    uint8_t crc = 0;
+
+    for (int i = 0; i < len; i++) {
+      crc ^= (uint8_t)data[i];
+      for (int b = 0; b < 8; b++)
+        crc = crc & 0x80 ? (uint8_t)(crc << 1 ^ 0x31) : (uint8_t)(crc << 1);
+    }
+    return crc;
+  }
+
+  I2C &_i2c;
+};
+
+/**
+ * TSL2591 in continuous mode: the sensor integrates all the time,
+ * the channels of the last finished integration are read without waiting.
+ * Use Adafruit_TSL2591::calculateLux() for the conversion to lux.
+ */
+class TSL2591Async {
+public:
+  TSL2591Async(I2C &i2c) : _i2c(i2c) {
+  }
+
+  // power on and enable the ALS, gain and integration time are set with the library
+  bool start() {
+    char buf[2] = { (char)(COMMAND | 0x00), 0x03 };
+    return _i2c.write(ADDRESS, buf, 2) == 0;
+  }
+
+  // false if no integration has finished yet
+  bool read(uint16_t &full, uint16_t &ir) {
+    char reg = COMMAND | 0x13;
+    char buf[5];
+
+    // status register followed by C0DATAL, C0DATAH, C1DATAL, C1DATAH
+    if (_i2c.write(ADDRESS, &reg, 1, true) != 0 || _i2c.read(ADDRESS, buf, 5) != 0)
+      return false;
+    if (!(buf[0] & 0x01))
+      return false;
+    full = (uint8_t)buf[1] | (uint8_t)buf[2] << 8;
+    ir = (uint8_t)buf[3] | (uint8_t)buf[4] << 8;
+    return true;
+  }
+
+private:
+  static const int ADDRESS = 0x29 << 1;
+  static const char COMMAND = (char)0xA0;
+
+  I2C &_i2c;
+};
+
+/**
+ * MH-Z19 CO2 concentration over UART, the answer is collected by
+ * BufferedSerial in the background while the other sensors are measured.
+ */
+class MHZ19Async {
+public:
+  MHZ19Async(BufferedSerial &serial) : _serial(serial), _len(0) {
+  }
+
+  void request() {
+    static const uint8_t cmd[9] = { 0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79 };
+    uint8_t c;
+
+    // drop anything left over from earlier requests
+    while (_serial.readable())
+      _serial.read(&c, 1);
+    _len = 0;
+    _serial.write(cmd, sizeof(cmd));
+  }
+
+  // false as long as the answer is not complete
+  bool collect(int32_t &co2) {
+    while (true) {
+      while (_len < sizeof(_answer) && _serial.readable()) {
+        if (_serial.read(&_answer[_len], 1) != 1)
+          break;
+        // resynchronize on the start byte
+        if (_len > 0 || _answer[0] == 0xFF)
+          _len++;
+      }
+      if (_len < sizeof(_answer))
+        return false;
+
+      uint8_t sum = 0;
+      for (int i = 1; i < 8; i++)
+        sum += _answer[i];
+      if (_answer[1] == 0x86 && (uint8_t)(0xFF - sum + 1) == _answer[8])
+        break;
+
+      // not an answer, it may start at a later start byte of the bytes read
+      size_t start = 1;
+      while (start < _len && _answer[start] != 0xFF)
+        start++;
+      memmove(_answer, _answer + start, _len - start);
+      _len -= start;
+    }
+    co2 = _answer[2] << 8 | _answer[3];
+    return true;
+  }
+
+private:
+  BufferedSerial &_serial;
+  uint8_t _answer[9];
+  size_t _len;
+};
+
+#endif // _SENSOR_ASYNC_H_
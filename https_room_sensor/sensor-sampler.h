@@ -0,0 +1,122 @@
+#ifndef _SENSOR_SAMPLER_H_
+#define _SENSOR_SAMPLER_H_
+
+#include <stdlib.h>
+
+#include "mbed.h"
+#include "spsc-queue.h"
+
+// sampling statistics since the last call of SensorSampler::stats()
+typedef struct {
+  uint32_t samples;
+  uint32_t dropped;         // queue was full, the uploader did not keep up
+  uint32_t jitter_mean_us;  // mean deviation of the sampling interval from the period
+  uint32_t jitter_max_us;
+  uint32_t read_mean_us;    // mean time needed to read the sensors (cycle time)
+  uint32_t read_max_us;     // longest time needed to read the sensors
+} SamplerStats;
+
+/**
+ * Reads the sensors at a fixed rate in its own thread, independent of
+ * network uploads, and hands the samples over to the uploader through a
+ * lock-free single producer/single consumer queue of N - 1 samples.
+ * The sensors are read by the read callback, so the sampler can be run
+ * with simulated sensors as well. All sensors used by the callback must
+ * only be accessed from the sampler thread after start().
+ */
+template <typename T, size_t N>
+class SensorSampler {
+public:
+  SensorSampler(Callback<void(T &)> read, std::chrono::milliseconds period, uint32_t stack_size = 4096)
+    : _read(read), _period(period), _thread(osPriorityAboveNormal, stack_size, NULL, "sampler"),
+      _jitter_sum(0), _intervals(0), _read_sum(0), _last_us(0), _running(false) {
+    memset(&_stats, 0, sizeof(_stats));
+  }
+
+  void start() {
+    _timer.start();
+    _events.call_every(_period, callback(this, &SensorSampler::sample));
+    _thread.start(callback(&_events, &EventQueue::dispatch_forever));
+  }
+
+  // uploader: take the oldest sample, false if there is none
+  bool pop(T &item) {
+    return _queue.pop(item);
+  }
+
+  // uploader: wait until a sample is available, false on timeout
+  bool wait(std::chrono::milliseconds timeout) {
+    // the flag may be left over from samples that were popped already
+    _flags.clear(FLAG_SAMPLE);
+    if (!_queue.empty())
+      return true;
+    _flags.wait_any_for(FLAG_SAMPLE, timeout);
+    return !_queue.empty();
+  }
+
+  SamplerStats stats() {
+    SamplerStats s;
+
+    CriticalSectionLock lock;
+    s = _stats;
+    if (_intervals)
+      s.jitter_mean_us = _jitter_sum / _intervals;
+    if (s.samples)
+      s.read_mean_us = (uint32_t)(_read_sum / s.samples);
+    memset(&_stats, 0, sizeof(_stats));
+    _jitter_sum = 0;
+    _read_sum = 0;
+    _intervals = 0;
+    return s;
+  }
+
+private:
+  enum {
+    FLAG_SAMPLE = 1
+  };
+
+  void sample() {
+    uint32_t start = (uint32_t)_timer.elapsed_time().count();
+    T item;
+
+    _read(item);
+    uint32_t read = (uint32_t)_timer.elapsed_time().count() - start;
+
+    bool pushed = _queue.push(item);
+    _flags.set(FLAG_SAMPLE);
+
+    CriticalSectionLock lock;
+    if (_running) {
+      int32_t interval = (int32_t)(start - _last_us);
+      uint32_t jitter = abs(interval - (int32_t)std::chrono::microseconds(_period).count());
+      _jitter_sum += jitter;
+      _intervals++;
+      if (jitter > _stats.jitter_max_us)
+        _stats.jitter_max_us = jitter;
+    }
+    _last_us = start;
+    _running = true;
+    _stats.samples++;
+    if (!pushed)
+      _stats.dropped++;
+    _read_sum += read;
+    if (read > _stats.read_max_us)
+      _stats.read_max_us = read;
+  }
+
+  Callback<void(T &)> _read;
+  std::chrono::milliseconds _period;
+  Thread _thread;
+  EventQueue _events;
+  EventFlags _flags;
+  Timer _timer;
+  SpscQueue<T, N> _queue;
+  SamplerStats _stats;
+  uint32_t _jitter_sum;
+  uint32_t _intervals;
+  uint64_t _read_sum;
+  uint32_t _last_us;
+  bool _running;
+};
+
+#endif // _SENSOR_SAMPLER_H_
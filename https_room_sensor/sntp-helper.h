@@ -0,0 +1,63 @@
+#ifndef _SNTP_HELPER_H_
+#define _SNTP_HELPER_H_
+
+#include "mbed.h"
+#include "NetworkInterface.h"
+
+#define SNTP_SERVER "pool.ntp.org"
+// seconds between 1900-01-01 (NTP) and 1970-01-01 (Unix)
+#define SNTP_UNIX_OFFSET 2208988800UL
+// any earlier RTC value means the time was never set
+#define SNTP_VALID_TIME 1600000000UL
+
+/**
+ * Set the RTC from an SNTP server, needed for the timestamps of
+ * telemetry that is uploaded later than it was sampled.
+ */
+nsapi_error_t sntp_sync_time(NetworkInterface *net, const char *server = SNTP_SERVER) {
+  SocketAddress adr;
+  UDPSocket sock;
+  uint8_t packet[48];
+
+  nsapi_error_t result = net->gethostbyname(server, &adr);
+  if (result != NSAPI_ERROR_OK) {
+    printf("[SNTP] gethostbyname(%s) returned: %d\n", server, result);
+    return result;
+  }
+  adr.set_port(123);
+
+  result = sock.open(net);
+  if (result != NSAPI_ERROR_OK)
+    return result;
+  sock.set_timeout(5000);
+
+  // LI = 0, version 3, mode 3 (client)
+  memset(packet, 0, sizeof(packet));
+  packet[0] = 0x1B;
+
+  nsapi_size_or_error_t size = sock.sendto(adr, packet, sizeof(packet));
+  if (size < 0) {
+    sock.close();
+    return size;
+  }
+  size = sock.recvfrom(NULL, packet, sizeof(packet));
+  sock.close();
+  if (size < (nsapi_size_or_error_t)sizeof(packet)) {
+    printf("[SNTP] no valid answer from %s (%d)\n", server, size);
+    return size < 0 ? size : NSAPI_ERROR_DEVICE_ERROR;
+  }
+
+  // transmit timestamp, seconds part
+  uint32_t seconds = (uint32_t)packet[40] << 24 | (uint32_t)packet[41] << 16 |
+                     (uint32_t)packet[42] << 8 | (uint32_t)packet[43];
+  set_time((time_t)(seconds - SNTP_UNIX_OFFSET));
+  printf("[SNTP] time set to %lu\n", (unsigned long)(seconds - SNTP_UNIX_OFFSET));
+
+  return NSAPI_ERROR_OK;
+}
+
+bool sntp_time_valid() {
+  return time(NULL) >= (time_t)SNTP_VALID_TIME;
+}
+
+#endif // _SNTP_HELPER_H_
@@ -0,0 +1,60 @@
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Lock-free queue for exactly one producer and one consumer thread.
+ * The producer only writes _head, the consumer only writes _tail, so no
+ * critical section is needed. Holds up to N - 1 elements.
+ * Does not depend on Mbed OS, so it can be used in host builds as well.
+ */
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N >= 2, "queue needs at least two slots");
+
+public:
+  SpscQueue() : _head(0), _tail(0) {
+  }
+
+  // producer: false if the queue is full
+  bool push(const T &item) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    size_t next = (head + 1) % N;
+
+    if (next == _tail.load(std::memory_order_acquire))
+      return false;
+    _items[head] = item;
+    _head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // consumer: false if the queue is empty
+  bool pop(T &item) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail == _head.load(std::memory_order_acquire))
+      return false;
+    item = _items[tail];
+    _tail.store((tail + 1) % N, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+  }
+
+  size_t size() const {
+    size_t head = _head.load(std::memory_order_acquire);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    return (head + N - tail) % N;
+  }
+
+private:
+  T _items[N];
+  std::atomic<size_t> _head;
+  std::atomic<size_t> _tail;
+};
+
+#endif // _SPSC_QUEUE_H_
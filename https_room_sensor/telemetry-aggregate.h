@@ -0,0 +1,205 @@
+#ifndef _TELEMETRY_AGGREGATE_H_
+#define _TELEMETRY_AGGREGATE_H_
+
+#include <math.h>
+
+#include "telemetry-batch.h"
+
+/**
+ * Running count, min, max, mean and variance of one value with constant
+ * memory (Welford's algorithm, numerically stable in single precision).
+ */
+class RunningStats {
+public:
+  RunningStats() {
+    reset();
+  }
+
+  void reset() {
+    _count = 0;
+    _min = 0.0f;
+    _max = 0.0f;
+    _mean = 0.0f;
+    _m2 = 0.0f;
+  }
+
+  void add(float value) {
+    if (_count == 0) {
+      _min = value;
+      _max = value;
+    } else {
+      if (value < _min)
+        _min = value;
+      if (value > _max)
+        _max = value;
+    }
+    _count++;
+    float delta = value - _mean;
+    _mean += delta / _count;
+    _m2 += delta * (value - _mean);
+  }
+
+  uint32_t count() const { return _count; }
+  float min() const { return _min; }
+  float max() const { return _max; }
+  float mean() const { return _mean; }
+  // population variance of the window
+  float variance() const { return _count ? _m2 / _count : 0.0f; }
+  float stddev() const { return sqrtf(variance()); }
+
+private:
+  uint32_t _count;
+  float _min;
+  float _max;
+  float _mean;
+  float _m2;
+};
+
+// statistics sent for a key, combined as bit mask
+enum {
+  AGG_MIN = 0x01,
+  AGG_MAX = 0x02,
+  AGG_MEAN = 0x04,
+  AGG_STDDEV = 0x08,
+  AGG_COUNT = 0x10
+};
+
+/**
+ * Aggregates every key of the samples over a window of WINDOW samples and
+ * renders the selected statistics as telemetry keys <key>_min, <key>_max,
+ * <key>_mean, <key>_stddev and <key>_count, e.g.
+ *   [{"ts":1626950000000,"values":{"CO2_max":1210,"temperature_mean":22.53}}]
+ * so short peaks between the uploaded samples are not lost.
+ * Keys without statistics (mask 0) are not aggregated at all.
+ * Values that are NaN (sensor not read) are skipped.
+ */
+template <size_t KEYS>
+class TelemetryAggregate {
+public:
+  TelemetryAggregate(const BatchKey *keys, const uint8_t *aggregates, uint32_t window)
+    : _keys(keys), _aggregates(aggregates), _window(window), _samples(0), _ts(0) {
+  }
+
+  // an empty window without keys, e.g. a slot of AggregateQueue
+  TelemetryAggregate() : _keys(NULL), _aggregates(NULL), _window(0), _samples(0), _ts(0) {
+  }
+
+  void add(const TelemetryRow<KEYS> &row) {
+    for (size_t k = 0; k < KEYS; k++)
+      if (_aggregates[k] && !isnan(row.values[k]))
+        _stats[k].add(row.values[k]);
+    _samples++;
+    _ts = row.ts;
+  }
+
+  // the window is full and should be closed
+  bool complete() const { return _samples >= _window; }
+  uint32_t samples() const { return _samples; }
+  uint32_t window() const { return _window; }
+  // timestamp of the last sample, 0 without time
+  uint32_t ts() const { return _ts; }
+  const RunningStats &stats(size_t key) const { return _stats[key]; }
+
+  void reset() {
+    for (size_t k = 0; k < KEYS; k++)
+      _stats[k].reset();
+    _samples = 0;
+  }
+
+  /**
+   * Render the statistics of the window into a writer with a printf like
+   * put(), timestamped with the last sample of the window.
+   */
+  template <typename W>
+  void render(W &w) const {
+    bool first = true;
+
+    if (_ts)
+      w.put("[{\"ts\":%lu000,\"values\":{", (unsigned long)_ts);
+    else
+      w.put("{");
+    for (size_t k = 0; k < KEYS; k++) {
+      const RunningStats &s = _stats[k];
+      int d = _keys[k].decimals;
+      if (!_aggregates[k] || s.count() == 0)
+        continue;
+      if (_aggregates[k] & AGG_MIN)
+        renderValue(w, first, k, "min", d, s.min());
+      if (_aggregates[k] & AGG_MAX)
+        renderValue(w, first, k, "max", d, s.max());
+      if (_aggregates[k] & AGG_MEAN)
+        renderValue(w, first, k, "mean", d + 1, s.mean());
+      if (_aggregates[k] & AGG_STDDEV)
+        renderValue(w, first, k, "stddev", d + 1, s.stddev());
+      if (_aggregates[k] & AGG_COUNT)
+        renderValue(w, first, k, "count", 0, (float)s.count());
+    }
+    w.put(_ts ? "}}]" : "}");
+  }
+
+private:
+  template <typename W>
+  void renderValue(W &w, bool &first, size_t k, const char *name, int decimals, float value) const {
+    char number[NUMBER_TEXT_MAX];
+    formatNumber(number, value, decimals);
+    w.put("%s\"%s_%s\":%s", first ? "" : ",", _keys[k].key, name, number);
+    first = false;
+  }
+
+  const BatchKey *_keys;
+  const uint8_t *_aggregates;
+  uint32_t _window;
+  uint32_t _samples;
+  uint32_t _ts;
+  RunningStats _stats[KEYS];
+};
+
+/**
+ * Closed windows of a TelemetryAggregate that were not uploaded yet, oldest
+ * first. A window is closed on schedule whether ThingsBoard is reachable or
+ * not, so every window keeps its own time span and timestamp, and it stays
+ * here until its upload succeeded. If N - 1 windows are waiting the oldest
+ * one is dropped for the next.
+ */
+template <size_t KEYS, size_t N>
+class AggregateQueue {
+  static_assert(N >= 2, "queue needs at least two slots");
+
+public:
+  AggregateQueue() : _head(0), _tail(0), _dropped(0) {
+  }
+
+  // take the statistics of the window and start the next one
+  void close(TelemetryAggregate<KEYS> &aggregate) {
+    size_t next = (_head + 1) % N;
+    if (next == _tail) {
+      _tail = (_tail + 1) % N;
+      _dropped++;
+    }
+    _windows[_head] = aggregate;
+    _head = next;
+    aggregate.reset();
+  }
+
+  bool empty() const { return _head == _tail; }
+  size_t size() const { return (_head + N - _tail) % N; }
+  // the oldest window, only if not empty
+  const TelemetryAggregate<KEYS> &front() const { return _windows[_tail]; }
+
+  // the oldest window was uploaded
+  void pop() {
+    if (!empty())
+      _tail = (_tail + 1) % N;
+  }
+
+  // windows dropped because the queue was full
+  uint32_t dropped() const { return _dropped; }
+
+private:
+  TelemetryAggregate<KEYS> _windows[N];
+  size_t _head;
+  size_t _tail;
+  uint32_t _dropped;
+};
+
+#endif // _TELEMETRY_AGGREGATE_H_
@@ -0,0 +1,158 @@
+#ifndef _TELEMETRY_BATCH_H_
+#define _TELEMETRY_BATCH_H_
+
+#include <math.h>
+#include <stdarg.h>
+
+#include "mbed.h"
+#include "telemetry-number.h"
+
+// key of a batch column and the number of digits after the decimal point
+typedef struct {
+  const char *key;
+  int decimals;
+} BatchKey;
+
+// one timestamped sample of KEYS values
+template <size_t KEYS>
+struct TelemetryRow {
+  uint32_t ts;          // unix time in seconds, 0 if the time was not set
+  float values[KEYS];
+};
+
+/**
+ * Collects up to ROWS timestamped samples and renders them as one
+ * ThingsBoard telemetry upload:
+ *   [{"ts":1626950000000,"values":{"temperature":22.53,...}},...]
+ * so several samples are sent with one HTTP request instead of one request
+ * per sample. Rows without a timestamp are rendered as plain key/value objects,
+ * ThingsBoard uses the time of arrival for them.
+ * Values that are NaN (e.g. suppressed by a TelemetryDeadband) are left out,
+ * the others are formatted with formatNumber() and the decimals of the key.
+ * If the batch is full, add() overwrites the oldest row.
+ */
+template <size_t KEYS, size_t ROWS>
+class TelemetryBatch {
+public:
+  typedef TelemetryRow<KEYS> Row;
+
+  TelemetryBatch(const BatchKey *keys) : _keys(keys), _first(0), _count(0) {
+  }
+
+  void add(const Row &row) {
+    if (_count == ROWS) {
+      _first = (_first + 1) % ROWS;
+      _count--;
+    }
+    _rows[(_first + _count) % ROWS] = row;
+    _count++;
+  }
+
+  void add(uint32_t ts, const float *values) {
+    Row row;
+    row.ts = ts;
+    memcpy(row.values, values, sizeof(row.values));
+    add(row);
+  }
+
+  const Row &row(size_t i) const { return _rows[(_first + i) % ROWS]; }
+  size_t count() const { return _count; }
+  bool full() const { return _count == ROWS; }
+  void clear() { _first = 0; _count = 0; }
+
+  /**
+   * Render all rows of the batch, returns the length of the JSON string or -1
+   * if it does not fit into buf.
+   */
+  int render(char *buf, size_t size) const {
+    JsonWriter w(buf, size);
+    render(w);
+    return w.length();
+  }
+
+  /**
+   * Render rows that are not part of the batch, e.g. read back from a log.
+   */
+  int render(char *buf, size_t size, const Row *rows, size_t n) const {
+    JsonWriter w(buf, size);
+    render(w, rows, n);
+    return w.length();
+  }
+
+  /**
+   * Render into any writer with a printf like put(), e.g. a ThingsBoardStream
+   * that sends the JSON while it is rendered.
+   */
+  template <typename W>
+  void render(W &w) const {
+    w.put("[");
+    for (size_t i = 0; i < _count; i++)
+      renderRow(w, row(i), i);
+    w.put("]");
+  }
+
+  template <typename W>
+  void render(W &w, const Row *rows, size_t n) const {
+    w.put("[");
+    for (size_t i = 0; i < n; i++)
+      renderRow(w, rows[i], i);
+    w.put("]");
+  }
+
+private:
+  class JsonWriter {
+  public:
+    JsonWriter(char *buf, size_t size) : _buf(buf), _size(size), _len(0), _error(size == 0) {
+      if (size)
+        buf[0] = '\0';
+    }
+
+    MBED_PRINTF_METHOD(1, 2)
+    void put(const char *fmt, ...) {
+      va_list args;
+
+      if (_error)
+        return;
+      va_start(args, fmt);
+      int ret = vsnprintf(_buf + _len, _size - _len, fmt, args);
+      va_end(args);
+      if (ret < 0 || (size_t)ret >= _size - _len)
+        _error = true;
+      else
+        _len += ret;
+    }
+
+    int length() const { return _error ? -1 : (int)_len; }
+
+  private:
+    char *_buf;
+    size_t _size;
+    size_t _len;
+    bool _error;
+  };
+
+  template <typename W>
+  void renderRow(W &w, const Row &r, size_t i) const {
+    if (r.ts)
+      w.put("%s{\"ts\":%lu000,\"values\":{", i ? "," : "", (unsigned long)r.ts);
+    else
+      w.put("%s{", i ? "," : "");
+    bool first = true;
+    for (size_t k = 0; k < KEYS; k++) {
+      if (isnan(r.values[k]))
+        continue;
+      char number[NUMBER_TEXT_MAX];
+      formatNumber(number, r.values[k], _keys[k].decimals);
+      w.put("%s\"%s\":%s", first ? "" : ",", _keys[k].key, number);
+      first = false;
+    }
+    w.put(r.ts ? "}}" : "}");
+  }
+
+  const BatchKey *_keys;
+  Row _rows[ROWS];
+  size_t _first;
+  size_t _count;
+};
+
+#endif // _TELEMETRY_BATCH_H_
@@ -0,0 +1,257 @@
+#ifndef _TELEMETRY_CBOR_H_
+#define _TELEMETRY_CBOR_H_
+
+#include <math.h>
+#include <string.h>
+
+#include "telemetry-batch.h"
+
+/**
+ * Minimal CBOR (RFC 8949) encoder into any writer with write(data, len),
+ * e.g. a ThingsBoardStream or a CborBuffer. Only the types telemetry needs:
+ * unsigned and negative integers, text strings, definite arrays and maps,
+ * half and single precision floats.
+ */
+template <typename W>
+class CborWriter {
+public:
+  CborWriter(W &w) : _w(w) {}
+
+  void uint(uint64_t value) { head(0, value); }
+
+  void integer(int64_t value) {
+    if (value < 0)
+      head(1, (uint64_t)(-1 - value));
+    else
+      head(0, (uint64_t)value);
+  }
+
+  void text(const char *s) {
+    size_t len = strlen(s);
+    head(3, len);
+    _w.write(s, len);
+  }
+
+  void array(size_t n) { head(4, n); }
+  void map(size_t n) { head(5, n); }
+
+  void float16(uint16_t half) {
+    char b[3] = { (char)0xF9, (char)(half >> 8), (char)half };
+    _w.write(b, 3);
+  }
+
+  void float32(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    char b[5] = { (char)0xFA, (char)(bits >> 24), (char)(bits >> 16), (char)(bits >> 8), (char)bits };
+    _w.write(b, 5);
+  }
+
+  /**
+   * The shortest encoding that keeps the value within half a unit of the
+   * given decimals: an integer, a half float or a single float. Half floats
+   * on the edge of the unit are not used, so the value rounds back to the same
+   * decimals.
+   */
+  void number(float value, int decimals) {
+    float scale = 1.0f;
+    for (int i = 0; i < decimals; i++)
+      scale *= 10.0f;
+    float rounded = roundf(value * scale) / scale;
+    if (rounded == floorf(rounded) && fabsf(rounded) < 2147483648.0f) {
+      integer((int64_t)rounded);
+      return;
+    }
+    uint16_t half = toHalf(rounded);
+    if (fabsf(fromHalf(half) - rounded) < 0.45f / scale) {
+      float16(half);
+      return;
+    }
+    float32(rounded);
+  }
+
+  // IEEE 754 half precision, rounded to nearest, NaN and infinity kept
+  static uint16_t toHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exp = ((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF)
+      return sign | 0x7C00 | (mant ? 0x200 : 0);
+    if (exp >= 31)
+      return sign | 0x7C00;
+    if (exp <= 0) {
+      if (exp < -10)
+        return sign;
+      mant |= 0x800000;
+      uint32_t shift = 14 - exp;
+      uint16_t half = (uint16_t)(mant >> shift);
+      if ((mant >> (shift - 1)) & 1)
+        half++;
+      return sign | half;
+    }
+    uint16_t half = sign | (uint16_t)(exp << 10) | (uint16_t)(mant >> 13);
+    if (mant & 0x1000)
+      half++;   // a carry into the exponent is still correct
+    return half;
+  }
+
+  static float fromHalf(uint16_t half) {
+    int exp = (half >> 10) & 0x1F;
+    int mant = half & 0x3FF;
+    float value;
+
+    if (exp == 0)
+      value = ldexpf((float)mant, -24);
+    else if (exp == 31)
+      value = mant ? NAN : INFINITY;
+    else
+      value = ldexpf((float)(mant | 0x400), exp - 25);
+    return (half & 0x8000) ? -value : value;
+  }
+
+private:
+  void head(uint8_t major, uint64_t value) {
+    char b[9];
+    size_t n;
+
+    b[0] = (char)(major << 5);
+    if (value < 24) {
+      b[0] |= (char)value;
+      n = 1;
+    } else if (value <= 0xFF) {
+      b[0] |= 24;
+      b[1] = (char)value;
+      n = 2;
+    } else if (value <= 0xFFFF) {
+      b[0] |= 25;
+      b[1] = (char)(value >> 8);
+      b[2] = (char)value;
+      n = 3;
+    } else if (value <= 0xFFFFFFFFu) {
+      b[0] |= 26;
+      for (int i = 0; i < 4; i++)
+        b[1 + i] = (char)(value >> (24 - 8 * i));
+      n = 5;
+    } else {
+      b[0] |= 27;
+      for (int i = 0; i < 8; i++)
+        b[1 + i] = (char)(value >> (56 - 8 * i));
+      n = 9;
+    }
+    _w.write(b, n);
+  }
+
+  W &_w;
+};
+
+// CBOR into a fixed buffer, length() is -1 if it did not fit
+class CborBuffer {
+public:
+  CborBuffer(uint8_t *buf, size_t size) : _buf(buf), _size(size), _len(0), _error(false) {}
+
+  void write(const char *data, size_t len) {
+    if (_error || len > _size - _len) {
+      _error = true;
+      return;
+    }
+    memcpy(_buf + _len, data, len);
+    _len += len;
+  }
+
+  int length() const { return _error ? -1 : (int)_len; }
+
+private:
+  uint8_t *_buf;
+  size_t _size;
+  size_t _len;
+  bool _error;
+};
+
+/**
+ * Binary counterpart of the JSON of a TelemetryBatch, with the same rows
+ * and NaN values left out. Two layouts:
+ *  - CBOR_NAMED: the structure of the JSON,
+ *      [{"ts":1626950000000,"values":{"temperature":22.53,...}},...]
+ *    for receivers that convert CBOR to JSON 1:1
+ *  - CBOR_INDEXED: keys are replaced by their index in the key table and a
+ *    row is [ts in seconds, {0:22.53,...}], the receiver needs the same table
+ * Numbers use the shortest of integer, half and single float that keeps the
+ * decimals of the key.
+ */
+enum CborLayout {
+  CBOR_NAMED = 0,
+  CBOR_INDEXED
+};
+
+template <size_t KEYS>
+class TelemetryCbor {
+public:
+  typedef TelemetryRow<KEYS> Row;
+
+  TelemetryCbor(const BatchKey *keys, CborLayout layout = CBOR_INDEXED) : _keys(keys), _layout(layout) {}
+
+  template <typename W, size_t ROWS>
+  void render(W &w, const TelemetryBatch<KEYS, ROWS> &batch) const {
+    CborWriter<W> c(w);
+    c.array(batch.count());
+    for (size_t i = 0; i < batch.count(); i++)
+      renderRow(c, batch.row(i));
+  }
+
+  template <typename W>
+  void render(W &w, const Row *rows, size_t n) const {
+    CborWriter<W> c(w);
+    c.array(n);
+    for (size_t i = 0; i < n; i++)
+      renderRow(c, rows[i]);
+  }
+
+  // render into a buffer, returns the length or -1 if it does not fit
+  template <size_t ROWS>
+  int render(uint8_t *buf, size_t size, const TelemetryBatch<KEYS, ROWS> &batch) const {
+    CborBuffer b(buf, size);
+    render(b, batch);
+    return b.length();
+  }
+
+  CborLayout layout() const { return _layout; }
+
+private:
+  template <typename W>
+  void renderRow(CborWriter<W> &c, const Row &r) const {
+    size_t n = 0;
+    for (size_t k = 0; k < KEYS; k++)
+      if (!isnan(r.values[k]))
+        n++;
+
+    if (_layout == CBOR_INDEXED) {
+      c.array(2);
+      c.uint(r.ts);
+    } else {
+      c.map(r.ts ? 2 : 1);
+      if (r.ts) {
+        c.text("ts");
+        c.uint((uint64_t)r.ts * 1000);
+      }
+      c.text("values");
+    }
+    c.map(n);
+    for (size_t k = 0; k < KEYS; k++) {
+      if (isnan(r.values[k]))
+        continue;
+      if (_layout == CBOR_INDEXED)
+        c.uint(k);
+      else
+        c.text(_keys[k].key);
+      c.number(r.values[k], _keys[k].decimals);
+    }
+  }
+
+  const BatchKey *_keys;
+  CborLayout _layout;
+};
+
+#endif // _TELEMETRY_CBOR_H_
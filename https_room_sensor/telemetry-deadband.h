@@ -0,0 +1,118 @@
+#ifndef _TELEMETRY_DEADBAND_H_
+#define _TELEMETRY_DEADBAND_H_
+
+#include <math.h>
+#include <string.h>
+
+#include "telemetry-batch.h"
+
+// report-by-exception policy of a key
+typedef struct {
+  float deadband;         // minimum change against the last sent value
+  uint32_t max_silence;   // send at least every max_silence seconds, 0 = only on change
+} DeadbandKey;
+
+/**
+ * Report-by-exception filter: a value is only sent if it moved by at least
+ * the deadband of its key since the value sent last, or if the key was not
+ * sent for max_silence seconds (heartbeat). Suppressed values are set to NaN,
+ * TelemetryBatch does not render them, and a row without any value left is
+ * dropped completely.
+ * The filter is pure logic, the time is passed in by the caller.
+ * The values left in the batch only count as sent after commit(), once the
+ * batch was uploaded or stored. rollback() forgets them if the batch is
+ * discarded, so the next values are compared against what really arrived.
+ */
+template <size_t KEYS>
+class TelemetryDeadband {
+public:
+  TelemetryDeadband(const DeadbandKey *keys) : _keys(keys), _values_in(0), _values_out(0) {
+    reset();
+    commit();
+  }
+
+  // the next value of every key is sent
+  void reset() {
+    for (size_t k = 0; k < KEYS; k++) {
+      _sent[k] = false;
+      _last[k] = 0.0f;
+      _time[k] = 0;
+    }
+  }
+
+  // the values filtered so far were uploaded or stored
+  void commit() {
+    memcpy(_committed_sent, _sent, sizeof(_sent));
+    memcpy(_committed_last, _last, sizeof(_last));
+    memcpy(_committed_time, _time, sizeof(_time));
+  }
+
+  // the values filtered since the last commit() were not sent
+  void rollback() {
+    memcpy(_sent, _committed_sent, sizeof(_sent));
+    memcpy(_last, _committed_last, sizeof(_last));
+    memcpy(_time, _committed_time, sizeof(_time));
+  }
+
+  /**
+   * Filter a row in place, now is a time in seconds (e.g. since boot).
+   * Returns false if no value of the row has to be sent.
+   */
+  bool filter(TelemetryRow<KEYS> &row, uint32_t now) {
+    bool any = false;
+
+    for (size_t k = 0; k < KEYS; k++) {
+      float value = row.values[k];
+      if (isnan(value))
+        continue;
+      _values_in++;
+      if (_sent[k] && fabsf(value - _last[k]) < _keys[k].deadband &&
+          (_keys[k].max_silence == 0 || now - _time[k] < _keys[k].max_silence)) {
+        row.values[k] = NAN;
+        continue;
+      }
+      _sent[k] = true;
+      _last[k] = value;
+      _time[k] = now;
+      _values_out++;
+      any = true;
+    }
+    return any;
+  }
+
+  /**
+   * Filter a row and add it to the batch if a value is left. If the batch is
+   * full, add() drops the oldest row, which may hold the value sent last of a
+   * key, so the filter starts over and the new row keeps all of its values.
+   */
+  template <size_t ROWS>
+  bool add(TelemetryBatch<KEYS, ROWS> &batch, TelemetryRow<KEYS> &row, uint32_t now) {
+    if (batch.full())
+      reset();
+    if (!filter(row, now))
+      return false;
+    batch.add(row);
+    return true;
+  }
+
+  // values passed to filter() and values left for sending
+  uint32_t values_in() const { return _values_in; }
+  uint32_t values_out() const { return _values_out; }
+  // values in per value sent, e.g. 4.0 if three of four values were suppressed
+  float ratio() const { return _values_out ? (float)_values_in / _values_out : 0.0f; }
+
+private:
+  const DeadbandKey *_keys;
+  // the last value of every key in the batch
+  bool _sent[KEYS];
+  float _last[KEYS];
+  uint32_t _time[KEYS];
+  // the last value of every key that was uploaded or stored
+  bool _committed_sent[KEYS];
+  float _committed_last[KEYS];
+  uint32_t _committed_time[KEYS];
+  uint32_t _values_in;
+  uint32_t _values_out;
+};
+
+#endif // _TELEMETRY_DEADBAND_H_
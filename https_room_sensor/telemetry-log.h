@@ -0,0 +1,243 @@
+#ifndef _TELEMETRY_LOG_H_
+#define _TELEMETRY_LOG_H_
+
+#include "mbed.h"
+#include "BlockDevice.h"
+#include "MbedCRC.h"
+
+/**
+ * Persistent ring log of fixed size records (e.g. timestamped sensor samples)
+ * on a block device, used to keep telemetry that could not be uploaded.
+ *
+ * Records are written strictly in sequence over the whole device, so every
+ * erase unit is erased equally often (wear levelling). The slot after the
+ * newest record is the head, a record is found by its distance to the head,
+ * so sequence numbers may wrap around. Finding head and tail after a reboot
+ * is a simple scan. When the log is full the oldest erase unit is erased and
+ * the records in it are dropped.
+ * Uploaded records are not erased but marked by appending an ack record
+ * carrying the sequence number of the last uploaded record.
+ *
+ * T has to be a plain struct, sizeof(record_t) has to be a multiple of the
+ * program size and a divisor of the erase size of the block device.
+ */
+template <typename T>
+class TelemetryLog {
+  static_assert(sizeof(T) >= sizeof(uint32_t), "ack records store a sequence number in the data");
+
+public:
+  TelemetryLog(BlockDevice *bd)
+    : _bd(bd), _slots(0), _slots_per_unit(0), _head(0), _next(0), _tail(0), _pending(0),
+      _peek_end(0), _dropped(0) {
+  }
+
+  /**
+   * Initialize the block device and find head and tail of the log.
+   */
+  int init() {
+    int ret = _bd->init();
+    if (ret != BD_ERROR_OK)
+      return ret;
+
+    bd_size_t erase_size = _bd->get_erase_size();
+    if (erase_size % sizeof(record_t) || sizeof(record_t) % _bd->get_program_size()) {
+      printf("[TLOG] record size %u does not fit erase/program size\n", (unsigned)sizeof(record_t));
+      return BD_ERROR_DEVICE_ERROR;
+    }
+    _slots_per_unit = erase_size / sizeof(record_t);
+    _slots = (_bd->size() / erase_size) * _slots_per_unit;
+    if (_slots < 2 * _slots_per_unit) {
+      printf("[TLOG] block device needs at least two erase units\n");
+      return BD_ERROR_DEVICE_ERROR;
+    }
+
+    // find the newest record, the oldest record and the last ack
+    bool empty = true;
+    uint32_t newest = 0, oldest = 0, acked = 0;
+    uint32_t newest_slot = _slots - 1;
+    bool has_ack = false;
+    record_t r;
+    for (uint32_t slot = 0; slot < _slots; slot++) {
+      if (read_slot(slot, &r) != BD_ERROR_OK)
+        continue;
+      if (empty || (int32_t)(r.seq - newest) > 0) {
+        newest = r.seq;
+        newest_slot = slot;
+      }
+      if (empty || (int32_t)(r.seq - oldest) < 0)
+        oldest = r.seq;
+      if (r.type == TYPE_ACK) {
+        uint32_t seq;
+        memcpy(&seq, &r.data, sizeof(seq));
+        if (!has_ack || (int32_t)(seq - acked) > 0)
+          acked = seq;
+        has_ack = true;
+      }
+      empty = false;
+    }
+
+    _head = (newest_slot + 1) % _slots;
+    _next = empty ? 0 : newest + 1;
+    _tail = empty ? 0 : oldest;
+    if (has_ack && (int32_t)(acked + 1 - _tail) > 0)
+      _tail = acked + 1;
+    _peek_end = _tail;
+    _pending = count(_tail, _next);
+
+    printf("[TLOG] %lu slots, %lu records pending\n", (unsigned long)_slots, (unsigned long)_pending);
+    return BD_ERROR_OK;
+  }
+
+  /**
+   * Append a record, drops the oldest erase unit if the log is full.
+   */
+  int append(const T &data) {
+    int ret = prepare_slot();
+    if (ret != BD_ERROR_OK)
+      return ret;
+    ret = write_record(TYPE_DATA, &data, sizeof(T));
+    if (ret == BD_ERROR_OK)
+      _pending++;
+    return ret;
+  }
+
+  /**
+   * Read up to max of the oldest not yet uploaded records without removing them.
+   * Call consume() after they were uploaded successfully.
+   */
+  size_t peek(T *out, size_t max) {
+    size_t n = 0;
+    uint32_t seq = _tail;
+    record_t r;
+
+    for (; seq != _next && n < max; seq++) {
+      if (read_slot(slot_of(seq), &r) != BD_ERROR_OK || r.seq != seq || r.type != TYPE_DATA)
+        continue;
+      out[n++] = r.data;
+    }
+    _peek_end = seq;
+    return n;
+  }
+
+  /**
+   * Remove the records returned by the last peek().
+   */
+  int consume() {
+    if (_peek_end == _tail)
+      return BD_ERROR_OK;
+
+    uint32_t acked = _peek_end - 1;
+    int ret = prepare_slot();
+    if (ret != BD_ERROR_OK)
+      return ret;
+    // prepare_slot() may have dropped some of the peeked records already
+    if ((int32_t)(acked + 1 - _tail) <= 0)
+      return BD_ERROR_OK;
+    ret = write_record(TYPE_ACK, &acked, sizeof(acked));
+    if (ret != BD_ERROR_OK)
+      return ret;
+
+    _pending -= count(_tail, acked + 1);
+    _tail = acked + 1;
+    return BD_ERROR_OK;
+  }
+
+  uint32_t pending() const { return _pending; }
+  uint32_t dropped() const { return _dropped; }
+  uint32_t capacity() const { return _slots; }
+
+private:
+  enum {
+    TYPE_DATA = 0x5A01,
+    TYPE_ACK  = 0x5A02
+  };
+
+  typedef struct {
+    uint32_t seq;
+    uint16_t type;
+    uint16_t crc;
+    T data;
+  } record_t;
+
+  uint16_t crc(const record_t *r) {
+    uint32_t c = 0;
+    MbedCRC<POLY_16BIT_CCITT, 16> ct;
+    ct.compute_partial_start(&c);
+    ct.compute_partial(&r->seq, sizeof(r->seq), &c);
+    ct.compute_partial(&r->data, sizeof(r->data), &c);
+    ct.compute_partial_stop(&c);
+    return (uint16_t)(c ^ r->type);
+  }
+
+  int read_slot(uint32_t slot, record_t *r) {
+    int ret = _bd->read(r, (bd_addr_t)slot * sizeof(record_t), sizeof(record_t));
+    if (ret != BD_ERROR_OK)
+      return ret;
+    if ((r->type != TYPE_DATA && r->type != TYPE_ACK) || r->crc != crc(r))
+      return BD_ERROR_DEVICE_ERROR;
+    return BD_ERROR_OK;
+  }
+
+  // number of data records with sequence numbers in [from, to)
+  uint32_t count(uint32_t from, uint32_t to) {
+    uint32_t n = 0;
+    record_t r;
+
+    for (uint32_t seq = from; seq != to; seq++)
+      if (read_slot(slot_of(seq), &r) == BD_ERROR_OK && r.seq == seq && r.type == TYPE_DATA)
+        n++;
+    return n;
+  }
+
+  // slot of one of the last _slots records, by its distance to the head
+  uint32_t slot_of(uint32_t seq) const {
+    return (_head + _slots - (_next - seq) % _slots) % _slots;
+  }
+
+  // erase the erase unit the head enters, this drops the oldest records if the log is full
+  int prepare_slot() {
+    if (_head % _slots_per_unit)
+      return BD_ERROR_OK;
+
+    // records in this unit are _slots older than the head, drop the ones not uploaded yet
+    uint32_t end = _next - _slots + _slots_per_unit;
+    if (_next - _tail > _slots - _slots_per_unit) {
+      uint32_t lost = count(_tail, end);
+      _pending -= lost;
+      _dropped += lost;
+      _tail = end;
+      if ((int32_t)(_peek_end - _tail) < 0)
+        _peek_end = _tail;
+    }
+
+    return _bd->erase((bd_addr_t)_head * sizeof(record_t), _bd->get_erase_size());
+  }
+
+  int write_record(uint16_t type, const void *data, size_t size) {
+    record_t r;
+
+    memset(&r, 0, sizeof(r));
+    r.seq = _next;
+    r.type = type;
+    memcpy(&r.data, data, size);
+    r.crc = crc(&r);
+
+    // a failed slot (e.g. half written before a power loss) is skipped, readers ignore gaps
+    int ret = _bd->program(&r, (bd_addr_t)_head * sizeof(record_t), sizeof(record_t));
+    _head = (_head + 1) % _slots;
+    _next++;
+    return ret;
+  }
+
+  BlockDevice *_bd;
+  uint32_t _slots;
+  uint32_t _slots_per_unit;
+  uint32_t _head;      // slot of the next record
+  uint32_t _next;      // sequence number of the next record
+  uint32_t _tail;      // sequence number of the oldest record not uploaded yet
+  uint32_t _pending;   // number of data records not uploaded yet
+  uint32_t _peek_end;  // sequence number after the last record returned by peek()
+  uint32_t _dropped;   // records lost because the log was full
+};
+
+#endif // _TELEMETRY_LOG_H_
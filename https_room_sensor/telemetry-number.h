@@ -0,0 +1,121 @@
+#ifndef _TELEMETRY_NUMBER_H_
+#define _TELEMETRY_NUMBER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// size of the text for formatNumber(): sign, the 39 digits of the largest float, point, 6 decimals and '\0'
+#define NUMBER_TEXT_MAX 48
+
+// digits of value, least significant first, at least one
+inline size_t numberDigits(uint8_t *digits, uint64_t value) {
+  size_t n = 0;
+  // 64 bit division is a library call on Cortex-M, the values of telemetry fit into 32 bits
+  while (value >> 32) {
+    digits[n++] = (uint8_t)(value % 10);
+    value /= 10;
+  }
+  uint32_t v = (uint32_t)value;
+  do {
+    digits[n++] = (uint8_t)(v % 10);
+    v /= 10;
+  } while (v);
+  return n;
+}
+
+// digits of mant * 2^shift for floats above 2^64, doubled digit by digit
+inline size_t numberDigitsLarge(uint8_t *digits, uint32_t mant, int shift) {
+  size_t n = numberDigits(digits, mant);
+  while (shift-- > 0) {
+    uint8_t carry = 0;
+    for (size_t i = 0; i < n; i++) {
+      uint8_t d = (uint8_t)(digits[i] * 2 + carry);
+      carry = d >= 10;
+      digits[i] = carry ? d - 10 : d;
+    }
+    if (carry)
+      digits[n++] = 1;
+  }
+  return n;
+}
+
+/**
+ * Decimal text of a float with the given decimals (0 to 6), without printf
+ * and heap. The value is rounded like printf("%.*f") does, to the nearest
+ * on the exact binary value with ties to even, in integer arithmetic:
+ * mantissa * 10^decimals has at most 44 bits. Trailing zeros are dropped
+ * but one decimal is kept, so ThingsBoard keeps the key as a double:
+ * 22.50 -> 22.5, 48.00 -> 48.0, with 0 decimals 48. -0.00 is 0.0, NaN and
+ * infinity are null. Returns the length, text needs NUMBER_TEXT_MAX bytes.
+ */
+inline size_t formatNumber(char *text, float value, int decimals) {
+  static const uint32_t pow10[7] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+  uint8_t digits[NUMBER_TEXT_MAX];
+  uint32_t bits;
+  size_t n;
+  bool zero;
+
+  memcpy(&bits, &value, 4);
+  int exp = (bits >> 23) & 0xFF;
+  uint32_t mant = bits & 0x7FFFFF;
+  if (exp == 0xFF) {
+    memcpy(text, "null", 5);
+    return 4;
+  }
+  if (decimals < 0)
+    decimals = 0;
+  if (decimals > 6)
+    decimals = 6;
+  if (exp)
+    mant |= 0x800000;
+  else
+    exp = 1;
+
+  // value = mant / 2^shift
+  int shift = 150 - exp;
+  if (shift <= 0) {
+    // an integer, the decimals are zeros
+    memset(digits, 0, decimals);
+    if (shift >= -40)
+      n = decimals + numberDigits(digits + decimals, (uint64_t)mant << -shift);
+    else
+      n = decimals + numberDigitsLarge(digits + decimals, mant, -shift);
+    zero = false;
+  } else {
+    // value * 10^decimals rounded, below 2^-45 it is always 0
+    uint64_t q = 0;
+    if (shift < 45) {
+      uint64_t p = (uint64_t)mant * pow10[decimals];
+      uint64_t half = (uint64_t)1 << (shift - 1);
+      uint64_t rem = p & ((half << 1) - 1);
+      q = p >> shift;
+      if (rem > half || (rem == half && (q & 1)))
+        q++;
+    }
+    n = numberDigits(digits, q);
+    zero = q == 0;
+  }
+  // at least one digit before the point
+  if (n <= (size_t)decimals) {
+    memset(digits + n, 0, decimals + 1 - n);
+    n = decimals + 1;
+  }
+
+  size_t len = 0;
+  if ((bits >> 31) && !zero)
+    text[len++] = '-';
+  for (size_t i = n; i-- > (size_t)decimals;)
+    text[len++] = (char)('0' + digits[i]);
+  if (decimals) {
+    size_t last = 0;
+    while (last < (size_t)decimals - 1 && digits[last] == 0)
+      last++;
+    text[len++] = '.';
+    for (size_t i = decimals; i-- > last;)
+      text[len++] = (char)('0' + digits[i]);
+  }
+  text[len] = '\0';
+  return len;
+}
+
+#endif // _TELEMETRY_NUMBER_H_
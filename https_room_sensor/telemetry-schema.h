@@ -0,0 +1,210 @@
+#ifndef _TELEMETRY_SCHEMA_H_
+#define _TELEMETRY_SCHEMA_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <tuple>
+#include <type_traits>
+
+#include "telemetry-number.h"
+
+/**
+ * Key of a TelemetrySchema: the name, the C++ type of the value and for
+ * floats the number of digits after the decimal point. The name has to be a
+ * constexpr char array at namespace scope:
+ *   constexpr char kTemperature[] = "temperature";
+ *   typedef SchemaKey<kTemperature, float, 2> Temperature;
+ */
+template <const char *NAME, typename T, int DECIMALS = 2>
+struct SchemaKey {
+  static_assert(std::is_same<T, int32_t>::value || std::is_same<T, uint32_t>::value ||
+    std::is_same<T, float>::value || std::is_same<T, bool>::value,
+    "telemetry values are int32_t, uint32_t, float or bool");
+  static_assert(DECIMALS >= 0 && DECIMALS <= 6, "0 to 6 decimals");
+
+  typedef T type;
+  enum { decimals = DECIMALS };
+  static constexpr const char *name() { return NAME; }
+};
+
+// length of the JSON without the values: '{' or ',', the quotes and ':' around each key, the closing '}'
+template <typename... Keys>
+constexpr size_t schemaLength() {
+  const char *names[] = { Keys::name()... };
+  size_t n = 1;
+  for (size_t k = 0; k < sizeof...(Keys); k++) {
+    n += 4;
+    for (const char *p = names[k]; *p; p++)
+      n++;
+  }
+  return n;
+}
+
+// the text of all segments and where they start, segment KEYS is the closing brace
+template <size_t LENGTH, size_t KEYS>
+struct SchemaSkeleton {
+  char text[LENGTH];
+  uint16_t start[KEYS + 2];
+};
+
+template <typename... Keys>
+constexpr SchemaSkeleton<schemaLength<Keys...>(), sizeof...(Keys)> schemaSkeleton() {
+  SchemaSkeleton<schemaLength<Keys...>(), sizeof...(Keys)> s = {};
+  const char *names[] = { Keys::name()... };
+  size_t n = 0;
+  for (size_t k = 0; k < sizeof...(Keys); k++) {
+    s.start[k] = (uint16_t)n;
+    s.text[n++] = k ? ',' : '{';
+    s.text[n++] = '"';
+    for (const char *p = names[k]; *p; p++)
+      s.text[n++] = *p;
+    s.text[n++] = '"';
+    s.text[n++] = ':';
+  }
+  s.start[sizeof...(Keys)] = (uint16_t)n;
+  s.text[n++] = '}';
+  s.start[sizeof...(Keys) + 1] = (uint16_t)n;
+  return s;
+}
+
+/**
+ * Telemetry message with keys and value types fixed at compile time. The
+ * JSON around the values, {"reason":<>,"errorstatus":<>}, is built by the
+ * compiler and kept in flash, an upload copies it and only formats the
+ * numbers. setValue() takes the key type and a value of exactly the type of
+ * the key, anything else does not compile:
+ *
+ *   typedef TelemetrySchema<Temperature, Co2> Room;
+ *   Room room;
+ *   room.setValue<Co2>((uint32_t)co2);
+ *   room.render(stream);
+ *
+ * Floats are formatted with formatNumber(), NaN is rendered as null.
+ */
+template <typename... Keys>
+class TelemetrySchema {
+public:
+  enum { KEYS = sizeof...(Keys) };
+  static_assert(KEYS > 0, "a schema needs at least one key");
+
+  TelemetrySchema() : _values() {}
+
+  template <typename K, typename V>
+  void setValue(V value) {
+    static_assert(indexOf<K>() < KEYS, "the key is not part of the schema");
+    static_assert(std::is_same<V, typename K::type>::value, "the value does not have the type of the key");
+    std::get<indexOf<K>()>(_values) = value;
+  }
+
+  template <typename K>
+  typename K::type value() const {
+    static_assert(indexOf<K>() < KEYS, "the key is not part of the schema");
+    return std::get<indexOf<K>()>(_values);
+  }
+
+  // render into any writer with write(data, len), e.g. a ThingsBoardStream
+  template <typename W>
+  void render(W &w) const {
+    renderFrom<0>(w);
+  }
+
+  // render into a buffer, returns the length of the JSON string or -1 if it does not fit
+  int render(char *buf, size_t size) const {
+    BufferWriter w(buf, size);
+    render(w);
+    return w.length();
+  }
+
+  // length of the JSON without the values
+  static constexpr size_t skeleton_length() { return schemaLength<Keys...>(); }
+
+private:
+  typedef SchemaSkeleton<schemaLength<Keys...>(), KEYS> Skeleton;
+
+  static constexpr Skeleton _skeleton = schemaSkeleton<Keys...>();
+
+  template <typename K>
+  static constexpr size_t indexOf() {
+    const bool match[] = { std::is_same<K, Keys>::value... };
+    for (size_t k = 0; k < KEYS; k++)
+      if (match[k])
+        return k;
+    return KEYS;
+  }
+
+  template <size_t I, typename W>
+  typename std::enable_if<(I < KEYS)>::type renderFrom(W &w) const {
+    typedef typename std::tuple_element<I, std::tuple<Keys...>>::type K;
+    w.write(_skeleton.text + _skeleton.start[I], _skeleton.start[I + 1] - _skeleton.start[I]);
+    char text[NUMBER_TEXT_MAX];
+    size_t len = format(text, std::get<I>(_values), K::decimals);
+    w.write(text, len);
+    renderFrom<I + 1>(w);
+  }
+
+  template <size_t I, typename W>
+  typename std::enable_if<(I == KEYS)>::type renderFrom(W &w) const {
+    w.write(_skeleton.text + _skeleton.start[KEYS], 1);
+  }
+
+  static size_t format(char *text, uint32_t value, int) {
+    char digits[10];
+    size_t n = 0;
+    do {
+      digits[n++] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value);
+    for (size_t i = 0; i < n; i++)
+      text[i] = digits[n - 1 - i];
+    return n;
+  }
+
+  static size_t format(char *text, int32_t value, int) {
+    if (value >= 0)
+      return format(text, (uint32_t)value, 0);
+    text[0] = '-';
+    return 1 + format(text + 1, 0u - (uint32_t)value, 0);
+  }
+
+  static size_t format(char *text, bool value, int) {
+    memcpy(text, value ? "true" : "false", value ? 4 : 5);
+    return value ? 4 : 5;
+  }
+
+  static size_t format(char *text, float value, int decimals) {
+    return formatNumber(text, value, decimals);
+  }
+
+  class BufferWriter {
+  public:
+    BufferWriter(char *buf, size_t size) : _buf(buf), _size(size), _len(0), _error(size == 0) {
+      if (size)
+        buf[0] = '\0';
+    }
+
+    void write(const char *data, size_t len) {
+      if (_error || len >= _size - _len) {
+        _error = true;
+        return;
+      }
+      memcpy(_buf + _len, data, len);
+      _len += len;
+      _buf[_len] = '\0';
+    }
+
+    int length() const { return _error ? -1 : (int)_len; }
+
+  private:
+    char *_buf;
+    size_t _size;
+    size_t _len;
+    bool _error;
+  };
+
+  std::tuple<typename Keys::type...> _values;
+};
+
+template <typename... Keys>
+constexpr typename TelemetrySchema<Keys...>::Skeleton TelemetrySchema<Keys...>::_skeleton;
+
+#endif // _TELEMETRY_SCHEMA_H_
@@ -0,0 +1,318 @@
+#ifndef _THINGSBOARD_STREAM_H_
+#define _THINGSBOARD_STREAM_H_
+
+#include <stdarg.h>
+#include <strings.h>
+
+#include "mbed.h"
+#include "deflate-stream.h"
+
+/**
+ * Streams a ThingsBoard upload (POST /api/v1/<token>/telemetry or /attributes)
+ * straight into the socket using HTTP/1.1 chunked transfer encoding.
+ * The payload is formatted into a fixed buffer and sent as one chunk whenever
+ * the buffer is full, so no heap is used and the memory needed does not grow
+ * with the number of keys or rows. The same buffer is used to read the response.
+ * The buffer has to be smaller than 64 KB and large enough for the response headers.
+ * The time needed for sending the request and waiting for the response is measured.
+ * With a DeflateStream set, a request can be sent with "Content-Encoding: gzip"
+ * and compressed while it is written. If the server answers 415 (Unsupported
+ * Media Type), compression is switched off and the caller sends it again.
+ *
+ *   stream.beginTelemetry(socket);
+ *   stream.put("{\"temperature\":%.2f}", t);
+ *   int status = stream.end();
+ */
+class ThingsBoardStream {
+public:
+  ThingsBoardStream(char *buf, size_t size)
+    : _buf(buf), _size(size), _len(0), _error(NSAPI_ERROR_OK), _chunked(false), _keep_alive(true),
+      _socket(NULL), _token(NULL), _host(NULL), _bytes(0), _request_us(0), _response_us(0),
+      _deflate(NULL), _gzip(false), _gzip_refused(false), _uncompressed(0) {
+  }
+
+  void begin(const char *token, const char *host) {
+    _token = token;
+    _host = host;
+  }
+
+  // compressor for gzip requests, NULL to send everything as is
+  void setCompression(DeflateStream<> *deflate) {
+    _deflate = deflate;
+  }
+
+  // gzip requests are possible and were not refused by the server
+  bool compression() const { return _deflate && !_gzip_refused; }
+  bool gzip_refused() const { return _gzip_refused; }
+
+  nsapi_error_t beginTelemetry(Socket *socket, const char *content_type = "application/json", bool gzip = false) {
+    return beginPost(socket, "telemetry", content_type, gzip && compression());
+  }
+
+  nsapi_error_t beginAttributes(Socket *socket) {
+    return beginPost(socket, "attributes", "application/json", false);
+  }
+
+  /**
+   * Append formatted payload, a single call has to fit into the buffer.
+   */
+  MBED_PRINTF_METHOD(1, 2)
+  void put(const char *fmt, ...) {
+    va_list args;
+
+    if (_error != NSAPI_ERROR_OK)
+      return;
+
+    if (_gzip) {
+      char text[128];
+      va_start(args, fmt);
+      int ret = vsnprintf(text, sizeof(text), fmt, args);
+      va_end(args);
+      if (ret < 0 || (size_t)ret >= sizeof(text))
+        _error = NSAPI_ERROR_NO_MEMORY;
+      else
+        _deflate->write(text, ret);
+      return;
+    }
+
+    va_start(args, fmt);
+    int ret = vsnprintf(_buf + _len, space(), fmt, args);
+    va_end(args);
+    if (ret >= 0 && (size_t)ret < space()) {
+      _len += ret;
+      return;
+    }
+
+    // does not fit anymore, send what is buffered and format again
+    flush();
+    if (_error != NSAPI_ERROR_OK)
+      return;
+    va_start(args, fmt);
+    ret = vsnprintf(_buf + _len, space(), fmt, args);
+    va_end(args);
+    if (ret < 0 || (size_t)ret >= space())
+      _error = NSAPI_ERROR_NO_MEMORY;
+    else
+      _len += ret;
+  }
+
+  void write(const char *data, size_t len) {
+    if (_gzip)
+      _deflate->write(data, len);
+    else
+      append(data, len);
+  }
+
+  /**
+   * Finish the request and read the response.
+   * Returns the HTTP status code or a negative nsapi error.
+   */
+  int end() {
+    bool gzip = _gzip;
+    if (_gzip) {
+      _deflate->finish();
+      _uncompressed = _deflate->size_in();
+      _gzip = false;
+    }
+    flush();
+    if (_error == NSAPI_ERROR_OK)
+      sendAll("0\r\n\r\n", 5);
+    _chunked = false;
+    _request_us = (uint32_t)_timer.elapsed_time().count();
+    _timer.reset();
+    _response_us = 0;
+    if (_error != NSAPI_ERROR_OK) {
+      _keep_alive = false;
+      return _error;
+    }
+    int status = readResponse();
+    _response_us = (uint32_t)_timer.elapsed_time().count();
+    if (gzip && status == 415) {
+      printf("[TBST] Server does not accept compressed requests\n");
+      _gzip_refused = true;
+    }
+    return status;
+  }
+
+  // false if the server wants to close the connection or the response could not be read completely
+  bool keep_alive() const { return _keep_alive; }
+  // bytes sent for the last request including headers and chunk framing
+  uint32_t bytes() const { return _bytes; }
+  // payload bytes of the last request before compression, 0 if it was not compressed
+  uint32_t uncompressed() const { return _uncompressed; }
+  // time from begin to the last byte of the request sent, and from there to the response read
+  uint32_t request_us() const { return _request_us; }
+  uint32_t response_us() const { return _response_us; }
+
+private:
+  // a chunk is sent as "xxxx\r\n" <data> "\r\n", the frame is reserved in the buffer
+  enum {
+    CHUNK_HEAD = 6,
+    CHUNK_TAIL = 2
+  };
+
+  // output of the compressor
+  static void deflated(void *ctx, const char *data, size_t len) {
+    ((ThingsBoardStream *)ctx)->append(data, len);
+  }
+
+  void append(const char *data, size_t len) {
+    while (len > 0 && _error == NSAPI_ERROR_OK) {
+      if (space() == 0)
+        flush();
+      size_t n = len < space() ? len : space();
+      memcpy(_buf + _len, data, n);
+      _len += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  size_t space() const {
+    size_t end = _size - (_chunked ? CHUNK_TAIL : 0);
+    return _len < end ? end - _len : 0;
+  }
+
+  nsapi_error_t beginPost(Socket *socket, const char *type, const char *content_type, bool gzip) {
+    _timer.reset();
+    _timer.start();
+    _socket = socket;
+    _error = NSAPI_ERROR_OK;
+    _keep_alive = true;
+    _bytes = 0;
+    _chunked = false;
+    _len = 0;
+    _gzip = false;
+    _uncompressed = 0;
+
+    put("POST /api/v1/%s/%s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Content-Type: %s\r\n"
+        "%s"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n", _token, type, _host, content_type, gzip ? "Content-Encoding: gzip\r\n" : "");
+    flush();
+
+    _chunked = true;
+    _len = CHUNK_HEAD;
+    if (gzip && _error == NSAPI_ERROR_OK) {
+      _deflate->begin(deflated, this);
+      _gzip = true;
+    }
+    return _error;
+  }
+
+  void flush() {
+    if (_error != NSAPI_ERROR_OK)
+      return;
+
+    if (!_chunked) {
+      sendAll(_buf, _len);
+      _len = 0;
+      return;
+    }
+
+    size_t data = _len - CHUNK_HEAD;
+    if (data > 0) {
+      char head[CHUNK_HEAD + 1];
+      snprintf(head, sizeof(head), "%04x\r\n", (unsigned)data);
+      memcpy(_buf, head, CHUNK_HEAD);
+      memcpy(_buf + _len, "\r\n", CHUNK_TAIL);
+      sendAll(_buf, _len + CHUNK_TAIL);
+    }
+    _len = CHUNK_HEAD;
+  }
+
+  void sendAll(const char *data, size_t len) {
+    while (len > 0 && _error == NSAPI_ERROR_OK) {
+      nsapi_size_or_error_t ret = _socket->send(data, len);
+      if (ret < 0) {
+        _error = ret;
+        return;
+      }
+      data += ret;
+      len -= ret;
+      _bytes += ret;
+    }
+  }
+
+  // value of a response header or NULL, the headers are null terminated
+  const char *header(const char *name) {
+    size_t n = strlen(name);
+
+    for (char *line = strstr(_buf, "\r\n"); line; line = strstr(line + 2, "\r\n"))
+      if (strncasecmp(line + 2, name, n) == 0 && line[2 + n] == ':')
+        return line + 3 + n;
+    return NULL;
+  }
+
+  int readResponse() {
+    size_t len = 0;
+    char *end = NULL;
+
+    // read until the end of the headers
+    while (!end) {
+      if (len >= _size - 1) {
+        _keep_alive = false;
+        return NSAPI_ERROR_NO_MEMORY;
+      }
+      nsapi_size_or_error_t ret = _socket->recv(_buf + len, _size - 1 - len);
+      if (ret <= 0) {
+        _keep_alive = false;
+        return ret < 0 ? ret : NSAPI_ERROR_NO_CONNECTION;
+      }
+      len += ret;
+      _buf[len] = '\0';
+      end = strstr(_buf, "\r\n\r\n");
+    }
+
+    int status = 0;
+    if (sscanf(_buf, "HTTP/1.%*d %d", &status) != 1) {
+      _keep_alive = false;
+      return NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    // skip the body to keep the connection usable, ThingsBoard answers uploads without one
+    size_t body = len - (end + 4 - _buf);
+    end[2] = '\0';
+    const char *value = header("Connection");
+    if (value && strstr(value, "close"))
+      _keep_alive = false;
+    value = header("Content-Length");
+    if (!value || header("Transfer-Encoding")) {
+      _keep_alive = false;
+      return status;
+    }
+    long remaining = strtol(value, NULL, 10) - (long)body;
+    while (remaining > 0) {
+      nsapi_size_or_error_t ret = _socket->recv(_buf, remaining < (long)_size ? remaining : _size);
+      if (ret <= 0) {
+        _keep_alive = false;
+        break;
+      }
+      remaining -= ret;
+    }
+
+    return status;
+  }
+
+  char *_buf;
+  size_t _size;
+  size_t _len;
+  nsapi_error_t _error;
+  bool _chunked;
+  bool _keep_alive;
+  Socket *_socket;
+  const char *_token;
+  const char *_host;
+  uint32_t _bytes;
+  Timer _timer;
+  uint32_t _request_us;
+  uint32_t _response_us;
+  DeflateStream<> *_deflate;
+  bool _gzip;
+  bool _gzip_refused;
+  uint32_t _uncompressed;
+};
+
+#endif // _THINGSBOARD_STREAM_H_
@@ -0,0 +1,130 @@
+#ifndef _UPLOAD_SCHEDULER_H_
+#define _UPLOAD_SCHEDULER_H_
+
+#include <math.h>
+#include <stdint.h>
+
+// limits and tuning of the UploadScheduler, intervals in seconds
+typedef struct {
+  uint32_t min_interval;     // upload interval while values change fast
+  uint32_t max_interval;     // upload interval while values are stable, also the limit of the back off
+  float smoothing;           // weight of a new observation in the moving averages (0..1]
+  uint32_t latency_target;   // uploads slower than this (ms) lengthen the interval
+  float failure_backoff;     // interval factor at a failure rate of 100%
+} SchedulerConfig;
+
+/**
+ * Chooses the upload interval from the dynamics of the signals and the
+ * health of the link: the interval is short while any key changes fast
+ * (e.g. CO2 rises because a room fills up) and long while all values are
+ * stable. Slow or failing uploads lengthen it again, so a bad link is not
+ * hammered. scale[k] is the change of key k per sample that counts as fast.
+ *
+ * The sensor noise is not a change: a key counts with its trend, the
+ * difference of a fast and a slow moving average of its values divided by
+ * their lag, and with steps larger than its noise floor (NOISE_FLOOR times
+ * the mean deviation from the fast average, at least scale[k]). A step is
+ * counted at once and starts the trend over at the new level.
+ * Pure logic without time or I/O, the caller reports samples and uploads.
+ */
+template <size_t KEYS>
+class UploadScheduler {
+public:
+  UploadScheduler(const SchedulerConfig &config, const float *scale)
+    : _config(config), _scale(scale), _has_last(false), _activity(0.0f),
+      _failure_rate(0.0f), _latency_ms(0.0f) {
+    for (size_t k = 0; k < KEYS; k++) {
+      _fast[k] = NAN;
+      _slow[k] = NAN;
+      _noise[k] = 0.0f;
+    }
+  }
+
+  void sample(const float *values) {
+    float fast = _config.smoothing;
+    float slow = _config.smoothing / SLOW_RATIO;
+    // a ramp lags (1 - w) / w samples behind in an average of weight w
+    float lag = (1.0f - slow) / slow - (1.0f - fast) / fast;
+    float activity = 0.0f;
+
+    for (size_t k = 0; k < KEYS; k++) {
+      if (isnan(values[k]))
+        continue;
+      if (isnan(_fast[k])) {
+        _fast[k] = values[k];
+        _slow[k] = values[k];
+        continue;
+      }
+      float deviation = fabsf(values[k] - _fast[k]);
+      float limit = NOISE_FLOOR * _noise[k];
+      if (limit < _scale[k])
+        limit = _scale[k];
+      float a;
+      if (deviation > limit) {
+        a = (deviation - limit) / _scale[k];
+        _fast[k] = values[k];
+        _slow[k] = values[k];
+      } else {
+        _noise[k] += fast * (deviation - _noise[k]);
+        _fast[k] += fast * (values[k] - _fast[k]);
+        _slow[k] += slow * (values[k] - _slow[k]);
+        a = fabsf(_fast[k] - _slow[k]) / lag / _scale[k];
+      }
+      // the fastest changing key decides
+      if (a > activity)
+        activity = a;
+    }
+    if (_has_last)
+      _activity += _config.smoothing * (activity - _activity);
+    _has_last = true;
+  }
+
+  void uploaded(bool ok, uint32_t latency_ms) {
+    _failure_rate += _config.smoothing * ((ok ? 0.0f : 1.0f) - _failure_rate);
+    if (ok)
+      _latency_ms += _config.smoothing * ((float)latency_ms - _latency_ms);
+  }
+
+  // seconds until the next upload
+  uint32_t interval() const {
+    float lo = (float)_config.min_interval;
+    float hi = (float)_config.max_interval;
+
+    // activity 0 gives max_interval, activity 1 (a fast change every sample) min_interval
+    float a = _activity < 1.0f ? _activity : 1.0f;
+    float interval = hi / (1.0f + a * (hi / lo - 1.0f));
+
+    float health = 1.0f + _failure_rate * (_config.failure_backoff - 1.0f);
+    if (_config.latency_target && _latency_ms > _config.latency_target)
+      health *= _latency_ms / _config.latency_target;
+    interval *= health;
+
+    if (interval < lo)
+      interval = lo;
+    if (interval > hi)
+      interval = hi;
+    return (uint32_t)(interval + 0.5f);
+  }
+
+  float activity() const { return _activity; }
+  float failure_rate() const { return _failure_rate; }
+  float latency_ms() const { return _latency_ms; }
+
+private:
+  // the slow average has this fraction of the weight of the fast one
+  static constexpr float SLOW_RATIO = 5.0f;
+  // deviations up to this multiple of the mean deviation are noise
+  static constexpr float NOISE_FLOOR = 6.0f;
+
+  SchedulerConfig _config;
+  const float *_scale;
+  float _fast[KEYS];
+  float _slow[KEYS];
+  float _noise[KEYS];
+  bool _has_last;
+  float _activity;
+  float _failure_rate;
+  float _latency_ms;
+};
+
+#endif // _UPLOAD_SCHEDULER_H_
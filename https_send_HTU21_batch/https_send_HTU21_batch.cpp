@@ -9,6 +9,8 @@
 #include "mbed_error.h"
 #include "mbed_fault_handler.h"
 #include "network-helper.h"
+#include "tls-connection.h"
+#include "tls-trust-store.h"
 #include "ThingsBoard.h"
 #include "SparkFunHTU21D.h"
 
@@ -63,7 +65,8 @@
 //"-----END CERTIFICATE-----\n";
 
 NetworkInterface *net;
-TLSSocket *socket;
+// root CA parsed once and shared by all TLS sockets
+TLSTrustStore trust;
 
 // Initialize ThingsBoard instance
 ThingsBoardHttps tb;
@@ -150,33 +153,27 @@ int main() {
   
   myHTU21.begin(i2c);
 
-  while(true) {
-    socket = new TLSSocket();
-  
-    result = socket->open(net);
-    if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.open(net) returned: %d\n", result);
-      thread_sleep_for(30000);
-      system_reset();
-    }
+  result = trust.init(SSL_CA_PEM);
+  if (result != NSAPI_ERROR_OK) {
+    printf("Error! trust.init(ssl_ca_pem) returned: %d\n", result);
+    thread_sleep_for(30000);
+    system_reset();
+  }
 
-    result = socket->set_root_ca_cert(SSL_CA_PEM);
-    if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.set_root_ca_cert(ssl_ca_pem) returned: %d\n", result);
-      thread_sleep_for(30000);
-      system_reset();
-    }
-    
-    socket->set_hostname(THINGSBOARD_HOST);
+  // keep one TLS connection open over all uploads, resume the TLS session on reconnects
+  TLSConnection tls(net, THINGSBOARD_HOST, &trust);
+  TLSSessionCache tls_sessions;
+  tls.set_session_cache(&tls_sessions);
 
-    result = socket->connect(adr);
+  while(true) {
+    result = tls.connect(adr);
     if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.connect(adr) Failed (%d).\n", result);
+      printf("Error! tls.connect(adr) Failed in step %d (%d).\n", tls.failed_step(), result);
       thread_sleep_for(30000);
       system_reset();
     }
     
-    tb.setSocket(socket);
+    tb.setSocket(tls.socket());
 
     printf("Sending data...\n");
 
@@ -202,9 +199,16 @@ int main() {
     data1[0].setValue(myHTU21.readTemperature());
     data1[1].setValue(myHTU21.readHumidity());
     bret = tb.sendTelemetry(data1, 2);
+    if(!bret && tls.reconnect(adr) == NSAPI_ERROR_OK) {
+      // the server may have closed the connection right before the request
+      tb.setSocket(tls.socket());
+      bret = tb.sendTelemetry(data1, 2);
+    }
     if(!bret) printf("error sending telemetry\n");
     
-    socket->~TLSSocket();
+    printf("TLS handshakes: %lu (full: %lu, resumed: %lu), connection reused: %lu\n",
+      (unsigned long)tls.handshakes(), (unsigned long)tls_sessions.full_handshakes(),
+      (unsigned long)tls_sessions.resumed_handshakes(), (unsigned long)tls.reuses());
     
     thread_sleep_for(15000);
   }
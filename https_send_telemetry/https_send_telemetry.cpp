@@ -7,6 +7,10 @@
 
 #include "mbed.h"
 #include "network-helper.h"
+#include "tls-connection.h"
+#include "tls-trust-store.h"
+#include "thingsboard-coap.h"
+#include "DTLSSocket.h"
 #include "ThingsBoard.h"
 
 #define PRINT_STR_REPEAT(str, times) \
@@ -16,6 +20,16 @@
   puts(""); \
 }
 
+// set to 1 to send with CoAP over UDP instead of https, every upload is one confirmable datagram
+#define THINGSBOARD_USE_COAP 0
+// set to 1 to secure CoAP with DTLS, the root CA of SSL_CA_PEM is used for the server certificate
+#define THINGSBOARD_COAP_DTLS 0
+#if THINGSBOARD_COAP_DTLS
+#define THINGSBOARD_COAP_PORT 5684
+#else
+#define THINGSBOARD_COAP_PORT 5683
+#endif
+
 // See https://thingsboard.io/docs/getting-started-guides/helloworld/ 
 // to understand how to obtain an access token
 #include "secrets.h"
@@ -60,11 +74,71 @@
 //"-----END CERTIFICATE-----\n";
 
 NetworkInterface *net;
-TLSSocket *socket;
+// root CA parsed once and shared by all TLS sockets
+TLSTrustStore trust;
 
 // Initialize ThingsBoard instance
 ThingsBoardHttps tb;
 
+#if THINGSBOARD_USE_COAP
+// uploads larger than 256 bytes are sent block-wise, the message IDs differ per device
+ThingsBoardCoap<256> tbc(HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2());
+#if THINGSBOARD_COAP_DTLS
+DTLSSocket udp;
+#else
+UDPSocket udp;
+#endif
+
+/**************************************************************************/
+/*
+    send the same telemetry with CoAP, prints the round trip time and
+    the datagrams needed, a lossy link shows up as retransmissions
+*/
+/**************************************************************************/
+void sendCoap(const SocketAddress &adr) {
+  nsapi_error_t result;
+  bool bret;
+  uint32_t samples = 0;
+
+  result = udp.open(net);
+  if (result != NSAPI_ERROR_OK) {
+    printf("Error! udp.open(net) returned: %d\n", result);
+    thread_sleep_for(30000);
+    system_reset();
+  }
+#if THINGSBOARD_COAP_DTLS
+  trust.attach(&udp);
+  udp.set_hostname(THINGSBOARD_HOST);
+#endif
+  // sets the peer address, with DTLS this runs the handshake
+  result = udp.connect(adr);
+  if (result != NSAPI_ERROR_OK) {
+    printf("Error! udp.connect(adr) Failed (%d).\n", result);
+    thread_sleep_for(30000);
+    system_reset();
+  }
+  tbc.begin(&udp, TOKEN);
+
+  while(true) {
+    printf("Sending data...\n");
+
+    // Uploads new telemetry to ThingsBoard using CoAP
+    bret = tbc.sendTelemetryInt("temperature", 22);
+    if(!bret) printf("error sending telemetry: temperature\n");
+    else samples++;
+    bret = tbc.sendTelemetryFloat("humidity", 42.5);
+    if(!bret) printf("error sending telemetry: humidity\n");
+    else samples++;
+
+    printf("CoAP: rtt %lu us, %lu datagrams (%lu retransmits, %lu bytes) for %lu samples, %lu datagrams per 100 samples\n",
+      (unsigned long)tbc.rtt_us(), (unsigned long)tbc.datagrams(), (unsigned long)tbc.retransmits(),
+      (unsigned long)tbc.bytes(), (unsigned long)samples, (unsigned long)(samples ? tbc.datagrams() * 100 / samples : 0));
+
+    thread_sleep_for(15000);
+  }
+}
+#endif
+
 int main() {
   SocketAddress adr;
   nsapi_error_t result;
@@ -95,43 +169,49 @@ int main() {
   
   tb.begin(TOKEN, THINGSBOARD_HOST, THINGSBOARD_PORT);
 
-  while(true) {
-    socket = new TLSSocket();
-  
-    result = socket->open(net);
-    if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.open(net) returned: %d\n", result);
-      thread_sleep_for(30000);
-      system_reset();
-    }
+  result = trust.init(SSL_CA_PEM);
+  if (result != NSAPI_ERROR_OK) {
+    printf("Error! trust.init(ssl_ca_pem) returned: %d\n", result);
+    thread_sleep_for(30000);
+    system_reset();
+  }
 
-    result = socket->set_root_ca_cert(SSL_CA_PEM);
-    if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.set_root_ca_cert(ssl_ca_pem) returned: %d\n", result);
-      thread_sleep_for(30000);
-      system_reset();
-    }
-    
-    socket->set_hostname(THINGSBOARD_HOST);
+#if THINGSBOARD_USE_COAP
+  adr.set_port(THINGSBOARD_COAP_PORT);
+  sendCoap(adr);
+#endif
+
+  // keep one TLS connection open over all uploads, resume the TLS session on reconnects
+  TLSConnection tls(net, THINGSBOARD_HOST, &trust);
+  TLSSessionCache tls_sessions;
+  tls.set_session_cache(&tls_sessions);
 
-    result = socket->connect(adr);
+  while(true) {
+    result = tls.connect(adr);
     if (result != NSAPI_ERROR_OK) {
-      printf("Error! socket.connect(adr) Failed (%d).\n", result);
+      printf("Error! tls.connect(adr) Failed in step %d (%d).\n", tls.failed_step(), result);
       thread_sleep_for(30000);
       system_reset();
     }
     
-    tb.setSocket(socket);
+    tb.setSocket(tls.socket());
 
     printf("Sending data...\n");
 
     // Uploads new telemetry to ThingsBoard using http
     bret = tb.sendTelemetryInt("temperature", 22);
+    if(!bret && tls.reconnect(adr) == NSAPI_ERROR_OK) {
+      // the server may have closed the connection right before the request
+      tb.setSocket(tls.socket());
+      bret = tb.sendTelemetryInt("temperature", 22);
+    }
     if(!bret) printf("error sending telemetry: temperature\n");
     bret = tb.sendTelemetryFloat("humidity", 42.5);
     if(!bret) printf("error sending telemetry: humidity\n");
 
-    socket->~TLSSocket();
+    printf("TLS handshakes: %lu (full: %lu, resumed: %lu), connection reused: %lu\n",
+      (unsigned long)tls.handshakes(), (unsigned long)tls_sessions.full_handshakes(),
+      (unsigned long)tls_sessions.resumed_handshakes(), (unsigned long)tls.reuses());
     
     thread_sleep_for(15000);
   }
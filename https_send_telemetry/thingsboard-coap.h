@@ -0,0 +1,345 @@
+#ifndef _THINGSBOARD_COAP_H_
+#define _THINGSBOARD_COAP_H_
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "mbed.h"
+
+/**
+ * Minimal ThingsBoard client for the CoAP device API (RFC 7252), e.g.
+ *   POST coap://host/api/v1/<token>/telemetry
+ * Every upload is one confirmable message of a few bytes of header over UDP,
+ * there is no connection setup. Lost messages are retransmitted with
+ * exponential backoff, uploads larger than BLOCK bytes are sent block-wise
+ * (Block1, RFC 7959). The socket has to be connected to the server address,
+ * it can be a UDPSocket (port 5683) or a DTLSSocket (port 5684).
+ * BLOCK has to be a power of two from 16 to 1024.
+ * Message IDs, tokens and the retransmission jitter come from a xorshift32
+ * seeded per device, e.g. with the chip UID, so devices booting together
+ * do not use the same IDs.
+ *
+ *   ThingsBoardCoap<> coap(HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2());
+ *   udp.open(net);
+ *   udp.connect(address);
+ *   coap.begin(&udp, TOKEN);
+ *   coap.sendTelemetryJson("{\"temperature\":22.5}");
+ */
+template <size_t BLOCK = 256>
+class ThingsBoardCoap {
+  static_assert(BLOCK >= 16 && BLOCK <= 1024 && (BLOCK & (BLOCK - 1)) == 0, "BLOCK has to be a power of two from 16 to 1024");
+
+public:
+  // RFC 7252 transmission parameters
+  static const int ACK_TIMEOUT_MS = 2000;
+  static const int MAX_RETRANSMIT = 4;
+
+  ThingsBoardCoap(uint32_t seed = 1)
+    : _socket(NULL), _token(NULL), _seed(seed ? seed : 1), _code(0),
+      _datagrams(0), _retransmits(0), _bytes(0), _rtt_us(0) {
+    _message_id = (uint16_t)random();
+  }
+
+  void begin(Socket *socket, const char *token) {
+    _socket = socket;
+    _token = token;
+  }
+
+  bool sendTelemetryJson(const char *json) {
+    return post("telemetry", json, strlen(json));
+  }
+
+  bool sendAttributeJSON(const char *json) {
+    return post("attributes", json, strlen(json));
+  }
+
+  bool sendTelemetryInt(const char *key, int value) {
+    return postf("telemetry", "{\"%s\":%d}", key, value);
+  }
+
+  bool sendTelemetryBool(const char *key, bool value) {
+    return postf("telemetry", "{\"%s\":%s}", key, value ? "true" : "false");
+  }
+
+  bool sendTelemetryFloat(const char *key, float value) {
+    return postf("telemetry", "{\"%s\":%.2f}", key, (double)value);
+  }
+
+  bool sendAttributeInt(const char *key, int value) {
+    return postf("attributes", "{\"%s\":%d}", key, value);
+  }
+
+  bool sendAttributeBool(const char *key, bool value) {
+    return postf("attributes", "{\"%s\":%s}", key, value ? "true" : "false");
+  }
+
+  bool sendAttributeString(const char *key, const char *value) {
+    return postf("attributes", "{\"%s\":\"%s\"}", key, value);
+  }
+
+  /**
+   * POST payload to /api/v1/<token>/<type>, block-wise if it is larger than BLOCK.
+   * true if the server answered with 2.04 Changed.
+   */
+  bool post(const char *type, const char *payload, size_t len) {
+    if (!_socket || !_token)
+      return false;
+
+    Timer rtt;
+    rtt.start();
+
+    // a random token matches responses to this request
+    uint32_t r = random();
+    uint8_t token[2] = { (uint8_t)r, (uint8_t)(r >> 8) };
+    bool blockwise = len > BLOCK;
+    uint32_t num = 0;
+    size_t offset = 0;
+
+    do {
+      size_t n = len - offset < BLOCK ? len - offset : BLOCK;
+      bool more = offset + n < len;
+      uint32_t block1 = blockwise ? (num << 4 | (more ? 0x08 : 0) | szx()) : NO_BLOCK;
+
+      size_t size = encode(token, type, block1, payload + offset, n);
+      if (size == 0)
+        return false;
+      if (!exchange(size, token))
+        return false;
+
+      if (more && _code != CODE_CONTINUE) {
+        printf("[COAP] Block %lu rejected (%d.%02d)\n", (unsigned long)num, _code >> 5, _code & 0x1F);
+        return false;
+      }
+      offset += n;
+      num++;
+    } while (offset < len);
+
+    _rtt_us = (uint32_t)rtt.elapsed_time().count();
+    if (_code != CODE_CHANGED && _code != CODE_CREATED) {
+      printf("[COAP] Upload rejected (%d.%02d)\n", _code >> 5, _code & 0x1F);
+      return false;
+    }
+    return true;
+  }
+
+  // response code of the last request, class in bits 5-7 and detail in bits 0-4
+  uint8_t code() const { return _code; }
+  // datagrams sent including retransmissions and ACKs of separate responses
+  uint32_t datagrams() const { return _datagrams; }
+  uint32_t retransmits() const { return _retransmits; }
+  uint32_t bytes() const { return _bytes; }
+  // time from the first datagram to the final response of the last successful upload
+  uint32_t rtt_us() const { return _rtt_us; }
+
+private:
+  enum {
+    TYPE_CON = 0,
+    TYPE_NON = 1,
+    TYPE_ACK = 2,
+    TYPE_RST = 3
+  };
+
+  enum {
+    CODE_EMPTY = 0x00,
+    CODE_POST = 0x02,
+    CODE_CREATED = 0x41,    // 2.01
+    CODE_CHANGED = 0x44,    // 2.04
+    CODE_CONTINUE = 0x5F    // 2.31
+  };
+
+  enum {
+    OPTION_URI_PATH = 11,
+    OPTION_CONTENT_FORMAT = 12,
+    OPTION_BLOCK1 = 27
+  };
+
+  static const uint32_t NO_BLOCK = 0xFFFFFFFF;
+  // room for the header, the options and the payload marker
+  static const size_t HEADER_SIZE = 128;
+
+  static uint8_t szx() {
+    uint8_t s = 0;
+    while ((16u << s) < BLOCK)
+      s++;
+    return s;
+  }
+
+  bool postf(const char *type, const char *fmt, ...) {
+    char payload[BLOCK];
+    va_list args;
+
+    va_start(args, fmt);
+    int ret = vsnprintf(payload, sizeof(payload), fmt, args);
+    va_end(args);
+    if (ret < 0 || (size_t)ret >= sizeof(payload))
+      return false;
+    return post(type, payload, ret);
+  }
+
+  // option with delta/length nibbles and extended bytes
+  static size_t putOption(uint8_t *p, uint16_t &last, uint16_t number, const void *value, size_t len) {
+    size_t n = 1;
+    uint16_t delta = number - last;
+    uint8_t dn = delta < 13 ? delta : (delta < 269 ? 13 : 14);
+    uint8_t ln = len < 13 ? len : (len < 269 ? 13 : 14);
+
+    p[0] = dn << 4 | ln;
+    if (dn == 13)
+      p[n++] = delta - 13;
+    else if (dn == 14) {
+      p[n++] = (delta - 269) >> 8;
+      p[n++] = (delta - 269) & 0xFF;
+    }
+    if (ln == 13)
+      p[n++] = len - 13;
+    else if (ln == 14) {
+      p[n++] = (len - 269) >> 8;
+      p[n++] = (len - 269) & 0xFF;
+    }
+    memcpy(p + n, value, len);
+    last = number;
+    return n + len;
+  }
+
+  // option value as shortest big endian unsigned integer
+  static size_t putUintOption(uint8_t *p, uint16_t &last, uint16_t number, uint32_t value) {
+    uint8_t buf[4];
+    size_t len = 0;
+
+    for (int shift = 24; shift >= 0; shift -= 8)
+      if (len || (value >> shift) & 0xFF)
+        buf[len++] = (value >> shift) & 0xFF;
+    return putOption(p, last, number, buf, len);
+  }
+
+  // confirmable POST into _tx, returns its size or 0 if it does not fit
+  size_t encode(const uint8_t *token, const char *type, uint32_t block1, const char *payload, size_t len) {
+    uint8_t *p = _tx;
+    uint16_t last = 0;
+    size_t n = 0;
+
+    if (strlen(_token) + strlen(type) + 32 > HEADER_SIZE)
+      return 0;
+
+    _message_id++;
+    p[n++] = 0x40 | TYPE_CON << 4 | 2;       // version 1, token length 2
+    p[n++] = CODE_POST;
+    p[n++] = _message_id >> 8;
+    p[n++] = _message_id & 0xFF;
+    p[n++] = token[0];
+    p[n++] = token[1];
+
+    n += putOption(p + n, last, OPTION_URI_PATH, "api", 3);
+    n += putOption(p + n, last, OPTION_URI_PATH, "v1", 2);
+    n += putOption(p + n, last, OPTION_URI_PATH, _token, strlen(_token));
+    n += putOption(p + n, last, OPTION_URI_PATH, type, strlen(type));
+    n += putUintOption(p + n, last, OPTION_CONTENT_FORMAT, 50);   // application/json
+    if (block1 != NO_BLOCK)
+      n += putUintOption(p + n, last, OPTION_BLOCK1, block1);
+
+    p[n++] = 0xFF;
+    memcpy(p + n, payload, len);
+    return n + len;
+  }
+
+  nsapi_error_t send(const void *data, size_t len) {
+    nsapi_size_or_error_t ret = _socket->send(data, len);
+    if (ret < 0)
+      return ret;
+    _datagrams++;
+    _bytes += ret;
+    return NSAPI_ERROR_OK;
+  }
+
+  /**
+   * Send the request in _tx and wait for the response, retransmitted up to
+   * MAX_RETRANSMIT times with doubling timeouts. Handles piggybacked and
+   * separate responses, the response code is stored in _code.
+   */
+  bool exchange(size_t size, const uint8_t *token) {
+    // initial timeout between ACK_TIMEOUT and 1.5 * ACK_TIMEOUT
+    int timeout = ACK_TIMEOUT_MS + (int)(random() % (ACK_TIMEOUT_MS / 2));
+    bool acked = false;
+
+    for (int attempt = 0; attempt <= MAX_RETRANSMIT; attempt++) {
+      if (attempt > 0) {
+        _retransmits++;
+        timeout *= 2;
+      }
+      if (send(_tx, size) != NSAPI_ERROR_OK)
+        return false;
+
+      Timer t;
+      t.start();
+      while (true) {
+        int left = timeout - (int)std::chrono::duration_cast<std::chrono::milliseconds>(t.elapsed_time()).count();
+        if (left <= 0)
+          break;
+        _socket->set_timeout(left);
+        nsapi_size_or_error_t ret = _socket->recv(_rx, sizeof(_rx));
+        if (ret == NSAPI_ERROR_WOULD_BLOCK)
+          break;
+        if (ret < 0)
+          return false;
+        if (ret < 4 || (_rx[0] & 0xC0) != 0x40)
+          continue;
+
+        uint8_t mtype = (_rx[0] >> 4) & 0x03;
+        uint8_t tkl = _rx[0] & 0x0F;
+        uint8_t code = _rx[1];
+        uint16_t id = _rx[2] << 8 | _rx[3];
+
+        if (mtype == TYPE_RST && id == _message_id) {
+          printf("[COAP] Request reset by server\n");
+          return false;
+        }
+        if (mtype == TYPE_ACK && id == _message_id && code == CODE_EMPTY) {
+          // separate response follows, it is not retransmitted by us anymore
+          acked = true;
+          timeout = ACK_TIMEOUT_MS * (1 << MAX_RETRANSMIT);
+          t.reset();
+          continue;
+        }
+        bool ours = tkl == 2 && (size_t)ret >= 6 && _rx[4] == token[0] && _rx[5] == token[1];
+        if (mtype == TYPE_ACK && id == _message_id && ours) {
+          _code = code;
+          return true;
+        }
+        if ((mtype == TYPE_CON || mtype == TYPE_NON) && ours) {
+          if (mtype == TYPE_CON) {
+            uint8_t ack[4] = { (uint8_t)(0x40 | TYPE_ACK << 4), CODE_EMPTY, _rx[2], _rx[3] };
+            send(ack, sizeof(ack));
+          }
+          _code = code;
+          return true;
+        }
+      }
+      if (acked)
+        break;
+    }
+    printf("[COAP] No response from server\n");
+    return false;
+  }
+
+  // xorshift32, deterministic for a given seed
+  uint32_t random() {
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+  }
+
+  Socket *_socket;
+  const char *_token;
+  uint32_t _seed;
+  uint16_t _message_id;
+  uint8_t _code;
+  uint8_t _tx[HEADER_SIZE + BLOCK];
+  uint8_t _rx[64];
+  uint32_t _datagrams;
+  uint32_t _retransmits;
+  uint32_t _bytes;
+  uint32_t _rtt_us;
+};
+
+#endif // _THINGSBOARD_COAP_H_
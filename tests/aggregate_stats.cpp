@@ -0,0 +1,232 @@
+// Checks the Welford statistics of RunningStats against a two-pass
+// reference in double precision, next to the naive single precision sum of
+// squares that loses the variance of values with a large offset (CO2 around
+// 900 ppm, humidity around 45 %RH), and the windows of TelemetryAggregate
+// over the room sensor trace: NaN values skipped, unselected keys left out,
+// and the queue of closed windows while the uploads fail.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests tests/aggregate_stats.cpp -o aggregate_stats
+//   ./aggregate_stats tests/room-trace.csv
+
+#include <stdarg.h>
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+#include "telemetry-aggregate.h"
+#include "room-trace.h"
+
+#define TRACE_MAX 4096
+#define AGGREGATE_WINDOW 60
+
+// the settings of https_room_sensor
+const BatchKey roomKeys[5] = {
+  { "temperature",  2 },
+  { "humidity",     2 },
+  { "VOCindex",     0 },
+  { "CO2",          0 },
+  { "light",        1 },
+};
+const uint8_t roomAggregates[5] = {
+  AGG_MIN | AGG_MAX | AGG_MEAN,             // temperature
+  AGG_MEAN,                                 // humidity
+  AGG_MAX | AGG_MEAN,                       // VOCindex
+  AGG_MIN | AGG_MAX | AGG_MEAN | AGG_STDDEV, // CO2
+  AGG_MEAN,                                 // light
+};
+
+RoomSample trace[TRACE_MAX];
+size_t traceLen;
+
+// statistics of the values in double precision, with two passes
+struct Reference {
+  Reference(const std::vector<float> &values) : min(values[0]), max(values[0]), mean(0.0), stddev(0.0) {
+    for (size_t i = 0; i < values.size(); i++) {
+      mean += values[i];
+      min = values[i] < min ? values[i] : min;
+      max = values[i] > max ? values[i] : max;
+    }
+    mean /= values.size();
+    for (size_t i = 0; i < values.size(); i++)
+      stddev += (values[i] - mean) * (values[i] - mean);
+    stddev = sqrt(stddev / values.size());
+  }
+
+  double min;
+  double max;
+  double mean;
+  double stddev;
+};
+
+// the textbook formula in single precision: E[x^2] - E[x]^2
+float naiveStddev(const std::vector<float> &values) {
+  float sum = 0.0f;
+  float squares = 0.0f;
+  for (size_t i = 0; i < values.size(); i++) {
+    sum += values[i];
+    squares += values[i] * values[i];
+  }
+  float mean = sum / values.size();
+  float variance = squares / values.size() - mean * mean;
+  return variance > 0.0f ? sqrtf(variance) : 0.0f;
+}
+
+/**************************************************************************/
+/*
+    values with a large offset and a small spread, Welford has to stay close
+    to the reference where the naive formula does not
+*/
+/**************************************************************************/
+bool checkOffset(const char *name, float offset, float spread, size_t n) {
+  std::vector<float> values;
+  RunningStats stats;
+  uint32_t seed = 12345;
+
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    values.push_back(offset + spread * ((float)(seed >> 8) / (1 << 24) - 0.5f));
+    stats.add(values.back());
+  }
+  Reference ref(values);
+  double welford = fabs(stats.stddev() - ref.stddev) / ref.stddev;
+  double naive = fabs(naiveStddev(values) - ref.stddev) / ref.stddev;
+  printf("[TEST] %-12s %6u values: stddev %.4f, error welford %.5f%%, naive %.2f%%\n", name, (unsigned)n,
+    ref.stddev, 100.0 * welford, 100.0 * naive);
+
+  CHECK(stats.count() == n, "%s: count %lu", name, (unsigned long)stats.count());
+  CHECK(stats.min() == (float)ref.min && stats.max() == (float)ref.max, "%s: min or max", name);
+  CHECK(fabs(stats.mean() - ref.mean) <= 1e-5 * fabs(ref.mean), "%s: mean %f, reference %f", name, stats.mean(), ref.mean);
+  CHECK(welford < 1e-3, "%s: stddev %f, reference %f", name, stats.stddev(), ref.stddev);
+  return true;
+}
+
+// JSON of the aggregate into a string
+class Writer {
+public:
+  MBED_PRINTF_METHOD(1, 2)
+  void put(const char *fmt, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    json += text;
+  }
+
+  std::string json;
+};
+
+/**************************************************************************/
+/*
+    the windows of the room sensor over the trace against the reference
+*/
+/**************************************************************************/
+bool checkWindows() {
+  TelemetryAggregate<5> aggregate(roomKeys, roomAggregates, AGGREGATE_WINDOW);
+  std::vector<float> values[5];
+  size_t windows = 0;
+
+  for (size_t i = 0; i < traceLen; i++) {
+    RoomSample row = trace[i];
+    // the 0 of the SGP40 warm-up stands in for a value that was not read (NaN)
+    if (row.values[2] == 0.0f)
+      row.values[2] = NAN;
+    aggregate.add(row);
+    for (size_t k = 0; k < 5; k++)
+      if (!isnan(row.values[k]))
+        values[k].push_back(row.values[k]);
+    if (!aggregate.complete())
+      continue;
+
+    for (size_t k = 0; k < 5; k++) {
+      const RunningStats &s = aggregate.stats(k);
+      CHECK(s.count() == values[k].size(), "window %u: key %u has %lu values, expected %u", (unsigned)windows,
+        (unsigned)k, (unsigned long)s.count(), (unsigned)values[k].size());
+      if (values[k].empty())
+        continue;
+      Reference ref(values[k]);
+      CHECK(fabs(s.mean() - ref.mean) <= 1e-5 * fabs(ref.mean) + 1e-6, "window %u: mean of key %u", (unsigned)windows, (unsigned)k);
+      CHECK(fabs(s.stddev() - ref.stddev) <= 1e-3 * ref.stddev + 1e-4, "window %u: stddev of key %u is %f, reference %f",
+        (unsigned)windows, (unsigned)k, s.stddev(), ref.stddev);
+      CHECK(s.min() == (float)ref.min && s.max() == (float)ref.max, "window %u: min or max of key %u", (unsigned)windows, (unsigned)k);
+    }
+
+    Writer w;
+    aggregate.render(w);
+    CHECK(w.json.find("\"temperature_min\":") != std::string::npos && w.json.find("\"CO2_stddev\":") != std::string::npos,
+      "window %u: %s", (unsigned)windows, w.json.c_str());
+    CHECK(w.json.find("humidity_max") == std::string::npos && w.json.find("light_stddev") == std::string::npos,
+      "window %u: unselected statistics in %s", (unsigned)windows, w.json.c_str());
+    // a window without VOC values has no VOC statistics
+    CHECK((w.json.find("VOCindex_") != std::string::npos) == !values[2].empty(), "window %u: VOCindex in %s",
+      (unsigned)windows, w.json.c_str());
+
+    aggregate.reset();
+    for (size_t k = 0; k < 5; k++)
+      values[k].clear();
+    windows++;
+  }
+  printf("[TEST] room trace: %u windows of %d samples match the reference\n", (unsigned)windows, AGGREGATE_WINDOW);
+  CHECK(windows == traceLen / AGGREGATE_WINDOW, "%u windows", (unsigned)windows);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    windows closed while the uploads fail: each keeps its own statistics and
+    timestamp until it is sent, the oldest are dropped when the queue is full
+*/
+/**************************************************************************/
+bool checkQueue() {
+  TelemetryAggregate<5> aggregate(roomKeys, roomAggregates, AGGREGATE_WINDOW);
+  AggregateQueue<5, 4> queue;
+  std::vector<std::string> closed;
+  size_t sent = 0;
+
+  for (size_t i = 0; i + AGGREGATE_WINDOW <= traceLen && closed.size() < 8; i++) {
+    aggregate.add(trace[i]);
+    if (!aggregate.complete())
+      continue;
+    Writer w;
+    aggregate.render(w);
+    closed.push_back(w.json);
+    queue.close(aggregate);
+    CHECK(aggregate.samples() == 0, "window not reset on close");
+    // the link is down while the first 4 windows close, the upload after the 7th fails
+    if (closed.size() < 5 || closed.size() == 7)
+      continue;
+    while (!queue.empty()) {
+      Writer sent_json;
+      queue.front().render(sent_json);
+      // 3 windows are kept, so windows 1 and 2 are gone when the link is back
+      size_t expect = sent == 0 ? 2 : sent;
+      CHECK(sent_json.json == closed[expect], "window %u sent as %s, closed as %s", (unsigned)expect,
+        sent_json.json.c_str(), closed[expect].c_str());
+      queue.pop();
+      sent = expect + 1;
+    }
+  }
+  CHECK(closed.size() == 8, "%u windows in the trace", (unsigned)closed.size());
+  CHECK(queue.dropped() == 2, "%lu windows dropped", (unsigned long)queue.dropped());
+  CHECK(sent == 8, "%u windows sent", (unsigned)sent);
+  CHECK(queue.empty(), "%u windows left", (unsigned)queue.size());
+  printf("[TEST] queue: %u windows closed during failed uploads, %lu dropped, the others sent in order\n",
+    (unsigned)closed.size(), (unsigned long)queue.dropped());
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  traceLen = loadTrace(argc > 1 ? argv[1] : "tests/room-trace.csv", trace, TRACE_MAX);
+  if (traceLen == 0)
+    return 1;
+
+  bool ok = checkOffset("CO2", 900.0f, 8.0f, 3600);
+  ok = checkOffset("humidity", 45.0f, 0.1f, 3600) && ok;
+  ok = checkOffset("temperature", 22.0f, 0.05f, 60) && ok;
+  ok = checkWindows() && ok;
+  ok = checkQueue() && ok;
+
+  printf("[TEST] aggregate_stats %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
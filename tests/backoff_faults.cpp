@@ -0,0 +1,290 @@
+// Runs the connection recovery of https_room_sensor, recoverConnection() with
+// its DnsCache, against a simulated network with injected faults and checks
+// that ReconnectBackoff escalates only as far as needed: a short outage of
+// the server is bridged by reopening the socket, a moved server by resolving
+// the host again, a broken link by reconnecting the interface, and only a
+// permanent outage ends in a reset. The first delay is 1 to 2 s, the delays
+// double up to 300 s, every 3 failures escalate one step, and devices with
+// different seeds do not retry at the same time.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests tests/backoff_faults.cpp -o backoff_faults -lpthread
+//   ./backoff_faults
+
+#include <vector>
+
+#include "mbed.h"
+#include "reconnect-backoff.h"
+#include "dns-cache.h"
+#include "connection-recovery.h"
+#include "check.h"
+
+// the settings of https_room_sensor
+#define RECONNECT_BASE_MS 2000
+#define RECONNECT_MAX_MS 300000
+#define RECONNECT_ATTEMPTS 3
+const BackoffConfig backoffConfig = { RECONNECT_BASE_MS, RECONNECT_MAX_MS, RECONNECT_ATTEMPTS };
+
+#define HOST "thingsboard.example"
+#define OLD_ADDRESS "192.0.2.10"
+#define NEW_ADDRESS "192.0.2.20"
+
+/**
+ * Network with injected faults: the server can be down, it can move to
+ * another address that DNS only reports to new lookups, and the link can
+ * break until the interface is reconnected.
+ */
+class FaultyNetwork : public NetworkInterface {
+public:
+  FaultyNetwork()
+    : server_down(false), link_broken(false), server_ip(OLD_ADDRESS), dns_ip(OLD_ADDRESS),
+      connects(0), disconnects(0), lookups(0) {
+  }
+
+  nsapi_error_t connect() override {
+    connects++;
+    link_broken = false;
+    return NSAPI_ERROR_OK;
+  }
+
+  nsapi_error_t disconnect() override {
+    disconnects++;
+    return NSAPI_ERROR_OK;
+  }
+
+  nsapi_value_or_error_t getaddrinfo(const char *host, SocketAddress *hints, SocketAddress **result,
+    const char *interface_name = NULL) override {
+    lookups++;
+    if (link_broken)
+      return NSAPI_ERROR_DNS_FAILURE;
+    *result = new SocketAddress[1];
+    (*result)[0].set_ip_address(dns_ip);
+    return 1;
+  }
+
+  bool server_down;
+  bool link_broken;
+  const char *server_ip;
+  const char *dns_ip;
+  uint32_t connects;
+  uint32_t disconnects;
+  uint32_t lookups;
+};
+
+// stand-in of TLSConnection on the FaultyNetwork, the connection is decided by the faults
+class FaultyConnection {
+public:
+  enum Step {
+    STEP_NONE = 0,
+    STEP_OPEN,
+    STEP_CONNECT
+  };
+
+  FaultyConnection(FaultyNetwork &net) : closes(0), _net(net), _step(STEP_NONE) {}
+
+  nsapi_error_t connect(const SocketAddress &address) {
+    _step = STEP_CONNECT;
+    if (_net.link_broken)
+      return NSAPI_ERROR_NO_CONNECTION;
+    if (_net.server_down || strcmp(address.get_ip_address(), _net.server_ip) != 0)
+      return NSAPI_ERROR_CONNECTION_TIMEOUT;
+    _step = STEP_NONE;
+    return NSAPI_ERROR_OK;
+  }
+
+  void close() {
+    closes++;
+  }
+
+  Step failed_step() const { return _step; }
+
+  uint32_t closes;
+
+private:
+  FaultyNetwork &_net;
+  Step _step;
+};
+
+// a failure reported to the backoff
+struct Failure {
+  uint32_t failures;                // failures since the last success or reset
+  ReconnectBackoff::Step step;
+  uint32_t delay_ms;
+};
+
+// a room sensor with its network, the time is simulated in ms
+struct Device {
+  Device(uint32_t seed)
+    : dns(&net, HOST, 443), conn(net), backoff(backoffConfig, seed), resets(0), recovered_ms(0), max_step(0) {
+    dns.resolve(0);
+    dns.address(adr);
+    net.lookups = 0;
+  }
+
+  FaultyNetwork net;
+  DnsCache<4> dns;
+  FaultyConnection conn;
+  ReconnectBackoff backoff;
+  SocketAddress adr;
+  std::vector<uint32_t> attempts;   // times of the connection attempts
+  std::vector<Failure> failures;
+  uint32_t resets;
+  uint32_t recovered_ms;            // first successful connection
+  int max_step;
+};
+
+/**************************************************************************/
+/*
+    one connection attempt of the upload loop if the backoff allows it,
+    recoverConnection() after a failure
+*/
+/**************************************************************************/
+void attempt(Device &d, uint32_t now_ms) {
+  if (!d.backoff.ready(now_ms))
+    return;
+  d.attempts.push_back(now_ms);
+
+  if (d.conn.connect(d.adr) == NSAPI_ERROR_OK) {
+    if (d.backoff.failures() && !d.recovered_ms)
+      d.recovered_ms = now_ms;
+    d.backoff.success();
+    return;
+  }
+
+  ReconnectBackoff::Step step = recoverConnection(d.backoff, now_ms, d.conn, d.dns, &d.net, d.adr);
+  Failure f = { d.backoff.failures(), step, d.backoff.delay_ms() };
+  d.failures.push_back(f);
+  if ((int)step > d.max_step)
+    d.max_step = step;
+  if (step == ReconnectBackoff::STEP_RESET) {
+    // the reboot starts over with a fresh backoff, connects the interface and resolves
+    d.resets++;
+    d.backoff = ReconnectBackoff(backoffConfig, d.resets * 7919 + 1);
+    d.net.connect();
+    d.dns.resolve(now_ms / 1000);
+    d.dns.address(d.adr);
+  }
+}
+
+// the upload loop checks the connection every second
+void run(Device &d, uint32_t from_ms, uint32_t to_ms) {
+  for (uint32_t t = from_ms; t < to_ms; t += 1000)
+    attempt(d, t);
+}
+
+bool checkServerRestart() {
+  Device d(0x1234);
+  d.net.server_down = true;
+  run(d, 0, 5000);
+  d.net.server_down = false;
+  run(d, 5000, 60000);
+  printf("[TEST] server restart: recovered after %lu ms, step %s\n", (unsigned long)d.recovered_ms,
+    ReconnectBackoff::name((ReconnectBackoff::Step)d.max_step));
+  CHECK(d.recovered_ms > 0 && d.recovered_ms < 5000 + 8000, "server restart: not recovered in time");
+  CHECK(d.max_step == ReconnectBackoff::STEP_REOPEN_SOCKET, "server restart: escalated to %s",
+    ReconnectBackoff::name((ReconnectBackoff::Step)d.max_step));
+  CHECK(d.net.lookups == 0 && d.net.disconnects == 0 && d.resets == 0, "server restart: needless recovery");
+  CHECK(d.backoff.failures() == 0, "server restart: failures not cleared");
+  return true;
+}
+
+bool checkServerMoved() {
+  Device d(0x2345);
+  d.net.server_ip = NEW_ADDRESS;
+  d.net.dns_ip = NEW_ADDRESS;
+  run(d, 0, 120000);
+  printf("[TEST] server moved: recovered after %lu ms with %lu lookups, step %s\n", (unsigned long)d.recovered_ms,
+    (unsigned long)d.net.lookups, ReconnectBackoff::name((ReconnectBackoff::Step)d.max_step));
+  CHECK(d.recovered_ms > 0, "server moved: not recovered");
+  CHECK(d.max_step == ReconnectBackoff::STEP_RESOLVE, "server moved: recovered at %s",
+    ReconnectBackoff::name((ReconnectBackoff::Step)d.max_step));
+  CHECK(d.net.lookups >= 1 && d.net.disconnects == 0 && d.resets == 0, "server moved: wrong recovery");
+  CHECK(strcmp(d.adr.get_ip_address(), NEW_ADDRESS) == 0, "server moved: still using %s", d.adr.get_ip_address());
+  return true;
+}
+
+bool checkLinkBroken() {
+  Device d(0x3456);
+  d.net.link_broken = true;
+  run(d, 0, 300000);
+  printf("[TEST] link broken: recovered after %lu ms with %lu interface reconnects, step %s\n",
+    (unsigned long)d.recovered_ms, (unsigned long)d.net.disconnects, ReconnectBackoff::name((ReconnectBackoff::Step)d.max_step));
+  CHECK(d.recovered_ms > 0, "link broken: not recovered");
+  CHECK(d.max_step == ReconnectBackoff::STEP_RECONNECT_INTERFACE, "link broken: recovered at %s",
+    ReconnectBackoff::name((ReconnectBackoff::Step)d.max_step));
+  CHECK(d.net.disconnects == 1 && d.resets == 0, "link broken: %lu reconnects, %lu resets",
+    (unsigned long)d.net.disconnects, (unsigned long)d.resets);
+  return true;
+}
+
+bool checkOutage() {
+  Device d(0x4567);
+  const uint32_t hour = 3600000;
+  d.net.server_down = true;
+  run(d, 0, hour);
+  printf("[TEST] outage: %u attempts and %lu resets in an hour, first delay %lu ms\n", (unsigned)d.attempts.size(),
+    (unsigned long)d.resets, (unsigned long)d.failures[0].delay_ms);
+  CHECK(d.resets >= 1, "outage: no reset");
+  CHECK(d.failures[0].delay_ms >= 1000 && d.failures[0].delay_ms <= 2000, "outage: first delay %lu ms",
+    (unsigned long)d.failures[0].delay_ms);
+  bool capped = false;
+  for (size_t i = 0; i < d.failures.size(); i++) {
+    const Failure &f = d.failures[i];
+    // 3 failures per step: socket, resolve, interface, then the reset
+    int step = (f.failures - 1) / 3 < 3 ? (f.failures - 1) / 3 : 3;
+    CHECK(f.step == step, "outage: failure %lu at step %s", (unsigned long)f.failures, ReconnectBackoff::name(f.step));
+    CHECK(f.delay_ms <= 300000, "outage: delay of %lu ms", (unsigned long)f.delay_ms);
+    // 2 s doubled 8 times is beyond 300 s, the jitter keeps at least half of it
+    if (f.failures >= 9) {
+      CHECK(f.delay_ms >= 150000, "outage: delay of %lu ms after %lu failures", (unsigned long)f.delay_ms,
+        (unsigned long)f.failures);
+      capped = true;
+    }
+  }
+  CHECK(capped, "outage: the delay never reached the limit");
+  for (size_t i = 1; i < d.attempts.size(); i++)
+    CHECK(d.attempts[i] - d.attempts[i - 1] <= 300000 + 1000, "outage: %lu ms without an attempt",
+      (unsigned long)(d.attempts[i] - d.attempts[i - 1]));
+  CHECK(d.attempts.size() < 100, "outage: the server is hammered");
+  return true;
+}
+
+/**************************************************************************/
+/*
+    devices failing together retry spread out over time
+*/
+/**************************************************************************/
+bool checkJitter() {
+  const int devices = 50;
+  std::vector<Device *> fleet;
+  for (int i = 0; i < devices; i++) {
+    fleet.push_back(new Device(0x9E3779B9u * (i + 1)));
+    fleet.back()->net.server_down = true;
+  }
+  for (int i = 0; i < devices; i++)
+    run(*fleet[i], 0, 60000);
+
+  // attempts per second once the delays are longer than the 1 s of the loop
+  std::vector<int> per_second(60, 0);
+  int worst = 0;
+  for (int i = 0; i < devices; i++)
+    for (size_t a = 0; a < fleet[i]->attempts.size(); a++)
+      if (fleet[i]->attempts[a] >= 15000)
+        worst = std::max(worst, ++per_second[fleet[i]->attempts[a] / 1000]);
+  for (int i = 0; i < devices; i++)
+    delete fleet[i];
+  printf("[TEST] jitter: at most %d of %d devices retry in the same second\n", worst, devices);
+  CHECK(worst <= devices / 3, "jitter: %d devices retry in the same second", worst);
+  return true;
+}
+
+int main() {
+  bool ok = checkServerRestart();
+  ok = checkServerMoved() && ok;
+  ok = checkLinkBroken() && ok;
+  ok = checkOutage() && ok;
+  ok = checkJitter() && ok;
+
+  printf("[TEST] backoff_faults %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
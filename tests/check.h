@@ -0,0 +1,16 @@
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <stdio.h>
+
+// a check of the tests, a failure is printed and the calling check returns false
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      printf("[TEST] FAILED %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      return false; \
+    } \
+  } while (0)
+
+#endif // _CHECK_H_
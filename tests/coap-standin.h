@@ -0,0 +1,237 @@
+#ifndef _COAP_STANDIN_H_
+#define _COAP_STANDIN_H_
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+
+/**
+ * ThingsBoard CoAP stand-in of the tests: a UDP server on a free port of
+ * localhost that answers confirmable POSTs latency_ms after they arrived,
+ * with 2.04 Changed piggybacked on the ACK, or 2.31 Continue for a Block1
+ * block with more to follow. The blocks of a transfer are put together into
+ * payload. A message ID that was already answered gets the same answer
+ * again without processing the request twice, like RFC 7252 deduplication.
+ * The settings can be changed between the requests:
+ *  - drop is the number of the next answers that are lost on the way back,
+ *    the retransmissions of the client are answered
+ *  - drop_block loses the first answer to the Block1 block with that number,
+ *    -1 loses none
+ *  - separate sends an empty ACK first and the response as a confirmable
+ *    message of its own, which the client has to acknowledge
+ * The arrival times of the datagrams of the last request are kept, so a test
+ * can check the retransmission timeouts.
+ */
+class CoapStandin {
+public:
+  CoapStandin()
+    : latency_ms(0), drop(0), drop_block(-1), separate(false), datagrams(0), requests(0), duplicates(0), blocks(0),
+      bytes(0), acks(0), _fd(-1), _port(0) {
+  }
+
+  ~CoapStandin() {
+    if (_fd >= 0)
+      ::close(_fd);
+  }
+
+  // bind a free port and answer in the background
+  bool start() {
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(_fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || getsockname(_fd, (struct sockaddr *)&sa, &len) != 0) {
+      printf("[TEST] stand-in server can not bind\n");
+      return false;
+    }
+    _port = ntohs(sa.sin_port);
+    std::thread(&CoapStandin::serving, this).detach();
+    return true;
+  }
+
+  SocketAddress address() const { return SocketAddress("127.0.0.1", _port); }
+
+  // the payload of the last complete upload
+  std::string payload() {
+    std::lock_guard<std::mutex> lock(_m);
+    return _payload;
+  }
+
+  // ms between the first datagram of the last request and its retransmissions
+  std::vector<uint32_t> retransmissions() {
+    std::lock_guard<std::mutex> lock(_m);
+    std::vector<uint32_t> ms;
+    for (size_t i = 1; i < _arrivals.size(); i++)
+      ms.push_back((uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(_arrivals[i] - _arrivals[0]).count());
+    return ms;
+  }
+
+  std::atomic<uint32_t> latency_ms;
+  std::atomic<uint32_t> drop;
+  std::atomic<int> drop_block;
+  std::atomic<bool> separate;
+
+  // datagrams and bytes received, requests processed, retransmitted requests
+  // answered again, Block1 blocks and ACKs of separate responses since start()
+  std::atomic<uint32_t> datagrams;
+  std::atomic<uint32_t> requests;
+  std::atomic<uint32_t> duplicates;
+  std::atomic<uint32_t> blocks;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint32_t> acks;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  enum {
+    TYPE_CON = 0,
+    TYPE_ACK = 2
+  };
+
+  void serving() {
+    uint8_t buf[2048];
+    uint16_t last_id = 0;
+    uint16_t separate_id = 0x8000;
+
+    while (true) {
+      struct sockaddr_storage from;
+      socklen_t len = sizeof(from);
+      ssize_t n = recvfrom(_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+      if (n < 0)
+        return;
+      datagrams++;
+      bytes += n;
+      if (n < 4 || (buf[0] & 0xC0) != 0x40)
+        continue;
+      uint8_t type = (buf[0] >> 4) & 0x03;
+      uint8_t tkl = buf[0] & 0x0F;
+      uint16_t id = buf[2] << 8 | buf[3];
+      if (type == TYPE_ACK) {
+        acks++;
+        continue;
+      }
+      if (type != TYPE_CON || (size_t)n < 4u + tkl)
+        continue;
+      {
+        std::lock_guard<std::mutex> lock(_m);
+        if (id != last_id)
+          _arrivals.clear();
+        _arrivals.push_back(Clock::now());
+      }
+      last_id = id;
+
+      std::vector<uint8_t> answer;
+      int block = -1;
+      std::map<uint16_t, std::vector<uint8_t> >::iterator seen = _answered.find(id);
+      if (seen != _answered.end()) {
+        duplicates++;
+        answer = seen->second;
+      } else {
+        answer = process(buf, n, tkl, block);
+        _answered[id] = answer;
+      }
+      if (latency_ms)
+        ThisThread::sleep_for(std::chrono::milliseconds(latency_ms.load()));
+      if (drop > 0) {
+        drop--;
+        continue;
+      }
+      if (block >= 0 && block == drop_block) {
+        drop_block = -1;
+        continue;
+      }
+      if (separate) {
+        uint8_t ack[4] = { 0x40 | TYPE_ACK << 4, 0x00, buf[2], buf[3] };
+        sendto(_fd, ack, sizeof(ack), 0, (struct sockaddr *)&from, len);
+        answer[0] = (answer[0] & 0xCF) | TYPE_CON << 4;
+        answer[2] = ++separate_id >> 8;
+        answer[3] = separate_id & 0xFF;
+      }
+      sendto(_fd, answer.data(), answer.size(), 0, (struct sockaddr *)&from, len);
+    }
+  }
+
+  // a new request: the blocks are put together, the answer is returned
+  std::vector<uint8_t> process(const uint8_t *buf, size_t n, uint8_t tkl, int &block) {
+    size_t p = 4 + tkl;
+    uint16_t number = 0;
+    uint32_t block1 = 0;
+    bool has_block1 = false;
+
+    requests++;
+    while (p < n && buf[p] != 0xFF) {
+      uint16_t delta = buf[p] >> 4, length = buf[p] & 0x0F;
+      p++;
+      if (delta == 13)
+        delta = 13 + buf[p++];
+      else if (delta == 14) {
+        delta = 269 + (buf[p] << 8 | buf[p + 1]);
+        p += 2;
+      }
+      if (length == 13)
+        length = 13 + buf[p++];
+      else if (length == 14) {
+        length = 269 + (buf[p] << 8 | buf[p + 1]);
+        p += 2;
+      }
+      number += delta;
+      if (number == 27) {
+        has_block1 = true;
+        for (uint16_t i = 0; i < length; i++)
+          block1 = block1 << 8 | buf[p + i];
+      }
+      p += length;
+    }
+    std::string data;
+    if (p < n)
+      data.assign((const char *)buf + p + 1, n - p - 1);
+
+    bool more = has_block1 && (block1 & 0x08);
+    {
+      std::lock_guard<std::mutex> lock(_m);
+      if (has_block1) {
+        blocks++;
+        block = block1 >> 4;
+        if ((block1 >> 4) == 0)
+          _assembling.clear();
+        _assembling += data;
+        if (!more)
+          _payload = _assembling;
+      } else {
+        _payload = data;
+      }
+    }
+
+    // ACK with the token, 2.31 Continue echoes the Block1 option
+    std::vector<uint8_t> answer(buf, buf + 4 + tkl);
+    answer[0] = 0x40 | TYPE_ACK << 4 | tkl;
+    answer[1] = more ? 0x5F : 0x44;
+    if (more) {
+      uint8_t value[3];
+      size_t len = 0;
+      for (int shift = 16; shift >= 0; shift -= 8)
+        if (len || (block1 >> shift) & 0xFF)
+          value[len++] = (block1 >> shift) & 0xFF;
+      answer.push_back(13 << 4 | len);
+      answer.push_back(27 - 13);
+      answer.insert(answer.end(), value, value + len);
+    }
+    return answer;
+  }
+
+  int _fd;
+  uint16_t _port;
+  std::mutex _m;
+  std::string _payload;
+  std::string _assembling;
+  std::vector<Clock::time_point> _arrivals;
+  std::map<uint16_t, std::vector<uint8_t> > _answered;
+};
+
+#endif // _COAP_STANDIN_H_
@@ -0,0 +1,175 @@
+// Runs the CoAP client of https_send_telemetry against a UDP stand-in on
+// localhost: the round trip time and the datagrams of 100 samples sent one
+// by one and as one block-wise upload, separate responses, and lost ACKs.
+// A lost ACK has to be retransmitted after ACK_TIMEOUT to 1.5 * ACK_TIMEOUT
+// with the timeout doubled for every further retransmission, and a lost ACK
+// of a Block1 block must not put the block into the upload twice.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_send_telemetry -I tests tests/coap_loopback.cpp -o coap_loopback -lpthread
+//   ./coap_loopback
+
+#include <string>
+
+#include "mbed.h"
+#include "thingsboard-coap.h"
+#include "coap-standin.h"
+#include "check.h"
+
+#define TOKEN "token_of_the_room_sensor"
+#define SAMPLES 100
+#define RTT_MS 5
+
+typedef ThingsBoardCoap<256> Coap;
+
+CoapStandin server;
+UDPSocket udp;
+
+// one sample of the room sensor as JSON
+std::string sample(int i) {
+  char json[96];
+  snprintf(json, sizeof(json), "{\"temperature\":%.1f,\"humidity\":%d,\"co2\":%d}", 21.0 + (i % 10) * 0.1,
+    40 + i % 7, 600 + i);
+  return json;
+}
+
+/**************************************************************************/
+/*
+    100 samples one upload each and as one JSON array sent block-wise
+*/
+/**************************************************************************/
+bool checkSamples(Coap &coap) {
+  uint32_t datagrams = coap.datagrams(), received = server.datagrams, rtt_sum = 0;
+
+  server.latency_ms = RTT_MS;
+  for (int i = 0; i < SAMPLES; i++) {
+    std::string json = sample(i);
+    CHECK(coap.sendTelemetryJson(json.c_str()), "sample %d not uploaded", i);
+    CHECK(server.payload() == json, "sample %d: server got %s", i, server.payload().c_str());
+    rtt_sum += coap.rtt_us();
+  }
+  datagrams = coap.datagrams() - datagrams;
+  received = server.datagrams - received;
+  printf("[TEST] one by one: %lu datagrams up, %lu received, mean RTT %lu us with %d ms latency\n",
+    (unsigned long)datagrams, (unsigned long)received, (unsigned long)(rtt_sum / SAMPLES), RTT_MS);
+  CHECK(datagrams == SAMPLES, "%lu datagrams for %d samples", (unsigned long)datagrams, SAMPLES);
+  CHECK(rtt_sum / SAMPLES >= RTT_MS * 1000, "mean RTT %lu us", (unsigned long)(rtt_sum / SAMPLES));
+  CHECK(rtt_sum / SAMPLES < RTT_MS * 1000 + 20000, "mean RTT %lu us", (unsigned long)(rtt_sum / SAMPLES));
+
+  std::string batch = "[";
+  for (int i = 0; i < SAMPLES; i++)
+    batch += (i ? "," : "") + sample(i);
+  batch += "]";
+  uint32_t blocks = server.blocks;
+  datagrams = coap.datagrams();
+  CHECK(coap.post("telemetry", batch.c_str(), batch.size()), "batch not uploaded");
+  datagrams = coap.datagrams() - datagrams;
+  blocks = server.blocks - blocks;
+  printf("[TEST] block-wise: %lu datagrams up for %u bytes, RTT %lu us\n", (unsigned long)datagrams,
+    (unsigned)batch.size(), (unsigned long)coap.rtt_us());
+  CHECK(server.payload() == batch, "batch of %u bytes, server got %u", (unsigned)batch.size(),
+    (unsigned)server.payload().size());
+  CHECK(datagrams == (batch.size() + 255) / 256, "%lu datagrams for %u bytes", (unsigned long)datagrams,
+    (unsigned)batch.size());
+  CHECK(blocks == datagrams, "%lu blocks of %lu datagrams", (unsigned long)blocks, (unsigned long)datagrams);
+  server.latency_ms = 0;
+  return true;
+}
+
+/**************************************************************************/
+/*
+    empty ACK first, the response follows as confirmable message that is
+    acknowledged by the client
+*/
+/**************************************************************************/
+bool checkSeparate(Coap &coap) {
+  uint32_t datagrams = coap.datagrams(), acks = server.acks;
+
+  server.separate = true;
+  for (int i = 0; i < 10; i++)
+    CHECK(coap.sendTelemetryJson(sample(i).c_str()), "separate response %d", i);
+  server.separate = false;
+  // the ACK of the last response may still be on its way
+  for (int i = 0; i < 100 && server.acks - acks < 10; i++)
+    ThisThread::sleep_for(std::chrono::milliseconds(1));
+  datagrams = coap.datagrams() - datagrams;
+  acks = server.acks - acks;
+  CHECK(acks == 10, "%lu separate responses acknowledged", (unsigned long)acks);
+  CHECK(datagrams == 20, "%lu datagrams for 10 separate responses", (unsigned long)datagrams);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    two answers lost: the request goes out again after the initial timeout
+    and after the doubled one, the server processes it once
+*/
+/**************************************************************************/
+bool checkLostAck(Coap &coap) {
+  uint32_t retransmits = coap.retransmits(), requests = server.requests, duplicates = server.duplicates;
+
+  server.drop = 2;
+  CHECK(coap.sendTelemetryJson(sample(0).c_str()), "upload with two lost ACKs");
+  std::vector<uint32_t> ms = server.retransmissions();
+  retransmits = coap.retransmits() - retransmits;
+  printf("[TEST] lost ACKs: retransmitted after %lu ms and %lu ms\n", ms.size() > 0 ? (unsigned long)ms[0] : 0ul,
+    ms.size() > 1 ? (unsigned long)ms[1] : 0ul);
+  CHECK(retransmits == 2 && ms.size() == 2, "%lu retransmits, %u arrivals", (unsigned long)retransmits,
+    (unsigned)ms.size());
+  // first timeout in [ACK_TIMEOUT, 1.5 * ACK_TIMEOUT), the second twice as long
+  CHECK(ms[0] >= Coap::ACK_TIMEOUT_MS && ms[0] < Coap::ACK_TIMEOUT_MS * 3 / 2 + 50,
+    "first retransmission after %lu ms", (unsigned long)ms[0]);
+  CHECK(ms[1] + 100 > 3 * ms[0] && ms[1] < 3 * ms[0] + 100, "second retransmission after %lu ms, first after %lu ms",
+    (unsigned long)ms[1], (unsigned long)ms[0]);
+  CHECK(server.requests - requests == 1, "request processed %lu times", (unsigned long)(server.requests - requests));
+  CHECK(server.duplicates - duplicates == 2, "%lu duplicates", (unsigned long)(server.duplicates - duplicates));
+  return true;
+}
+
+/**************************************************************************/
+/*
+    the answer to the third of 5 blocks lost: the block is sent again and
+    answered from the deduplication, the upload has every byte once
+*/
+/**************************************************************************/
+bool checkLostBlockAck(Coap &coap) {
+  uint32_t retransmits = coap.retransmits(), blocks = server.blocks, duplicates = server.duplicates;
+  std::string batch = "[";
+  for (int i = 0; batch.size() < 4 * 256 + 100; i++)
+    batch += (i ? "," : "") + sample(i);
+  batch += "]";
+
+  server.drop_block = 2;
+  CHECK(coap.post("telemetry", batch.c_str(), batch.size()), "block-wise upload with a lost ACK");
+  retransmits = coap.retransmits() - retransmits;
+  blocks = server.blocks - blocks;
+  printf("[TEST] lost Block1 ACK: %lu blocks, %lu retransmitted, RTT %lu us\n", (unsigned long)blocks,
+    (unsigned long)retransmits, (unsigned long)coap.rtt_us());
+  CHECK(retransmits == 1, "%lu retransmits", (unsigned long)retransmits);
+  CHECK(blocks == 5, "%lu blocks processed", (unsigned long)blocks);
+  CHECK(server.duplicates - duplicates == 1, "%lu duplicates", (unsigned long)(server.duplicates - duplicates));
+  CHECK(server.payload() == batch, "batch of %u bytes, server got %u", (unsigned)batch.size(),
+    (unsigned)server.payload().size());
+  CHECK(coap.rtt_us() >= Coap::ACK_TIMEOUT_MS * 1000u, "RTT %lu us with a lost block", (unsigned long)coap.rtt_us());
+  return true;
+}
+
+int main() {
+  if (!server.start())
+    return 1;
+  udp.open(NetworkInterface::get_default_instance());
+  if (udp.connect(server.address()) != NSAPI_ERROR_OK) {
+    printf("[TEST] no socket to the stand-in\n");
+    return 1;
+  }
+  Coap coap(HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2());
+  coap.begin(&udp, TOKEN);
+
+  bool ok = checkSamples(coap);
+  ok = checkSeparate(coap) && ok;
+  ok = checkLostAck(coap) && ok;
+  ok = checkLostBlockAck(coap) && ok;
+
+  printf("[TEST] coap_loopback %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// Replays a room sensor trace through TelemetryDeadband and TelemetryBatch
+// the way https_room_sensor uploads it and checks what ThingsBoard ends up
+// with: every sampled value is within the deadband of the value last
+// received for its key, and no key is silent longer than max_silence.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests tests/deadband_trace.cpp -o deadband_trace
+//   ./deadband_trace tests/room-trace.csv
+
+#include "mbed.h"
+#include "telemetry-deadband.h"
+#include "room-trace.h"
+
+#define TRACE_MAX 4096
+
+// the settings of https_room_sensor
+const DeadbandKey roomDeadbands[5] = {
+  { 0.1f,  300 },   // temperature
+  { 0.5f,  300 },   // humidity
+  { 5.0f,  300 },   // VOCindex
+  { 20.0f, 300 },   // CO2
+  { 10.0f, 300 },   // light
+};
+const BatchKey roomKeys[5] = {
+  { "temperature",  2 },
+  { "humidity",     2 },
+  { "VOCindex",     0 },
+  { "CO2",          0 },
+  { "light",        1 },
+};
+
+RoomSample trace[TRACE_MAX];
+RoomSample flicker[TRACE_MAX];
+size_t traceLen;
+
+// the values as ThingsBoard has them, from the uploaded rows
+struct Server {
+  bool has[5];
+  float value[5];
+  uint32_t time[5];
+  uint32_t silence[5];   // longest time between two received values
+
+  Server() {
+    for (size_t k = 0; k < 5; k++) {
+      has[k] = false;
+      value[k] = 0.0f;
+      time[k] = 0;
+      silence[k] = 0;
+    }
+  }
+
+  template <size_t ROWS>
+  void receive(const TelemetryBatch<5, ROWS> &batch) {
+    for (size_t i = 0; i < batch.count(); i++) {
+      const RoomSample &row = batch.row(i);
+      for (size_t k = 0; k < 5; k++) {
+        if (isnan(row.values[k]))
+          continue;
+        if (has[k] && row.ts - time[k] > silence[k])
+          silence[k] = row.ts - time[k];
+        has[k] = true;
+        value[k] = row.values[k];
+        time[k] = row.ts;
+      }
+    }
+  }
+};
+
+/**************************************************************************/
+/*
+    upload every interval seconds, the first upload after first seconds
+    like the warm-up of the SGP40, and check the server after each upload.
+    Every fail_every-th upload fails and its batch is discarded like without
+    the flash log, the values of it must not count as sent.
+*/
+/**************************************************************************/
+template <size_t ROWS>
+bool replay(const char *name, const RoomSample *trace, uint32_t first, uint32_t interval, uint32_t fail_every = 0) {
+  TelemetryDeadband<5> deadband(roomDeadbands);
+  TelemetryBatch<5, ROWS> batch(roomKeys);
+  Server server;
+  uint32_t next = first;
+  uint32_t uploads = 0;
+
+  for (size_t i = 0; i < traceLen; i++) {
+    RoomSample sample = trace[i];
+    deadband.add(batch, sample, sample.ts);
+    if (sample.ts + 1 < next && i + 1 < traceLen)
+      continue;
+    next = sample.ts + 1 + interval;
+    if (fail_every && ++uploads % fail_every == 0) {
+      batch.clear();
+      deadband.rollback();
+      continue;
+    }
+    server.receive(batch);
+    batch.clear();
+    deadband.commit();
+
+    // what the server shows is within the deadband of the sample just taken
+    for (size_t k = 0; k < 5; k++) {
+      CHECK(server.has[k], "%s: key %u never received by %u s", name, (unsigned)k, (unsigned)sample.ts);
+      float diff = fabsf(server.value[k] - trace[i].values[k]);
+      CHECK(diff < roomDeadbands[k].deadband, "%s: key %u off by %.2f at %u s", name, (unsigned)k, diff, (unsigned)sample.ts);
+    }
+  }
+  // a heartbeat in a failed upload is sent with the next one
+  for (size_t k = 0; k < 5; k++)
+    CHECK(server.silence[k] <= roomDeadbands[k].max_silence + (fail_every ? interval : 0), "%s: key %u silent for %u s",
+      name, (unsigned)k, (unsigned)server.silence[k]);
+
+  printf("[TEST] %s: %lu of %lu values sent (%.1f:1)\n", name, (unsigned long)deadband.values_out(),
+    (unsigned long)deadband.values_in(), deadband.ratio());
+  CHECK(deadband.values_out() < deadband.values_in() / 2, "%s: the deadband suppresses too little", name);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  traceLen = loadTrace(argc > 1 ? argv[1] : "tests/room-trace.csv", trace, TRACE_MAX);
+  if (traceLen == 0)
+    return 1;
+
+  // a lamp flickering during the warm-up puts a row into the batch every second,
+  // so the batch drops the rows with the first values of the stable keys
+  for (size_t i = 0; i < traceLen; i++) {
+    flicker[i] = trace[i];
+    if (trace[i].ts < 120)
+      flicker[i].values[4] = trace[i].ts & 1 ? 400.0f : 0.0f;
+  }
+
+  bool ok = true;
+  // the room sensor: 120 s warm-up into a batch of 60 rows, then every minute
+  ok = replay<60>("warm-up 120 s, batch 60", trace, 120, 60) && ok;
+  ok = replay<60>("flicker in the warm-up", flicker, 120, 60) && ok;
+  // a batch that overflows on every upload
+  ok = replay<8>("every 30 s, batch 8", trace, 30, 30) && ok;
+  // uploads that keep up with the samples
+  ok = replay<60>("every 10 s, batch 60", trace, 10, 10) && ok;
+  // every third upload fails and its batch is lost
+  ok = replay<60>("every 60 s, every third fails", trace, 120, 60, 3) && ok;
+  ok = replay<60>("every 10 s, every second fails", trace, 10, 10, 2) && ok;
+
+  printf("[TEST] deadband_trace %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// Runs the DnsCache of https_room_sensor against a resolver stand-in with
+// changing records, a lookup latency and failures: the background refresh
+// before the addresses expire that does not block the caller, the switch to
+// the next address after failed(), and failing lookups that keep the old
+// addresses and are retried later.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests tests/dns_cache.cpp -o dns_cache -lpthread
+//   ./dns_cache
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+#include "dns-cache.h"
+#include "check.h"
+
+#define HOST "thingsboard.example"
+#define PORT 443
+#define TTL_S 300
+#define AHEAD_S 30
+#define LATENCY_MS 50
+
+/**
+ * Resolver stand-in: answers getaddrinfo() with the records set by the test
+ * after latency_ms, or with fail as error. The asynchronous lookup of the
+ * host shims runs getaddrinfo() on a thread of its own, like the network
+ * stack of Mbed OS.
+ */
+class DnsStandin : public NetworkInterface {
+public:
+  DnsStandin() : latency_ms(0), fail(0), lookups(0) {}
+
+  void set_records(const std::vector<std::string> &records) {
+    std::lock_guard<std::mutex> lock(_m);
+    _records = records;
+  }
+
+  nsapi_value_or_error_t getaddrinfo(const char *host, SocketAddress *hints, SocketAddress **result,
+    const char *interface_name = NULL) override {
+    lookups++;
+    if (latency_ms)
+      ThisThread::sleep_for(std::chrono::milliseconds(latency_ms.load()));
+    if (fail)
+      return fail;
+    std::lock_guard<std::mutex> lock(_m);
+    if (_records.empty())
+      return 0;
+    *result = new SocketAddress[_records.size()];
+    for (size_t i = 0; i < _records.size(); i++)
+      (*result)[i].set_ip_address(_records[i].c_str());
+    return (nsapi_value_or_error_t)_records.size();
+  }
+
+  std::atomic<uint32_t> latency_ms;
+  std::atomic<nsapi_error_t> fail;
+  std::atomic<uint32_t> lookups;
+
+private:
+  std::mutex _m;
+  std::vector<std::string> _records;
+};
+
+DnsStandin resolver;
+
+// the address of the cache, "" if it has none
+std::string current(DnsCache<4> &dns) {
+  SocketAddress adr;
+  if (!dns.address(adr))
+    return "";
+  return adr.get_ip_address() ? adr.get_ip_address() : "";
+}
+
+/**************************************************************************/
+/*
+    wait until the background lookup of the cache is done, false after 1 s
+*/
+/**************************************************************************/
+bool settle(DnsCache<4> &dns) {
+  for (int i = 0; i < 1000; i++) {
+    if (!dns.pending())
+      return true;
+    ThisThread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*
+    the addresses are refreshed in the background AHEAD_S before they
+    expire, the caller keeps the old address until the answer is there
+*/
+/**************************************************************************/
+bool checkRefresh() {
+  DnsCache<4> dns(&resolver, HOST, PORT, TTL_S, AHEAD_S);
+  SocketAddress adr;
+
+  resolver.set_records({ "192.0.2.10" });
+  CHECK(dns.resolve(1000) == NSAPI_ERROR_OK, "refresh: first resolve failed");
+  CHECK(dns.address(adr) && adr.get_port() == PORT, "refresh: no address with port %u", (unsigned)PORT);
+  uint32_t lookups = resolver.lookups;
+
+  // the server moves, the cache does not look it up before the refresh is due
+  resolver.set_records({ "192.0.2.20" });
+  resolver.latency_ms = LATENCY_MS;
+  dns.poll(1000 + TTL_S - AHEAD_S - 1);
+  CHECK(resolver.lookups == lookups, "refresh: lookup %lu s before the expiry", (unsigned long)AHEAD_S + 1);
+
+  Timer timer;
+  timer.start();
+  dns.poll(1000 + TTL_S - AHEAD_S);
+  uint32_t poll_ms = (uint32_t)(timer.elapsed_time().count() / 1000);
+  CHECK(poll_ms < LATENCY_MS / 2, "refresh: poll() blocked for %lu ms", (unsigned long)poll_ms);
+  CHECK(current(dns) == "192.0.2.10", "refresh: %s while the lookup runs", current(dns).c_str());
+  dns.poll(1000 + TTL_S - AHEAD_S + 1);
+  CHECK(settle(dns), "refresh: no answer");
+  printf("[TEST] refresh: %lu s before the expiry, poll() returned after %lu ms, now %s\n", (unsigned long)AHEAD_S,
+    (unsigned long)poll_ms, current(dns).c_str());
+  CHECK(resolver.lookups - lookups == 1, "refresh: %lu lookups", (unsigned long)(resolver.lookups - lookups));
+  CHECK(dns.refreshes() == 1 && current(dns) == "192.0.2.20", "refresh: %s after the refresh", current(dns).c_str());
+  CHECK(!dns.expired(1000 + TTL_S), "refresh: the refreshed addresses expire at the old time");
+  resolver.latency_ms = 0;
+  return true;
+}
+
+/**************************************************************************/
+/*
+    failed() goes round the addresses, a refresh stays on the address in use
+*/
+/**************************************************************************/
+bool checkRotation() {
+  DnsCache<4> dns(&resolver, HOST, PORT, TTL_S, AHEAD_S);
+  const char *order[] = { "192.0.2.1", "192.0.2.2", "192.0.2.3", "192.0.2.1" };
+
+  resolver.set_records({ "192.0.2.1", "192.0.2.2", "192.0.2.3" });
+  CHECK(dns.resolve(0) == NSAPI_ERROR_OK && dns.count() == 3, "rotation: %u addresses", (unsigned)dns.count());
+  for (int i = 0; i < 4; i++) {
+    CHECK(current(dns) == order[i], "rotation: %s after %d failures", current(dns).c_str(), i);
+    dns.failed();
+  }
+  // on the second address, which the new answer lists last
+  resolver.set_records({ "192.0.2.3", "192.0.2.4", "192.0.2.2" });
+  dns.poll(TTL_S - AHEAD_S);
+  CHECK(settle(dns) && dns.refreshes() == 1, "rotation: no refresh");
+  CHECK(current(dns) == "192.0.2.2", "rotation: %s after the refresh", current(dns).c_str());
+  dns.failed();
+  CHECK(current(dns) == "192.0.2.3", "rotation: %s after the refresh and a failure", current(dns).c_str());
+
+  // a single address stays
+  resolver.set_records({ "192.0.2.9" });
+  CHECK(dns.resolve(TTL_S) == NSAPI_ERROR_OK && dns.count() == 1, "rotation: %u addresses", (unsigned)dns.count());
+  dns.failed();
+  CHECK(current(dns) == "192.0.2.9", "rotation: %s with a single address", current(dns).c_str());
+  printf("[TEST] rotation: 3 addresses in turn, the address in use kept by a refresh\n");
+  return true;
+}
+
+/**************************************************************************/
+/*
+    failing lookups: nothing to connect to before the first success, later
+    the old addresses stay and the refresh is retried after AHEAD_S / 2
+*/
+/**************************************************************************/
+bool checkFailingResolve() {
+  DnsCache<4> dns(&resolver, HOST, PORT, TTL_S, AHEAD_S);
+  SocketAddress adr;
+
+  resolver.fail = NSAPI_ERROR_DNS_FAILURE;
+  nsapi_error_t result = dns.resolve(0);
+  CHECK(result == NSAPI_ERROR_DNS_FAILURE, "failing: resolve returned %d", result);
+  CHECK(!dns.address(adr) && dns.count() == 0, "failing: address without a lookup");
+  // an answer without records is a failure too
+  resolver.fail = 0;
+  resolver.set_records({});
+  result = dns.resolve(0);
+  CHECK(result == NSAPI_ERROR_DNS_FAILURE, "failing: resolve without records returned %d", result);
+
+  resolver.set_records({ "192.0.2.10" });
+  CHECK(dns.resolve(0) == NSAPI_ERROR_OK, "failing: resolve failed");
+  resolver.fail = NSAPI_ERROR_TIMEOUT;
+  result = dns.resolve(10);
+  CHECK(result == NSAPI_ERROR_TIMEOUT, "failing: resolve returned %d", result);
+  CHECK(current(dns) == "192.0.2.10", "failing: %s after a failed resolve", current(dns).c_str());
+
+  // the background refresh fails and is retried, not at every poll
+  uint32_t due = TTL_S - AHEAD_S;
+  dns.poll(due);
+  CHECK(settle(dns) && dns.refresh_errors() == 1, "failing: %lu refresh errors",
+    (unsigned long)dns.refresh_errors());
+  CHECK(current(dns) == "192.0.2.10", "failing: %s after a failed refresh", current(dns).c_str());
+  uint32_t lookups = resolver.lookups;
+  dns.poll(due + 1);
+  dns.poll(due + AHEAD_S / 2);
+  CHECK(resolver.lookups == lookups, "failing: %lu lookups before the retry",
+    (unsigned long)(resolver.lookups - lookups));
+  resolver.fail = 0;
+  resolver.set_records({ "192.0.2.20" });
+  dns.poll(due + AHEAD_S / 2 + 1);
+  CHECK(settle(dns) && dns.refreshes() == 1, "failing: the retry did not refresh");
+  CHECK(current(dns) == "192.0.2.20", "failing: %s after the retry", current(dns).c_str());
+  printf("[TEST] failing: no address before the first answer, old address kept, retried after %d s\n",
+    AHEAD_S / 2 + 1);
+  return true;
+}
+
+int main() {
+  bool ok = checkRefresh();
+  ok = checkRotation() && ok;
+  ok = checkFailingResolve() && ok;
+
+  printf("[TEST] dns_cache %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
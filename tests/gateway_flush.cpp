@@ -0,0 +1,131 @@
+// Runs flush() of the ThingsBoard gateway client of http_send_batch with a
+// publish failing in the middle: the messages published before the failure
+// must not be sent again, the samples of the others stay for the next flush
+// with their devices and in their order, and samples collected in between
+// are added after them.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I http_send_batch -I tests tests/gateway_flush.cpp -o gateway_flush
+//   ./gateway_flush
+
+#include <string>
+#include <vector>
+
+#include "mbed.h"
+#include "thingsboard-gateway.h"
+#include "check.h"
+
+#define DEVICES 3
+
+/**
+ * MQTT client stand-in: keeps the telemetry messages it was given, the
+ * publish with the number fail_at (counted from 1) fails.
+ */
+class RecordingMqtt {
+public:
+  RecordingMqtt() : fail_at(0), calls(0) {}
+
+  bool publish(const char *topic, const char *payload, size_t len) {
+    if (strcmp(topic, "v1/gateway/telemetry") != 0)
+      return true;
+    if (++calls == fail_at)
+      return false;
+    messages.push_back(std::string(payload, len));
+    return true;
+  }
+
+  bool session_present() const { return false; }
+
+  uint32_t fail_at;
+  uint32_t calls;
+  std::vector<std::string> messages;
+};
+
+// a small payload, so the samples need several messages
+typedef ThingsBoardGateway<RecordingMqtt, 4, 32, 1024, 200> Gateway;
+
+const char *names[DEVICES] = { "dev-0", "dev-1", "dev-2" };
+
+/**************************************************************************/
+/*
+    the samples in the messages as device * 1000 + n, in the order sent
+*/
+/**************************************************************************/
+std::vector<int> received(const RecordingMqtt &mqtt) {
+  std::vector<int> samples;
+  for (size_t m = 0; m < mqtt.messages.size(); m++) {
+    const std::string &s = mqtt.messages[m];
+    int device = -1;
+    for (size_t p = 0; p < s.size(); p++) {
+      for (int d = 0; d < DEVICES; d++)
+        if (s.compare(p, strlen(names[d]) + 4, std::string("\"") + names[d] + "\":[") == 0)
+          device = d;
+      if (s.compare(p, 4, "\"n\":") == 0)
+        samples.push_back(device * 1000 + atoi(s.c_str() + p + 4));
+    }
+  }
+  return samples;
+}
+
+/**************************************************************************/
+/*
+    the samples from..to, device n % DEVICES
+*/
+/**************************************************************************/
+bool collect(Gateway &gw, int from, int to) {
+  for (int n = from; n < to; n++)
+    CHECK(gw.telemetry(n % DEVICES, 1626950000000ull + n, "\"n\":%d", n), "sample %d not collected", n);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    the publish number fail_at of the first flush fails, every sample
+    arrives once with its device
+*/
+/**************************************************************************/
+bool checkFailure(uint32_t fail_at) {
+  RecordingMqtt mqtt;
+  Gateway gw(mqtt);
+  const int first = 18, second = 6;
+
+  for (int d = 0; d < DEVICES; d++)
+    gw.addDevice(names[d]);
+  if (!collect(gw, 0, first))
+    return false;
+  mqtt.fail_at = fail_at;
+  CHECK(!gw.flush(), "failure %lu: flush did not fail", (unsigned long)fail_at);
+  size_t sent = received(mqtt).size();
+  CHECK(gw.pending() == first - sent, "failure %lu: %u samples sent, %u pending", (unsigned long)fail_at,
+    (unsigned)sent, (unsigned)gw.pending());
+
+  // more samples before the next flush succeeds
+  if (!collect(gw, first, first + second))
+    return false;
+  CHECK(gw.flush(), "failure %lu: second flush failed", (unsigned long)fail_at);
+  CHECK(gw.pending() == 0, "failure %lu: %u pending", (unsigned long)fail_at, (unsigned)gw.pending());
+
+  std::vector<int> samples = received(mqtt);
+  std::vector<int> count(first + second, 0);
+  for (size_t i = 0; i < samples.size(); i++) {
+    int device = samples[i] / 1000, n = samples[i] % 1000;
+    CHECK(n < first + second && device == n % DEVICES, "failure %lu: sample %d of device %d",
+      (unsigned long)fail_at, n, device);
+    count[n]++;
+  }
+  for (int n = 0; n < first + second; n++)
+    CHECK(count[n] == 1, "failure %lu: sample %d received %d times", (unsigned long)fail_at, n, count[n]);
+  printf("[TEST] publish %lu of the flush failed: %u samples sent before, %u in %u messages after\n",
+    (unsigned long)fail_at, (unsigned)sent, (unsigned)(samples.size() - sent),
+    (unsigned)mqtt.messages.size());
+  return true;
+}
+
+int main() {
+  bool ok = checkFailure(1);
+  ok = checkFailure(2) && ok;
+  ok = checkFailure(3) && ok;
+
+  printf("[TEST] gateway_flush %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+#ifndef _HTTP_STANDIN_H_
+#define _HTTP_STANDIN_H_
+
+#include <atomic>
+#include <deque>
+#include <string>
+
+#include "mbed.h"
+
+/**
+ * ThingsBoard HTTP stand-in of the tests: a server on a free port of
+ * localhost with one thread per connection. Every request, with a
+ * Content-Length or a chunked body, is answered with 200 latency_ms after it
+ * was received, so requests that arrive together are answered together like
+ * over a link with that round trip time. The host TLSSocket does not
+ * encrypt, so the stand-in also serves the TLS examples, a connection is a
+ * TLS handshake there. The settings can be changed between the requests:
+ *  - max_requests closes a connection after that many requests, like
+ *    keepalive_requests of nginx, 0 keeps it open
+ *  - content_length false answers without Content-Length and closes the
+ *    connection after the response, the end of the body is the close
+ *  - body is the body of the responses
+ * The server has to outlive the connections to it.
+ */
+class HttpStandin {
+public:
+  HttpStandin()
+    : latency_ms(0), max_requests(0), content_length(true), body(""), connections(0), requests(0), bytes(0),
+      sent(0), _listener(-1), _port(0) {
+  }
+
+  ~HttpStandin() {
+    if (_listener >= 0)
+      ::close(_listener);
+  }
+
+  // listen on a free port and accept in the background
+  bool start() {
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int one = 1;
+
+    _listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(_listener, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(_listener, 64) != 0 ||
+      getsockname(_listener, (struct sockaddr *)&sa, &len) != 0) {
+      printf("[TEST] stand-in server can not listen\n");
+      return false;
+    }
+    _port = ntohs(sa.sin_port);
+    std::thread(&HttpStandin::accepting, this).detach();
+    return true;
+  }
+
+  SocketAddress address() const { return SocketAddress("127.0.0.1", _port); }
+
+  std::atomic<uint32_t> latency_ms;
+  std::atomic<uint32_t> max_requests;
+  std::atomic<bool> content_length;
+  const char *body;
+
+  // connections accepted, requests answered, bytes received and sent since start()
+  std::atomic<uint32_t> connections;
+  std::atomic<uint32_t> requests;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> sent;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  void accepting() {
+    while (true) {
+      int fd = accept(_listener, NULL, NULL);
+      if (fd < 0)
+        return;
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      connections++;
+      std::thread(&HttpStandin::session, this, fd).detach();
+    }
+  }
+
+  // data of a connection not parsed yet, with the time every read of it arrived
+  struct Input {
+    Input() : start(0), closed(false) {}
+    std::string data;
+    uint64_t start;         // stream offset of data[0]
+    bool closed;
+    std::deque<std::pair<uint64_t, Clock::time_point> > reads;
+  };
+
+  // more data of the connection, false if none was read, closed tells if there is no more
+  bool receive(int fd, Input &in, int flags) {
+    char buf[4096];
+    ssize_t n = recv(fd, buf, sizeof(buf), flags);
+    if (n <= 0) {
+      in.closed = n == 0 || !(flags & MSG_DONTWAIT) || (errno != EAGAIN && errno != EWOULDBLOCK);
+      return false;
+    }
+    in.data.append(buf, n);
+    bytes += n;
+    in.reads.push_back(std::make_pair(in.start + in.data.size(), Clock::now()));
+    return true;
+  }
+
+  // drop the first length bytes, the time is when the last of them arrived
+  void consume(Input &in, size_t length, Clock::time_point &arrived) {
+    uint64_t end = in.start + length;
+    while (!in.reads.empty() && in.reads.front().first < end)
+      in.reads.pop_front();
+    if (!in.reads.empty())
+      arrived = in.reads.front().second;
+    if (!in.reads.empty() && in.reads.front().first == end)
+      in.reads.pop_front();
+    in.data.erase(0, length);
+    in.start = end;
+  }
+
+  // a whole request with its body, false if the connection is closed
+  bool request(int fd, Input &in, Clock::time_point &arrived) {
+    size_t end;
+
+    while ((end = in.data.find("\r\n\r\n")) == std::string::npos)
+      if (!receive(fd, in, 0))
+        return false;
+    std::string head = in.data.substr(0, end + 4);
+    size_t pos = end + 4;
+    for (size_t i = 0; i < head.size(); i++)
+      head[i] = (char)tolower(head[i]);
+
+    if (head.find("transfer-encoding: chunked") != std::string::npos) {
+      while (true) {
+        size_t line;
+        while ((line = in.data.find("\r\n", pos)) == std::string::npos)
+          if (!receive(fd, in, 0))
+            return false;
+        size_t size = strtoul(in.data.c_str() + pos, NULL, 16);
+        while (in.data.size() < line + 2 + size + 2)
+          if (!receive(fd, in, 0))
+            return false;
+        pos = line + 2 + size + 2;
+        if (size == 0)
+          break;
+      }
+    } else {
+      size_t at = head.find("content-length:");
+      pos += at == std::string::npos ? 0 : strtoul(head.c_str() + at + 15, NULL, 10);
+      while (in.data.size() < pos)
+        if (!receive(fd, in, 0))
+          return false;
+    }
+    consume(in, pos, arrived);
+    return true;
+  }
+
+  // wait until due, reading what arrives meanwhile so its time is known
+  void wait(int fd, Input &in, Clock::time_point due) {
+    while (!in.closed) {
+      Clock::time_point now = Clock::now();
+      if (now >= due)
+        return;
+      struct pollfd p = { fd, POLLIN, 0 };
+      int ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1;
+      if (poll(&p, 1, ms) > 0)
+        while (receive(fd, in, MSG_DONTWAIT))
+          ;
+    }
+    std::this_thread::sleep_until(due);
+  }
+
+  void session(int fd) {
+    Input in;
+    Clock::time_point arrived = Clock::now();
+    uint32_t served = 0;
+    char response[512];
+
+    while (request(fd, in, arrived)) {
+      wait(fd, in, arrived + std::chrono::milliseconds(latency_ms.load()));
+      served++;
+      bool last = !content_length || (max_requests && served >= max_requests);
+      int len;
+      if (content_length)
+        len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+          "Content-Length: %u\r\n%s\r\n%s", (unsigned)strlen(body), last ? "Connection: close\r\n" : "", body);
+      else
+        len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+          "Connection: close\r\n\r\n%s", body);
+      requests++;
+      sent += len;
+      send(fd, response, len, MSG_NOSIGNAL);
+      if (last)
+        break;
+    }
+    // lingering close like nginx: requests still coming in would reset the
+    // connection and the client could lose the response
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    shutdown(fd, SHUT_WR);
+    while (recv(fd, response, sizeof(response), 0) > 0)
+      ;
+    ::close(fd);
+  }
+
+  int _listener;
+  uint16_t _port;
+};
+
+#endif // _HTTP_STANDIN_H_
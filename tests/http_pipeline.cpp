@@ -0,0 +1,169 @@
+// Runs the pipelined uploads of the http examples against the HTTP stand-in
+// with a round trip time: a reporting cycle of 4 requests sent together
+// against one request after the other, responses with a body that arrive
+// together, so the start of the next response is left over in the buffer,
+// bodies larger than the buffer, and responses without Content-Length that
+// end with the connection.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I common -I tests tests/http_pipeline.cpp -o http_pipeline -lpthread
+//   ./http_pipeline
+
+#include "mbed.h"
+#include "http-pipeline.h"
+#include "http-standin.h"
+#include "check.h"
+
+#define TOKEN "token_of_the_room_sensor"
+#define RTT_MS 20
+#define CYCLES 10
+#define REQUESTS 4
+
+HttpStandin server;
+// the size of the examples
+char pipebuf[512];
+HttpPipeline pipeline(pipebuf, sizeof(pipebuf));
+
+/**************************************************************************/
+/*
+    one reporting cycle, all requests sent before the first response is
+    read or every response read right after its request
+*/
+/**************************************************************************/
+bool cycle(TCPSocket &socket, bool pipelined, int &statuses) {
+  for (int i = 0; i < REQUESTS; i++) {
+    CHECK(pipeline.postTelemetry(&socket, "{\"key%d\":%d}", i, 20 + i), "request %d not sent", i);
+    if (!pipelined && pipeline.response() == 200)
+      statuses++;
+  }
+  while (pipeline.pending())
+    if (pipeline.response() == 200)
+      statuses++;
+  return true;
+}
+
+/**************************************************************************/
+/*
+    ms per cycle of CYCLES cycles on one connection
+*/
+/**************************************************************************/
+bool runCycles(bool pipelined, double &ms) {
+  TCPSocket socket;
+  Timer timer;
+  int statuses = 0;
+  uint32_t connections = server.connections;
+
+  socket.open(NetworkInterface::get_default_instance());
+  CHECK(socket.connect(server.address()) == NSAPI_ERROR_OK, "no connection to the stand-in");
+  timer.start();
+  for (int c = 0; c < CYCLES; c++)
+    if (!cycle(socket, pipelined, statuses))
+      return false;
+  ms = timer.elapsed_time().count() / 1000.0 / CYCLES;
+  socket.close();
+  CHECK(statuses == CYCLES * REQUESTS, "%d of %d requests answered with 200", statuses, CYCLES * REQUESTS);
+  CHECK(server.connections - connections == 1, "%lu connections", (unsigned long)(server.connections - connections));
+  CHECK(pipeline.keep_alive(), "connection not kept open");
+  return true;
+}
+
+/**************************************************************************/
+/*
+    a cycle of 4 requests pipelined takes one round trip, not 4
+*/
+/**************************************************************************/
+bool checkThroughput() {
+  double pipelined_ms, sequential_ms;
+
+  server.latency_ms = RTT_MS;
+  server.body = "";
+  if (!runCycles(false, sequential_ms) || !runCycles(true, pipelined_ms))
+    return false;
+  printf("[TEST] %d requests with %d ms round trip: %.1f ms per cycle one after the other, %.1f ms pipelined\n",
+    REQUESTS, RTT_MS, sequential_ms, pipelined_ms);
+  CHECK(sequential_ms >= REQUESTS * RTT_MS, "%.1f ms one after the other", sequential_ms);
+  CHECK(pipelined_ms < RTT_MS * 3 / 2, "%.1f ms pipelined", pipelined_ms);
+  server.latency_ms = 0;
+  return true;
+}
+
+/**************************************************************************/
+/*
+    responses with a body, arriving together: the bytes of the next
+    responses are kept in the buffer, none is taken as a body
+*/
+/**************************************************************************/
+bool checkLeftover() {
+  static char large[400];
+  double ms;
+
+  // all responses of a cycle in one segment, more than one in the buffer
+  server.latency_ms = 5;
+  server.body = "{\"shared\":{\"interval\":60},\"client\":{}}";
+  if (!runCycles(true, ms))
+    return false;
+  // a body of more than the buffer left after the headers is read in pieces
+  memset(large, ' ', sizeof(large) - 1);
+  large[0] = '{';
+  large[sizeof(large) - 2] = '}';
+  server.body = large;
+  if (!runCycles(true, ms))
+    return false;
+  server.body = "";
+  server.latency_ms = 0;
+  printf("[TEST] responses with bodies of 39 and %u bytes: all matched to their requests\n",
+    (unsigned)(sizeof(large) - 1));
+  return true;
+}
+
+/**************************************************************************/
+/*
+    the server answers without Content-Length and closes the connection:
+    the first status is returned, the requests after it are lost
+*/
+/**************************************************************************/
+bool checkNoContentLength() {
+  TCPSocket socket;
+
+  server.content_length = false;
+  server.body = "{}";
+  socket.open(NetworkInterface::get_default_instance());
+  CHECK(socket.connect(server.address()) == NSAPI_ERROR_OK, "no connection to the stand-in");
+  for (int i = 0; i < REQUESTS; i++)
+    CHECK(pipeline.postTelemetry(&socket, "{\"key%d\":%d}", i, i), "request %d not sent", i);
+  int status = pipeline.response();
+  CHECK(status == 200, "first response %d", status);
+  CHECK(!pipeline.keep_alive(), "connection kept open without Content-Length");
+  int lost = 0;
+  while (pipeline.pending())
+    if (pipeline.response() == NSAPI_ERROR_NO_CONNECTION)
+      lost++;
+  CHECK(lost == REQUESTS - 1, "%d requests lost", lost);
+  socket.close();
+
+  // a single request on a new connection
+  socket.open(NetworkInterface::get_default_instance());
+  CHECK(socket.connect(server.address()) == NSAPI_ERROR_OK, "no connection to the stand-in");
+  CHECK(pipeline.postTelemetry(&socket, "{\"key\":%d}", 1), "request not sent");
+  status = pipeline.response();
+  CHECK(status == 200, "response %d on a new connection", status);
+  CHECK(pipeline.pending() == 0, "%d pending", pipeline.pending());
+  socket.close();
+  server.content_length = true;
+  server.body = "";
+  printf("[TEST] without Content-Length: status of the first response, %d requests lost\n", lost);
+  return true;
+}
+
+int main() {
+  if (!server.start())
+    return 1;
+  pipeline.begin(TOKEN, "localhost");
+
+  bool ok = checkThroughput();
+  ok = checkLeftover() && ok;
+  ok = checkNoContentLength() && ok;
+
+  printf("[TEST] http_pipeline %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+#ifndef _MQTT_STANDIN_H_
+#define _MQTT_STANDIN_H_
+
+#include <atomic>
+#include <deque>
+#include <set>
+#include <vector>
+
+#include "mbed.h"
+
+/**
+ * ThingsBoard MQTT broker stand-in of the tests: a server on a free port of
+ * localhost with a thread per connection that answers CONNECT, PUBLISH with
+ * QoS 1 and PINGREQ. The PUBACK of a message is sent latency_ms after the
+ * message arrived, by a second thread, so messages in flight are
+ * acknowledged together like over a link with that round trip time.
+ * The settings can be changed between the messages:
+ *  - hold_id keeps the PUBACK of the message with that packet identifier
+ *    back until release(), 0 holds nothing
+ *  - push_every sends a PUBLISH of push_size bytes to the device after
+ *    every that many messages, like attribute updates of the server
+ * A PUBLISH reusing the identifier of a message that was not acknowledged
+ * yet, without the DUP flag, is counted as reused_ids.
+ * The server has to outlive the connections to it.
+ */
+class MqttStandin {
+public:
+  MqttStandin()
+    : latency_ms(0), hold_id(0), push_every(0), push_size(0), connections(0), messages(0), bytes(0),
+      reused_ids(0), pushed(0), _listener(-1), _port(0), _release(false) {
+  }
+
+  ~MqttStandin() {
+    if (_listener >= 0)
+      ::close(_listener);
+  }
+
+  // listen on a free port and accept in the background
+  bool start() {
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int one = 1;
+
+    _listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(_listener, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(_listener, 64) != 0 ||
+      getsockname(_listener, (struct sockaddr *)&sa, &len) != 0) {
+      printf("[TEST] stand-in broker can not listen\n");
+      return false;
+    }
+    _port = ntohs(sa.sin_port);
+    std::thread(&MqttStandin::accepting, this).detach();
+    return true;
+  }
+
+  SocketAddress address() const { return SocketAddress("127.0.0.1", _port); }
+
+  // send the PUBACK held back and hold nothing more
+  void release() {
+    std::lock_guard<std::mutex> lock(_m);
+    hold_id = 0;
+    _release = true;
+    _cv.notify_all();
+  }
+
+  std::atomic<uint32_t> latency_ms;
+  std::atomic<uint16_t> hold_id;
+  std::atomic<uint32_t> push_every;
+  std::atomic<uint32_t> push_size;
+
+  // connections accepted, messages and bytes received, identifiers reused
+  // while in flight and messages pushed to the device since start()
+  std::atomic<uint32_t> connections;
+  std::atomic<uint32_t> messages;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint32_t> reused_ids;
+  std::atomic<uint32_t> pushed;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  typedef struct {
+    Clock::time_point due;
+    std::vector<uint8_t> packet;
+    uint16_t id;            // of a PUBACK, 0 for other packets
+  } Reply;
+
+  // one connection: the replies go out at their due time, held ones on release()
+  struct Session {
+    Session(int fd) : fd(fd), closed(false) {}
+    int fd;
+    bool closed;
+    std::deque<Reply> replies;
+    std::vector<Reply> held;
+    std::set<uint16_t> in_flight;
+  };
+
+  void accepting() {
+    while (true) {
+      int fd = accept(_listener, NULL, NULL);
+      if (fd < 0)
+        return;
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      connections++;
+      std::thread(&MqttStandin::receiving, this, fd).detach();
+    }
+  }
+
+  bool readAll(int fd, uint8_t *buf, size_t len) {
+    while (len > 0) {
+      ssize_t n = recv(fd, buf, len, 0);
+      if (n <= 0)
+        return false;
+      buf += n;
+      len -= n;
+      bytes += n;
+    }
+    return true;
+  }
+
+  void queue(Session &s, Clock::time_point due, const std::vector<uint8_t> &packet, uint16_t id) {
+    std::lock_guard<std::mutex> lock(_m);
+    Reply r = { due, packet, id };
+    s.replies.push_back(r);
+    _cv.notify_all();
+  }
+
+  void receiving(int fd) {
+    Session s(fd);
+    std::thread sender(&MqttStandin::sending, this, &s);
+    std::vector<uint8_t> packet;
+    uint8_t type;
+
+    while (readAll(fd, &type, 1)) {
+      size_t length = 0;
+      uint8_t byte;
+      int shift = 0;
+      do {
+        if (!readAll(fd, &byte, 1))
+          goto done;
+        length |= (size_t)(byte & 0x7F) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      packet.resize(length);
+      if (length && !readAll(fd, packet.data(), length))
+        break;
+      Clock::time_point now = Clock::now();
+
+      if ((type & 0xF0) == 0x10) {
+        queue(s, now, std::vector<uint8_t>{ 0x20, 0x02, 0x00, 0x00 }, 0);
+      } else if ((type & 0xF0) == 0x30 && (type & 0x06)) {
+        size_t topic = (size_t)packet[0] << 8 | packet[1];
+        uint16_t id = (uint16_t)(packet[2 + topic] << 8 | packet[3 + topic]);
+        uint32_t n = ++messages;
+        {
+          std::lock_guard<std::mutex> lock(_m);
+          if (!s.in_flight.insert(id).second && !(type & 0x08))
+            reused_ids++;
+        }
+        queue(s, now + std::chrono::milliseconds(latency_ms.load()),
+          std::vector<uint8_t>{ 0x40, 0x02, (uint8_t)(id >> 8), (uint8_t)id }, id);
+        if (push_every && n % push_every == 0)
+          queue(s, now, attributes(push_size), 0);
+      } else if ((type & 0xF0) == 0xC0) {
+        queue(s, now, std::vector<uint8_t>{ 0xD0, 0x00 }, 0);
+      } else if ((type & 0xF0) == 0xE0) {
+        break;
+      }
+    }
+done:
+    {
+      std::lock_guard<std::mutex> lock(_m);
+      s.closed = true;
+      _cv.notify_all();
+    }
+    sender.join();
+    ::close(fd);
+  }
+
+  void sending(Session *s) {
+    std::unique_lock<std::mutex> lock(_m);
+
+    while (!s->closed) {
+      std::vector<Reply> out;
+      if (_release) {
+        _release = false;
+        out.swap(s->held);
+      }
+      while (!s->replies.empty() && Clock::now() >= s->replies.front().due) {
+        Reply &r = s->replies.front();
+        if (r.id && r.id == hold_id)
+          s->held.push_back(r);
+        else
+          out.push_back(r);
+        s->replies.pop_front();
+      }
+      if (out.empty()) {
+        if (s->replies.empty())
+          _cv.wait(lock);
+        else
+          _cv.wait_until(lock, s->replies.front().due);
+        continue;
+      }
+      for (size_t i = 0; i < out.size(); i++)
+        if (out[i].id)
+          s->in_flight.erase(out[i].id);
+      lock.unlock();
+      for (size_t i = 0; i < out.size(); i++)
+        send(s->fd, out[i].packet.data(), out[i].packet.size(), MSG_NOSIGNAL);
+      lock.lock();
+    }
+  }
+
+  // PUBLISH with QoS 0 of an attribute update, size bytes after the fixed header
+  std::vector<uint8_t> attributes(size_t size) {
+    static const char topic[] = "v1/devices/me/attributes";
+    std::vector<uint8_t> body;
+
+    body.push_back(0);
+    body.push_back(sizeof(topic) - 1);
+    body.insert(body.end(), topic, topic + sizeof(topic) - 1);
+    body.push_back('{');
+    while (body.size() + 1 < size)
+      body.push_back(' ');
+    body.push_back('}');
+
+    std::vector<uint8_t> packet;
+    packet.push_back(0x30);
+    size_t length = body.size();
+    do {
+      uint8_t byte = length % 128;
+      length /= 128;
+      packet.push_back(length ? byte | 0x80 : byte);
+    } while (length);
+    packet.insert(packet.end(), body.begin(), body.end());
+    pushed++;
+    return packet;
+  }
+
+  int _listener;
+  uint16_t _port;
+  std::mutex _m;
+  std::condition_variable _cv;
+  bool _release;
+};
+
+#endif // _MQTT_STANDIN_H_
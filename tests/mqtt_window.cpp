@@ -0,0 +1,175 @@
+// Runs the MQTT client of http_send_batch against a broker stand-in on
+// localhost: packets pushed by the broker that are larger than the receive
+// buffer of the client must not break the parsing of the PUBACKs after them,
+// a packet identifier that is still in flight is never handed out again when
+// the identifiers wrap, and the messages per second of the window of 4
+// messages in flight against HTTP requests one after the other over a kept
+// open connection, with the same round trip time of the server.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I http_send_batch -I tests tests/mqtt_window.cpp -o mqtt_window -lpthread
+//   ./mqtt_window
+
+#include "mbed.h"
+#include "ThingsBoard.h"
+#include "thingsboard-mqtt.h"
+#include "mqtt-standin.h"
+#include "http-standin.h"
+#include "check.h"
+
+#define TOKEN "token_of_the_room_sensor"
+#define RTT_MS 10
+
+MqttStandin broker;
+HttpStandin server;
+
+/**************************************************************************/
+/*
+    a client connected to the broker stand-in
+*/
+/**************************************************************************/
+template <size_t WINDOW>
+bool connectMqtt(TCPSocket &socket, ThingsBoardMqtt<WINDOW> &mqtt) {
+  socket.open(NetworkInterface::get_default_instance());
+  CHECK(socket.connect(broker.address()) == NSAPI_ERROR_OK, "no connection to the broker");
+  mqtt.begin(TOKEN, "room-1");
+  CHECK(mqtt.connect(&socket) == NSAPI_ERROR_OK, "no CONNACK");
+  return true;
+}
+
+/**************************************************************************/
+/*
+    attribute updates of 5 to 300 bytes between the PUBACKs: every message
+    is acknowledged, the client stays connected
+*/
+/**************************************************************************/
+bool checkPushedPackets() {
+  static const uint32_t sizes[5] = { 5, 16, 17, 40, 300 };
+  TCPSocket socket;
+  ThingsBoardMqtt<4> mqtt;
+  const uint32_t count = 200;
+
+  broker.latency_ms = 0;
+  broker.push_every = 3;
+  if (!connectMqtt(socket, mqtt))
+    return false;
+  uint32_t pushed = broker.pushed;
+  for (uint32_t i = 0; i < count; i++) {
+    broker.push_size = sizes[i / 3 % 5];
+    CHECK(mqtt.sendTelemetryInt("n", (int)i), "message %lu not published", (unsigned long)i);
+  }
+  CHECK(mqtt.flush(), "%u messages not acknowledged", (unsigned)mqtt.inFlight());
+  broker.push_every = 0;
+  pushed = broker.pushed - pushed;
+  printf("[TEST] pushed packets: %lu messages, %lu acknowledged between %lu packets of the broker\n",
+    (unsigned long)mqtt.published(), (unsigned long)mqtt.acked(), (unsigned long)pushed);
+  CHECK(mqtt.connected(), "connection lost between the pushed packets");
+  CHECK(mqtt.acked() == count, "%lu of %lu messages acknowledged", (unsigned long)mqtt.acked(),
+    (unsigned long)count);
+  CHECK(pushed >= count / 3, "%lu packets pushed", (unsigned long)pushed);
+  mqtt.disconnect();
+  socket.close();
+  return true;
+}
+
+/**************************************************************************/
+/*
+    the PUBACK of the first message held back while the identifiers wrap:
+    its identifier must be skipped, the broker never sees it reused
+*/
+/**************************************************************************/
+bool checkIdWrap() {
+  TCPSocket socket;
+  ThingsBoardMqtt<4> mqtt;
+  const uint32_t count = 70000;
+
+  broker.latency_ms = 0;
+  broker.hold_id = 1;
+  if (!connectMqtt(socket, mqtt))
+    return false;
+  uint32_t reused = broker.reused_ids;
+  for (uint32_t i = 0; i < count; i++)
+    CHECK(mqtt.sendTelemetryInt("n", (int)i), "message %lu not published", (unsigned long)i);
+  // everything but the held message is acknowledged
+  for (int i = 0; i < 100 && mqtt.inFlight() > 1; i++)
+    mqtt.poll(10);
+  reused = broker.reused_ids - reused;
+  CHECK(reused == 0, "%lu identifiers reused while in flight", (unsigned long)reused);
+  CHECK(mqtt.inFlight() == 1, "%u messages in flight with one PUBACK held", (unsigned)mqtt.inFlight());
+  broker.release();
+  CHECK(mqtt.flush(), "%u messages not acknowledged after the release", (unsigned)mqtt.inFlight());
+  printf("[TEST] identifier wrap: %lu messages, %lu acknowledged, no identifier in flight reused\n",
+    (unsigned long)mqtt.published(), (unsigned long)mqtt.acked());
+  CHECK(mqtt.acked() == count, "%lu of %lu messages acknowledged", (unsigned long)mqtt.acked(),
+    (unsigned long)count);
+  mqtt.disconnect();
+  socket.close();
+  return true;
+}
+
+/**************************************************************************/
+/*
+    messages per second with RTT_MS to the server: the MQTT window against
+    one HTTP request after the other on a kept open connection
+*/
+/**************************************************************************/
+bool checkRate() {
+  const char *json = "{\"temperature\":42.2,\"humidity\":80}";
+  const uint32_t count = 100;
+  Timer timer;
+
+  // MQTT, up to 4 messages in flight
+  TCPSocket mqtt_socket;
+  ThingsBoardMqtt<4> mqtt;
+  broker.latency_ms = RTT_MS;
+  if (!connectMqtt(mqtt_socket, mqtt))
+    return false;
+  uint64_t broker_bytes = broker.bytes;
+  timer.start();
+  for (uint32_t i = 0; i < count; i++)
+    CHECK(mqtt.sendTelemetryJson(json), "MQTT message %lu not published", (unsigned long)i);
+  CHECK(mqtt.flush(), "%u MQTT messages not acknowledged", (unsigned)mqtt.inFlight());
+  double mqtt_rate = count * 1e6 / timer.elapsed_time().count();
+  broker_bytes = broker.bytes - broker_bytes;
+  mqtt.disconnect();
+  mqtt_socket.close();
+
+  // HTTP, a request waits for the response of the last
+  TCPSocket http_socket;
+  ThingsBoardHttp tb;
+  SocketAddress adr = server.address();
+  server.latency_ms = RTT_MS;
+  http_socket.open(NetworkInterface::get_default_instance());
+  CHECK(http_socket.connect(adr) == NSAPI_ERROR_OK, "no connection to the HTTP server");
+  tb.begin(&http_socket, TOKEN, "localhost", adr.get_port());
+  uint64_t server_bytes = server.bytes, server_sent = server.sent;
+  timer.reset();
+  for (uint32_t i = 0; i < count; i++)
+    CHECK(tb.sendTelemetryJson(json), "HTTP request %lu failed", (unsigned long)i);
+  double http_rate = count * 1e6 / timer.elapsed_time().count();
+  server_bytes = server.bytes - server_bytes;
+  server_sent = server.sent - server_sent;
+  http_socket.close();
+
+  printf("[TEST] %d ms round trip: MQTT %.0f msgs/s, %.0f bytes/msg up, 4 bytes/msg down\n", RTT_MS, mqtt_rate,
+    (double)broker_bytes / count);
+  printf("[TEST] %d ms round trip: HTTP %.0f msgs/s, %.0f bytes/msg up, %.0f bytes/msg down\n", RTT_MS, http_rate,
+    (double)server_bytes / count, (double)server_sent / count);
+  // the window overlaps 4 round trips, half of it is left with the scheduling of the host
+  CHECK(mqtt_rate > 2 * http_rate, "MQTT %.0f msgs/s, HTTP %.0f msgs/s", mqtt_rate, http_rate);
+  CHECK(broker_bytes < server_bytes, "MQTT %lu bytes, HTTP %lu bytes", (unsigned long)broker_bytes,
+    (unsigned long)server_bytes);
+  return true;
+}
+
+int main() {
+  if (!broker.start() || !server.start())
+    return 1;
+
+  bool ok = checkPushedPackets();
+  ok = checkIdWrap() && ok;
+  ok = checkRate() && ok;
+
+  printf("[TEST] mqtt_window %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#ifndef _ROOM_TRACE_H_
+#define _ROOM_TRACE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "telemetry-batch.h"
+#include "check.h"
+
+typedef TelemetryRow<5> RoomSample;
+
+/**
+ * Reads a room sensor trace (tests/room-trace.csv) into rows: one line per
+ * sample with the second, temperature, humidity, VOCindex, CO2 and light,
+ * lines starting with # are comments. The second goes to ts.
+ * Returns the number of samples or 0 if the file can not be read.
+ */
+inline size_t loadTrace(const char *path, RoomSample *rows, size_t max) {
+  FILE *f = fopen(path, "r");
+  char line[128];
+  size_t n = 0;
+
+  if (!f) {
+    printf("[TEST] can not open %s\n", path);
+    return 0;
+  }
+  while (n < max && fgets(line, sizeof(line), f)) {
+    RoomSample &r = rows[n];
+    unsigned ts;
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%u,%f,%f,%f,%f,%f", &ts, &r.values[0], &r.values[1], &r.values[2], &r.values[3], &r.values[4]) != 6) {
+      printf("[TEST] %s: bad line %u\n", path, (unsigned)n);
+      n = 0;
+      break;
+    }
+    r.ts = ts;
+    n++;
+  }
+  fclose(f);
+  return n;
+}
+
+#endif // _ROOM_TRACE_H_
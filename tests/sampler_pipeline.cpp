@@ -0,0 +1,139 @@
+// Runs the sampling pipeline of https_room_sensor with mocked sensors: a
+// SensorSampler reading simulated sensors with a varying conversion time
+// hands the samples over the SPSC queue to an uploader that stalls now and
+// then like on a slow upload. Every sample carries its number, so the
+// uploader sees any sample lost or reordered on the way. Also reports the
+// jitter of the sampling interval and the cycle time of the reads.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests tests/sampler_pipeline.cpp -o sampler_pipeline -lpthread
+//   ./sampler_pipeline
+
+#include <atomic>
+
+#include "mbed.h"
+#include "sensor-sampler.h"
+#include "telemetry-batch.h"
+#include "check.h"
+
+typedef TelemetryRow<5> RoomSample;
+
+// faster than the room sensor, so a test takes seconds
+#define PERIOD_MS 10
+
+/**
+ * Sensors of the tests: a cycle takes 1 to 4 ms like the conversions of the
+ * room sensor scaled to the period, every sample gets the next number as ts.
+ */
+class MockSensors {
+public:
+  MockSensors() : next(0) {}
+
+  void read(RoomSample &sample) {
+    uint32_t n = next++;
+    ThisThread::sleep_for(std::chrono::milliseconds(1 + n % 4));
+    sample.ts = n;
+    sample.values[0] = 21.0f + (n % 10) * 0.01f;
+    sample.values[1] = 45.0f;
+    sample.values[2] = 100.0f;
+    sample.values[3] = 600.0f;
+    sample.values[4] = 300.0f;
+  }
+
+  std::atomic<uint32_t> next;
+};
+
+/**************************************************************************/
+/*
+    the queue alone: a million numbers from one thread to another, in order
+*/
+/**************************************************************************/
+bool checkQueue() {
+  static SpscQueue<uint32_t, 64> queue;
+  const uint32_t count = 1000000;
+  uint32_t expect = 0, full = 0;
+
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < count; i++)
+      while (!queue.push(i)) {
+        full++;
+        std::this_thread::yield();
+      }
+  });
+  while (expect < count) {
+    uint32_t item;
+    if (!queue.pop(item)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (item != expect) {
+      producer.join();
+      CHECK(false, "queue: %lu instead of %lu", (unsigned long)item, (unsigned long)expect);
+    }
+    expect++;
+  }
+  producer.join();
+  CHECK(queue.empty(), "queue: %u items left", (unsigned)queue.size());
+  printf("[TEST] queue: %lu items in order, the producer found it full %lu times\n", (unsigned long)count,
+    (unsigned long)full);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    the sampler with mocked sensors and an uploader that stalls for stall_ms
+    every 30 samples, until it got samples samples. The samples have to come
+    in order, a gap has to be counted as dropped by the sampler.
+*/
+/**************************************************************************/
+template <size_t N>
+bool checkPipeline(const char *label, uint32_t samples, uint32_t stall_ms, bool lossless) {
+  // the sampler thread runs until the end of the process
+  MockSensors *sensors = new MockSensors();
+  SensorSampler<RoomSample, N> *sampler = new SensorSampler<RoomSample, N>(
+    callback(sensors, &MockSensors::read), std::chrono::milliseconds(PERIOD_MS));
+  uint32_t expect = 0, gaps = 0, popped = 0;
+
+  sampler->start();
+  while (expect < samples) {
+    RoomSample sample;
+    CHECK(sampler->wait(std::chrono::milliseconds(1000)), "%s: no sample after %lu", label, (unsigned long)expect);
+    while (sampler->pop(sample)) {
+      CHECK((int32_t)(sample.ts - expect) >= 0, "%s: sample %lu after %lu", label, (unsigned long)sample.ts,
+        (unsigned long)expect);
+      gaps += sample.ts - expect;
+      expect = sample.ts + 1;
+      if (++popped % 30 == 0)
+        ThisThread::sleep_for(std::chrono::milliseconds(stall_ms));
+    }
+  }
+  SamplerStats st = sampler->stats();
+
+  printf("[TEST] %s: %lu samples, queue of %u, uploader stalls %lu ms: %lu lost, %lu dropped\n", label,
+    (unsigned long)st.samples, (unsigned)(N - 1), (unsigned long)stall_ms, (unsigned long)gaps,
+    (unsigned long)st.dropped);
+  printf("[TEST] %s: jitter mean %lu us max %lu us, cycle time mean %lu us max %lu us\n", label,
+    (unsigned long)st.jitter_mean_us, (unsigned long)st.jitter_max_us, (unsigned long)st.read_mean_us,
+    (unsigned long)st.read_max_us);
+  CHECK(gaps == st.dropped, "%s: %lu samples missing but %lu dropped", label, (unsigned long)gaps,
+    (unsigned long)st.dropped);
+  if (lossless)
+    CHECK(gaps == 0, "%s: %lu samples lost", label, (unsigned long)gaps);
+  else
+    CHECK(gaps > 0, "%s: the stalls did not overrun the queue", label);
+  // the sampling keeps its rate while the uploader stalls
+  CHECK(st.jitter_mean_us < PERIOD_MS * 1000 / 2, "%s: mean jitter %lu us", label, (unsigned long)st.jitter_mean_us);
+  CHECK(st.read_max_us >= 1000, "%s: cycle time %lu us", label, (unsigned long)st.read_max_us);
+  return true;
+}
+
+int main() {
+  bool ok = checkQueue();
+  // stalls of 20 periods fit into the queue of 63 samples of the room sensor
+  ok = checkPipeline<64>("pipeline", 300, 20 * PERIOD_MS, true) && ok;
+  // a queue of 7 samples is overrun by the same stalls, the loss is counted
+  ok = checkPipeline<8>("overrun", 150, 20 * PERIOD_MS, false) && ok;
+
+  printf("[TEST] sampler_pipeline %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+// Replays a room sensor trace through the UploadScheduler with the upload
+// loop of https_room_sensor and checks the upload intervals it chooses:
+// short after the light is switched on and while the room fills up, close to
+// the longest while the room is empty and only the sensor noise changes the
+// values, and longer again for failing or slow uploads, always between the
+// limits.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests tests/scheduler_trace.cpp -o scheduler_trace
+//   ./scheduler_trace tests/room-trace.csv
+
+#include <vector>
+
+#include "mbed.h"
+#include "upload-scheduler.h"
+#include "room-trace.h"
+
+#define TRACE_MAX 4096
+
+// the settings of https_room_sensor
+#define UPLOAD_INTERVAL_MIN 5
+#define UPLOAD_INTERVAL_MAX 60
+#define WRITEINTERAL_STARTUP 120
+const float roomScales[5] = {
+  0.05f,  // temperature
+  0.2f,   // humidity
+  2.0f,   // VOCindex
+  5.0f,   // CO2
+  20.0f,  // light
+};
+const SchedulerConfig schedulerConfig = {
+  UPLOAD_INTERVAL_MIN,
+  UPLOAD_INTERVAL_MAX,
+  0.1f,   // smoothing
+  2000,   // uploads slower than 2 s lengthen the interval
+  4.0f,   // failing uploads make the interval four times longer
+};
+
+RoomSample trace[TRACE_MAX];
+size_t traceLen;
+
+// an upload of the replay, at the second of the trace after the samples of the interval
+struct Upload {
+  uint32_t ts;
+  uint32_t interval;
+};
+
+/**************************************************************************/
+/*
+    the upload loop of the room sensor: the interval is counted in samples,
+    a fast change shortens the running interval, after an upload the
+    scheduler sets the next one
+*/
+/**************************************************************************/
+std::vector<Upload> replay(const RoomSample *samples, size_t n, bool ok, uint32_t latency_ms) {
+  UploadScheduler<5> scheduler(schedulerConfig, roomScales);
+  std::vector<Upload> uploads;
+  int writeinterval = WRITEINTERAL_STARTUP;
+  int writeCounter = 0;
+  uint32_t last = 0;
+  bool warmup = true;
+
+  for (size_t i = 0; i < n; i++) {
+    scheduler.sample(samples[i].values);
+    if (!warmup && (int)scheduler.interval() < writeinterval)
+      writeinterval = scheduler.interval();
+    if (++writeCounter < writeinterval)
+      continue;
+    Upload u = { samples[i].ts, samples[i].ts + 1 - last };
+    uploads.push_back(u);
+    last = samples[i].ts + 1;
+    scheduler.uploaded(ok, latency_ms);
+    writeCounter = 0;
+    warmup = false;
+    writeinterval = scheduler.interval();
+  }
+  return uploads;
+}
+
+// mean interval of the uploads from..to seconds of the trace
+float meanInterval(const std::vector<Upload> &uploads, uint32_t from, uint32_t to) {
+  uint32_t sum = 0;
+  uint32_t n = 0;
+  for (size_t i = 0; i < uploads.size(); i++) {
+    if (uploads[i].ts >= from && uploads[i].ts < to) {
+      sum += uploads[i].interval;
+      n++;
+    }
+  }
+  return n ? (float)sum / n : 0.0f;
+}
+
+bool checkLimits(const char *name, const std::vector<Upload> &uploads) {
+  CHECK(!uploads.empty(), "%s: no upload", name);
+  CHECK(uploads[0].interval == WRITEINTERAL_STARTUP, "%s: first upload after %u s", name, (unsigned)uploads[0].interval);
+  for (size_t i = 1; i < uploads.size(); i++)
+    CHECK(uploads[i].interval >= UPLOAD_INTERVAL_MIN && uploads[i].interval <= UPLOAD_INTERVAL_MAX,
+      "%s: interval of %u s at %u s", name, (unsigned)uploads[i].interval, (unsigned)uploads[i].ts);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    the room: stable while empty, fast when the light goes on, faster while it fills up
+*/
+/**************************************************************************/
+bool checkRoom() {
+  std::vector<Upload> uploads = replay(trace, traceLen, true, 300);
+  CHECK(checkLimits("room", uploads), "room");
+
+  float empty = meanInterval(uploads, 120, 310);
+  float filling = meanInterval(uploads, 330, 720);
+  printf("[TEST] room: %u uploads, mean interval %.1f s empty, %.1f s filling up\n",
+    (unsigned)uploads.size(), empty, filling);
+  CHECK(filling < empty, "room: uploads while filling up are not more frequent");
+
+  // the upload after the light went on is at most one short interval late
+  uint32_t after = 0;
+  for (size_t i = 0; i < uploads.size() && !after; i++)
+    if (uploads[i].ts >= 310)
+      after = uploads[i].ts - 310;
+  CHECK(after <= 2 * UPLOAD_INTERVAL_MIN, "room: first upload %u s after the light went on", (unsigned)after);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    values that do not change at all give the longest interval, the noise
+    of the empty room almost
+*/
+/**************************************************************************/
+bool checkStable() {
+  std::vector<RoomSample> samples(traceLen, trace[100]);
+  for (size_t i = 0; i < samples.size(); i++)
+    samples[i].ts = (uint32_t)i;
+  std::vector<Upload> uploads = replay(samples.data(), samples.size(), true, 300);
+  CHECK(checkLimits("stable", uploads), "stable");
+  for (size_t i = 1; i < uploads.size(); i++)
+    CHECK(uploads[i].interval == UPLOAD_INTERVAL_MAX, "stable: interval of %u s", (unsigned)uploads[i].interval);
+  size_t stable = uploads.size();
+
+  // the sensors keep their noise in the empty room, the uploads stay rare
+  uploads = replay(trace, traceLen, true, 300);
+  uint32_t shortest = UPLOAD_INTERVAL_MAX;
+  for (size_t i = 1; i < uploads.size() && uploads[i].ts < 310; i++)
+    if (uploads[i].interval < shortest)
+      shortest = uploads[i].interval;
+  printf("[TEST] stable: %u uploads every %d s, in the empty room every %u s or longer\n", (unsigned)stable,
+    UPLOAD_INTERVAL_MAX, (unsigned)shortest);
+  CHECK(shortest >= UPLOAD_INTERVAL_MAX * 3 / 4, "stable: interval of %u s in the empty room", (unsigned)shortest);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    failing and slow uploads lengthen the intervals of the same trace
+*/
+/**************************************************************************/
+bool checkLink() {
+  std::vector<Upload> good = replay(trace, traceLen, true, 300);
+  std::vector<Upload> failing = replay(trace, traceLen, false, 0);
+  std::vector<Upload> slow = replay(trace, traceLen, true, 6000);
+  CHECK(checkLimits("failing", failing) && checkLimits("slow", slow), "link");
+
+  float g = meanInterval(good, 330, 900);
+  float f = meanInterval(failing, 330, 900);
+  float s = meanInterval(slow, 330, 900);
+  printf("[TEST] link: mean interval %.1f s good, %.1f s failing, %.1f s slow\n", g, f, s);
+  CHECK(f > 2 * g, "link: failing uploads do not back off");
+  CHECK(s > 2 * g, "link: slow uploads do not back off");
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  traceLen = loadTrace(argc > 1 ? argv[1] : "tests/room-trace.csv", trace, TRACE_MAX);
+  if (traceLen == 0)
+    return 1;
+
+  bool ok = checkRoom();
+  ok = checkStable() && ok;
+  ok = checkLink() && ok;
+
+  printf("[TEST] scheduler_trace %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
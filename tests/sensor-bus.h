@@ -0,0 +1,112 @@
+#ifndef _SENSOR_BUS_H_
+#define _SENSOR_BUS_H_
+
+#include "mbed.h"
+#include "SparkFunHTU21D.h"
+#include "MHZ19.h"
+
+/**
+ * Simulated buses of the sensor tests: the sensor stand-ins of host/ with
+ * faults injected into their answers and the traffic counted.
+ */
+
+/**
+ * HTU21D on the I2C bus. corrupt is the number of the next completed reads
+ * that deliver a flipped data bit, so the CRC does not match. Every transfer
+ * counts its address byte, a transfer that is not acknowledged only that.
+ */
+class FaultyHTU21 : public HTU21D {
+public:
+  FaultyHTU21() : corrupt(0), transfers(0), nacks(0), bytes(0), crc_errors(0) {}
+
+  int write(const char *data, int length, bool repeated) override {
+    transfers++;
+    bytes += 1 + length;
+    return HTU21D::write(data, length, repeated);
+  }
+
+  int read(char *data, int length) override {
+    transfers++;
+    int ret = HTU21D::read(data, length);
+    if (ret != 0) {
+      nacks++;
+      bytes += 1;
+      return ret;
+    }
+    bytes += 1 + length;
+    if (corrupt > 0) {
+      corrupt--;
+      crc_errors++;
+      data[1] ^= 0x04;
+    }
+    return ret;
+  }
+
+  // time the transfers take on the bus, 9 clocks per byte
+  uint32_t bus_us(uint32_t hz) const { return (uint32_t)((uint64_t)bytes * 9 * 1000000 / hz); }
+
+  uint32_t corrupt;
+  uint32_t transfers;
+  uint32_t nacks;
+  uint32_t bytes;
+  uint32_t crc_errors;
+};
+
+/**
+ * MH-Z19 on the serial port. The stand-in answers into a port of its own,
+ * the answer is passed on with the faults set for the next requests:
+ *  - noise is sent before the answer, like bytes of a disturbed line
+ *  - corrupt answers get a wrong checksum
+ *  - truncate answers lose their last bytes
+ *  - silent requests are not answered
+ */
+class FaultyMHZ19 : public MHZ19 {
+public:
+  FaultyMHZ19()
+    : noise(NULL), noise_len(0), corrupt(0), truncate(0), silent(0), requests(0), _port(NULL), _answers(NC, NC) {
+  }
+
+  void begin(BufferedSerial &serial) {
+    _port = &serial;
+    MHZ19::begin(_answers);
+    HostSerial::attach(serial.tx(), this);
+  }
+
+  void received(const uint8_t *data, size_t length) override {
+    uint8_t answer[9];
+
+    requests++;
+    MHZ19::received(data, length);
+    ssize_t n = _answers.read(answer, sizeof(answer));
+    if (n != (ssize_t)sizeof(answer) || !_port)
+      return;
+    if (silent > 0) {
+      silent--;
+      return;
+    }
+    if (noise_len)
+      _port->inject(noise, noise_len);
+    if (corrupt > 0) {
+      corrupt--;
+      answer[8] ^= 0x01;
+    }
+    if (truncate > 0) {
+      truncate--;
+      n -= 4;
+    }
+    _port->inject(answer, n);
+  }
+
+  const uint8_t *noise;
+  size_t noise_len;
+  uint32_t corrupt;
+  uint32_t truncate;
+  uint32_t silent;
+  uint32_t requests;
+
+private:
+  BufferedSerial *_port;
+  BufferedSerial _answers;
+};
+
+#endif // _SENSOR_BUS_H_
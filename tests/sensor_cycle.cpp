@@ -0,0 +1,233 @@
+// Runs the split phase sensor drivers of https_room_sensor against the
+// sensor stand-ins of host/ on a simulated bus: the cycle time of a read of
+// all sensors like readSensors() does it, against the conversion times one
+// after the other, and the fault paths of the drivers: an HTU21 answer with
+// a CRC mismatch is rejected and read again, an MH-Z19 answer behind line
+// noise, with a wrong checksum, truncated or missing is skipped and the
+// driver resynchronizes on the next answer.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_room_sensor -I tests tests/sensor_cycle.cpp -o sensor_cycle -lpthread
+//   ./sensor_cycle
+
+#include <math.h>
+
+#include "mbed.h"
+#include "Adafruit_TSL2591.h"
+#include "sensor-async.h"
+#include "sensor-bus.h"
+#include "check.h"
+
+// the settings of https_room_sensor
+#define MHZ19_TIMEOUT_MS 200
+#define I2C_HZ 100000
+
+I2C i2c(I2C_SDA, I2C_SCL);
+BufferedSerial serial(PC_12, PD_2);
+FaultyHTU21 htu21;
+Adafruit_TSL2591 tsl2591;
+FaultyMHZ19 mhz19;
+HTU21Async asyncHTU21(i2c);
+TSL2591Async asyncTSL2591(i2c);
+MHZ19Async asyncMHZ19(serial);
+
+struct Reading {
+  float temperature;
+  float humidity;
+  float lux;
+  int32_t co2;
+  bool co2_valid;
+};
+
+/**************************************************************************/
+/*
+    the MH-Z19 answer within the timeout of the room sensor
+*/
+/**************************************************************************/
+bool collectCO2(int32_t &co2, Timer &cycle) {
+  while (!asyncMHZ19.collect(co2)) {
+    if (cycle.elapsed_time() >= std::chrono::milliseconds(MHZ19_TIMEOUT_MS))
+      return false;
+    ThisThread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*
+    one cycle in the order of readSensors(): all conversions started first,
+    values that could not be read keep the last reading
+*/
+/**************************************************************************/
+uint32_t readCycle(Reading &r) {
+  Timer cycle;
+  uint16_t full, ir;
+
+  cycle.start();
+  asyncMHZ19.request();
+  bool bHTU21 = asyncHTU21.startTemperature();
+  if (asyncTSL2591.read(full, ir))
+    r.lux = tsl2591.calculateLux(full, ir);
+
+  if (bHTU21) {
+    ThisThread::sleep_for(std::chrono::milliseconds(HTU21Async::TEMPERATURE_MS));
+    for (int i = 0; i < 5 && !asyncHTU21.readTemperature(r.temperature); i++)
+      ThisThread::sleep_for(std::chrono::milliseconds(5));
+    asyncHTU21.startHumidity();
+    ThisThread::sleep_for(std::chrono::milliseconds(HTU21Async::HUMIDITY_MS));
+    for (int i = 0; i < 5 && !asyncHTU21.readHumidity(r.humidity); i++)
+      ThisThread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  r.co2_valid = collectCO2(r.co2, cycle);
+  return (uint32_t)cycle.elapsed_time().count();
+}
+
+/**************************************************************************/
+/*
+    cycle time and bus traffic of reads without faults
+*/
+/**************************************************************************/
+bool checkCycleTime() {
+  const int cycles = 10;
+  Reading r = { 0, 0, 0, 0, false };
+  uint32_t sum = 0, longest = 0;
+  uint32_t transfers = htu21.transfers, nacks = htu21.nacks, bytes = htu21.bytes;
+
+  // the first integration of the light sensor
+  ThisThread::sleep_for(std::chrono::milliseconds(100 * (TSL2591_INTEGRATIONTIME_300MS + 1)));
+  for (int i = 0; i < cycles; i++) {
+    uint32_t us = readCycle(r);
+    sum += us;
+    if (us > longest)
+      longest = us;
+    CHECK(r.co2_valid, "cycle %d: no CO2", i);
+    CHECK(fabsf(r.temperature - htu21.readTemperature()) < 0.05f, "cycle %d: temperature %.2f", i,
+      (double)r.temperature);
+    CHECK(fabsf(r.humidity - htu21.readHumidity()) < 0.1f, "cycle %d: humidity %.2f", i, (double)r.humidity);
+    CHECK(abs(r.co2 - mhz19.getCO2()) <= 1, "cycle %d: CO2 %ld", i, (long)r.co2);
+    CHECK(r.lux > 100.0f, "cycle %d: %.1f lux", i, (double)r.lux);
+  }
+  transfers = htu21.transfers - transfers;
+  nacks = htu21.nacks - nacks;
+  bytes = htu21.bytes - bytes;
+
+  // one after the other: both HTU21 conversions, an integration of the TSL2591,
+  // the MH-Z19 command and answer of 9 bytes each at 9600 baud
+  uint32_t sequential_ms = HTU21Async::TEMPERATURE_MS + HTU21Async::HUMIDITY_MS +
+    100 * (TSL2591_INTEGRATIONTIME_300MS + 1) + 18 * 10 * 1000 / 9600;
+  printf("[TEST] cycle time: mean %lu us, longest %lu us, one conversion after the other %lu ms\n",
+    (unsigned long)(sum / cycles), (unsigned long)longest, (unsigned long)sequential_ms);
+  printf("[TEST] HTU21 per cycle: %.1f transfers, %.1f not acknowledged, %.1f bytes, %lu us on the bus at %d kHz\n",
+    (double)transfers / cycles, (double)nacks / cycles, (double)bytes / cycles,
+    (unsigned long)(htu21.bus_us(I2C_HZ) / htu21.transfers * transfers / cycles), I2C_HZ / 1000);
+  // the conversions of the HTU21 are the cycle, the others run meanwhile
+  uint32_t conversions_us = (HTU21Async::TEMPERATURE_MS + HTU21Async::HUMIDITY_MS) * 1000;
+  CHECK(sum / cycles >= conversions_us, "mean cycle time %lu us", (unsigned long)(sum / cycles));
+  CHECK(sum / cycles < conversions_us + 30000, "mean cycle time %lu us", (unsigned long)(sum / cycles));
+  CHECK(longest < sequential_ms * 1000 / 2, "longest cycle %lu us", (unsigned long)longest);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    HTU21 answers with a CRC mismatch are never taken as a value
+*/
+/**************************************************************************/
+bool checkHTU21Crc() {
+  float value = -100.0f;
+
+  // one corrupted answer: rejected, the next read of the same conversion is fine
+  CHECK(asyncHTU21.startTemperature(), "start temperature");
+  ThisThread::sleep_for(std::chrono::milliseconds(HTU21Async::TEMPERATURE_MS));
+  htu21.corrupt = 1;
+  CHECK(!asyncHTU21.readTemperature(value), "corrupted temperature %.2f accepted", (double)value);
+  CHECK(value == -100.0f, "corrupted temperature changed the value to %.2f", (double)value);
+  CHECK(asyncHTU21.readTemperature(value), "temperature not read after a CRC mismatch");
+  CHECK(fabsf(value - htu21.readTemperature()) < 0.05f, "temperature %.2f", (double)value);
+
+  // in the cycle: a mismatch costs one retry, all five corrupted keep the last value
+  Reading r = { 0, 0, 0, 0, false };
+  readCycle(r);
+  float last = r.humidity;
+  uint32_t errors = htu21.crc_errors;
+  htu21.corrupt = 1;
+  readCycle(r);
+  CHECK(htu21.crc_errors == errors + 1, "%lu CRC errors", (unsigned long)(htu21.crc_errors - errors));
+  CHECK(fabsf(r.temperature - htu21.readTemperature()) < 0.05f, "temperature %.2f after a retry", (double)r.temperature);
+  r.humidity = last;
+  htu21.corrupt = 100;
+  readCycle(r);
+  htu21.corrupt = 0;
+  CHECK(r.humidity == last, "humidity %.2f from corrupted answers", (double)r.humidity);
+  printf("[TEST] HTU21: %lu CRC mismatches rejected\n", (unsigned long)htu21.crc_errors);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    one MH-Z19 request with the faults set, true if the answer was collected
+*/
+/**************************************************************************/
+bool requestCO2(int32_t &co2) {
+  Timer cycle;
+
+  cycle.start();
+  co2 = -1;
+  asyncMHZ19.request();
+  return collectCO2(co2, cycle);
+}
+
+bool checkMHZ19Resync() {
+  static const uint8_t noise[3] = { 0x00, 0x86, 0x12 };
+  static const uint8_t start_bytes[3] = { 0xFF, 0x01, 0xFF };
+  int32_t co2;
+
+  // noise before the answer, without and with start bytes in it
+  mhz19.noise = noise;
+  mhz19.noise_len = sizeof(noise);
+  CHECK(requestCO2(co2) && abs(co2 - mhz19.getCO2()) <= 1, "CO2 %ld behind noise", (long)co2);
+  mhz19.noise = start_bytes;
+  mhz19.noise_len = sizeof(start_bytes);
+  CHECK(requestCO2(co2) && abs(co2 - mhz19.getCO2()) <= 1, "CO2 %ld behind start bytes", (long)co2);
+  mhz19.noise_len = 0;
+
+  // a broken answer gives no value, the next request is read again
+  mhz19.corrupt = 1;
+  CHECK(!requestCO2(co2) && co2 == -1, "CO2 %ld from a wrong checksum", (long)co2);
+  CHECK(requestCO2(co2) && abs(co2 - mhz19.getCO2()) <= 1, "CO2 %ld after a wrong checksum", (long)co2);
+  mhz19.truncate = 1;
+  CHECK(!requestCO2(co2), "CO2 %ld from a truncated answer", (long)co2);
+  CHECK(requestCO2(co2) && abs(co2 - mhz19.getCO2()) <= 1, "CO2 %ld after a truncated answer", (long)co2);
+  mhz19.silent = 1;
+  CHECK(!requestCO2(co2), "CO2 %ld without an answer", (long)co2);
+  CHECK(requestCO2(co2) && abs(co2 - mhz19.getCO2()) <= 1, "CO2 %ld after a missing answer", (long)co2);
+
+  // a late answer of the last request is dropped by the next one
+  mhz19.silent = 0;
+  asyncMHZ19.request();
+  ThisThread::sleep_for(std::chrono::milliseconds(5));
+  mhz19.truncate = 1;
+  CHECK(requestCO2(co2) == false, "CO2 %ld from a truncated answer", (long)co2);
+  CHECK(requestCO2(co2) && abs(co2 - mhz19.getCO2()) <= 1, "CO2 %ld after a late answer", (long)co2);
+
+  printf("[TEST] MH-Z19: resynchronized after noise, wrong checksum, truncated, missing and late answers, "
+    "%lu requests\n", (unsigned long)mhz19.requests);
+  return true;
+}
+
+int main() {
+  htu21.begin(i2c);
+  tsl2591.begin(i2c);
+  tsl2591.setGain(TSL2591_GAIN_MED);
+  tsl2591.setTiming(TSL2591_INTEGRATIONTIME_300MS);
+  asyncTSL2591.start();
+  mhz19.begin(serial);
+
+  bool ok = checkCycleTime();
+  ok = checkHTU21Crc() && ok;
+  ok = checkMHZ19Resync() && ok;
+
+  printf("[TEST] sensor_cycle %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+// Counts the TLS handshakes of 1000 ThingsBoard uploads against a stand-in
+// server: with a new TLSSocket per upload like the examples did before, and
+// with TLSConnection keeping the connection open and TLSSessionCache resuming
+// the session like https_send_HTU21_batch does now. The server closes every
+// connection after a number of requests like keepalive_requests of nginx,
+// so the upload loop also has to notice closed connections and reconnect.
+//
+// Host build (Linux), with the Mbed OS shims of host/:
+//   g++ -std=c++14 -O2 -I host -I https_send_HTU21_batch -I common -I tests tests/tls_keepalive.cpp -o tls_keepalive -lpthread
+//   ./tls_keepalive
+
+#include "mbed.h"
+#include "tls-connection.h"
+#include "tls-trust-store.h"
+#include "ThingsBoard.h"
+#include "secrets.h"
+#include "http-standin.h"
+#include "check.h"
+
+#define UPLOADS 1000
+
+HttpStandin server;
+TLSTrustStore trust;
+
+/**************************************************************************/
+/*
+    one upload of the loop of https_send_HTU21_batch, with a retry on a new
+    connection if the server closed it right before the request
+*/
+/**************************************************************************/
+bool upload(TLSConnection &tls, const SocketAddress &adr, ThingsBoardHttps &tb, Telemetry *data) {
+  if (tls.connect(adr) != NSAPI_ERROR_OK)
+    return false;
+  tb.setSocket(tls.socket());
+  bool bret = tb.sendTelemetry(data, 2);
+  if (!bret && tls.reconnect(adr) == NSAPI_ERROR_OK) {
+    tb.setSocket(tls.socket());
+    bret = tb.sendTelemetry(data, 2);
+  }
+  return bret;
+}
+
+/**************************************************************************/
+/*
+    the examples before the connection manager: socket, CA and handshake per upload
+*/
+/**************************************************************************/
+bool checkSocketPerUpload() {
+  SocketAddress adr = server.address();
+  ThingsBoardHttps tb;
+  Telemetry data[2] = { { "temperature", 21.5 }, { "humidity", 45.0 } };
+  uint32_t connections = server.connections;
+  uint32_t failed = 0;
+
+  server.max_requests = 0;
+  tb.begin(TOKEN, THINGSBOARD_HOST, adr.get_port());
+  for (int i = 0; i < UPLOADS; i++) {
+    TLSSocket *socket = new TLSSocket();
+    socket->open(NetworkInterface::get_default_instance());
+    socket->set_root_ca_cert(SSL_CA_PEM);
+    if (socket->connect(adr) != NSAPI_ERROR_OK) {
+      failed++;
+    } else {
+      tb.setSocket(socket);
+      if (!tb.sendTelemetry(data, 2))
+        failed++;
+    }
+    socket->close();
+    delete socket;
+  }
+  connections = server.connections - connections;
+  printf("[TEST] socket per upload: %lu handshakes per %d uploads, %lu failed\n", (unsigned long)connections,
+    UPLOADS, (unsigned long)failed);
+  CHECK(failed == 0, "socket per upload: %lu uploads failed", (unsigned long)failed);
+  CHECK(connections == UPLOADS, "socket per upload: %lu connections", (unsigned long)connections);
+  return true;
+}
+
+/**************************************************************************/
+/*
+    one connection as long as the server keeps it open, resumed sessions after that
+*/
+/**************************************************************************/
+bool checkKeepAlive(uint32_t max_requests) {
+  SocketAddress adr = server.address();
+  ThingsBoardHttps tb;
+  Telemetry data[2] = { { "temperature", 21.5 }, { "humidity", 45.0 } };
+  TLSConnection tls(NetworkInterface::get_default_instance(), THINGSBOARD_HOST, &trust);
+  TLSSessionCache tls_sessions;
+  uint32_t connections = server.connections;
+  uint32_t requests = server.requests;
+  uint32_t failed = 0;
+
+  server.max_requests = max_requests;
+  tls.set_session_cache(&tls_sessions);
+  tb.begin(TOKEN, THINGSBOARD_HOST, adr.get_port());
+  for (int i = 0; i < UPLOADS; i++)
+    if (!upload(tls, adr, tb, data))
+      failed++;
+  tls.close();
+  connections = server.connections - connections;
+  requests = server.requests - requests;
+
+  printf("[TEST] keep-alive, server closes after %lu requests: %lu handshakes per %d uploads "
+    "(full %lu, resumed %lu), %lu reused, %lu failed\n", (unsigned long)max_requests, (unsigned long)tls.handshakes(),
+    UPLOADS, (unsigned long)tls_sessions.full_handshakes(), (unsigned long)tls_sessions.resumed_handshakes(),
+    (unsigned long)tls.reuses(), (unsigned long)failed);
+  CHECK(failed == 0, "keep-alive: %lu uploads failed", (unsigned long)failed);
+  CHECK(requests == UPLOADS, "keep-alive: the server got %lu requests", (unsigned long)requests);
+  CHECK(tls.handshakes() == connections, "keep-alive: %lu handshakes but %lu connections",
+    (unsigned long)tls.handshakes(), (unsigned long)connections);
+  // a connection carries max_requests uploads, a close noticed only by the failed request costs one more
+  uint32_t expected = (UPLOADS + max_requests - 1) / max_requests;
+  CHECK(tls.handshakes() >= expected && tls.handshakes() <= expected + expected / 10 + 1,
+    "keep-alive: %lu handshakes, expected %lu", (unsigned long)tls.handshakes(), (unsigned long)expected);
+  CHECK(tls_sessions.full_handshakes() == 1, "keep-alive: %lu full handshakes", (unsigned long)tls_sessions.full_handshakes());
+  CHECK(tls_sessions.resumed_handshakes() == tls.handshakes() - 1, "keep-alive: %lu resumed handshakes",
+    (unsigned long)tls_sessions.resumed_handshakes());
+  return true;
+}
+
+int main() {
+  if (!server.start() || trust.init(SSL_CA_PEM) != NSAPI_ERROR_OK)
+    return 1;
+
+  bool ok = checkSocketPerUpload();
+  ok = checkKeepAlive(100) && ok;
+  ok = checkKeepAlive(10) && ok;
+
+  printf("[TEST] tls_keepalive %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}